@@ -67,7 +67,7 @@ slake::ValueRef<> getSlakeBuildVersionInfo(slake::Runtime *rt, slake::Value *thi
 	}
 }
 
-std::unique_ptr<std::istream> fsModuleLocator(slake::Runtime *rt, slake::ValueRef<slake::RefValue> ref) {
+std::shared_ptr<slake::ModuleImage> fsModuleLocator(slake::Runtime *rt, slake::ValueRef<slake::RefValue> ref) {
 	std::string path;
 	for (size_t i = 0; i < ref->entries.size(); ++i) {
 		path += ref->entries[i].name;
@@ -76,15 +76,15 @@ std::unique_ptr<std::istream> fsModuleLocator(slake::Runtime *rt, slake::ValueRe
 	}
 	path += ".slx";
 
-	std::unique_ptr<std::ifstream> fs = std::make_unique<std::ifstream>();
-	fs->exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
-	fs->open(path, std::ios_base::binary);
-
-	return fs;
+	return slake::mapModuleFile(path);
 }
 
-void printTraceback(slake::Runtime *rt) {
-	auto ctxt = rt->activeContexts.at(std::this_thread::get_id());
+void printTraceback(slake::Runtime *rt, const slake::Context *ctxt) {
+	if (!ctxt)
+		ctxt = rt->getActiveContext();
+	if (!ctxt)
+		return;
+
 	printf("Traceback:\n");
 	for (auto i = ctxt->majorFrames.rbegin(); i != ctxt->majorFrames.rend(); ++i) {
 		printf("\t%s: 0x%08x", rt->getFullName(i->curFn).c_str(), i->curIns);
@@ -103,15 +103,11 @@ int main(int argc, char **argv) {
 
 	slake::ValueRef<slake::ModuleValue> mod;
 	try {
-		std::ifstream fs;
-		fs.exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
-		fs.open("hostext/main.slx", std::ios_base::in | std::ios_base::binary);
-
-		rt->setModuleLocator(fsModuleLocator);
+		rt->setModuleImageLocator(fsModuleLocator);
 		slake::stdlib::load(rt.get());
 
-		mod = rt->loadModule(fs, slake::LMOD_NOCONFLICT);
-	} catch (std::ios::failure e) {
+		mod = rt->loadModuleFile("hostext/main.slx", slake::LMOD_NOCONFLICT);
+	} catch (slake::LoaderError &e) {
 		printf("Error loading main module: %s\n", e.what());
 		return -1;
 	}
@@ -130,13 +126,12 @@ int main(int argc, char **argv) {
 
 			printf("%d\n", ((slake::I32Value *)result.get())->getData());
 		}
-	} catch (slake::NotFoundError e) {
+	} catch (slake::NotFoundError &e) {
 		printf("NotFoundError: %s, ref = %s\n", e.what(), std::to_string(e.ref.get()).c_str());
-		printTraceback(rt.get());
-	} catch (slake::RuntimeExecError e) {
-		auto ctxt = rt->activeContexts.at(std::this_thread::get_id());
+		printTraceback(rt.get(), e.context.get());
+	} catch (slake::RuntimeExecError &e) {
 		printf("RuntimeExecError: %s\n", e.what());
-		printTraceback(rt.get());
+		printTraceback(rt.get(), e.context.get());
 	}
 
 	mod.reset();
@@ -0,0 +1,56 @@
+#ifndef _SLAKE_CLONE_H_
+#define _SLAKE_CLONE_H_
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "type.h"
+
+namespace slake {
+	/// @brief Type in a structured clone, custom types are referred by full
+	/// names since they are resolved in another runtime.
+	struct ClonedType final {
+		TypeId typeId = TypeId::None;
+		TypeFlags flags = 0;
+		std::deque<std::string> path;			   // Full name of a custom type
+		std::unique_ptr<ClonedType> elementType;  // Element type of an array
+	};
+
+	/// @brief Graph of values which does not belong to any runtime, for passing
+	/// values between runtimes.
+	///
+	/// Scalars, strings, arrays and objects are cloned, values which are
+	/// referred more than once, including cycles, are cloned once. Classes of
+	/// the objects are referred by their full names, which have to be loaded
+	/// into the runtime which restores the clone.
+	struct StructuredClone final {
+		static constexpr uint32_t IDX_NULL = UINT32_MAX;
+
+		struct Node final {
+			TypeId typeId = TypeId::None;
+			uint64_t scalar = 0;					// Bits of a scalar
+			std::string str;						// Data of a string
+			std::u32string wstr;					// Data of a UTF-32 string
+			ClonedType elementType;					// Element type of an array
+			std::vector<uint32_t> elements;			// Indices of elements of an array
+			std::deque<std::string> classPath;	// Full name of the class of an object
+
+			/// @brief Fields of an object, fields of the base classes are listed
+			/// after the ones of the derived classes.
+			std::vector<std::vector<std::pair<std::string, uint32_t>>> fields;
+		};
+
+		/// @brief Nodes of the values, the first one is the root, no node for
+		/// a null root.
+		std::vector<Node> nodes;
+
+		/// @brief Size of string data which were moved into the clone instead
+		/// of being copied.
+		size_t szTransferred = 0;
+	};
+}
+
+#endif
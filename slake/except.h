@@ -1,12 +1,21 @@
 #ifndef _SLAKE_EXCEPT_H_
 #define _SLAKE_EXCEPT_H_
 
+#include <memory>
 #include <stdexcept>
 #include <slake/valdef/ref.h>
 
 namespace slake {
+	struct Context;
+
 	class RuntimeExecError : public std::runtime_error {
 	public:
+		/// @brief Context which was being executed when the error was thrown,
+		/// which keeps its frames for tracebacks. Errors which propagated
+		/// through nested executions keep the innermost context, nullptr if
+		/// the error was not thrown by an execution.
+		std::shared_ptr<Context> context;
+
 		inline RuntimeExecError(std::string msg) : runtime_error(msg){};
 		virtual ~RuntimeExecError() = default;
 	};
@@ -85,6 +94,14 @@ namespace slake {
 		virtual ~AbortedError() = default;
 	};
 
+	/// @brief Raises when the budget of an execution was exhausted, see
+	/// ExecBudget.
+	class InterruptedError : public RuntimeExecError {
+	public:
+		inline InterruptedError(std::string msg) : RuntimeExecError(msg){};
+		virtual ~InterruptedError() = default;
+	};
+
 	class FrameBoundaryExceededError : public RuntimeExecError {
 	public:
 		inline FrameBoundaryExceededError(std::string msg) : RuntimeExecError(msg){};
@@ -131,6 +148,14 @@ namespace slake {
 		virtual ~LoaderError() = default;
 	};
 
+	/// @brief Raises when a value cannot be cloned into or restored in a
+	/// runtime.
+	class CloneError : public RuntimeExecError {
+	public:
+		inline CloneError(std::string msg) : RuntimeExecError(msg){};
+		virtual ~CloneError() = default;
+	};
+
 	class NullRefError : public RuntimeExecError {
 	public:
 		inline NullRefError() : RuntimeExecError("Null reference detected"){};
@@ -0,0 +1,134 @@
+#include "runtime.h"
+
+#include <iterator>
+
+#ifdef _WIN32
+	#include <Windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+using namespace slake;
+
+std::shared_ptr<BufferedModuleImage> BufferedModuleImage::fromStream(std::istream &fs) {
+	std::string buf;
+
+	// Read from the stream buffer directly, so the exception mask of the
+	// stream will not be triggered by reaching the end.
+	if (auto sb = fs.rdbuf(); sb)
+		buf.assign(std::istreambuf_iterator<char>(sb), std::istreambuf_iterator<char>());
+
+	return std::make_shared<BufferedModuleImage>(std::move(buf));
+}
+
+std::shared_ptr<ModuleImage> ModuleImageCache::get(const std::string &name) const {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (auto it = _images.find(name); it != _images.end())
+		return it->second;
+	return {};
+}
+
+std::shared_ptr<ModuleImage> ModuleImageCache::insert(const std::string &name, std::shared_ptr<ModuleImage> image) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// Another runtime may have located the module concurrently.
+	return _images.insert({ name, image }).first->second;
+}
+
+void ModuleImageCache::clear() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_images.clear();
+}
+
+size_t ModuleImageCache::getImageCount() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _images.size();
+}
+
+size_t ModuleImageCache::getSize() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	size_t size = 0;
+	for (auto &i : _images)
+		size += i.second->getSize();
+	return size;
+}
+
+#ifdef _WIN32
+
+MappedModuleImage::MappedModuleImage(const std::string &path) {
+	HANDLE hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		throw LoaderError("Error opening module file `" + path + "'");
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size)) {
+		CloseHandle(hFile);
+		throw LoaderError("Error getting size of module file `" + path + "'");
+	}
+	_hFile = hFile;
+	_size = (size_t)size.QuadPart;
+
+	// Empty files cannot be mapped.
+	if (!_size)
+		return;
+
+	if (!(_hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr))) {
+		CloseHandle(hFile);
+		throw LoaderError("Error mapping module file `" + path + "'");
+	}
+
+	if (!(_data = (const char *)MapViewOfFile(_hMapping, FILE_MAP_READ, 0, 0, 0))) {
+		CloseHandle(_hMapping);
+		CloseHandle(hFile);
+		throw LoaderError("Error mapping module file `" + path + "'");
+	}
+}
+
+MappedModuleImage::~MappedModuleImage() {
+	if (_data)
+		UnmapViewOfFile(_data);
+	if (_hMapping)
+		CloseHandle(_hMapping);
+	if (_hFile)
+		CloseHandle(_hFile);
+}
+
+#else
+
+MappedModuleImage::MappedModuleImage(const std::string &path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw LoaderError("Error opening module file `" + path + "'");
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		throw LoaderError("Error getting size of module file `" + path + "'");
+	}
+	_size = (size_t)st.st_size;
+
+	// Empty files cannot be mapped.
+	if (_size) {
+		void *p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			close(fd);
+			throw LoaderError("Error mapping module file `" + path + "'");
+		}
+		_data = (const char *)p;
+	}
+
+	// The mapping keeps a reference to the file.
+	close(fd);
+}
+
+MappedModuleImage::~MappedModuleImage() {
+	if (_data)
+		munmap((void *)_data, _size);
+}
+
+#endif
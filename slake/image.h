@@ -0,0 +1,216 @@
+#ifndef _SLAKE_IMAGE_H_
+#define _SLAKE_IMAGE_H_
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "except.h"
+#include "slxfmt.h"
+
+namespace slake {
+	class Value;
+
+	/// @brief Bytes of a whole SLX image.
+	class ModuleImage {
+	public:
+		virtual ~ModuleImage() = default;
+
+		virtual const char *getData() const noexcept = 0;
+		virtual size_t getSize() const noexcept = 0;
+	};
+
+	/// @brief Image which holds a private copy of its bytes, used for
+	/// streams and other sources that cannot be mapped.
+	class BufferedModuleImage final : public ModuleImage {
+	private:
+		std::string _buf;
+
+	public:
+		inline BufferedModuleImage(std::string &&buf) : _buf(std::move(buf)) {}
+		virtual ~BufferedModuleImage() = default;
+
+		virtual inline const char *getData() const noexcept override { return _buf.data(); }
+		virtual inline size_t getSize() const noexcept override { return _buf.size(); }
+
+		/// @brief Read all remaining bytes of a stream into a new image.
+		static std::shared_ptr<BufferedModuleImage> fromStream(std::istream &fs);
+	};
+
+	/// @brief Image which is mapped read-only from a file.
+	class MappedModuleImage final : public ModuleImage {
+	private:
+		const char *_data = nullptr;
+		size_t _size = 0;
+#ifdef _WIN32
+		void *_hFile = nullptr, *_hMapping = nullptr;
+#endif
+
+	public:
+		/// @brief Map a file.
+		/// @param path Path to the file.
+		/// @throw LoaderError The file cannot be opened or mapped.
+		MappedModuleImage(const std::string &path);
+		virtual ~MappedModuleImage();
+
+		MappedModuleImage(const MappedModuleImage &) = delete;
+		MappedModuleImage &operator=(const MappedModuleImage &) = delete;
+
+		virtual inline const char *getData() const noexcept override { return _data; }
+		virtual inline size_t getSize() const noexcept override { return _size; }
+	};
+
+	/// @brief Map a module file into memory.
+	/// @param path Path to the module file.
+	/// @return Mapped image of the file.
+	inline std::shared_ptr<ModuleImage> mapModuleFile(const std::string &path) {
+		return std::make_shared<MappedModuleImage>(path);
+	}
+
+	/// @brief Images of modules keyed by full names of the modules, which can
+	/// be shared by several runtimes.
+	///
+	/// Images are immutable, runtimes which share a cache locate, read or
+	/// map each module once, and undecoded bodies and constant pools are
+	/// read from the shared images. Each runtime only decodes the functions
+	/// which it calls. Values, generic instances and heaps are still owned
+	/// by each runtime.
+	///
+	/// Only the bytes are shared, loaded code is not: functions, classes
+	/// and constant pool entries are decoded into values of each runtime,
+	/// so memory of the loaded code still grows with the number of
+	/// runtimes. Operands of a decoded body are walked by the garbage
+	/// collector of its runtime, literals are returned into its heap by the
+	/// executions, and opcodes are rewritten by its feedback, so a body
+	/// cannot be shared even if its operands are literals.
+	class ModuleImageCache final {
+	private:
+		std::map<std::string, std::shared_ptr<ModuleImage>> _images;
+		mutable std::mutex _mutex;
+
+	public:
+		/// @brief Get an image.
+		/// @param name Full name of the module.
+		/// @return The image, null if it was not cached.
+		std::shared_ptr<ModuleImage> get(const std::string &name) const;
+		/// @brief Cache an image unless another one was cached with the name.
+		/// @param name Full name of the module.
+		/// @param image Image to be cached.
+		/// @return The image which is cached with the name.
+		std::shared_ptr<ModuleImage> insert(const std::string &name, std::shared_ptr<ModuleImage> image);
+		/// @brief Drop every image, modules are located again on next import.
+		/// Runtimes which are using the images keep them alive.
+		void clear();
+
+		/// @brief Get number of cached images.
+		size_t getImageCount() const;
+		/// @brief Get total size of cached images in bytes.
+		size_t getSize() const;
+	};
+
+	/// @brief Location of a section in an image.
+	struct ImageSection final {
+		size_t off = 0, size = 0;
+		bool present = false;
+	};
+
+	/// @brief Format information of an image, filled by the loader after
+	/// reading the header.
+	struct ImageLayout final {
+		uint8_t fmtVer = 0;
+		ImageSection sections[slxfmt::SCT_MAX];
+	};
+
+	/// @brief Bounds-checked cursor over bytes of an image, all reads are
+	/// done from the memory in place.
+	class ImageReader final {
+	private:
+		std::shared_ptr<ModuleImage> _image;
+		const char *_begin, *_cur, *_end;
+		ImageLayout _layout;
+		std::vector<Value *> *_consts = nullptr;
+
+		inline void _check(size_t size) const {
+			if ((size_t)(_end - _cur) < size)
+				throw LoaderError("Unexpected end of SLX image");
+		}
+
+	public:
+		inline ImageReader(const void *data, size_t size)
+			: _begin((const char *)data), _cur((const char *)data), _end((const char *)data + size) {}
+		/// @brief Construct a reader which keeps the image alive.
+		/// @param image Image to be read.
+		inline ImageReader(std::shared_ptr<ModuleImage> image)
+			: ImageReader(image->getData(), image->getSize()) {
+			_image = image;
+		}
+
+		/// @brief Read a single element.
+		/// @tparam T Type of element to read.
+		/// @return Element read from the image.
+		template <typename T>
+		inline T read() {
+			_check(sizeof(T));
+			T value;
+			memcpy((void *)&value, _cur, sizeof(T));
+			_cur += sizeof(T);
+			return value;
+		}
+
+		/// @brief Get a view of the next bytes without copying them.
+		/// @param size Number of bytes.
+		/// @return View to the bytes which is valid while the image is alive.
+		inline std::string_view readView(size_t size) {
+			_check(size);
+			std::string_view view(_cur, size);
+			_cur += size;
+			return view;
+		}
+
+		inline void skip(size_t size) {
+			_check(size);
+			_cur += size;
+		}
+
+		inline void seek(size_t off) {
+			if (off > (size_t)(_end - _begin))
+				throw LoaderError("Unexpected end of SLX image");
+			_cur = _begin + off;
+		}
+
+		/// @brief Get a new reader on the same image.
+		/// @param off Offset for the new reader.
+		/// @return The new reader, which shares the image and the layout.
+		inline ImageReader fork(size_t off) const {
+			ImageReader r = *this;
+			r.seek(off);
+			return r;
+		}
+
+		inline size_t tell() const noexcept { return _cur - _begin; }
+		inline size_t getSize() const noexcept { return _end - _begin; }
+		inline const char *getBegin() const noexcept { return _begin; }
+
+		/// @brief Get the image which owns the bytes.
+		/// @return Owner image, null if the reader is on a borrowed buffer.
+		inline const std::shared_ptr<ModuleImage> &getImage() const noexcept { return _image; }
+
+		inline const ImageLayout &getLayout() const noexcept { return _layout; }
+		inline void setLayout(const ImageLayout &layout) noexcept { _layout = layout; }
+
+		/// @brief Get values of the constant pool which were decoded by the
+		/// loader, indexed by the constant indices.
+		/// @return The values, null if each use of a constant is decoded
+		/// into a new value.
+		inline std::vector<Value *> *getConsts() const noexcept { return _consts; }
+		inline void setConsts(std::vector<Value *> *consts) noexcept { _consts = consts; }
+	};
+}
+
+#endif
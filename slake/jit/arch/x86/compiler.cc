@@ -1,129 +1,781 @@
 #include <cstdint>
 #include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <slake/runtime.h>
 
 #include "../../base.hh"
 
-#define MODRM(mod, rm, reg) ((rm) | ((reg) << 3) | ((mod) << 6))
-#define SIB(scale, index, base) ((base) | ((index) << 3) | ((scale) << 6))
-#define REXPF(w, r, x, b) (0b01000000 | ((w) << 3) | ((r) << 2) | ((x) << 1) | (b))
-
-enum LegacyPrefix : uint8_t {
-	LPF_NONE = 0,
-	LPF_LOCK = 0xf0,
-	LPF_REPNZ = 0xf2,
-	LPF_REPNE = 0xf2,
-	LPF_REP = 0xf3,
-	LPF_REPE = 0xf3,
-	LPF_REPZ = 0xf3,
-	LPF_BND = 0xf2,
-
-	LPF_CS_SEGOD = 0x2e,
-	LPF_SS_SEGOD = 0x36,
-	LPF_DS_SEGOD = 0x3e,
-	LPF_ES_SEGOD = 0x26,
-	LPF_FS_SEGOD = 0x64,
-	LPF_GS_SEGOD = 0x65,
-	LPF_BRANCH_TAKEN = 0x3e,
-	LPF_BRANCH_NOT_TAKEN = 0x2e,
-
-	LPF_OPRDSZ_OD = 0x66,
-	LPF_ADDRSZ_OD = 0x67
-};
-
-enum ModType : uint8_t {
-	MOD_BASE = 0,
-	MOD_DISP8,
-	MOD_DISP32,
-	MOD_REG
-};
-
-enum RegType : uint8_t {
-	REG_EAX = 0,
-	REG_ECX,
-	REG_EDX,
-	REG_EBX,
-	REG_ESP,  // Also represents `none' in SIB byte.
-	REG_EBP,
-	REG_ESI,
-	REG_EDI
-};
-
-template <typename T>
-uint8_t genIns(
-	char *dest,
-	uint32_t opcode,
-	uint8_t modRm,
-	uint8_t sib,
-	uint32_t disp,
-	T immediate,
-	uint8_t rexPrefix,
-	uint8_t legacyPrefix = LPF_NONE) {
-	auto origin = dest;
-	char buf[15] = { 0 };
-	if (!dest)
-		dest = buf;
-
-	// Legacy Prefix
-	if (legacyPrefix)
-		*(uint8_t *)(dest++) = legacyPrefix;
-
-	// Prefix
-	if (rexPrefix & 0b01000000)
-		*(uint8_t *)(dest++) = rexPrefix;
-
-	// Opcode
-	if ((opcode & 0xff0000))
-		*(uint8_t *)(dest++) = opcode & 0xff0000;
-	if ((opcode & 0xff00))
-		*(uint8_t *)(dest++) = opcode & 0xff00;
-	*(uint8_t *)(dest++) = opcode & 0xff;
-
-	*(uint8_t *)(dest++) = modRm;  // Mod R/M
-
-	if ((modRm & 0b111) == 0b100)
-		*(uint8_t *)(dest++) = sib;	 // SIB
-
-	// Displacement
-	if ((modRm >> 6) == MOD_DISP8)
-		*(uint8_t *)(dest++) = disp & 0xff;
-	else if ((modRm >> 6) == MOD_DISP32)
-		*(uint32_t *)dest = disp, dest += sizeof(uint32_t);
-
-	if constexpr (!std::is_same<T, nullptr_t>::value) {
-		*(T *)dest = immediate;
-		dest += sizeof(T);
-	}
+// Type-specialized integer instructions, register moves and jumps are
+// compiled into native code, which reads operands through the frame slots,
+// checks types of the operands by the virtual tables of the literals and
+// computes the results inline. Results of arithmetic are boxed by a store
+// helper, comparisons store the shared boolean values directly. Forward jumps
+// are native jumps, backward ones call the poll helper, which checks budgets
+// of the contexts.
+//
+// Other instructions, and the specialized ones whose operands do not match at
+// runtime, call the executor, which runs the instruction with the interpreter.
+// The compiled code dispatches to the next instruction through a jump table
+// without returning to the interpreter loop.
+//
+// Feedback of the instructions is recorded by compiled code too, except by
+// the slow paths of native instructions when the feedback was reset, which
+// allocate it again.
+//
+// Only the System V x86-64 calling convention is supported for now, other
+// targets fall back to the interpreter.
+
+namespace {
+	enum Reg : uint8_t {
+		RAX = 0,
+		RCX,
+		RDX,
+		RBX,
+		RSP,
+		RBP,
+		RSI,
+		RDI,
+		R8,
+		R9,
+		R10,
+		R11,
+		R12,
+		R13,
+		R14,
+		R15
+	};
+
+	// Condition codes of Jcc and CMOVcc, inverted by flipping the lowest bit.
+	enum Cond : uint8_t {
+		CC_B = 0x2,
+		CC_AE = 0x3,
+		CC_E = 0x4,
+		CC_NE = 0x5,
+		CC_BE = 0x6,
+		CC_A = 0x7,
+		CC_L = 0xc,
+		CC_GE = 0xd,
+		CC_LE = 0xe,
+		CC_G = 0xf
+	};
+
+	// Opcodes of ALU instructions which take r/m, reg operands.
+	constexpr uint8_t ALU_ADD = 0x01, ALU_SUB = 0x29, ALU_CMP = 0x39, ALU_TEST = 0x85;
+
+	class CodeBuffer final {
+	public:
+		std::string code;
+
+		inline size_t size() const { return code.size(); }
+
+		template <typename T>
+		inline void put(T value) {
+			code.append((const char *)&value, sizeof(T));
+		}
+
+		inline void put(std::initializer_list<uint8_t> bytes) {
+			for (auto i : bytes)
+				code.push_back((char)i);
+		}
+
+		template <typename T>
+		inline void patch(size_t off, T value) {
+			memcpy(&code[off], &value, sizeof(T));
+		}
+
+		/// @brief Emit a rel32 which will be patched once the destination is known.
+		/// @return Offset of the rel32.
+		inline size_t putRel32() {
+			size_t off = size();
+			put<int32_t>(0);
+			return off;
+		}
+
+		inline void patchRel32(size_t off, size_t dest) {
+			patch<int32_t>(off, (int32_t)((int64_t)dest - (int64_t)(off + sizeof(int32_t))));
+		}
+
+		inline void putRex(bool w, uint8_t reg, uint8_t rm) {
+			uint8_t rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+			if (rex != 0x40)
+				put<uint8_t>(rex);
+		}
+
+		/// @brief Emit a ModR/M which addresses [base + disp32].
+		inline void putModRmMem(uint8_t reg, Reg base, int32_t disp) {
+			put<uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7));
+			if ((base & 7) == RSP)
+				put<uint8_t>(0x24);	 // SIB of [base]
+			put<int32_t>(disp);
+		}
+
+		inline void putModRmReg(uint8_t reg, Reg rm) {
+			put<uint8_t>(0xc0 | ((reg & 7) << 3) | (rm & 7));
+		}
+
+		/// @brief mov dst, [base + disp]
+		inline void load(bool w, Reg dst, Reg base, int32_t disp) {
+			putRex(w, dst, base);
+			put<uint8_t>(0x8b);
+			putModRmMem(dst, base, disp);
+		}
+
+		/// @brief mov [base + disp], src
+		inline void store(bool w, Reg base, int32_t disp, Reg src) {
+			putRex(w, src, base);
+			put<uint8_t>(0x89);
+			putModRmMem(src, base, disp);
+		}
+
+		/// @brief mov dst, src
+		inline void mov(bool w, Reg dst, Reg src) {
+			alu(0x89, w, dst, src);
+		}
+
+		/// @brief mov dst, imm, which is zero-extended if it fits in 32 bits.
+		inline void movImm(Reg dst, uint64_t imm) {
+			bool w = imm > UINT32_MAX;
+			putRex(w, 0, dst);
+			put<uint8_t>(0xb8 + (dst & 7));
+			if (w)
+				put<uint64_t>(imm);
+			else
+				put<uint32_t>((uint32_t)imm);
+		}
+
+		/// @brief op dst, src
+		inline void alu(uint8_t opcode, bool w, Reg dst, Reg src) {
+			putRex(w, src, dst);
+			put<uint8_t>(opcode);
+			putModRmReg(src, dst);
+		}
+
+		/// @brief imul dst, src
+		inline void imul(bool w, Reg dst, Reg src) {
+			putRex(w, dst, src);
+			put({ 0x0f, 0xaf });
+			putModRmReg(dst, src);
+		}
+
+		/// @brief cmovcc dst, src
+		inline void cmov(Cond cond, Reg dst, Reg src) {
+			putRex(true, dst, src);
+			put({ 0x0f, (uint8_t)(0x40 + cond) });
+			putModRmReg(dst, src);
+		}
+
+		/// @brief cmp dword [base + disp], imm
+		inline void cmpMem32(Reg base, int32_t disp, uint32_t imm) {
+			putRex(false, 0, base);
+			put<uint8_t>(0x81);
+			putModRmMem(7, base, disp);
+			put<uint32_t>(imm);
+		}
+
+		/// @brief cmp qword [base + disp], src
+		inline void cmpMem64(Reg base, int32_t disp, Reg src) {
+			putRex(true, src, base);
+			put<uint8_t>(0x39);
+			putModRmMem(src, base, disp);
+		}
+
+		/// @brief add qword [base + disp], imm
+		inline void addMem64(Reg base, int32_t disp, int8_t imm) {
+			putRex(true, 0, base);
+			put<uint8_t>(0x83);
+			putModRmMem(0, base, disp);
+			put<int8_t>(imm);
+		}
+
+		/// @brief add dword [base + disp], imm
+		inline void addMem32(Reg base, int32_t disp, int8_t imm) {
+			putRex(false, 0, base);
+			put<uint8_t>(0x83);
+			putModRmMem(0, base, disp);
+			put<int8_t>(imm);
+		}
+
+		/// @brief cmp eax, imm
+		inline void cmpEax(uint32_t imm) {
+			put<uint8_t>(0x3d);
+			put<uint32_t>(imm);
+		}
+
+		/// @return Offset of the rel32.
+		inline size_t jcc(Cond cond) {
+			put({ 0x0f, (uint8_t)(0x80 + cond) });
+			return putRel32();
+		}
+
+		/// @return Offset of the rel32.
+		inline size_t jmp() {
+			put<uint8_t>(0xe9);
+			return putRel32();
+		}
+
+		inline void call(const void *fn) {
+			movImm(RAX, (uint64_t)(uintptr_t)fn);
+			put({ 0xff, 0xd0 });  // call rax
+		}
+	};
+
+	struct RelocDesc {
+		size_t off;	   // Offset of the rel32
+		uint32_t ins;  // Destination instruction
+	};
+
+	using namespace slake;
+
+	class FnCompiler final {
+	private:
+		CodeBuffer &_buf;
+		const JITRuntimeInfo &_info;
+		const Instruction *_body;
+		uint32_t _nIns;
+		const std::atomic<InsFeedback *> *_feedback;
+
+		// Jumps to the slow paths, which call the executor.
+		std::vector<RelocDesc> _slowRelocs;
+
+	public:
+		std::vector<RelocDesc> relocs;	// Jumps to the instructions
+		std::vector<size_t> dispatchRelocs;	 // Jumps to the dispatcher
+
+		inline FnCompiler(
+			CodeBuffer &buf,
+			const JITRuntimeInfo &info,
+			const Instruction *body,
+			uint32_t nIns,
+			const std::atomic<InsFeedback *> *feedback)
+			: _buf(buf), _info(info), _body(body), _nIns(nIns), _feedback(feedback) {}
+
+		void jmpIns(uint32_t dest) {
+			if (dest < _nIns)
+				relocs.push_back({ _buf.jmp(), dest });
+			else {
+				_buf.movImm(RAX, dest);
+				dispatchRelocs.push_back(_buf.jmp());
+			}
+		}
+
+		void jmpDispatch() {
+			dispatchRelocs.push_back(_buf.jmp());
+		}
+
+		/// @brief Check if an operand is a slot reference which can be read
+		/// natively.
+		static bool isSlotRef(Value *operand, bool unwrapValue) {
+			if (!operand)
+				return false;
+
+			switch (operand->getType().typeId) {
+				case TypeId::RegRef:
+					return ((RegRefValue *)operand)->unwrapValue == unwrapValue &&
+						   ((RegRefValue *)operand)->index >= 0 &&
+						   ((RegRefValue *)operand)->index < (INT32_MAX >> 3);
+				case TypeId::LocalVarRef:
+					return ((LocalVarRefValue *)operand)->unwrapValue == unwrapValue &&
+						   ((LocalVarRefValue *)operand)->index >= 0 &&
+						   ((LocalVarRefValue *)operand)->index < (INT32_MAX >> 3);
+				case TypeId::ArgRef:
+					return ((ArgRefValue *)operand)->unwrapValue == unwrapValue &&
+						   ((ArgRefValue *)operand)->index < (INT32_MAX >> 3);
+				default:
+					return false;
+			}
+		}
+
+		static bool isRegVar(Value *operand) {
+			return isSlotRef(operand, false) && operand->getType() == TypeId::RegRef;
+		}
+
+		/// @brief Check if an operand is a constant of the type variant.
+		static bool isConstant(Value *operand, QuickVariant variant) {
+			static const TypeId typeIds[N_JIT_INT_TYPES] = { TypeId::I32, TypeId::I64, TypeId::U32, TypeId::U64 };
+			return operand && operand->getType() == typeIds[variant];
+		}
+
+		static uint64_t getConstant(Value *operand, QuickVariant variant) {
+			switch (variant) {
+				case QV_I32:
+					return (uint32_t)((I32Value *)operand)->getData();
+				case QV_I64:
+					return (uint64_t)((I64Value *)operand)->getData();
+				case QV_U32:
+					return ((U32Value *)operand)->getData();
+				default:
+					return ((U64Value *)operand)->getData();
+			}
+		}
+
+		/// @brief Jump to the slow path of an instruction.
+		void jccSlow(Cond cond, uint32_t offIns) {
+			_slowRelocs.push_back({ _buf.jcc(cond), offIns });
+		}
+
+		/// @brief Load the variable of a slot reference, jumping to the slow
+		/// path if the slot does not exist.
+		void loadSlot(Value *operand, Reg dst, uint32_t offIns) {
+			int32_t offSlots, offCount;
+			uint32_t index;
+			switch (operand->getType().typeId) {
+				case TypeId::RegRef:
+					offSlots = offsetof(JITFrameSlots, regs);
+					offCount = offsetof(JITFrameSlots, nRegs);
+					index = ((RegRefValue *)operand)->index;
+					break;
+				case TypeId::LocalVarRef:
+					offSlots = offsetof(JITFrameSlots, localVars);
+					offCount = offsetof(JITFrameSlots, nLocalVars);
+					index = ((LocalVarRefValue *)operand)->index;
+					break;
+				default:
+					offSlots = offsetof(JITFrameSlots, args);
+					offCount = offsetof(JITFrameSlots, nArgs);
+					index = ((ArgRefValue *)operand)->index;
+			}
+
+			_buf.cmpMem32(R14, offCount, index);
+			jccSlow(CC_BE, offIns);
+			_buf.load(true, dst, R14, offSlots);
+			_buf.load(true, dst, dst, index * sizeof(void *));
+		}
+
+		/// @brief Load an integer operand, jumping to the slow path if it is
+		/// not of the type variant. RDX is clobbered.
+		void loadInt(Value *operand, QuickVariant variant, Reg dst, uint32_t offIns) {
+			if (isConstant(operand, variant)) {
+				_buf.movImm(dst, getConstant(operand, variant));
+				return;
+			}
+
+			loadSlot(operand, dst, offIns);
+			_buf.load(true, dst, dst, _info.offVarValue);
+			loadLiteral(dst, variant, offIns);
+		}
+
+		/// @brief Load data of a literal, jumping to the slow path if it is
+		/// null or not of the type variant. RDX is clobbered.
+		void loadLiteral(Reg reg, QuickVariant variant, uint32_t offIns) {
+			bool w = variant == QV_I64 || variant == QV_U64;
+
+			_buf.alu(ALU_TEST, true, reg, reg);
+			jccSlow(CC_E, offIns);
+			_buf.movImm(RDX, (uint64_t)(uintptr_t)_info.literalVtables[variant]);
+			_buf.cmpMem64(reg, 0, RDX);
+			jccSlow(CC_NE, offIns);
+			_buf.load(w, reg, reg, _info.offLiteralData[variant]);
+		}
+
+		/// @brief Load feedback of the function into R10, jumping to the slow
+		/// path if it was reset.
+		void loadFeedback(uint32_t offIns) {
+			_buf.movImm(R10, (uint64_t)(uintptr_t)_feedback);
+			_buf.load(true, R10, R10, 0);
+			_buf.alu(ALU_TEST, true, R10, R10);
+			jccSlow(CC_E, offIns);
+		}
+
+		// Counters are incremented in place like plain 32-bit integers.
+		static_assert(sizeof(util::RelaxedAtomic<uint32_t>) == sizeof(uint32_t));
 
-	return dest - origin;
+		/// @brief Count an execution of an instruction, the feedback has to
+		/// be loaded.
+		void countIns(uint32_t offIns) {
+			_buf.addMem64(R12, _info.offNExecutedIns, 1);
+			_buf.addMem32(R10, getFeedbackOffset(offIns) + offsetof(InsFeedback, nExecs), 1);
+		}
+
+		static int32_t getFeedbackOffset(uint32_t offIns) {
+			return (int32_t)(offIns * sizeof(InsFeedback));
+		}
+
+		/// @brief Call a helper with the runtime, the context and the frame.
+		void callHelper(const void *fn) {
+			_buf.mov(true, RDI, RBX);
+			_buf.mov(true, RSI, R12);
+			_buf.mov(true, RDX, R13);
+			_buf.call(fn);
+		}
+
+		/// @brief Call the executor and continue from the offset it returned.
+		/// @param fallthrough true if the next instruction follows.
+		void emitExec(uint32_t offIns, bool fallthrough) {
+			_buf.mov(true, RCX, R14);
+			_buf.movImm(R8, offIns);
+			callHelper((const void *)_info.executor);
+
+			if (offIns + 1 < _nIns) {
+				// Fall through if the instruction did not jump.
+				_buf.cmpEax(offIns + 1);
+				dispatchRelocs.push_back(_buf.jcc(CC_NE));
+				if (!fallthrough)
+					relocs.push_back({ _buf.jmp(), offIns + 1 });
+			} else
+				jmpDispatch();
+		}
+
+		/// @brief Emit a jump which was taken, backward jumps call the poll
+		/// helper.
+		void emitTaken(uint32_t offIns, uint32_t dest) {
+			if (dest > offIns)
+				jmpIns(dest);
+			else {
+				_buf.movImm(RCX, dest);
+				callHelper((const void *)_info.poll);
+				jmpDispatch();
+			}
+		}
+
+		/// @brief Compile a type-specialized instruction natively.
+		/// @return false if the instruction has to be executed by the executor.
+		bool compileQuickIns(uint32_t offIns) {
+			auto &ins = _body[offIns];
+
+			// The fused arithmetic follows the load.
+			if (isFusedLoadOpcode(ins.opcode))
+				return compileLoadValue(offIns);
+
+			QuickVariant variant = getQuickVariant(ins.opcode);
+			if (variant >= N_JIT_INT_TYPES)
+				return false;
+
+			bool w = variant == QV_I64 || variant == QV_U64,
+				 isSigned = variant == QV_I32 || variant == QV_I64;
+
+			Opcode op = getGenericOpcode(ins.opcode);
+			switch (op) {
+				case Opcode::ADD:
+				case Opcode::SUB:
+				case Opcode::MUL: {
+					if (ins.operands.size() != 3 ||
+						!(isSlotRef(ins.operands[0], false) && ins.operands[0]->getType() != TypeId::ArgRef))
+						return false;
+					for (size_t i = 1; i < 3; ++i) {
+						if (!isConstant(ins.operands[i], variant) && !isSlotRef(ins.operands[i], true))
+							return false;
+					}
+
+					loadFeedback(offIns);
+					loadInt(ins.operands[1], variant, RAX, offIns);
+					loadInt(ins.operands[2], variant, RCX, offIns);
+					loadSlot(ins.operands[0], RSI, offIns);
+
+					if (op == Opcode::ADD)
+						_buf.alu(ALU_ADD, w, RAX, RCX);
+					else if (op == Opcode::SUB)
+						_buf.alu(ALU_SUB, w, RAX, RCX);
+					else
+						_buf.imul(w, RAX, RCX);
+					_buf.mov(true, R8, RAX);
+					_buf.mov(true, RCX, RSI);
+					emitStore(offIns, variant);
+					return true;
+				}
+				case Opcode::INCF:
+				case Opcode::DECF: {
+					if (ins.operands.size() != 2 ||
+						!(isSlotRef(ins.operands[1], false) && ins.operands[1]->getType() != TypeId::ArgRef))
+						return false;
+
+					loadFeedback(offIns);
+					loadSlot(ins.operands[1], RSI, offIns);
+					_buf.load(true, RAX, RSI, _info.offVarValue);
+					loadLiteral(RAX, variant, offIns);
+
+					_buf.movImm(RCX, 1);
+					_buf.alu(op == Opcode::INCF ? ALU_ADD : ALU_SUB, w, RAX, RCX);
+					_buf.mov(true, R8, RAX);
+					_buf.mov(true, RCX, RSI);
+					emitStore(offIns, variant);
+					return true;
+				}
+				case Opcode::EQ:
+				case Opcode::NEQ:
+				case Opcode::LT:
+				case Opcode::GT:
+				case Opcode::LTEQ:
+				case Opcode::GTEQ: {
+					// Results are stored without type checks, only into
+					// registers, which are untyped.
+					if (ins.operands.size() != 3 || !isRegVar(ins.operands[0]))
+						return false;
+					for (size_t i = 1; i < 3; ++i) {
+						if (!isConstant(ins.operands[i], variant) && !isSlotRef(ins.operands[i], true))
+							return false;
+					}
+
+					Cond cond;
+					switch (op) {
+						case Opcode::EQ:
+							cond = CC_E;
+							break;
+						case Opcode::NEQ:
+							cond = CC_NE;
+							break;
+						case Opcode::LT:
+							cond = isSigned ? CC_L : CC_B;
+							break;
+						case Opcode::GT:
+							cond = isSigned ? CC_G : CC_A;
+							break;
+						case Opcode::LTEQ:
+							cond = isSigned ? CC_LE : CC_BE;
+							break;
+						default:
+							cond = isSigned ? CC_GE : CC_AE;
+					}
+
+					loadFeedback(offIns);
+					loadInt(ins.operands[1], variant, RAX, offIns);
+					loadInt(ins.operands[2], variant, RCX, offIns);
+					loadSlot(ins.operands[0], RSI, offIns);
+					countIns(offIns);
+
+					_buf.movImm(RDX, (uint64_t)(uintptr_t)_info.boolValues[0]);
+					_buf.movImm(RDI, (uint64_t)(uintptr_t)_info.boolValues[1]);
+					_buf.alu(ALU_CMP, w, RAX, RCX);
+					_buf.cmov(cond, RDX, RDI);
+					_buf.store(true, RSI, _info.offVarValue, RDX);
+
+					if (!isFusedJumpOpcode(ins.opcode)) {
+						if (offIns + 1 >= _nIns)
+							jmpIns(offIns + 1);
+						return true;
+					}
+
+					// The fused jump is verified to have a constant destination.
+					uint32_t dest = ((U32Value *)_body[offIns + 1].operands[0])->getData();
+					if (getFusedJump(ins.opcode) == Opcode::JF)
+						cond = (Cond)(cond ^ 1);
+
+					size_t offTakenRel = _buf.jcc(cond);
+					_buf.addMem32(R10, getFeedbackOffset(offIns) + offsetof(InsFeedback, nNotTaken), 1);
+					jmpIns(offIns + 2);
+
+					_buf.patchRel32(offTakenRel, _buf.size());
+					_buf.addMem32(R10, getFeedbackOffset(offIns) + offsetof(InsFeedback, nTaken), 1);
+					emitTaken(offIns, dest);
+					return true;
+				}
+				default:
+					return false;
+			}
+		}
+
+		/// @brief Call the store helper with the variable in RCX and the
+		/// result in R8.
+		void emitStore(uint32_t offIns, QuickVariant variant) {
+			countIns(offIns);
+			_buf.movImm(R9, offIns);
+			callHelper((const void *)_info.stores[variant]);
+
+			_buf.cmpEax(offIns + 1);
+			dispatchRelocs.push_back(_buf.jcc(CC_NE));
+			if (offIns + 1 >= _nIns)
+				jmpDispatch();
+		}
+
+		/// @brief Compile an instruction natively.
+		/// @return false if the instruction has to be executed by the executor.
+		bool compileIns(uint32_t offIns) {
+			auto &ins = _body[offIns];
+
+			// Feedback is addressed with 32-bit displacements.
+			if ((uint64_t)offIns * sizeof(InsFeedback) > INT32_MAX / 2)
+				return false;
+
+			if (isQuickOpcode(ins.opcode))
+				return compileQuickIns(offIns);
+
+			switch (ins.opcode) {
+				case Opcode::NOP:
+					loadFeedback(offIns);
+					countIns(offIns);
+					if (offIns + 1 >= _nIns)
+						jmpIns(offIns + 1);
+					return true;
+				case Opcode::JMP: {
+					if (ins.operands.size() != 1 || !ins.operands[0] || ins.operands[0]->getType() != TypeId::U32)
+						return false;
+
+					loadFeedback(offIns);
+					countIns(offIns);
+					emitTaken(offIns, ((U32Value *)ins.operands[0])->getData());
+					return true;
+				}
+				case Opcode::STORE: {
+					// Registers are untyped, values are stored into them
+					// without type checks.
+					if (ins.operands.size() != 2 || !isRegVar(ins.operands[0]) || !ins.operands[1])
+						return false;
+
+					loadFeedback(offIns);
+
+					auto src = ins.operands[1];
+					switch (src->getType().typeId) {
+						case TypeId::RegRef:
+						case TypeId::LocalVarRef:
+						case TypeId::ArgRef: {
+							bool unwrapValue = isSlotRef(src, true);
+							if (!unwrapValue && !isSlotRef(src, false))
+								return false;
+
+							loadSlot(src, RAX, offIns);
+							if (unwrapValue)
+								_buf.load(true, RAX, RAX, _info.offVarValue);
+							break;
+						}
+						default:
+							_buf.movImm(RAX, (uint64_t)(uintptr_t)src);
+					}
+
+					loadSlot(ins.operands[0], RCX, offIns);
+					countIns(offIns);
+					_buf.store(true, RCX, _info.offVarValue, RAX);
+					if (offIns + 1 >= _nIns)
+						jmpIns(offIns + 1);
+					return true;
+				}
+				case Opcode::LVALUE:
+					return compileLoadValue(offIns);
+				default:
+					return false;
+			}
+		}
+
+		/// @brief Compile a LVALUE, or a LVALUE which is fused with the
+		/// following arithmetic, which is compiled separately.
+		/// @return false if the instruction has to be executed by the executor.
+		bool compileLoadValue(uint32_t offIns) {
+			auto &ins = _body[offIns];
+
+			// Register and local variable slots always hold variables.
+			if (ins.operands.size() != 2 ||
+				!isRegVar(ins.operands[0]) ||
+				!isSlotRef(ins.operands[1], false) ||
+				ins.operands[1]->getType() == TypeId::ArgRef)
+				return false;
+
+			loadFeedback(offIns);
+			loadSlot(ins.operands[1], RAX, offIns);
+			_buf.load(true, RAX, RAX, _info.offVarValue);
+			loadSlot(ins.operands[0], RCX, offIns);
+			countIns(offIns);
+			_buf.store(true, RCX, _info.offVarValue, RAX);
+			if (offIns + 1 >= _nIns)
+				jmpIns(offIns + 1);
+			return true;
+		}
+
+		/// @brief Emit the slow paths, which are placed after the
+		/// instructions.
+		void emitStubs() {
+			std::map<uint32_t, size_t> stubs;
+
+			for (auto &i : _slowRelocs) {
+				auto it = stubs.find(i.ins);
+				if (it == stubs.end()) {
+					it = stubs.insert({ i.ins, _buf.size() }).first;
+					emitExec(i.ins, false);
+				}
+				_buf.patchRel32(i.off, it->second);
+			}
+		}
+	};
 }
 
-uint8_t enterIns[] = {
-	0x53,  // push ebx
-	0x51,  // push ecx
-	0x56,  // push esi
-	0x57,  // push edi
-
-	0x55,		// push ebp
-	0x89, 0xe5	// mov ebp, esp
-};
-uint8_t leaveIns[] = {
-	0x89, 0xec,	 // mov esp, ebp
-	0x5d,		 // pop ebp
-
-	0x5f,		 // pop edi
-	0x5e,		 // pop esi
-	0x59,		 // pop ecx
-	0x5b,		 // pop ebx
-	0xc3		 // ret
-};
-
-slake::ICodePage *slake::compileFn(FnValue *fn) {
-	slake::ICodePage *codePage;
-	size_t size;
-	// Enter instructions
-	memcpy(codePage->getPtr(), enterIns, sizeof(enterIns));
-	// Leave instructions
-	memcpy(&(((char *)codePage->getPtr())[size + sizeof(enterIns)]), leaveIns, sizeof(leaveIns));
+slake::ICodePage *slake::compileFn(CodeHeap &heap, const FnValue *fn, const JITRuntimeInfo &info) {
+#if defined(__x86_64__) && !defined(_WIN32)
+	uint32_t nIns = fn->getInsCount();
+	auto body = fn->getBody();
+	if (!nIns || !body)
+		return nullptr;
+
+	CodeBuffer buf;
+	std::vector<size_t> insOffs(nIns);
+	FnCompiler compiler(buf, info, body, nIns, &fn->_feedback);
+
+	// Feedback is allocated by the slow paths if it is reset later.
+	fn->_getFeedback(0);
+
+	// Prologue, the arguments are saved into callee-saved registers, R15 is
+	// saved only to keep the stack aligned to 16 bytes for the calls.
+	buf.put({
+		0x53,				// push rbx
+		0x41, 0x54,			// push r12
+		0x41, 0x55,			// push r13
+		0x41, 0x56,			// push r14
+		0x41, 0x57,			// push r15
+		0x48, 0x89, 0xfb,	// mov rbx, rdi
+		0x49, 0x89, 0xf4,	// mov r12, rsi
+		0x49, 0x89, 0xd5,	// mov r13, rdx
+		0x49, 0x89, 0xce,	// mov r14, rcx
+		0x44, 0x89, 0xc0	// mov eax, r8d
+	});
+
+	// Dispatcher, eax holds offset of the next instruction.
+	size_t offDispatch = buf.size();
+	buf.cmpEax(nIns);
+	size_t offExitRel = buf.jcc(CC_AE);
+	buf.put({ 0x48, 0x8d, 0x15 });	// lea rdx, [rip + table]
+	size_t offTableRel = buf.putRel32();
+	buf.put({ 0x89, 0xc0 });		// mov eax, eax
+	buf.put({ 0xff, 0x24, 0xc2 });	// jmp [rdx + rax * 8]
+
+	for (uint32_t i = 0; i < nIns; ++i) {
+		insOffs[i] = buf.size();
+
+		if (!compiler.compileIns(i))
+			compiler.emitExec(i, true);
+	}
+
+	compiler.emitStubs();
+
+	// Offsets which are out of the body are left to the interpreter, which
+	// throws for them.
+	size_t offExit = buf.size();
+	buf.put({ 0x83, 0xf8, 0xff });	// cmp eax, UINT32_MAX
+	size_t offLeaveRel = buf.jcc(CC_E);
+	buf.store(false, R13, info.offCurIns, RAX);
+	size_t offLeave = buf.size();
+	buf.put({
+		0x41, 0x5f,	 // pop r15
+		0x41, 0x5e,	 // pop r14
+		0x41, 0x5d,	 // pop r13
+		0x41, 0x5c,	 // pop r12
+		0x5b,		 // pop rbx
+		0xc3		 // ret
+	});
+
+	// Jump table, which has absolute addresses of the instructions.
+	buf.code.resize((buf.size() + 7) & ~(size_t)7, (char)0xcc);
+	size_t offTable = buf.size();
+	for (uint32_t i = 0; i < nIns; ++i)
+		buf.put<uint64_t>(0);
+
+	buf.patchRel32(offExitRel, offExit);
+	buf.patchRel32(offLeaveRel, offLeave);
+	buf.patchRel32(offTableRel, offTable);
+	for (auto &i : compiler.relocs)
+		buf.patchRel32(i.off, insOffs[i.ins]);
+	for (auto i : compiler.dispatchRelocs)
+		buf.patchRel32(i, offDispatch);
+
+	ICodePage *codePage = heap.alloc(buf.size());
+
+	auto base = (uintptr_t)codePage->getPtr();
+	for (uint32_t i = 0; i < nIns; ++i)
+		buf.patch<uint64_t>(offTable + sizeof(uint64_t) * i, (uint64_t)(base + insOffs[i]));
+
+	memcpy(codePage->getPtr(), buf.code.data(), buf.size());
+	codePage->firm();
 
 	return codePage;
+#else
+	return nullptr;
+#endif
 }
@@ -2,6 +2,11 @@
 #define _SLAKE_JIT_H_
 
 #include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
 
 namespace slake {
 	class ICodePage {
@@ -13,10 +18,180 @@ namespace slake {
 		virtual void jump() = 0;
 	};
 
+	class Runtime;
 	class FnValue;
+	struct Context;
+	struct MajorFrame;
 
-	ICodePage* genCodePage(size_t size);
-	ICodePage *compileFn(FnValue* fn);
+	/// @brief Pointers to the registers, local variables and arguments of the
+	/// frame which is being executed by compiled code. They are refreshed by
+	/// the runtime after each instruction which is not compiled natively.
+	struct JITFrameSlots final {
+		void **regs;
+		void **localVars;
+		void **args;
+		uint32_t nRegs;
+		uint32_t nLocalVars;
+		uint32_t nArgs;
+	};
+
+	/// @brief Slow path which executes an instruction with the interpreter.
+	/// @return Offset of the next instruction, or UINT32_MAX if the compiled
+	/// code has to return to the interpreter.
+	using JITInsExecutor = uint32_t (*)(Runtime *rt, Context *context, MajorFrame *frame, JITFrameSlots *slots, uint32_t offIns);
+	/// @brief Called by backward jumps of compiled code to check budgets and
+	/// requests of the runtime.
+	/// @param offIns Destination of the jump.
+	/// @return The destination, or UINT32_MAX if the compiled code has to
+	/// return to the interpreter.
+	using JITPoll = uint32_t (*)(Runtime *rt, Context *context, MajorFrame *frame, uint32_t offIns);
+	/// @brief Box a result of compiled code and store it into a variable.
+	/// @param bits Result, which is truncated to the type of the instruction.
+	/// @param offIns Offset of the instruction.
+	/// @return Offset of the next instruction, or UINT32_MAX if the store threw.
+	using JITStore = uint32_t (*)(Runtime *rt, Context *context, MajorFrame *frame, void *var, uint64_t bits, uint32_t offIns);
+	/// @brief Entry of compiled functions, which starts from specified
+	/// instruction and returns once the executor returned UINT32_MAX.
+	using JITFnEntry = void (*)(Runtime *rt, Context *context, MajorFrame *frame, JITFrameSlots *slots, uint32_t offIns);
+
+	/// @brief Integer types which are compiled natively, in the order of
+	/// QuickVariant.
+	constexpr size_t N_JIT_INT_TYPES = 4;
+
+	/// @brief Layouts and helpers of the runtime which are used by compiled
+	/// code, they are filled by the runtime since most of them are private.
+	struct JITRuntimeInfo final {
+		JITInsExecutor executor;
+		JITPoll poll;
+		JITStore stores[N_JIT_INT_TYPES];
+
+		const void *literalVtables[N_JIT_INT_TYPES];  // Virtual tables of the literal values
+		uint32_t offLiteralData[N_JIT_INT_TYPES];	   // Offsets of the data of the literal values
+		const void *boolValues[2];					   // Shared false and true values
+
+		uint32_t offVarValue;		 // Offset of VarValue::value
+		uint32_t offCurIns;			 // Offset of MajorFrame::curIns
+		uint32_t offNExecutedIns;	 // Offset of Context::nExecutedIns
+	};
+
+	//
+	// Primitives for executable memory, which are implemented for each OS.
+	//
+
+	/// @brief Get granularity of protection of executable memory.
+	size_t getCodePageSize();
+	/// @brief Reserve readable and executable memory.
+	/// @param size Size of the memory, which is a multiple of the page size.
+	/// @return Reserved memory.
+	/// @throw std::bad_alloc Out of memory.
+	void *mapCodeMemory(size_t size);
+	/// @brief Make pages writable or executable, they are never both.
+	/// @param ptr Pointer to the first page.
+	/// @param size Size of the pages.
+	/// @param writable Make the pages readable and writable if true, or
+	/// readable and executable if false.
+	void protectCodeMemory(void *ptr, size_t size, bool writable);
+	void unmapCodeMemory(void *ptr, size_t size);
+
+	struct CodeHeapStats final {
+		size_t szReserved = 0;		 // Size of mapped regions
+		size_t szInUse = 0;			 // Size of allocated code blobs
+		size_t szFree = 0;			 // Size of freed blocks which can be reused
+		size_t nBlobs = 0;			 // Number of allocated code blobs
+		size_t nPages = 0;			 // Number of pages which hold live blobs
+		size_t nProtectCalls = 0;	 // Number of protection changes
+	};
+
+	class CodeBlob;
+
+	/// @brief Executable memory manager of the JIT compiler.
+	///
+	/// Code blobs are allocated from mapped regions by bumping, and freed
+	/// blobs are reused by later allocations. Pages are writable only while
+	/// blobs in them are being written: allocating a blob makes its pages
+	/// writable, and firming it makes them executable again. Inside a write
+	/// batch, pages are made executable once the outermost batch ends, so
+	/// compiling several functions changes the protections only once.
+	///
+	/// Pages which hold live blobs are never made writable again, since
+	/// other threads may be executing the code in them. Blobs which are
+	/// allocated outside batches get pages of their own, blobs in a batch
+	/// share the pages which were made writable by the batch, and must not
+	/// be executed until the batch ends.
+	class CodeHeap final {
+	private:
+		struct Region {
+			char *base;
+			size_t size;
+			size_t szBumped = 0;			   // Size allocated by bumping
+			size_t szInUse = 0;				   // Size of allocated blobs
+			std::map<size_t, size_t> freeBlocks;  // Offsets and sizes of freed blocks
+			std::vector<uint32_t> nPageBlobs;	  // Number of live blobs in each page
+		};
+
+		std::map<char *, Region> _regions;
+		Region *_curRegion = nullptr;
+
+		std::set<char *> _batchPages;  // Pages which were made writable by current batch
+		uint32_t _writeDepth = 0;
+
+		size_t _szPage;
+		CodeHeapStats _stats;
+
+		std::mutex _mutex;
+
+		Region &_newRegion(size_t szMin);
+		/// @brief Check if a blob can be allocated in a page, i.e. the page
+		/// holds no code which may be executed or written by others.
+		/// @param off Offset of the page in the region.
+		/// @param batched Whether the blob is allocated in a batch.
+		bool _isPageAllocatable(Region &region, size_t off, bool batched);
+		/// @brief Find space for a blob in a free block.
+		/// @return Offset of the space, or SIZE_MAX if there is no such space.
+		size_t _fitFreeBlock(Region &region, size_t offBlock, size_t szBlock, size_t size, bool batched);
+		void _protect(char *ptr, size_t size, bool writable);
+		void _makeBatchWritable(char *ptr, size_t size);
+		void _flush();
+
+		void _free(char *ptr, size_t size);
+		void _firm(char *ptr, size_t size, bool batched);
+
+		friend class CodeBlob;
+
+	public:
+		/// @brief Default size of regions.
+		static constexpr size_t SZ_REGION = 1024 * 1024;
+		/// @brief Alignment of code blobs.
+		static constexpr size_t BLOB_ALIGN = 16;
+
+		CodeHeap();
+		~CodeHeap();
+
+		CodeHeap(const CodeHeap &) = delete;
+		CodeHeap &operator=(const CodeHeap &) = delete;
+
+		/// @brief Allocate a code blob, which is writable until it is firmed.
+		/// Deleting the blob returns its memory to the heap.
+		/// @param size Size of the blob.
+		/// @return Allocated blob.
+		ICodePage *alloc(size_t size);
+
+		/// @brief Begin a write batch, batches can be nested.
+		void beginWrite();
+		/// @brief End a write batch, pages which were written in the batch
+		/// are made executable once the outermost batch ends.
+		void endWrite();
+
+		CodeHeapStats getStats();
+	};
+
+	/// @brief Compile a function body for current architecture.
+	/// @param heap Heap to allocate the code from.
+	/// @param fn Function to be compiled.
+	/// @param info Layouts and helpers of the runtime.
+	/// @return Code blob which starts with a JITFnEntry, or nullptr if the
+	/// function cannot be compiled.
+	ICodePage *compileFn(CodeHeap &heap, const FnValue *fn, const JITRuntimeInfo &info);
 }
 
 #endif
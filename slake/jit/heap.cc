@@ -0,0 +1,284 @@
+#include <slake/runtime.h>
+
+#if SLAKE_ENABLE_JIT
+
+#include <cassert>
+
+using namespace slake;
+
+namespace slake {
+	class CodeBlob final : public ICodePage {
+	public:
+		CodeHeap *heap;
+		char *ptr;
+		size_t size;
+		bool batched;
+		bool firmed = false;
+
+		inline CodeBlob(CodeHeap *heap, char *ptr, size_t size, bool batched) : heap(heap), ptr(ptr), size(size), batched(batched) {}
+		virtual inline ~CodeBlob() {
+			heap->_free(ptr, size);
+		}
+		virtual inline size_t getSize() override { return size; }
+		virtual inline void *getPtr() override { return ptr; }
+
+		virtual void firm() override {
+			heap->_firm(ptr, size, batched);
+			firmed = true;
+		}
+		virtual inline void jump() override {
+			assert(firmed);
+			((void (*)())ptr)();
+		}
+	};
+}
+
+CodeHeap::CodeHeap() : _szPage(getCodePageSize()) {
+}
+
+CodeHeap::~CodeHeap() {
+	// Every blob should have been freed with the functions.
+	assert(!_stats.nBlobs);
+
+	for (auto &i : _regions)
+		unmapCodeMemory(i.second.base, i.second.size);
+}
+
+CodeHeap::Region &CodeHeap::_newRegion(size_t szMin) {
+	size_t size = szMin > SZ_REGION ? (szMin + _szPage - 1) & ~(_szPage - 1) : SZ_REGION;
+
+	char *base = (char *)mapCodeMemory(size);
+
+	Region &region = _regions[base];
+	region.base = base;
+	region.size = size;
+	region.nPageBlobs.resize(size / _szPage);
+
+	_stats.szReserved += size;
+
+	return region;
+}
+
+bool CodeHeap::_isPageAllocatable(Region &region, size_t off, bool batched) {
+	if (_batchPages.count(region.base + (off & ~(_szPage - 1))))
+		return batched;
+	return !region.nPageBlobs[off / _szPage];
+}
+
+size_t CodeHeap::_fitFreeBlock(Region &region, size_t offBlock, size_t szBlock, size_t size, bool batched) {
+	// Pages which are covered by the block entirely hold no blobs, only the
+	// pages at its ends may hold live ones.
+	size_t off = offBlock;
+	if (!_isPageAllocatable(region, off, batched))
+		off = (off + _szPage - 1) & ~(_szPage - 1);
+
+	if (off + size > offBlock + szBlock || !_isPageAllocatable(region, off + size - 1, batched))
+		return SIZE_MAX;
+	return off;
+}
+
+void CodeHeap::_protect(char *ptr, size_t size, bool writable) {
+	char *begin = (char *)((uintptr_t)ptr & ~(uintptr_t)(_szPage - 1)),
+		 *end = (char *)(((uintptr_t)ptr + size + _szPage - 1) & ~(uintptr_t)(_szPage - 1));
+
+	protectCodeMemory(begin, end - begin, writable);
+	++_stats.nProtectCalls;
+}
+
+void CodeHeap::_makeBatchWritable(char *ptr, size_t size) {
+	char *begin = (char *)((uintptr_t)ptr & ~(uintptr_t)(_szPage - 1)),
+		 *end = (char *)(((uintptr_t)ptr + size + _szPage - 1) & ~(uintptr_t)(_szPage - 1));
+
+	// Change protections of consecutive pages which are not writable with a
+	// single call.
+	char *runBegin = nullptr;
+	for (char *i = begin; i <= end; i += _szPage) {
+		if (i < end && !_batchPages.count(i)) {
+			if (!runBegin)
+				runBegin = i;
+			_batchPages.insert(i);
+		} else if (runBegin) {
+			protectCodeMemory(runBegin, i - runBegin, true);
+			++_stats.nProtectCalls;
+			runBegin = nullptr;
+		}
+	}
+}
+
+void CodeHeap::_flush() {
+	char *runBegin = nullptr, *runEnd = nullptr;
+	for (auto i : _batchPages) {
+		if (runBegin && i == runEnd) {
+			runEnd += _szPage;
+			continue;
+		}
+		if (runBegin) {
+			protectCodeMemory(runBegin, runEnd - runBegin, false);
+			++_stats.nProtectCalls;
+		}
+		runBegin = i;
+		runEnd = i + _szPage;
+	}
+	if (runBegin) {
+		protectCodeMemory(runBegin, runEnd - runBegin, false);
+		++_stats.nProtectCalls;
+	}
+
+	_batchPages.clear();
+}
+
+ICodePage *CodeHeap::alloc(size_t size) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	size = (size + BLOB_ALIGN - 1) & ~(BLOB_ALIGN - 1);
+
+	bool batched = _writeDepth;
+
+	Region *region = nullptr;
+	size_t off = 0;
+
+	// Reuse freed blocks first.
+	for (auto &i : _regions) {
+		for (auto j = i.second.freeBlocks.begin(); j != i.second.freeBlocks.end(); ++j) {
+			size_t offBlock = j->first, szBlock = j->second;
+			if ((off = _fitFreeBlock(i.second, offBlock, szBlock, size, batched)) == SIZE_MAX)
+				continue;
+
+			region = &i.second;
+
+			region->freeBlocks.erase(j);
+			if (off > offBlock)
+				region->freeBlocks[offBlock] = off - offBlock;
+			if (offBlock + szBlock > off + size)
+				region->freeBlocks[off + size] = offBlock + szBlock - (off + size);
+			break;
+		}
+		if (region)
+			break;
+	}
+
+	if (!region) {
+		if (size > SZ_REGION) {
+			// Large blobs get their own regions, which are released once
+			// the blobs are freed.
+			region = &_newRegion(size);
+		} else {
+			// Bump from the next page if current one holds live blobs, the
+			// skipped space is reused once they are freed.
+			if (_curRegion &&
+				_curRegion->szBumped < _curRegion->size &&
+				!_isPageAllocatable(*_curRegion, _curRegion->szBumped, batched)) {
+				size_t offAligned = (_curRegion->szBumped + _szPage - 1) & ~(_szPage - 1);
+				_curRegion->freeBlocks[_curRegion->szBumped] = offAligned - _curRegion->szBumped;
+				_curRegion->szBumped = offAligned;
+			}
+
+			if (!_curRegion || _curRegion->size - _curRegion->szBumped < size)
+				_curRegion = &_newRegion(size);
+			region = _curRegion;
+		}
+
+		off = region->szBumped;
+		region->szBumped += size;
+	}
+
+	region->szInUse += size;
+	for (size_t i = off / _szPage; i <= (off + size - 1) / _szPage; ++i)
+		++region->nPageBlobs[i];
+	_stats.szInUse += size;
+	++_stats.nBlobs;
+
+	char *ptr = region->base + off;
+	if (batched)
+		_makeBatchWritable(ptr, size);
+	else
+		_protect(ptr, size, true);
+
+	return new CodeBlob(this, ptr, size, batched);
+}
+
+void CodeHeap::_free(char *ptr, size_t size) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = std::prev(_regions.upper_bound(ptr));
+	Region &region = it->second;
+
+	size_t off = ptr - region.base, szBlob = size;
+
+	for (size_t i = off / _szPage; i <= (off + size - 1) / _szPage; ++i)
+		--region.nPageBlobs[i];
+
+	// Merge with the neighbouring free blocks.
+	if (auto next = region.freeBlocks.find(off + size); next != region.freeBlocks.end()) {
+		size += next->second;
+		region.freeBlocks.erase(next);
+	}
+	if (auto next = region.freeBlocks.lower_bound(off); next != region.freeBlocks.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == off) {
+			off = prev->first;
+			size += prev->second;
+			region.freeBlocks.erase(prev);
+		}
+	}
+
+	// Give blocks at the end back to the bump allocator.
+	if (off + size == region.szBumped)
+		region.szBumped = off;
+	else
+		region.freeBlocks[off] = size;
+
+	region.szInUse -= szBlob;
+	_stats.szInUse -= szBlob;
+	--_stats.nBlobs;
+
+	// Release empty regions except the one for bumping.
+	if (!region.szInUse && &region != _curRegion) {
+		_batchPages.erase(
+			_batchPages.lower_bound(region.base),
+			_batchPages.lower_bound(region.base + region.size));
+		unmapCodeMemory(region.base, region.size);
+		_stats.szReserved -= region.size;
+		_regions.erase(it);
+	}
+}
+
+void CodeHeap::_firm(char *ptr, size_t size, bool batched) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// Pages of blobs in batches are made executable once the batch ends.
+	if (!batched)
+		_protect(ptr, size, false);
+}
+
+void CodeHeap::beginWrite() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	++_writeDepth;
+}
+
+void CodeHeap::endWrite() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	assert(_writeDepth);
+	if (!--_writeDepth)
+		_flush();
+}
+
+CodeHeapStats CodeHeap::getStats() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	CodeHeapStats stats = _stats;
+	for (auto &i : _regions) {
+		for (auto &j : i.second.freeBlocks)
+			stats.szFree += j.second;
+		for (auto j : i.second.nPageBlobs) {
+			if (j)
+				++stats.nPages;
+		}
+	}
+
+	return stats;
+}
+
+#endif
@@ -1,45 +1,26 @@
 #include "../../base.hh"
-#include <cstdint>
-#include <cstring>
-#include <cassert>
-#include <memory_resource>
+#include <new>
 #include <sys/mman.h>
-#include <sys/sysinfo.h>
 
 #include <unistd.h>
 
-static size_t _PAGESIZE = 0;
-
-class LinuxCodePage : public slake::ICodePage {
-public:
-	char *ptr;
-	size_t size;
-	bool firmed = false;
+size_t slake::getCodePageSize() {
+	static size_t szPage = (size_t)sysconf(_SC_PAGESIZE);
+	return szPage;
+}
 
-	inline LinuxCodePage(size_t size) : ptr(ptr), size(size) {
-		struct sysinfo info;
-		sysinfo(&info);
-		if(!_PAGESIZE)
-			_PAGESIZE = info.mem_unit;
-		ptr = (char*)aligned_alloc(_PAGESIZE, size);
-	}
-	virtual inline ~LinuxCodePage() {
-		mprotect(ptr, size, PROT_READ);
-		free(ptr);
-	}
-	virtual inline size_t getSize() override { return size; }
-	virtual inline void *getPtr() override { return ptr; }
+void *slake::mapCodeMemory(size_t size) {
+	void *ptr = mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+		throw std::bad_alloc();
+	return ptr;
+}
 
-	virtual void firm() override {
-		mprotect(ptr, size, PROT_EXEC | PROT_READ);
-		firmed = true;
-	}
-	virtual inline void jump() override {
-		assert(firmed);
-		((void (*)())ptr)();
-	}
-};
+void slake::protectCodeMemory(void *ptr, size_t size, bool writable) {
+	if (mprotect(ptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC))
+		throw std::bad_alloc();
+}
 
-slake::ICodePage *slake::genCodePage(size_t size) {
-	return new LinuxCodePage(size);
+void slake::unmapCodeMemory(void *ptr, size_t size) {
+	munmap(ptr, size);
 }
@@ -1,40 +1,32 @@
 #include "../../base.hh"
-#include <cstdint>
-#include <cstring>
-#include <cassert>
+#include <new>
 
 #include <Windows.h>
 
-class Win32CodePage : public slake::ICodePage {
-public:
-	char *ptr;
-	size_t size;
-	DWORD oldProtect;
-	bool firmed = false;
+size_t slake::getCodePageSize() {
+	static size_t szPage = [] {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return (size_t)info.dwPageSize;
+	}();
+	return szPage;
+}
 
-	inline Win32CodePage(size_t size) : ptr(ptr), size(size) {
-		ptr = new char[size];
-		VirtualProtect(ptr, size, PAGE_READWRITE, &oldProtect);
-		FlushInstructionCache(GetCurrentProcess(), ptr, size);
-	}
-	virtual inline ~Win32CodePage() {
-		VirtualProtect(ptr, size, oldProtect, &oldProtect);
-		delete[] ptr;
-	}
-	virtual inline size_t getSize() override { return size; }
-	virtual inline void *getPtr() override { return ptr; }
+void *slake::mapCodeMemory(size_t size) {
+	void *ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READ);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
 
-	virtual void firm() override {
-		DWORD tmp;
-		VirtualProtect(ptr, size, PAGE_EXECUTE_READ, &tmp);
-		firmed = true;
-	}
-	virtual inline void jump() override {
-		assert(firmed);
-		((void (*)())ptr)();
-	}
-};
+void slake::protectCodeMemory(void *ptr, size_t size, bool writable) {
+	DWORD oldProtect;
+	if (!VirtualProtect(ptr, size, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &oldProtect))
+		throw std::bad_alloc();
+	if (!writable)
+		FlushInstructionCache(GetCurrentProcess(), ptr, size);
+}
 
-slake::ICodePage *slake::genCodePage(size_t size) {
-	return new Win32CodePage(size);
+void slake::unmapCodeMemory(void *ptr, size_t size) {
+	VirtualFree(ptr, 0, MEM_RELEASE);
 }
@@ -2,6 +2,7 @@
 #include <slake/lib/core.h>
 #include <slake/lib/std/util.h>
 #include <slake/lib/std/math.h>
+#include <slake/lib/std/worker.h>
 
 using namespace slake;
 
@@ -13,4 +14,5 @@ void stdlib::load(Runtime *rt) {
 	root->scope->addMember("std", modStd = new ModuleValue(rt, ACCESS_PUB));
 	math::load(rt);
 	util::load(rt);
+	worker::load(rt);
 }
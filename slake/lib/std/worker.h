@@ -0,0 +1,50 @@
+#ifndef _SLAKE_LIB_STD_WORKER_H_
+#define _SLAKE_LIB_STD_WORKER_H_
+
+#include <slake/runtime.h>
+
+namespace slake {
+	namespace stdlib {
+		/// @brief Worker isolates, each of them has its own runtime and heap
+		/// and runs on its own thread.
+		///
+		/// A worker calls a function of a module with each message which was
+		/// posted to it, and posts the return value back. Messages are
+		/// structured clones, see StructuredClone. Runtimes of the workers
+		/// share module images and locators with the runtimes which spawned
+		/// them. Workers belong to the runtimes which spawned them, IDs of
+		/// the workers are only valid in those runtimes.
+		///
+		/// Members of std.worker:
+		/// - spawn(module: string, fn: string): u32
+		/// - post(worker: u32, message: any): void
+		/// - transfer(worker: u32, message: any): void, strings in the
+		///   message are moved to the worker instead of being copied,
+		///   except literals of the modules.
+		/// - recv(worker: u32): any, waits for the next result.
+		/// - close(worker: u32): void, waits for the worker to handle the
+		///   posted messages and exit, results which were not received are
+		///   dropped.
+		namespace worker {
+			extern ModuleValue *modWorker;
+
+			/// @brief Called on threads of new workers to prepare their
+			/// runtimes before loading the modules, e.g. registering native
+			/// modules.
+			using IsolateInitializer = std::function<void(Runtime *rt)>;
+
+			/// @brief Set the initializer of workers which are spawned by a
+			/// runtime, workers inherit it for the workers spawned by them.
+			void setIsolateInitializer(Runtime *rt, IsolateInitializer initializer);
+
+			/// @brief Close every worker which was spawned by a runtime and
+			/// wait for them to exit, which is done by the runtime on its
+			/// destruction as well.
+			void closeAll(Runtime *rt);
+
+			void load(Runtime *rt);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,321 @@
+#include <slake/lib/std.h>
+#include <slake/lib/std/worker.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace slake;
+using namespace slake::stdlib;
+using namespace slake::stdlib::worker;
+
+ModuleValue *stdlib::worker::modWorker = nullptr;
+
+namespace {
+	struct Worker final {
+		std::thread thread;
+
+		std::mutex mutex;
+		std::condition_variable cond;
+		std::deque<StructuredClone> inbox, outbox;
+		bool closing = false, exited = false;
+		std::string error;	// Error which stopped the worker
+	};
+
+	/// @brief Configuration of runtimes of the workers, which is inherited
+	/// from the spawning runtime.
+	struct WorkerConfig final {
+		RuntimeFlags flags;
+		std::shared_ptr<ModuleImageCache> moduleImageCache;
+		ModuleLocatorFn moduleLocator;
+		ModuleImageLocatorFn moduleImageLocator;
+		unsigned int nLoaderThreads;
+		IsolateInitializer initializer;
+	};
+
+	/// @brief Workers which were spawned by a runtime, they are closed with
+	/// the runtime.
+	struct WorkerRegistry final : public NativeLibState {
+		std::mutex mutex;
+		std::map<uint32_t, std::shared_ptr<Worker>> workers;
+		uint32_t nextId = 0;
+		IsolateInitializer initializer;
+
+		virtual ~WorkerRegistry();
+	};
+}
+
+static std::shared_ptr<WorkerRegistry> _getRegistry(Runtime *rt) {
+	return rt->getNativeLibState<WorkerRegistry>("std.worker");
+}
+
+static void _closeWorker(std::shared_ptr<Worker> worker) {
+	{
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		worker->closing = true;
+	}
+	worker->cond.notify_all();
+
+	if (worker->thread.joinable())
+		worker->thread.join();
+}
+
+static void _closeWorkers(WorkerRegistry &registry) {
+	std::map<uint32_t, std::shared_ptr<Worker>> workers;
+	{
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		workers.swap(registry.workers);
+	}
+
+	for (auto &i : workers)
+		_closeWorker(i.second);
+}
+
+WorkerRegistry::~WorkerRegistry() {
+	_closeWorkers(*this);
+}
+
+static std::shared_ptr<Worker> _getWorker(Runtime *rt, Value *id) {
+	if (!id || id->getType() != TypeId::U32)
+		throw InvalidArgumentsError();
+
+	auto registry = _getRegistry(rt);
+
+	std::lock_guard<std::mutex> lock(registry->mutex);
+	if (auto it = registry->workers.find(((U32Value *)id)->getData()); it != registry->workers.end())
+		return it->second;
+
+	throw InvalidArgumentsError("Invalid worker");
+}
+
+static void _runWorker(std::shared_ptr<Worker> worker, WorkerConfig config, std::string modName, std::string fnName) {
+	// Exceptions may hold values of the runtime, which has to outlive them.
+	std::unique_ptr<Runtime> rt;
+
+	try {
+		rt = std::make_unique<Runtime>(config.flags);
+
+		rt->setModuleImageCache(config.moduleImageCache);
+		rt->setModuleLocator(config.moduleLocator);
+		rt->setModuleImageLocator(config.moduleImageLocator);
+		rt->setLoaderThreadCount(config.nLoaderThreads);
+
+		// Workers which are spawned by the worker are prepared in the same
+		// way.
+		_getRegistry(rt.get())->initializer = config.initializer;
+		if (config.initializer)
+			config.initializer(rt.get());
+
+		ValueRef<RefValue> ref = new RefValue(rt.get());
+		for (size_t i = 0, j; i <= modName.size(); i = j + 1) {
+			if ((j = modName.find('.', i)) == std::string::npos)
+				j = modName.size();
+			ref->entries.push_back(RefEntry(modName.substr(i, j - i)));
+		}
+
+		auto mod = rt->importModule(ref);
+
+		ValueRef<> fn = mod->getMember(fnName);
+		if (!fn || fn->getType() != TypeId::Fn)
+			throw NotFoundError("Worker function `" + fnName + "' was not found", ref);
+
+		while (true) {
+			StructuredClone message;
+			{
+				std::unique_lock<std::mutex> lock(worker->mutex);
+				worker->cond.wait(lock, [&]() { return worker->inbox.size() || worker->closing; });
+
+				// Posted messages are handled before exiting.
+				if (worker->inbox.empty())
+					break;
+
+				message = std::move(worker->inbox.front());
+				worker->inbox.pop_front();
+			}
+
+			auto arg = rt->restoreClone(std::move(message));
+			auto result = fn->call(nullptr, { arg.get() });
+
+			// Results may be shared with the worker, e.g. literals and
+			// globals, so they are copied.
+			auto resultClone = rt->cloneValue(result.get());
+
+			{
+				std::lock_guard<std::mutex> lock(worker->mutex);
+				worker->outbox.push_back(std::move(resultClone));
+			}
+			worker->cond.notify_all();
+		}
+	} catch (std::exception &e) {
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		worker->error = e.what();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		worker->exited = true;
+	}
+	worker->cond.notify_all();
+}
+
+//
+// Native function callback implementations start
+//
+
+#define _nArgCheck(op, n) \
+	if (!(args.size() op(n))) throw InvalidArgumentsError()
+#define _nullRefCheck(x) \
+	if (!(x)) throw NullRefError()
+#define _typeCheck(x, t) \
+	if ((x)->getType() != (t)) throw InvalidArgumentsError()
+
+static ValueRef<> _spawnImpl(Runtime *rt, Value *thisObject, std::deque<Value *> args) {
+	_nArgCheck(==, 2);
+
+	_nullRefCheck(args[0]);
+	_typeCheck(args[0], TypeId::String);
+	_nullRefCheck(args[1]);
+	_typeCheck(args[1], TypeId::String);
+
+	WorkerConfig config;
+	config.flags = rt->_flags & (RT_NOJIT | RT_DEBUG | RT_GCDBG | RT_STRICT);
+	config.moduleImageCache = rt->getModuleImageCache();
+	config.moduleLocator = rt->getModuleLocator();
+	config.moduleImageLocator = rt->getModuleImageLocator();
+	config.nLoaderThreads = rt->getLoaderThreadCount();
+
+	auto worker = std::make_shared<Worker>();
+
+	auto registry = _getRegistry(rt);
+
+	uint32_t id;
+	{
+		std::lock_guard<std::mutex> lock(registry->mutex);
+		config.initializer = registry->initializer;
+		id = registry->nextId++;
+		registry->workers[id] = worker;
+	}
+
+	worker->thread = std::thread(
+		_runWorker,
+		worker,
+		std::move(config),
+		((StringValue *)args[0])->getData(),
+		((StringValue *)args[1])->getData());
+
+	return new U32Value(rt, id);
+}
+
+static void _post(Runtime *rt, std::deque<Value *> &args, bool transfer) {
+	_nArgCheck(==, 2);
+
+	auto worker = _getWorker(rt, args[0]);
+	auto message = rt->cloneValue(args[1], transfer);
+
+	{
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		if (worker->closing)
+			throw InvalidArgumentsError("Worker was closed");
+		worker->inbox.push_back(std::move(message));
+	}
+	worker->cond.notify_all();
+}
+
+static ValueRef<> _postImpl(Runtime *rt, Value *thisObject, std::deque<Value *> args) {
+	_post(rt, args, false);
+	return nullptr;
+}
+
+static ValueRef<> _transferImpl(Runtime *rt, Value *thisObject, std::deque<Value *> args) {
+	_post(rt, args, true);
+	return nullptr;
+}
+
+static ValueRef<> _recvImpl(Runtime *rt, Value *thisObject, std::deque<Value *> args) {
+	_nArgCheck(==, 1);
+
+	auto worker = _getWorker(rt, args[0]);
+
+	StructuredClone result;
+	bool isReceived = false;
+	std::string error;
+	{
+		// GC cycles would be stalled by waiting in the execution.
+		Runtime::BlockingScope blockingScope(rt);
+
+		std::unique_lock<std::mutex> lock(worker->mutex);
+		worker->cond.wait(lock, [&]() { return worker->outbox.size() || worker->exited; });
+
+		if (worker->outbox.size()) {
+			result = std::move(worker->outbox.front());
+			worker->outbox.pop_front();
+			isReceived = true;
+		} else
+			error = worker->error;
+	}
+
+	if (!isReceived) {
+		if (error.size())
+			throw AbortedError("Worker stopped with an error: " + error);
+		throw AbortedError("Worker exited");
+	}
+
+	return rt->restoreClone(std::move(result));
+}
+
+static ValueRef<> _closeImpl(Runtime *rt, Value *thisObject, std::deque<Value *> args) {
+	_nArgCheck(==, 1);
+
+	auto worker = _getWorker(rt, args[0]);
+	{
+		Runtime::BlockingScope blockingScope(rt);
+		_closeWorker(worker);
+	}
+
+	auto registry = _getRegistry(rt);
+
+	std::lock_guard<std::mutex> lock(registry->mutex);
+	registry->workers.erase(((U32Value *)args[0])->getData());
+
+	return nullptr;
+}
+
+//
+// Native function callback implementations end
+//
+
+void stdlib::worker::setIsolateInitializer(Runtime *rt, IsolateInitializer initializer) {
+	auto registry = _getRegistry(rt);
+
+	std::lock_guard<std::mutex> lock(registry->mutex);
+	registry->initializer = initializer;
+}
+
+void stdlib::worker::closeAll(Runtime *rt) {
+	auto registry = _getRegistry(rt);
+
+	Runtime::BlockingScope blockingScope(rt);
+	_closeWorkers(*registry);
+}
+
+void stdlib::worker::load(Runtime *rt) {
+	modStd->scope->addMember("worker",
+		modWorker = new ModuleValue(rt, ACCESS_PUB));
+
+	modWorker->scope->addMember(
+		rt->mangleName("spawn", { TypeId::String, TypeId::String }),
+		new NativeFnValue(rt, _spawnImpl, ACCESS_PUB, TypeId::U32));
+	modWorker->scope->addMember(
+		rt->mangleName("post", { TypeId::U32, TypeId::Any }),
+		new NativeFnValue(rt, _postImpl, ACCESS_PUB, TypeId::None));
+	modWorker->scope->addMember(
+		rt->mangleName("transfer", { TypeId::U32, TypeId::Any }),
+		new NativeFnValue(rt, _transferImpl, ACCESS_PUB, TypeId::None));
+	modWorker->scope->addMember(
+		rt->mangleName("recv", { TypeId::U32 }),
+		new NativeFnValue(rt, _recvImpl, ACCESS_PUB, TypeId::Any));
+	modWorker->scope->addMember(
+		rt->mangleName("close", { TypeId::U32 }),
+		new NativeFnValue(rt, _closeImpl, ACCESS_PUB, TypeId::None));
+}
@@ -1,71 +1,111 @@
 #include "opcode.h"
 
+#include <iterator>
+
 using namespace slake;
 
-#define MNEMONIC_ENTRIES         \
-	MNEMONIC_ENTRY(NOP),         \
-		MNEMONIC_ENTRY(PUSH),    \
-		MNEMONIC_ENTRY(POP),     \
-		MNEMONIC_ENTRY(LOAD),    \
-		MNEMONIC_ENTRY(RLOAD),   \
-		MNEMONIC_ENTRY(STORE),   \
-		MNEMONIC_ENTRY(LVAR),    \
-		MNEMONIC_ENTRY(REG),     \
-		MNEMONIC_ENTRY(LVALUE),  \
-		MNEMONIC_ENTRY(ENTER),   \
-		MNEMONIC_ENTRY(LEAVE),   \
-		MNEMONIC_ENTRY(ADD),     \
-		MNEMONIC_ENTRY(SUB),     \
-		MNEMONIC_ENTRY(MUL),     \
-		MNEMONIC_ENTRY(DIV),     \
-		MNEMONIC_ENTRY(MOD),     \
-		MNEMONIC_ENTRY(AND),     \
-		MNEMONIC_ENTRY(OR),      \
-		MNEMONIC_ENTRY(XOR),     \
-		MNEMONIC_ENTRY(LAND),    \
-		MNEMONIC_ENTRY(LOR),     \
-		MNEMONIC_ENTRY(EQ),      \
-		MNEMONIC_ENTRY(NEQ),     \
-		MNEMONIC_ENTRY(LT),      \
-		MNEMONIC_ENTRY(GT),      \
-		MNEMONIC_ENTRY(LTEQ),    \
-		MNEMONIC_ENTRY(GTEQ),    \
-		MNEMONIC_ENTRY(LSH),     \
-		MNEMONIC_ENTRY(RSH),     \
-		MNEMONIC_ENTRY(NOT),     \
-		MNEMONIC_ENTRY(LNOT),    \
-		MNEMONIC_ENTRY(INCF),    \
-		MNEMONIC_ENTRY(DECF),    \
-		MNEMONIC_ENTRY(INCB),    \
-		MNEMONIC_ENTRY(DECB),    \
-		MNEMONIC_ENTRY(NEG),     \
-		MNEMONIC_ENTRY(AT),      \
-		MNEMONIC_ENTRY(JMP),     \
-		MNEMONIC_ENTRY(JT),      \
-		MNEMONIC_ENTRY(JF),      \
-		MNEMONIC_ENTRY(PUSHARG), \
-		MNEMONIC_ENTRY(CALL),    \
-		MNEMONIC_ENTRY(MCALL),   \
-		MNEMONIC_ENTRY(ACALL),   \
-		MNEMONIC_ENTRY(AMCALL),  \
-		MNEMONIC_ENTRY(YIELD),   \
-		MNEMONIC_ENTRY(AWAIT),   \
-		MNEMONIC_ENTRY(LTHIS),   \
-		MNEMONIC_ENTRY(RET),     \
-		MNEMONIC_ENTRY(LRET),    \
-		MNEMONIC_ENTRY(NEW),     \
-		MNEMONIC_ENTRY(THROW),   \
-		MNEMONIC_ENTRY(PUSHXH),  \
-		MNEMONIC_ENTRY(LEXCEPT), \
-		MNEMONIC_ENTRY(ABORT),   \
-		MNEMONIC_ENTRY(CAST),    \
+#define MNEMONIC_ENTRIES           \
+	MNEMONIC_ENTRY(NOP),           \
+		MNEMONIC_ENTRY(PUSH),      \
+		MNEMONIC_ENTRY(POP),       \
+		MNEMONIC_ENTRY(LOAD),      \
+		MNEMONIC_ENTRY(RLOAD),     \
+		MNEMONIC_ENTRY(STORE),     \
+		MNEMONIC_ENTRY(LVAR),      \
+		MNEMONIC_ENTRY(REG),       \
+		MNEMONIC_ENTRY(LVALUE),    \
+		MNEMONIC_ENTRY(ENTER),     \
+		MNEMONIC_ENTRY(LEAVE),     \
+		MNEMONIC_ENTRY(ADD),       \
+		MNEMONIC_ENTRY(SUB),       \
+		MNEMONIC_ENTRY(MUL),       \
+		MNEMONIC_ENTRY(DIV),       \
+		MNEMONIC_ENTRY(MOD),       \
+		MNEMONIC_ENTRY(AND),       \
+		MNEMONIC_ENTRY(OR),        \
+		MNEMONIC_ENTRY(XOR),       \
+		MNEMONIC_ENTRY(LAND),      \
+		MNEMONIC_ENTRY(LOR),       \
+		MNEMONIC_ENTRY(EQ),        \
+		MNEMONIC_ENTRY(NEQ),       \
+		MNEMONIC_ENTRY(LT),        \
+		MNEMONIC_ENTRY(GT),        \
+		MNEMONIC_ENTRY(LTEQ),      \
+		MNEMONIC_ENTRY(GTEQ),      \
+		MNEMONIC_ENTRY(LSH),       \
+		MNEMONIC_ENTRY(RSH),       \
+		MNEMONIC_ENTRY(NOT),       \
+		MNEMONIC_ENTRY(LNOT),      \
+		MNEMONIC_ENTRY(INCF),      \
+		MNEMONIC_ENTRY(DECF),      \
+		MNEMONIC_ENTRY(INCB),      \
+		MNEMONIC_ENTRY(DECB),      \
+		MNEMONIC_ENTRY(NEG),       \
+		MNEMONIC_ENTRY(AT),        \
+		MNEMONIC_ENTRY(JMP),       \
+		MNEMONIC_ENTRY(JT),        \
+		MNEMONIC_ENTRY(JF),        \
+		MNEMONIC_ENTRY(PUSHARG),   \
+		MNEMONIC_ENTRY(CALL),      \
+		MNEMONIC_ENTRY(MCALL),     \
+		MNEMONIC_ENTRY(TAILCALL),  \
+		MNEMONIC_ENTRY(MTAILCALL), \
+		MNEMONIC_ENTRY(ACALL),     \
+		MNEMONIC_ENTRY(AMCALL),    \
+		MNEMONIC_ENTRY(YIELD),     \
+		MNEMONIC_ENTRY(AWAIT),     \
+		MNEMONIC_ENTRY(LTHIS),     \
+		MNEMONIC_ENTRY(RET),       \
+		MNEMONIC_ENTRY(LRET),      \
+		MNEMONIC_ENTRY(NEW),       \
+		MNEMONIC_ENTRY(THROW),     \
+		MNEMONIC_ENTRY(PUSHXH),    \
+		MNEMONIC_ENTRY(LEXCEPT),   \
+		MNEMONIC_ENTRY(ABORT),     \
+		MNEMONIC_ENTRY(CAST),      \
 		MNEMONIC_ENTRY(TYPEOF)
 
+#define QUICK_MNEMONIC_ENTRY(m)                                  \
+	MNEMONIC_ENTRY(m##_I32), MNEMONIC_ENTRY(m##_I64),              \
+		MNEMONIC_ENTRY(m##_U32), MNEMONIC_ENTRY(m##_U64),          \
+		MNEMONIC_ENTRY(m##_F32), MNEMONIC_ENTRY(m##_F64)
+
+#define FUSED_MNEMONIC_ENTRY(m)                                          \
+	MNEMONIC_ENTRY(m##_I32_JT), MNEMONIC_ENTRY(m##_I64_JT),                \
+		MNEMONIC_ENTRY(m##_U32_JT), MNEMONIC_ENTRY(m##_U64_JT),            \
+		MNEMONIC_ENTRY(m##_F32_JT), MNEMONIC_ENTRY(m##_F64_JT),            \
+		MNEMONIC_ENTRY(m##_I32_JF), MNEMONIC_ENTRY(m##_I64_JF),            \
+		MNEMONIC_ENTRY(m##_U32_JF), MNEMONIC_ENTRY(m##_U64_JF),            \
+		MNEMONIC_ENTRY(m##_F32_JF), MNEMONIC_ENTRY(m##_F64_JF)
+
+#define QUICK_MNEMONIC_ENTRIES        \
+	QUICK_MNEMONIC_ENTRY(ADD),        \
+		QUICK_MNEMONIC_ENTRY(SUB),    \
+		QUICK_MNEMONIC_ENTRY(MUL),    \
+		QUICK_MNEMONIC_ENTRY(DIV),    \
+		QUICK_MNEMONIC_ENTRY(MOD),    \
+		QUICK_MNEMONIC_ENTRY(EQ),     \
+		QUICK_MNEMONIC_ENTRY(NEQ),    \
+		QUICK_MNEMONIC_ENTRY(LT),     \
+		QUICK_MNEMONIC_ENTRY(GT),     \
+		QUICK_MNEMONIC_ENTRY(LTEQ),   \
+		QUICK_MNEMONIC_ENTRY(GTEQ),   \
+		QUICK_MNEMONIC_ENTRY(INCF),   \
+		QUICK_MNEMONIC_ENTRY(DECF),   \
+		FUSED_MNEMONIC_ENTRY(EQ),     \
+		FUSED_MNEMONIC_ENTRY(NEQ),    \
+		FUSED_MNEMONIC_ENTRY(LT),     \
+		FUSED_MNEMONIC_ENTRY(GT),     \
+		FUSED_MNEMONIC_ENTRY(LTEQ),   \
+		FUSED_MNEMONIC_ENTRY(GTEQ),   \
+		QUICK_MNEMONIC_ENTRY(LVALUE_ARITH)
+
 #define MNEMONIC_ENTRY(m) \
 	{ Opcode::m, #m }
 
 const std::map<Opcode, std::string> slake::OPCODE_MNEMONIC_MAP = {
-	MNEMONIC_ENTRIES
+	MNEMONIC_ENTRIES,
+	QUICK_MNEMONIC_ENTRIES
 };
 
 #undef MNEMONIC_ENTRY
@@ -74,5 +114,87 @@ const std::map<Opcode, std::string> slake::OPCODE_MNEMONIC_MAP = {
 	{ #m, Opcode::m }
 
 const std::map<std::string, Opcode> slake::MNEMONIC_OPCODE_MAP = {
-	MNEMONIC_ENTRIES
+	MNEMONIC_ENTRIES,
+	QUICK_MNEMONIC_ENTRIES
+};
+
+/// @brief Groups of the type-specialized instructions, in the order of the opcodes.
+static const Opcode _quickOpcodeGroups[] = {
+	Opcode::ADD,
+	Opcode::SUB,
+	Opcode::MUL,
+	Opcode::DIV,
+	Opcode::MOD,
+	Opcode::EQ,
+	Opcode::NEQ,
+	Opcode::LT,
+	Opcode::GT,
+	Opcode::LTEQ,
+	Opcode::GTEQ,
+	Opcode::INCF,
+	Opcode::DECF,
+
+	// Superinstructions, with the JT and JF variants for each comparison.
+	Opcode::EQ,
+	Opcode::EQ,
+	Opcode::NEQ,
+	Opcode::NEQ,
+	Opcode::LT,
+	Opcode::LT,
+	Opcode::GT,
+	Opcode::GT,
+	Opcode::LTEQ,
+	Opcode::LTEQ,
+	Opcode::GTEQ,
+	Opcode::GTEQ,
+
+	// LVALUE fused with arithmetic.
+	Opcode::LVALUE
 };
+
+Opcode slake::getGenericOpcode(Opcode opcode) {
+	if (!isQuickOpcode(opcode))
+		return opcode;
+	return _quickOpcodeGroups[((uint16_t)opcode - (uint16_t)Opcode::ADD_I32) / N_QUICK_TYPES];
+}
+
+Opcode slake::getQuickOpcode(Opcode opcode, QuickVariant variant) {
+	for (uint16_t i = 0; i < std::size(_quickOpcodeGroups); ++i) {
+		if (_quickOpcodeGroups[i] == opcode)
+			return (Opcode)((uint16_t)Opcode::ADD_I32 + i * N_QUICK_TYPES + variant);
+	}
+	return Opcode::OPCODE_MAX;
+}
+
+Opcode slake::getFusedJumpOpcode(Opcode opcode, Opcode jumpOpcode) {
+	if (!isQuickOpcode(opcode) || isFusedJumpOpcode(opcode))
+		return Opcode::OPCODE_MAX;
+
+	switch (getGenericOpcode(opcode)) {
+		case Opcode::EQ:
+		case Opcode::NEQ:
+		case Opcode::LT:
+		case Opcode::GT:
+		case Opcode::LTEQ:
+		case Opcode::GTEQ:
+			break;
+		default:
+			return Opcode::OPCODE_MAX;
+	}
+
+	uint16_t off = (uint16_t)opcode - (uint16_t)Opcode::EQ_I32;
+	switch (jumpOpcode) {
+		case Opcode::JT:
+			return (Opcode)((uint16_t)Opcode::EQ_I32_JT + (off / N_QUICK_TYPES) * 2 * N_QUICK_TYPES + off % N_QUICK_TYPES);
+		case Opcode::JF:
+			return (Opcode)((uint16_t)Opcode::EQ_I32_JF + (off / N_QUICK_TYPES) * 2 * N_QUICK_TYPES + off % N_QUICK_TYPES);
+		default:
+			return Opcode::OPCODE_MAX;
+	}
+}
+
+Opcode slake::getUnfusedOpcode(Opcode opcode) {
+	if (!isFusedJumpOpcode(opcode))
+		return opcode;
+	return getQuickOpcode(getGenericOpcode(opcode), getQuickVariant(opcode));
+}
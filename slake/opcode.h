@@ -89,9 +89,116 @@ namespace slake {
 
 		CONSTSW,  // Constant switch
 
-		OPCODE_MAX
+		TAILCALL,	// Tail call, which reuses current frame
+		MTAILCALL,	// Method tail call
+
+		OPCODE_MAX,
+
+		// Type-specialized instructions, which are emitted by compilers for
+		// operands with statically known types, or rewritten from the
+		// generic ones by the interpreter. Each group has variants for I32,
+		// I64, U32, U64, F32 and F64, in the order of QuickVariant.
+		ADD_I32 = 0x100, ADD_I64, ADD_U32, ADD_U64, ADD_F32, ADD_F64,
+		SUB_I32, SUB_I64, SUB_U32, SUB_U64, SUB_F32, SUB_F64,
+		MUL_I32, MUL_I64, MUL_U32, MUL_U64, MUL_F32, MUL_F64,
+		DIV_I32, DIV_I64, DIV_U32, DIV_U64, DIV_F32, DIV_F64,
+		MOD_I32, MOD_I64, MOD_U32, MOD_U64, MOD_F32, MOD_F64,
+		EQ_I32, EQ_I64, EQ_U32, EQ_U64, EQ_F32, EQ_F64,
+		NEQ_I32, NEQ_I64, NEQ_U32, NEQ_U64, NEQ_F32, NEQ_F64,
+		LT_I32, LT_I64, LT_U32, LT_U64, LT_F32, LT_F64,
+		GT_I32, GT_I64, GT_U32, GT_U64, GT_F32, GT_F64,
+		LTEQ_I32, LTEQ_I64, LTEQ_U32, LTEQ_U64, LTEQ_F32, LTEQ_F64,
+		GTEQ_I32, GTEQ_I64, GTEQ_U32, GTEQ_U64, GTEQ_F32, GTEQ_F64,
+		INCF_I32, INCF_I64, INCF_U32, INCF_U64, INCF_F32, INCF_F64,
+		DECF_I32, DECF_I64, DECF_U32, DECF_U64, DECF_F32, DECF_F64,
+
+		// Superinstructions which fuse a specialized comparison with the
+		// following JT or JF on its result. The jump is left in place and
+		// its destination is read from there, so jumps into it still work.
+		EQ_I32_JT, EQ_I64_JT, EQ_U32_JT, EQ_U64_JT, EQ_F32_JT, EQ_F64_JT,
+		EQ_I32_JF, EQ_I64_JF, EQ_U32_JF, EQ_U64_JF, EQ_F32_JF, EQ_F64_JF,
+		NEQ_I32_JT, NEQ_I64_JT, NEQ_U32_JT, NEQ_U64_JT, NEQ_F32_JT, NEQ_F64_JT,
+		NEQ_I32_JF, NEQ_I64_JF, NEQ_U32_JF, NEQ_U64_JF, NEQ_F32_JF, NEQ_F64_JF,
+		LT_I32_JT, LT_I64_JT, LT_U32_JT, LT_U64_JT, LT_F32_JT, LT_F64_JT,
+		LT_I32_JF, LT_I64_JF, LT_U32_JF, LT_U64_JF, LT_F32_JF, LT_F64_JF,
+		GT_I32_JT, GT_I64_JT, GT_U32_JT, GT_U64_JT, GT_F32_JT, GT_F64_JT,
+		GT_I32_JF, GT_I64_JF, GT_U32_JF, GT_U64_JF, GT_F32_JF, GT_F64_JF,
+		LTEQ_I32_JT, LTEQ_I64_JT, LTEQ_U32_JT, LTEQ_U64_JT, LTEQ_F32_JT, LTEQ_F64_JT,
+		LTEQ_I32_JF, LTEQ_I64_JF, LTEQ_U32_JF, LTEQ_U64_JF, LTEQ_F32_JF, LTEQ_F64_JF,
+		GTEQ_I32_JT, GTEQ_I64_JT, GTEQ_U32_JT, GTEQ_U64_JT, GTEQ_F32_JT, GTEQ_F64_JT,
+		GTEQ_I32_JF, GTEQ_I64_JF, GTEQ_U32_JF, GTEQ_U64_JF, GTEQ_F32_JF, GTEQ_F64_JF,
+
+		// Superinstructions which fuse a LVALUE with the following
+		// specialized arithmetic which reads the loaded value. The arithmetic
+		// is left in place as well.
+		LVALUE_ARITH_I32, LVALUE_ARITH_I64, LVALUE_ARITH_U32, LVALUE_ARITH_U64, LVALUE_ARITH_F32, LVALUE_ARITH_F64,
+
+		QUICK_OPCODE_MAX
 	};
 
+	/// @brief Type variants of type-specialized instructions.
+	enum QuickVariant : uint8_t {
+		QV_I32 = 0,
+		QV_I64,
+		QV_U32,
+		QV_U64,
+		QV_F32,
+		QV_F64,
+
+		N_QUICK_TYPES
+	};
+
+	inline bool isQuickOpcode(Opcode opcode) {
+		return opcode >= Opcode::ADD_I32 && opcode < Opcode::QUICK_OPCODE_MAX;
+	}
+
+	/// @brief Check if an opcode is a generic or a type-specialized one.
+	inline bool isValidOpcode(Opcode opcode) {
+		return opcode < Opcode::OPCODE_MAX || isQuickOpcode(opcode);
+	}
+
+	inline bool isFusedJumpOpcode(Opcode opcode) {
+		return opcode >= Opcode::EQ_I32_JT && opcode < Opcode::LVALUE_ARITH_I32;
+	}
+
+	inline bool isFusedLoadOpcode(Opcode opcode) {
+		return opcode >= Opcode::LVALUE_ARITH_I32 && opcode < Opcode::QUICK_OPCODE_MAX;
+	}
+
+	/// @brief Get the generic instruction of a type-specialized instruction.
+	/// The generic instruction of a superinstruction is its first
+	/// instruction, the fused one is still executed separately then.
+	/// @param opcode Opcode to be converted.
+	/// @return Generic opcode, or the opcode itself if it is generic.
+	Opcode getGenericOpcode(Opcode opcode);
+
+	/// @brief Get a type-specialized variant of an instruction.
+	/// @param opcode Generic opcode.
+	/// @param variant Type variant.
+	/// @return Specialized opcode, or OPCODE_MAX if the instruction has no
+	/// specialized variants.
+	Opcode getQuickOpcode(Opcode opcode, QuickVariant variant);
+
+	/// @brief Get the superinstruction of a specialized comparison followed
+	/// by a jump.
+	/// @param opcode Specialized comparison.
+	/// @param jumpOpcode JT or JF.
+	/// @return Fused opcode, or OPCODE_MAX if the instructions cannot be fused.
+	Opcode getFusedJumpOpcode(Opcode opcode, Opcode jumpOpcode);
+
+	/// @brief Get the specialized comparison of a superinstruction.
+	Opcode getUnfusedOpcode(Opcode opcode);
+
+	/// @brief Get the jump which is fused into a superinstruction.
+	/// @return JT or JF.
+	inline Opcode getFusedJump(Opcode opcode) {
+		return (((uint16_t)opcode - (uint16_t)Opcode::EQ_I32_JT) / N_QUICK_TYPES) & 1 ? Opcode::JF : Opcode::JT;
+	}
+
+	inline QuickVariant getQuickVariant(Opcode opcode) {
+		return (QuickVariant)(((uint16_t)opcode - (uint16_t)Opcode::ADD_I32) % N_QUICK_TYPES);
+	}
+
 	extern const std::map<Opcode, std::string> OPCODE_MNEMONIC_MAP;
 	extern const std::map<std::string, Opcode> MNEMONIC_OPCODE_MAP;
 }
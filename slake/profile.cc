@@ -0,0 +1,106 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <set>
+
+using namespace slake;
+
+void Profile::addSample(std::thread::id thread, const std::vector<ProfileFrame> &frames) {
+	std::vector<uint32_t> stack;
+	stack.reserve(frames.size() + 1);
+
+	if (auto it = _threadIndices.find(thread); it != _threadIndices.end())
+		stack.push_back(it->second);
+	else {
+		uint32_t index = (uint32_t)_threadIndices.size();
+		_threadIndices[thread] = index;
+		stack.push_back(index);
+	}
+
+	for (auto &i : frames) {
+		if (auto it = _frameIndices.find(i); it != _frameIndices.end())
+			stack.push_back(it->second);
+		else {
+			uint32_t index = (uint32_t)_frames.size();
+			_frames.push_back(i);
+			_frameIndices[i] = index;
+			stack.push_back(index);
+		}
+	}
+
+	++_stacks[stack];
+	++_nSamples;
+}
+
+void Profile::clear() {
+	_frames.clear();
+	_frameIndices.clear();
+	_threadIndices.clear();
+	_stacks.clear();
+	_nSamples = 0;
+}
+
+void Profile::writeFoldedStacks(std::ostream &os) const {
+	for (auto &i : _stacks) {
+		os << "thread-" << i.first[0];
+
+		for (size_t j = 1; j < i.first.size(); ++j) {
+			auto &frame = _frames[i.first[j]];
+
+			os << ';' << frame.fnName;
+			if (frame.line != UINT32_MAX)
+				os << ':' << frame.line;
+		}
+
+		os << ' ' << i.second << '\n';
+	}
+}
+
+void Profile::writeReport(std::ostream &os) const {
+	struct FnStats {
+		size_t nSelfSamples = 0, nTotalSamples = 0;
+	};
+	std::map<std::string, FnStats> fnStats;
+
+	for (auto &i : _stacks) {
+		if (i.first.size() < 2)
+			continue;
+
+		// Recursive functions are counted once for each sample.
+		std::set<std::string> fns;
+		for (size_t j = 1; j < i.first.size(); ++j)
+			fns.insert(_frames[i.first[j]].fnName);
+		for (auto &j : fns)
+			fnStats[j].nTotalSamples += i.second;
+
+		fnStats[_frames[i.first.back()].fnName].nSelfSamples += i.second;
+	}
+
+	std::vector<std::pair<std::string, FnStats>> sortedStats(fnStats.begin(), fnStats.end());
+	std::sort(sortedStats.begin(), sortedStats.end(), [](auto &lhs, auto &rhs) {
+		if (lhs.second.nSelfSamples != rhs.second.nSelfSamples)
+			return lhs.second.nSelfSamples > rhs.second.nSelfSamples;
+		return lhs.second.nTotalSamples > rhs.second.nTotalSamples;
+	});
+
+	auto toMs = [this](size_t nSamples) {
+		return (double)nSamples * interval.count() / 1000.0;
+	};
+	auto toPercent = [this](size_t nSamples) {
+		return _nSamples ? (double)nSamples * 100.0 / _nSamples : 0.0;
+	};
+
+	os << _nSamples << " samples, " << interval.count() << "us per sample\n";
+	os << std::setw(10) << "self ms" << std::setw(8) << "self%"
+	   << std::setw(10) << "total ms" << std::setw(8) << "total%"
+	   << "  function\n";
+
+	os << std::fixed << std::setprecision(1);
+	for (auto &i : sortedStats) {
+		os << std::setw(10) << toMs(i.second.nSelfSamples) << std::setw(8) << toPercent(i.second.nSelfSamples)
+		   << std::setw(10) << toMs(i.second.nTotalSamples) << std::setw(8) << toPercent(i.second.nTotalSamples)
+		   << "  " << i.first << '\n';
+	}
+	os << std::defaultfloat;
+}
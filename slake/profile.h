@@ -0,0 +1,62 @@
+#ifndef _SLAKE_PROFILE_H_
+#define _SLAKE_PROFILE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace slake {
+	/// @brief Frame of a sampled stack.
+	struct ProfileFrame final {
+		std::string fnName;	 // Full name of the function
+		uint32_t line;		 // Source line, UINT32_MAX if the function has no source locations
+
+		inline bool operator<(const ProfileFrame &rhs) const {
+			if (fnName != rhs.fnName)
+				return fnName < rhs.fnName;
+			return line < rhs.line;
+		}
+	};
+
+	/// @brief Stacks sampled by the profiler, see Runtime::startProfiler().
+	///
+	/// Identical stacks of a thread are merged, frames are referred by
+	/// indices into a table of distinct frames.
+	class Profile final {
+	private:
+		std::vector<ProfileFrame> _frames;
+		std::map<ProfileFrame, uint32_t> _frameIndices;
+		std::map<std::thread::id, uint32_t> _threadIndices;
+
+		/// @brief Numbers of samples of the stacks, keyed by index of the
+		/// thread followed by indices of the frames, outermost first.
+		std::map<std::vector<uint32_t>, size_t> _stacks;
+		size_t _nSamples = 0;
+
+	public:
+		/// @brief Interval between the samples.
+		std::chrono::microseconds interval{};
+
+		/// @brief Add a sample.
+		/// @param thread Thread which was executing the stack.
+		/// @param frames Frames of the stack, outermost first.
+		void addSample(std::thread::id thread, const std::vector<ProfileFrame> &frames);
+		void clear();
+
+		inline size_t getSampleCount() const { return _nSamples; }
+
+		/// @brief Write the stacks in folded format, one line with frames
+		/// separated by semicolons and number of the samples for each stack,
+		/// which can be read by flame graph tools.
+		void writeFoldedStacks(std::ostream &os) const;
+		/// @brief Write self and total samples and times of each function,
+		/// functions with most self samples first.
+		void writeReport(std::ostream &os) const;
+	};
+}
+
+#endif
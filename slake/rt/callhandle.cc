@@ -0,0 +1,97 @@
+#include <slake/runtime.h>
+
+using namespace slake;
+
+CallHandle::CallHandle(FnValue *fn) : _rt(fn->getRuntime()), _fn(fn) {
+	fn->loadBody();
+	_newContext();
+
+	std::lock_guard<std::mutex> lock(_rt->_callHandlesMutex);
+	_rt->_callHandles.insert(this);
+}
+
+CallHandle::~CallHandle() {
+	if (_rt) {
+		std::lock_guard<std::mutex> lock(_rt->_callHandlesMutex);
+		_rt->_callHandles.erase(this);
+	}
+}
+
+void CallHandle::_detach() {
+	_argVars.clear();
+	_context.reset();
+	_fn = nullptr;
+	_rt = nullptr;
+}
+
+void CallHandle::_newContext() {
+	_context = std::make_shared<Context>();
+
+	// The bottom frame receives the result, like the one of FnValue::call().
+	auto &bottomFrame = _context->majorFrames.emplace_back(_rt);
+	bottomFrame.curFn = _fn.get();
+}
+
+ValueRef<> CallHandle::call(Value *thisObject, Value *const *args, size_t nArgs) {
+	if (!_rt)
+		throw std::logic_error("Runtime of the call handle was destroyed");
+
+	// Argument variables are touched outside the execution.
+	Runtime::ExecScope execScope(_rt);
+
+	FnValue *fn = _fn.get();
+	Context *context = _context.get();
+
+	// Frames which were left by an exception.
+	while (context->majorFrames.size() > 1)
+		Runtime::_popFrame(context);
+
+	auto &bottomFrame = context->majorFrames.front();
+	bottomFrame.curIns = UINT32_MAX - 1;
+	bottomFrame.returnValue = nullptr;
+
+	context->flags = 0;
+	context->budget = _budget;
+
+	auto &frame = _rt->_pushFrame(context);
+	frame.curFn = fn;
+	frame.scopeValue = fn->getParent();
+	frame.thisObject = thisObject;
+
+	for (size_t i = 0; i < nArgs; ++i) {
+		if (i == _argVars.size())
+			_argVars.push_back(new VarValue(_rt, ACCESS_PUB, i < fn->paramTypes.size() ? fn->paramTypes[i] : TypeId::Any));
+
+		_argVars[i]->setData(args[i]);
+		frame.argStack.push_back(_argVars[i].get());
+	}
+
+	if (_rt->_isTracing.load(std::memory_order_relaxed))
+		_rt->_traceCall(context, frame);
+
+#if SLAKE_ENABLE_JIT
+	_rt->_countFnCall(fn);
+#endif
+
+	ValueRef<> result;
+	try {
+		result = fn->exec(_context);
+	} catch (...) {
+		for (size_t i = 0; i < nArgs; ++i)
+			_argVars[i]->setData(nullptr);
+		throw;
+	}
+
+	// The context belongs to the returned context value now.
+	if (!(context->flags & CTX_DONE)) {
+		_newContext();
+		_argVars.clear();
+		return result;
+	}
+
+	// Arguments are not kept alive by the handle.
+	for (size_t i = 0; i < nArgs; ++i)
+		_argVars[i]->setData(nullptr);
+
+	return result;
+}
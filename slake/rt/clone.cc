@@ -0,0 +1,350 @@
+#include <slake/runtime.h>
+
+#include <unordered_map>
+
+using namespace slake;
+
+template <typename T, TypeId VT>
+static inline uint64_t _cloneScalar(Value *v) {
+	uint64_t bits = 0;
+	T data = ((LiteralValue<T, VT> *)v)->getData();
+	memcpy(&bits, &data, sizeof(T));
+	return bits;
+}
+
+template <typename T, TypeId VT>
+static inline Value *_restoreScalar(Runtime *rt, uint64_t bits) {
+	T data;
+	memcpy(&data, &bits, sizeof(T));
+	return new LiteralValue<T, VT>(rt, data);
+}
+
+std::deque<std::string> Runtime::_getClonedPath(const MemberValue *v) {
+	std::deque<std::string> path;
+
+	while ((Value *)v != _rootValue) {
+		if (v->_genericArgs.size())
+			throw CloneError("Instances of generic classes cannot be cloned");
+
+		path.push_front(v->getName());
+		v = (const MemberValue *)v->getParent();
+	}
+
+	return path;
+}
+
+Value *Runtime::_resolveClonedPath(const std::deque<std::string> &path) {
+	ValueRef<RefValue> ref = new RefValue(this);
+	for (auto &i : path)
+		ref->entries.push_back(RefEntry(i));
+
+	auto v = resolveRef(ref.get());
+	if (!v)
+		throw CloneError("Type `" + std::to_string(ref.get()) + "' referred by the clone was not found");
+	return v;
+}
+
+ClonedType Runtime::_cloneType(const Type &type) {
+	ClonedType clonedType;
+	clonedType.typeId = type.typeId;
+	clonedType.flags = type.flags;
+
+	switch (type.typeId) {
+		case TypeId::Class:
+		case TypeId::Interface:
+		case TypeId::Trait:
+		case TypeId::Object:
+			type.loadDeferredType(this);
+			clonedType.path = _getClonedPath((MemberValue *)type.getCustomTypeExData());
+			break;
+		case TypeId::Array:
+			// Types of array values may be without element types.
+			if (std::holds_alternative<Type *>(type.exData))
+				clonedType.elementType = std::make_unique<ClonedType>(_cloneType(type.getArrayExData()));
+			break;
+		case TypeId::Map:
+		case TypeId::GenericArg:
+			throw CloneError("Type cannot be cloned");
+		default:;
+	}
+
+	return clonedType;
+}
+
+Type Runtime::_restoreType(const ClonedType &type) {
+	switch (type.typeId) {
+		case TypeId::Class:
+		case TypeId::Interface:
+		case TypeId::Trait:
+		case TypeId::Object:
+			return Type(type.typeId, _resolveClonedPath(type.path), type.flags);
+		case TypeId::Array: {
+			Type restoredType(TypeId::Array, type.flags);
+			if (type.elementType)
+				restoredType.exData = new Type(_restoreType(*type.elementType));
+			return restoredType;
+		}
+		default:
+			return Type(type.typeId, type.flags);
+	}
+}
+
+StructuredClone Runtime::cloneValue(Value *v, bool transfer) {
+	StructuredClone clone;
+
+	std::unordered_map<Value *, uint32_t> indices;
+	std::vector<Value *> values;
+
+	// Values get their nodes once they were seen, the nodes are filled in
+	// order, so graphs are cloned without recursion.
+	auto getIndex = [&](Value *v) -> uint32_t {
+		if (!v)
+			return StructuredClone::IDX_NULL;
+
+		if (auto it = indices.find(v); it != indices.end())
+			return it->second;
+
+		uint32_t index = (uint32_t)values.size();
+		indices[v] = index;
+		values.push_back(v);
+		clone.nodes.emplace_back();
+		return index;
+	};
+
+	getIndex(v);
+
+	for (size_t i = 0; i < values.size(); ++i) {
+		Value *v = values[i];
+		auto typeId = v->getType().typeId;
+
+		clone.nodes[i].typeId = typeId;
+
+		switch (typeId) {
+			case TypeId::I8:
+				clone.nodes[i].scalar = _cloneScalar<std::int8_t, TypeId::I8>(v);
+				break;
+			case TypeId::I16:
+				clone.nodes[i].scalar = _cloneScalar<std::int16_t, TypeId::I16>(v);
+				break;
+			case TypeId::I32:
+				clone.nodes[i].scalar = _cloneScalar<std::int32_t, TypeId::I32>(v);
+				break;
+			case TypeId::I64:
+				clone.nodes[i].scalar = _cloneScalar<std::int64_t, TypeId::I64>(v);
+				break;
+			case TypeId::U8:
+				clone.nodes[i].scalar = _cloneScalar<uint8_t, TypeId::U8>(v);
+				break;
+			case TypeId::U16:
+				clone.nodes[i].scalar = _cloneScalar<uint16_t, TypeId::U16>(v);
+				break;
+			case TypeId::U32:
+				clone.nodes[i].scalar = _cloneScalar<uint32_t, TypeId::U32>(v);
+				break;
+			case TypeId::U64:
+				clone.nodes[i].scalar = _cloneScalar<uint64_t, TypeId::U64>(v);
+				break;
+			case TypeId::F32:
+				clone.nodes[i].scalar = _cloneScalar<float, TypeId::F32>(v);
+				break;
+			case TypeId::F64:
+				clone.nodes[i].scalar = _cloneScalar<double, TypeId::F64>(v);
+				break;
+			case TypeId::Bool:
+				clone.nodes[i].scalar = _cloneScalar<bool, TypeId::Bool>(v);
+				break;
+			case TypeId::Char:
+				clone.nodes[i].scalar = _cloneScalar<uint8_t, TypeId::Char>(v);
+				break;
+			case TypeId::WChar:
+				clone.nodes[i].scalar = _cloneScalar<char32_t, TypeId::WChar>(v);
+				break;
+			case TypeId::String: {
+				auto value = (StringValue *)v;
+
+				// Literals are shared by the executions, they are copied.
+				if (transfer && !(value->_flags & VF_LITERAL)) {
+					clone.nodes[i].str = std::move(value->_data);
+					value->_data.clear();
+					value->reportSizeFreedToRuntime(clone.nodes[i].str.size());
+					clone.szTransferred += clone.nodes[i].str.size();
+				} else
+					clone.nodes[i].str = value->_data;
+				break;
+			}
+			case TypeId::WString: {
+				auto value = (WStringValue *)v;
+
+				if (transfer && !(value->_flags & VF_LITERAL)) {
+					clone.nodes[i].wstr = std::move(value->_data);
+					value->_data.clear();
+					clone.szTransferred += clone.nodes[i].wstr.size() * sizeof(char32_t);
+				} else
+					clone.nodes[i].wstr = value->_data;
+				break;
+			}
+			case TypeId::Array: {
+				auto value = (ArrayValue *)v;
+
+				// Nodes may be reallocated by getIndex().
+				std::vector<uint32_t> elements;
+				elements.reserve(value->values.size());
+				for (auto j : value->values)
+					elements.push_back(getIndex(j));
+
+				clone.nodes[i].elementType = _cloneType(value->type);
+				clone.nodes[i].elements = std::move(elements);
+				break;
+			}
+			case TypeId::Object: {
+				auto value = (ObjectValue *)v;
+
+				auto classPath = _getClonedPath(value->_class);
+
+				std::vector<std::vector<std::pair<std::string, uint32_t>>> fields;
+				for (auto j = value; j; j = j->_parent) {
+					auto &curFields = fields.emplace_back();
+					for (auto &k : j->scope->members) {
+						if (k.second->getType() == TypeId::Var)
+							curFields.push_back({ k.first, getIndex(((VarValue *)k.second)->getData()) });
+					}
+				}
+
+				clone.nodes[i].classPath = std::move(classPath);
+				clone.nodes[i].fields = std::move(fields);
+				break;
+			}
+			default:
+				throw CloneError("Value of type `" + std::to_string(v->getType(), this) + "' cannot be cloned");
+		}
+	}
+
+	return clone;
+}
+
+ValueRef<> Runtime::restoreClone(StructuredClone &&clone) {
+	if (clone.nodes.empty())
+		return nullptr;
+
+	// Values are not reachable until the root is returned, which is fine
+	// since no GC cycle is done during restoring.
+	std::vector<Value *> values(clone.nodes.size());
+
+	// Allocate the values, references between them are restored later.
+	for (size_t i = 0; i < clone.nodes.size(); ++i) {
+		auto &node = clone.nodes[i];
+
+		switch (node.typeId) {
+			case TypeId::I8:
+				values[i] = _restoreScalar<std::int8_t, TypeId::I8>(this, node.scalar);
+				break;
+			case TypeId::I16:
+				values[i] = _restoreScalar<std::int16_t, TypeId::I16>(this, node.scalar);
+				break;
+			case TypeId::I32:
+				values[i] = _restoreScalar<std::int32_t, TypeId::I32>(this, node.scalar);
+				break;
+			case TypeId::I64:
+				values[i] = _restoreScalar<std::int64_t, TypeId::I64>(this, node.scalar);
+				break;
+			case TypeId::U8:
+				values[i] = _restoreScalar<uint8_t, TypeId::U8>(this, node.scalar);
+				break;
+			case TypeId::U16:
+				values[i] = _restoreScalar<uint16_t, TypeId::U16>(this, node.scalar);
+				break;
+			case TypeId::U32:
+				values[i] = _restoreScalar<uint32_t, TypeId::U32>(this, node.scalar);
+				break;
+			case TypeId::U64:
+				values[i] = _restoreScalar<uint64_t, TypeId::U64>(this, node.scalar);
+				break;
+			case TypeId::F32:
+				values[i] = _restoreScalar<float, TypeId::F32>(this, node.scalar);
+				break;
+			case TypeId::F64:
+				values[i] = _restoreScalar<double, TypeId::F64>(this, node.scalar);
+				break;
+			case TypeId::Bool:
+				values[i] = _restoreScalar<bool, TypeId::Bool>(this, node.scalar);
+				break;
+			case TypeId::Char:
+				values[i] = _restoreScalar<uint8_t, TypeId::Char>(this, node.scalar);
+				break;
+			case TypeId::WChar:
+				values[i] = _restoreScalar<char32_t, TypeId::WChar>(this, node.scalar);
+				break;
+			case TypeId::String: {
+				auto value = new StringValue(this, {});
+				value->_data = std::move(node.str);
+				value->reportSizeAllocatedToRuntime(value->_data.size());
+				values[i] = value;
+				break;
+			}
+			case TypeId::WString: {
+				auto value = new WStringValue(this, {});
+				value->_data = std::move(node.wstr);
+				values[i] = value;
+				break;
+			}
+			case TypeId::Array:
+				values[i] = new ArrayValue(this, _restoreType(node.elementType));
+				break;
+			case TypeId::Object: {
+				auto cls = _resolveClonedPath(node.classPath);
+				if (cls->getType() != TypeId::Class)
+					throw CloneError("Class `" + getFullName((MemberValue *)cls) + "' referred by the clone is not a class");
+
+				values[i] = _newClassInstance((ClassValue *)cls);
+				break;
+			}
+			default:
+				throw CloneError("Invalid value type in the clone");
+		}
+	}
+
+	auto getValue = [&](uint32_t index) -> Value * {
+		if (index == StructuredClone::IDX_NULL)
+			return nullptr;
+		if (index >= values.size())
+			throw CloneError("Invalid value index in the clone");
+		return values[index];
+	};
+
+	for (size_t i = 0; i < clone.nodes.size(); ++i) {
+		auto &node = clone.nodes[i];
+
+		switch (node.typeId) {
+			case TypeId::Array: {
+				auto value = (ArrayValue *)values[i];
+				for (auto j : node.elements)
+					value->values.push_back(getValue(j));
+				break;
+			}
+			case TypeId::Object: {
+				auto value = (ObjectValue *)values[i];
+
+				// Layouts of the classes may differ if the runtimes loaded
+				// different versions of the modules.
+				for (auto &j : node.fields) {
+					if (!value)
+						throw CloneError("Mismatched inheritance chain of cloned object");
+
+					for (auto &k : j) {
+						auto it = value->scope->members.find(k.first);
+						if (it == value->scope->members.end() || it->second->getType() != TypeId::Var)
+							throw CloneError("Field `" + k.first + "' of cloned object was not found");
+
+						((VarValue *)it->second)->setData(getValue(k.second));
+					}
+
+					value = value->_parent;
+				}
+				break;
+			}
+			default:;
+		}
+	}
+
+	return values[0];
+}
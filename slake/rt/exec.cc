@@ -254,10 +254,55 @@ static Value *_execUnaryOp(ValueRef<> x, Opcode opcode) {
 	throw InvalidOperandsError("Binary operation with incompatible types");
 }
 
+MajorFrame &slake::Runtime::_pushFrame(Context *context) {
+	if (context->freeFrames.empty())
+		return context->majorFrames.emplace_back(this);
+
+	context->majorFrames.push_back(std::move(context->freeFrames.back()));
+	context->freeFrames.pop_back();
+	return context->majorFrames.back();
+}
+
+void slake::Runtime::_popFrame(Context *context) {
+	auto &frame = context->majorFrames.back();
+
+	if (context->freeFrames.size() < MAX_FREE_FRAMES) {
+		// Clear the frame without releasing capacities of the vectors.
+		frame.scopeValue = nullptr;
+		frame.curFn = nullptr;
+		frame.curIns = 0;
+		frame.argStack.clear();
+		frame.nextArgStack.clear();
+		frame.localVars.clear();
+		frame.regs.clear();
+		frame.thisObject = nullptr;
+		frame.returnValue = nullptr;
+		frame.curExcept = nullptr;
+		frame.isTraced = false;
+
+		frame.minorFrames.erase(frame.minorFrames.begin() + 1, frame.minorFrames.end());
+		auto &minorFrame = frame.minorFrames.front();
+		minorFrame.exceptHandlers.clear();
+		minorFrame.dataStack.clear();
+		minorFrame.nLocalVars = 0;
+		minorFrame.nRegs = 0;
+
+		context->freeFrames.push_back(std::move(frame));
+	}
+
+	context->majorFrames.pop_back();
+}
+
 void slake::Runtime::_callFn(Context *context, FnValue *fn) {
+	if (!fn->isBodyLoaded())
+		_loadLazyFnBody(fn);
+#if SLAKE_ENABLE_JIT
+	_countFnCall(fn);
+#endif
+
+	// References to the other frames are kept by the deque.
 	auto &curFrame = context->majorFrames.back();
-	MajorFrame frame(this);
-	frame.curIns = 0;
+	auto &frame = _pushFrame(context);
 	frame.curFn = fn;
 
 	for (size_t i = 0; i < curFrame.nextArgStack.size(); ++i) {
@@ -267,8 +312,286 @@ void slake::Runtime::_callFn(Context *context, FnValue *fn) {
 	}
 
 	curFrame.nextArgStack.clear();
-	context->majorFrames.push_back(frame);
-	return;
+
+	if (_isTracing.load(std::memory_order_relaxed))
+		_traceCall(context, frame);
+}
+
+/// @brief Get key of an integral switch case.
+/// @return false if the value is not an integral value.
+static bool _getSwitchKey(Value *v, uint64_t &keyOut) {
+	switch (v->getType().typeId) {
+		case TypeId::I8:
+			keyOut = (uint64_t)(int64_t)((I8Value *)v)->getData();
+			return true;
+		case TypeId::I16:
+			keyOut = (uint64_t)(int64_t)((I16Value *)v)->getData();
+			return true;
+		case TypeId::I32:
+			keyOut = (uint64_t)(int64_t)((I32Value *)v)->getData();
+			return true;
+		case TypeId::I64:
+			keyOut = (uint64_t)((I64Value *)v)->getData();
+			return true;
+		case TypeId::U8:
+			keyOut = ((U8Value *)v)->getData();
+			return true;
+		case TypeId::U16:
+			keyOut = ((U16Value *)v)->getData();
+			return true;
+		case TypeId::U32:
+			keyOut = ((U32Value *)v)->getData();
+			return true;
+		case TypeId::U64:
+			keyOut = ((U64Value *)v)->getData();
+			return true;
+		case TypeId::Bool:
+			keyOut = ((BoolValue *)v)->getData();
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// @brief Build lookup table of a CONSTSW instruction.
+/// @param cases Keys and destinations of the cases, in pairs.
+/// @param defaultDest Destination if no case matched.
+/// @param nIns Number of instructions of the function.
+/// @return Built lookup table.
+static SwitchTable _buildSwitchTable(ArrayValue *cases, uint32_t defaultDest, uint32_t nIns) {
+	if (cases->values.size() & 1)
+		throw InvalidOperandsError("Invalid switch table");
+	if (defaultDest >= nIns)
+		throw InvalidOperandsError("Invalid switch destination");
+
+	SwitchTable table;
+	table.defaultDest = defaultDest;
+
+	size_t nCases = cases->values.size() / 2;
+	for (size_t i = 0; i < nCases; ++i) {
+		Value *key = cases->values[i * 2], *dest = cases->values[i * 2 + 1];
+		if (!key || !dest || dest->getType() != TypeId::U32 || ((U32Value *)dest)->getData() >= nIns)
+			throw InvalidOperandsError("Invalid switch case");
+
+		// Keys must be of a single type, the same as the values to be matched.
+		if (!i)
+			table.keyType = key->getType().typeId;
+		else if (key->getType() != table.keyType)
+			throw InvalidOperandsError("Switch cases with incompatible types");
+
+		uint32_t offDest = ((U32Value *)dest)->getData();
+
+		uint64_t intKey;
+		if (_getSwitchKey(key, intKey))
+			table.intDests.insert({ intKey, offDest });
+		else if (key->getType() == TypeId::String)
+			table.strDests.insert({ ((StringValue *)key)->getData(), offDest });
+		else
+			throw InvalidOperandsError("Invalid switch case");
+	}
+
+	// Use an array for keys in a dense range, where at least half of the
+	// slots are cases.
+	if (table.intDests.size()) {
+		uint64_t minKey = UINT64_MAX, maxKey = 0;
+		bool isSigned = table.keyType == TypeId::I8 || table.keyType == TypeId::I16 ||
+						table.keyType == TypeId::I32 || table.keyType == TypeId::I64;
+		for (auto &i : table.intDests) {
+			// Offset signed keys so that they are ordered as unsigned ones.
+			uint64_t key = isSigned ? i.first ^ ((uint64_t)1 << 63) : i.first;
+			minKey = std::min(minKey, key);
+			maxKey = std::max(maxKey, key);
+		}
+
+		if (maxKey - minKey < table.intDests.size() * 2) {
+			table.minKey = isSigned ? minKey ^ ((uint64_t)1 << 63) : minKey;
+			table.denseDests.assign(maxKey - minKey + 1, UINT32_MAX);
+			for (auto &i : table.intDests)
+				table.denseDests[i.first - table.minKey] = i.second;
+			table.intDests.clear();
+		}
+	}
+
+	return table;
+}
+
+void slake::Runtime::_buildSwitchTables(FnValue *fn) {
+	fn->_switchTables.clear();
+
+	for (uint32_t i = 0; i < fn->nIns; ++i) {
+		auto &ins = fn->body[i];
+
+		ins.switchTable = nullptr;
+		if (ins.opcode != Opcode::CONSTSW ||
+			ins.operands.size() != 3 ||
+			!ins.operands[1] || ins.operands[1]->getType() != TypeId::Array ||
+			!ins.operands[2] || ins.operands[2]->getType() != TypeId::U32)
+			continue;
+
+		// Invalid case tables are left without lookup tables, and are
+		// reported by the executions.
+		try {
+			fn->_switchTables.push_back(std::make_shared<const SwitchTable>(
+				_buildSwitchTable(
+					(ArrayValue *)ins.operands[1],
+					((U32Value *)ins.operands[2])->getData(),
+					fn->nIns)));
+		} catch (InvalidOperandsError &) {
+			continue;
+		}
+		ins.switchTable = fn->_switchTables.back().get();
+	}
+}
+
+/// @brief Get destination of a value in lookup table of a CONSTSW instruction.
+static uint32_t _lookupSwitchTable(const SwitchTable &table, Value *v) {
+	if (!v)
+		throw NullRefError();
+
+	if (table.keyType != TypeId::None && v->getType() != table.keyType)
+		throw InvalidOperandsError("Switch condition with incompatible type");
+
+	if (uint64_t key; _getSwitchKey(v, key)) {
+		if (table.denseDests.size()) {
+			uint64_t off = key - table.minKey;
+			if (off < table.denseDests.size() && table.denseDests[off] != UINT32_MAX)
+				return table.denseDests[off];
+		} else if (auto it = table.intDests.find(key); it != table.intDests.end())
+			return it->second;
+	} else if (v->getType() == TypeId::String) {
+		if (auto it = table.strDests.find(((StringValue *)v)->getData()); it != table.strDests.end())
+			return it->second;
+	}
+
+	return table.defaultDest;
+}
+
+/// @brief Check if a tail call can discard a frame.
+/// @return false if the frame has exception handlers, which have to catch
+/// exceptions thrown by the callee.
+static bool _isTailCallable(const MajorFrame &frame) {
+	for (auto &i : frame.minorFrames) {
+		if (i.exceptHandlers.size())
+			return false;
+	}
+	return true;
+}
+
+void slake::Runtime::_tailCallFn(Context *context, FnValue *fn) {
+	if (!fn->isBodyLoaded())
+		_loadLazyFnBody(fn);
+#if SLAKE_ENABLE_JIT
+	_countFnCall(fn);
+#endif
+
+	auto &frame = context->majorFrames.back();
+
+	if (frame.isTraced)
+		_traceReturn(frame);
+
+	frame.argStack.resize(frame.nextArgStack.size());
+	for (size_t i = 0; i < frame.nextArgStack.size(); ++i) {
+		VarValue *argVar = new VarValue(this, ACCESS_PUB, i < fn->paramTypes.size() ? fn->paramTypes[i] : TypeId::Any);
+		argVar->setData(frame.nextArgStack[i]);
+		frame.argStack[i] = argVar;
+	}
+	frame.nextArgStack.clear();
+
+	frame.curFn = fn;
+	frame.curIns = 0;
+	frame.scopeValue = nullptr;
+	frame.thisObject = nullptr;
+	frame.returnValue = nullptr;
+	frame.curExcept = nullptr;
+	frame.localVars.clear();
+	frame.regs.clear();
+	frame.minorFrames.clear();
+	frame.minorFrames.push_back(MinorFrame(0, 0));
+
+	if (_isTracing.load(std::memory_order_relaxed))
+		_traceCall(context, frame);
+}
+
+ContextValue *slake::Runtime::_newCoroutine(MajorFrame &callerFrame, FnValue *fn, Value *thisObject) {
+	auto coroutine = std::make_shared<Context>();
+
+	// The bottom frame receives the result, like the one of FnValue::call().
+	MajorFrame bottomFrame(this);
+	bottomFrame.curFn = fn;
+	bottomFrame.curIns = UINT32_MAX - 1;
+	bottomFrame.nextArgStack.swap(callerFrame.nextArgStack);
+	coroutine->majorFrames.push_back(std::move(bottomFrame));
+
+	auto &frame = coroutine->majorFrames.back();
+	if (fn->isNative()) {
+#if SLAKE_ENABLE_STATS
+		_countStat(_getAllocBuffer()->nNativeCalls);
+#endif
+		bool isTraced = _shouldTrace(TRACE_NATIVE_CALLS);
+		auto beginTime = isTraced ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+		frame.returnValue = ((NativeFnValue *)fn)->call(thisObject, { frame.nextArgStack.begin(), frame.nextArgStack.end() }).get();
+
+		if (isTraced)
+			_addTraceEvent('X', "native", getFullName(fn), beginTime, std::chrono::steady_clock::now());
+		frame.nextArgStack.clear();
+		frame.curIns = UINT32_MAX;
+		coroutine->flags |= CTX_DONE;
+	} else {
+		_callFn(coroutine.get(), fn);
+
+		if (thisObject)
+			coroutine->getCurFrame().thisObject = (coroutine->getCurFrame().scopeValue = thisObject);
+	}
+
+	return new ContextValue(this, coroutine);
+}
+
+Context *slake::Runtime::_switchToResumer(Context *coroutine) {
+	Context *resumer = coroutine->resumer;
+
+	// Instructions after the last check are charged to the budget which the
+	// coroutine was executed on.
+	Context *root = resumer;
+	while (root->resumer)
+		root = root->resumer;
+	if (root->budget.isLimited())
+		_chargeBudget(coroutine, root);
+
+	if (!(coroutine->flags & CTX_YIELDED))
+		coroutine->flags |= CTX_DONE;
+	coroutine->flags &= ~CTX_RUNNING;
+	coroutine->resumer = nullptr;
+
+	resumer->awaitee = nullptr;
+	resumer->getCurFrame().returnValue = coroutine->getCurFrame().returnValue;
+
+	return resumer;
+}
+
+void slake::Runtime::_chargeBudget(Context *context, Context *root) {
+	uint64_t nIns = context->nExecutedIns - context->nChargedIns;
+	context->nChargedIns = context->nExecutedIns;
+
+	auto &fuel = root->budget.fuel;
+	if (fuel != UINT64_MAX)
+		fuel = nIns < fuel ? fuel - nIns : 0;
+}
+
+void slake::Runtime::_checkBudget(Context *context, Context *root) {
+	_chargeBudget(context, root);
+
+	auto &budget = root->budget;
+	if (budget.fuel &&
+		(budget.deadline == ExecBudget::Clock::time_point::max() ||
+			ExecBudget::Clock::now() < budget.deadline))
+		return;
+
+	if (budget.action == BUDGET_INTERRUPT)
+		throw InterruptedError(budget.fuel ? "Deadline exceeded" : "Fuel exhausted");
+
+	// The execution loop stops once the instruction returned.
+	context->flags |= CTX_PREEMPTED;
 }
 
 VarValue *slake::Runtime::_addLocalVar(MajorFrame &frame, Type type) {
@@ -283,49 +606,559 @@ VarValue *slake::Runtime::_addLocalReg(MajorFrame &frame) {
 	return v;
 }
 
-void slake::Runtime::_execIns(Context *context, Instruction ins) {
-	auto &curMajorFrame = context->majorFrames.back();
-	auto &curMinorFrame = curMajorFrame.minorFrames.back();
+/// @brief Resolve a register, local variable or argument reference operand.
+/// @param frame Frame to resolve the operand in.
+/// @param i Operand to be resolved.
+/// @return Resolved operand, or the operand itself if it is not a reference.
+static inline Value *_resolveOperand(MajorFrame &frame, Value *i) {
+	if (!i)
+		return i;
 
-	for (auto &i : ins.operands) {
-		if (!i)
-			continue;
+	bool unwrapValue = false;
+	switch (i->getType().typeId) {
+		case TypeId::LocalVarRef: {
+			unwrapValue = ((LocalVarRefValue *)i)->unwrapValue;
 
-		bool unwrapValue = false;
-		switch (i->getType().typeId) {
-			case TypeId::LocalVarRef: {
-				unwrapValue = ((LocalVarRefValue *)i)->unwrapValue;
+			auto index = ((LocalVarRefValue *)i)->index;
 
-				auto index = ((LocalVarRefValue *)i)->index;
+			if (index >= frame.localVars.size())
+				throw InvalidLocalVarIndexError("Invalid local variable index", index);
 
-				if (index >= curMajorFrame.localVars.size())
-					throw InvalidLocalVarIndexError("Invalid local variable index", index);
+			i = frame.localVars.at(index);
+			break;
+		}
+		case TypeId::RegRef: {
+			unwrapValue = ((RegRefValue *)i)->unwrapValue;
 
-				i = curMajorFrame.localVars.at(index);
-				break;
-			}
-			case TypeId::RegRef: {
-				unwrapValue = ((RegRefValue *)i)->unwrapValue;
+			auto index = ((RegRefValue *)i)->index;
+
+			if (index >= frame.regs.size())
+				throw InvalidRegisterIndexError("Invalid register index", index);
+
+			i = frame.regs.at(index);
+			break;
+		}
+		case TypeId::ArgRef:
+			unwrapValue = ((ArgRefValue *)i)->unwrapValue;
+
+			i = frame.argStack[((ArgRefValue *)i)->index];
+			break;
+	}
+
+	if (unwrapValue)
+		i = ((VarValue *)i)->value;
+	return i;
+}
+
+/// @brief Check if an operand always resolves to a variable.
+static bool _isVarOperand(Value *i) {
+	if (!i)
+		return false;
+
+	switch (i->getType().typeId) {
+		case TypeId::LocalVarRef:
+			return !((LocalVarRefValue *)i)->unwrapValue;
+		case TypeId::RegRef:
+			return !((RegRefValue *)i)->unwrapValue;
+		default:
+			return false;
+	}
+}
+
+/// @brief Get the type variant of type-specialized instructions for a type.
+/// @return true if there are such variants for the type.
+static bool _getQuickVariant(TypeId typeId, QuickVariant &variantOut) {
+	switch (typeId) {
+		case TypeId::I32:
+			variantOut = QV_I32;
+			return true;
+		case TypeId::I64:
+			variantOut = QV_I64;
+			return true;
+		case TypeId::U32:
+			variantOut = QV_U32;
+			return true;
+		case TypeId::U64:
+			variantOut = QV_U64;
+			return true;
+		case TypeId::F32:
+			variantOut = QV_F32;
+			return true;
+		case TypeId::F64:
+			variantOut = QV_F64;
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// @brief Get the type-specialized variant of an instruction.
+/// @param opcode Generic opcode.
+/// @param typeId Type of the operands.
+/// @return Specialized opcode, or OPCODE_MAX if there is no such variant.
+static Opcode _getQuickOpcode(Opcode opcode, TypeId typeId) {
+	QuickVariant variant;
+	if (!_getQuickVariant(typeId, variant))
+		return Opcode::OPCODE_MAX;
+	return getQuickOpcode(opcode, variant);
+}
+
+/// @brief Check if two operands refer to the same register or local variable,
+/// the first one as a variable and the second one as its value.
+static bool _isSameSlot(Value *var, Value *value) {
+	if (!var || !value || var->getType() != value->getType())
+		return false;
+
+	switch (var->getType().typeId) {
+		case TypeId::LocalVarRef:
+			return !((LocalVarRefValue *)var)->unwrapValue && ((LocalVarRefValue *)value)->unwrapValue &&
+				   ((LocalVarRefValue *)var)->index == ((LocalVarRefValue *)value)->index;
+		case TypeId::RegRef:
+			return !((RegRefValue *)var)->unwrapValue && ((RegRefValue *)value)->unwrapValue &&
+				   ((RegRefValue *)var)->index == ((RegRefValue *)value)->index;
+		default:
+			return false;
+	}
+}
+
+/// @brief Fuse a specialized comparison with the following jump on its result.
+/// @param body Function body.
+/// @param nIns Number of instructions in the body.
+/// @param offIns Offset of the comparison.
+/// @param opcode Specialized comparison.
+/// @return The superinstruction, or the comparison itself if the
+/// instructions cannot be fused.
+static Opcode _fuseCompareJump(const Instruction *body, uint32_t nIns, uint32_t offIns, Opcode opcode) {
+	if (offIns + 1 >= nIns)
+		return opcode;
+
+	auto &ins = body[offIns], &jumpIns = body[offIns + 1];
+
+	auto fusedOpcode = getFusedJumpOpcode(opcode, jumpIns.opcode);
+	if (fusedOpcode == Opcode::OPCODE_MAX ||
+		ins.operands.size() != 3 ||
+		jumpIns.operands.size() != 2 ||
+		!jumpIns.operands[0] ||
+		jumpIns.operands[0]->getType() != TypeId::U32 ||
+		!_isSameSlot(ins.operands[0], jumpIns.operands[1]))
+		return opcode;
+
+	return fusedOpcode;
+}
+
+/// @brief Check if an instruction is a specialized arithmetic, which can be
+/// fused with a LVALUE before it.
+static bool _isQuickArith(Opcode opcode) {
+	if (!isQuickOpcode(opcode))
+		return false;
+
+	switch (getGenericOpcode(opcode)) {
+		case Opcode::ADD:
+		case Opcode::SUB:
+		case Opcode::MUL:
+		case Opcode::DIV:
+		case Opcode::MOD:
+			return !isFusedJumpOpcode(opcode);
+		default:
+			return false;
+	}
+}
+
+/// @brief Fuse a LVALUE with the following specialized arithmetic which
+/// reads the loaded value.
+/// @param body Function body.
+/// @param nIns Number of instructions in the body.
+/// @param offIns Offset of the LVALUE.
+/// @return The superinstruction, or LVALUE if the instructions cannot be
+/// fused.
+static Opcode _fuseLoadArith(const Instruction *body, uint32_t nIns, uint32_t offIns) {
+	if (offIns + 1 >= nIns)
+		return Opcode::LVALUE;
+
+	auto &ins = body[offIns], &arithIns = body[offIns + 1];
+
+	if (!_isQuickArith(arithIns.opcode) ||
+		ins.operands.size() != 2 ||
+		arithIns.operands.size() != 3 ||
+		!_isVarOperand(ins.operands[0]) ||
+		!_isVarOperand(ins.operands[1]) ||
+		!(_isSameSlot(ins.operands[0], arithIns.operands[1]) || _isSameSlot(ins.operands[0], arithIns.operands[2])))
+		return Opcode::LVALUE;
+
+	return getQuickOpcode(Opcode::LVALUE, getQuickVariant(arithIns.opcode));
+}
 
-				auto index = ((RegRefValue *)i)->index;
+void slake::Runtime::_verifyFnBody(FnValue *fn) {
+	for (uint32_t i = 0; i < fn->nIns; ++i) {
+		auto &ins = fn->body[i];
+
+		// Tail calls discard the frame, they must be followed by instructions
+		// which return the results directly.
+		if (ins.opcode == Opcode::TAILCALL || ins.opcode == Opcode::MTAILCALL) {
+			if (i + 2 >= fn->nIns ||
+				fn->body[i + 1].opcode != Opcode::LRET ||
+				fn->body[i + 2].opcode != Opcode::RET ||
+				fn->body[i + 1].operands.size() != 1 ||
+				fn->body[i + 2].operands.size() != 1 ||
+				!_isSameSlot(fn->body[i + 1].operands[0], fn->body[i + 2].operands[0]))
+				ins.opcode = ins.opcode == Opcode::TAILCALL ? Opcode::CALL : Opcode::MCALL;
+			continue;
+		}
 
-				if (index >= curMajorFrame.regs.size())
-					throw InvalidRegisterIndexError("Invalid register index", index);
+		if (!isQuickOpcode(ins.opcode))
+			continue;
 
-				i = curMajorFrame.regs.at(index);
+		// Loads are fused once the arithmetic after them was verified.
+		if (isFusedLoadOpcode(ins.opcode)) {
+			ins.opcode = Opcode::LVALUE;
+			continue;
+		}
+
+		// Superinstructions read the jump which follows them.
+		if (isFusedJumpOpcode(ins.opcode) &&
+			_fuseCompareJump(fn->body, fn->nIns, i, getUnfusedOpcode(ins.opcode)) != ins.opcode)
+			ins.opcode = getUnfusedOpcode(ins.opcode);
+
+		// Only the shapes are verified here: the destination and register
+		// operands have to be variables and constant operands have to be of
+		// the specialized type. Types of variable operands are unknown until
+		// they are read, so the specialized handlers still check them and
+		// de-quicken on a mismatch. Rewrite the instructions which fail the
+		// check into the generic ones.
+		bool safe;
+		switch (getGenericOpcode(ins.opcode)) {
+			case Opcode::INCF:
+			case Opcode::DECF:
+				safe = ins.operands.size() == 2 &&
+					   _isVarOperand(ins.operands[0]) &&
+					   _isVarOperand(ins.operands[1]);
 				break;
+			default: {
+				safe = ins.operands.size() == 3 && _isVarOperand(ins.operands[0]);
+
+				// Constant operands have to be of the specialized type.
+				for (size_t j = 1; safe && j < ins.operands.size(); ++j) {
+					auto operand = ins.operands[j];
+					if (!operand) {
+						safe = false;
+						break;
+					}
+
+					switch (auto typeId = operand->getType().typeId; typeId) {
+						case TypeId::LocalVarRef:
+						case TypeId::RegRef:
+						case TypeId::ArgRef:
+							break;
+						default: {
+							QuickVariant variant;
+							safe = _getQuickVariant(typeId, variant) && variant == getQuickVariant(ins.opcode);
+						}
+					}
+				}
 			}
-			case TypeId::ArgRef:
-				unwrapValue = ((ArgRefValue *)i)->unwrapValue;
+		}
 
-				i = curMajorFrame.argStack[((ArgRefValue *)i)->index];
-				break;
+		if (!safe) {
+			ins.opcode = getGenericOpcode(ins.opcode);
+			continue;
 		}
 
-		if (unwrapValue)
-			i = ((VarValue *)i)->value;
+		ins.opcode = _fuseCompareJump(fn->body, fn->nIns, i, ins.opcode);
 	}
 
+	for (uint32_t i = 0; i < fn->nIns; ++i) {
+		if (fn->body[i].opcode == Opcode::LVALUE)
+			fn->body[i].opcode = _fuseLoadArith(fn->body, fn->nIns, i);
+	}
+
+	_buildSwitchTables(fn);
+}
+
+template <typename T, Opcode op>
+static inline bool _quickCompare(T a, T b) {
+	if constexpr (op == Opcode::EQ)
+		return a == b;
+	else if constexpr (op == Opcode::NEQ)
+		return a != b;
+	else if constexpr (op == Opcode::LT)
+		return a < b;
+	else if constexpr (op == Opcode::GT)
+		return a > b;
+	else if constexpr (op == Opcode::LTEQ)
+		return a <= b;
+	else
+		return a >= b;
+}
+
+template <typename T, Opcode op>
+static bool _execQuickBinaryOp(Runtime *rt, MajorFrame &frame, const Instruction &ins) {
+	using V = LiteralValue<T, getValueType<T>()>;
+
+	Value *x = _resolveOperand(frame, ins.operands[1]),
+		  *y = _resolveOperand(frame, ins.operands[2]);
+	if (!x || !y || x->getType() != getValueType<T>() || y->getType() != getValueType<T>())
+		return false;
+
+	T a = ((V *)x)->getData(), b = ((V *)y)->getData();
+
+	Value *result;
+	if constexpr (op == Opcode::ADD)
+		result = new V(rt, a + b);
+	else if constexpr (op == Opcode::SUB)
+		result = new V(rt, a - b);
+	else if constexpr (op == Opcode::MUL)
+		result = new V(rt, a * b);
+	else if constexpr (op == Opcode::DIV)
+		result = new V(rt, a / b);
+	else if constexpr (op == Opcode::MOD) {
+		if constexpr (std::is_same<T, float>::value)
+			result = new V(rt, fmodf(a, b));
+		else if constexpr (std::is_same<T, double>::value)
+			result = new V(rt, fmod(a, b));
+		else
+			result = new V(rt, a % b);
+	} else
+		result = new BoolValue(rt, _quickCompare<T, op>(a, b));
+
+	((VarValue *)_resolveOperand(frame, ins.operands[0]))->setData(result);
+	++frame.curIns;
+	return true;
+}
+
+template <typename T, Opcode op>
+static bool _execQuickIncDec(Runtime *rt, MajorFrame &frame, const Instruction &ins) {
+	using V = LiteralValue<T, getValueType<T>()>;
+
+	auto var = (VarValue *)_resolveOperand(frame, ins.operands[1]);
+
+	Value *x = var->getData();
+	if (!x || x->getType() != getValueType<T>())
+		return false;
+
+	if constexpr (op == Opcode::INCF)
+		var->setData(new V(rt, (T)(((V *)x)->getData() + 1)));
+	else
+		var->setData(new V(rt, (T)(((V *)x)->getData() - 1)));
+	++frame.curIns;
+	return true;
+}
+
+template <typename T, Opcode op, Opcode jumpOp>
+static bool _execQuickCompareJump(
+	Runtime *rt,
+	MajorFrame &frame,
+	const Instruction &ins,
+	const Instruction &jumpIns,
+	InsFeedback &feedback) {
+	using V = LiteralValue<T, getValueType<T>()>;
+
+	Value *x = _resolveOperand(frame, ins.operands[1]),
+		  *y = _resolveOperand(frame, ins.operands[2]);
+	if (!x || !y || x->getType() != getValueType<T>() || y->getType() != getValueType<T>())
+		return false;
+
+	bool cond = _quickCompare<T, op>(((V *)x)->getData(), ((V *)y)->getData());
+
+	// The result is still stored since it may be used after the jump.
+	((VarValue *)_resolveOperand(frame, ins.operands[0]))->setData(new BoolValue(rt, cond));
+
+	bool taken = cond == (jumpOp == Opcode::JT);
+	feedback.recordBranch(taken);
+
+	if (taken)
+		frame.curIns = ((U32Value *)jumpIns.operands[0])->getData();
+	else
+		frame.curIns += 2;
+	return true;
+}
+
+template <typename T>
+static bool _execQuickLoadArith(Runtime *rt, MajorFrame &frame, const Instruction &ins, const Instruction &arithIns) {
+	// The arithmetic may have been rewritten since the instructions were fused.
+	if (!_isQuickArith(arithIns.opcode) || getQuickVariant(arithIns.opcode) != getQuickVariant(ins.opcode))
+		return false;
+
+	// Both operands are verified to resolve to variables.
+	((VarValue *)_resolveOperand(frame, ins.operands[0]))->setData(((VarValue *)_resolveOperand(frame, ins.operands[1]))->getData());
+	++frame.curIns;
+
+	// The arithmetic is left to the next dispatch if types of its operands
+	// changed, which rewrites it into the generic one.
+	switch (getGenericOpcode(arithIns.opcode)) {
+		case Opcode::ADD:
+			_execQuickBinaryOp<T, Opcode::ADD>(rt, frame, arithIns);
+			break;
+		case Opcode::SUB:
+			_execQuickBinaryOp<T, Opcode::SUB>(rt, frame, arithIns);
+			break;
+		case Opcode::MUL:
+			_execQuickBinaryOp<T, Opcode::MUL>(rt, frame, arithIns);
+			break;
+		case Opcode::DIV:
+			_execQuickBinaryOp<T, Opcode::DIV>(rt, frame, arithIns);
+			break;
+		default:
+			_execQuickBinaryOp<T, Opcode::MOD>(rt, frame, arithIns);
+	}
+	return true;
+}
+
+#define QUICK_CASES(op, fn)                                             \
+	case Opcode::op##_I32:                                              \
+		succeeded = fn<int32_t, Opcode::op>(this, curMajorFrame, ins);  \
+		break;                                                          \
+	case Opcode::op##_I64:                                              \
+		succeeded = fn<int64_t, Opcode::op>(this, curMajorFrame, ins);  \
+		break;                                                          \
+	case Opcode::op##_U32:                                              \
+		succeeded = fn<uint32_t, Opcode::op>(this, curMajorFrame, ins); \
+		break;                                                          \
+	case Opcode::op##_U64:                                              \
+		succeeded = fn<uint64_t, Opcode::op>(this, curMajorFrame, ins); \
+		break;                                                          \
+	case Opcode::op##_F32:                                              \
+		succeeded = fn<float, Opcode::op>(this, curMajorFrame, ins);    \
+		break;                                                          \
+	case Opcode::op##_F64:                                              \
+		succeeded = fn<double, Opcode::op>(this, curMajorFrame, ins);   \
+		break;
+
+#define FUSED_CASES(op, jump)                                                                                               \
+	case Opcode::op##_I32_##jump:                                                                                           \
+		succeeded = _execQuickCompareJump<int32_t, Opcode::op, Opcode::jump>(this, curMajorFrame, ins, nextIns, feedback);  \
+		break;                                                                                                              \
+	case Opcode::op##_I64_##jump:                                                                                           \
+		succeeded = _execQuickCompareJump<int64_t, Opcode::op, Opcode::jump>(this, curMajorFrame, ins, nextIns, feedback);  \
+		break;                                                                                                              \
+	case Opcode::op##_U32_##jump:                                                                                           \
+		succeeded = _execQuickCompareJump<uint32_t, Opcode::op, Opcode::jump>(this, curMajorFrame, ins, nextIns, feedback); \
+		break;                                                                                                              \
+	case Opcode::op##_U64_##jump:                                                                                           \
+		succeeded = _execQuickCompareJump<uint64_t, Opcode::op, Opcode::jump>(this, curMajorFrame, ins, nextIns, feedback); \
+		break;                                                                                                              \
+	case Opcode::op##_F32_##jump:                                                                                           \
+		succeeded = _execQuickCompareJump<float, Opcode::op, Opcode::jump>(this, curMajorFrame, ins, nextIns, feedback);    \
+		break;                                                                                                              \
+	case Opcode::op##_F64_##jump:                                                                                           \
+		succeeded = _execQuickCompareJump<double, Opcode::op, Opcode::jump>(this, curMajorFrame, ins, nextIns, feedback);   \
+		break;
+
+#define LOAD_ARITH_CASES                                                               \
+	case Opcode::LVALUE_ARITH_I32:                                                     \
+		succeeded = _execQuickLoadArith<int32_t>(this, curMajorFrame, ins, nextIns);  \
+		break;                                                                         \
+	case Opcode::LVALUE_ARITH_I64:                                                     \
+		succeeded = _execQuickLoadArith<int64_t>(this, curMajorFrame, ins, nextIns);  \
+		break;                                                                         \
+	case Opcode::LVALUE_ARITH_U32:                                                     \
+		succeeded = _execQuickLoadArith<uint32_t>(this, curMajorFrame, ins, nextIns); \
+		break;                                                                         \
+	case Opcode::LVALUE_ARITH_U64:                                                     \
+		succeeded = _execQuickLoadArith<uint64_t>(this, curMajorFrame, ins, nextIns); \
+		break;                                                                         \
+	case Opcode::LVALUE_ARITH_F32:                                                     \
+		succeeded = _execQuickLoadArith<float>(this, curMajorFrame, ins, nextIns);    \
+		break;                                                                         \
+	case Opcode::LVALUE_ARITH_F64:                                                     \
+		succeeded = _execQuickLoadArith<double>(this, curMajorFrame, ins, nextIns);   \
+		break;
+
+bool slake::Runtime::_execQuickIns(Context *context, Instruction &ins) {
+	auto &curMajorFrame = context->majorFrames.back();
+	uint32_t offIns = curMajorFrame.curIns;
+	auto &feedback = curMajorFrame.curFn->_getFeedback(offIns);
+
+	// Only superinstructions read the following instruction, which always
+	// exists for them.
+	auto &nextIns = curMajorFrame.curFn->body[isFusedJumpOpcode(ins.opcode) || isFusedLoadOpcode(ins.opcode) ? offIns + 1 : offIns];
+
+	bool succeeded;
+	switch (ins.opcode) {
+		QUICK_CASES(ADD, _execQuickBinaryOp)
+		QUICK_CASES(SUB, _execQuickBinaryOp)
+		QUICK_CASES(MUL, _execQuickBinaryOp)
+		QUICK_CASES(DIV, _execQuickBinaryOp)
+		QUICK_CASES(MOD, _execQuickBinaryOp)
+		QUICK_CASES(EQ, _execQuickBinaryOp)
+		QUICK_CASES(NEQ, _execQuickBinaryOp)
+		QUICK_CASES(LT, _execQuickBinaryOp)
+		QUICK_CASES(GT, _execQuickBinaryOp)
+		QUICK_CASES(LTEQ, _execQuickBinaryOp)
+		QUICK_CASES(GTEQ, _execQuickBinaryOp)
+		QUICK_CASES(INCF, _execQuickIncDec)
+		QUICK_CASES(DECF, _execQuickIncDec)
+		FUSED_CASES(EQ, JT)
+		FUSED_CASES(EQ, JF)
+		FUSED_CASES(NEQ, JT)
+		FUSED_CASES(NEQ, JF)
+		FUSED_CASES(LT, JT)
+		FUSED_CASES(LT, JF)
+		FUSED_CASES(GT, JT)
+		FUSED_CASES(GT, JF)
+		FUSED_CASES(LTEQ, JT)
+		FUSED_CASES(LTEQ, JF)
+		FUSED_CASES(GTEQ, JT)
+		FUSED_CASES(GTEQ, JF)
+		LOAD_ARITH_CASES
+		default:
+			throw std::logic_error("Unhandled opcode");
+	}
+
+	if (!succeeded) {
+		// Types of the operands changed, rewrite the instruction back into
+		// the generic one.
+		ins.opcode = getGenericOpcode(ins.opcode);
+#if SLAKE_ENABLE_STATS
+		_countStat(_getAllocBuffer()->nQuickInsMisses);
+#endif
+		return false;
+	}
+
+#if SLAKE_ENABLE_STATS
+	_countStat(_getAllocBuffer()->nQuickInsHits);
+#endif
+
+	++feedback.nExecs;
+
+	if (curMajorFrame.curIns <= offIns)
+		_pollBudget(context);
+	return true;
+}
+
+#undef QUICK_CASES
+#undef FUSED_CASES
+#undef LOAD_ARITH_CASES
+
+void slake::Runtime::_recordReceiver(InsFeedback &feedback, const Value *receiver) {
+	bool isHit = feedback.recordReceiver(receiver);
+#if SLAKE_ENABLE_STATS
+	if (receiver && receiver->getType() == TypeId::Object)
+		_countStat(isHit ? _getAllocBuffer()->nInlineCacheHits : _getAllocBuffer()->nInlineCacheMisses);
+#else
+	(void)isHit;
+#endif
+}
+
+void slake::Runtime::_execIns(Context *context, Instruction &srcIns) {
+	++context->nExecutedIns;
+
+#if SLAKE_ENABLE_STATS
+	_countStat(_getAllocBuffer()->nExecutedIns[(size_t)srcIns.opcode.load()]);
+#endif
+
+	if (isQuickOpcode(srcIns.opcode) && _execQuickIns(context, srcIns))
+		return;
+
+	auto &curMajorFrame = context->majorFrames.back();
+	auto &curMinorFrame = curMajorFrame.minorFrames.back();
+
+	Instruction ins = srcIns;
+	for (auto &i : ins.operands)
+		i = _resolveOperand(curMajorFrame, i);
+
+	InsFeedback &feedback = curMajorFrame.curFn->_getFeedback(curMajorFrame.curIns);
+	++feedback.nExecs;
+
 	switch (ins.opcode) {
 		case Opcode::NOP:
 			break;
@@ -384,6 +1217,8 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 			if (!v)
 				throw NullRefError();
 
+			_recordReceiver(feedback, v);
+
 			if (!(v = resolveRef((RefValue *)ins.operands[2], v))) {
 				throw NotFoundError("Member not found", (RefValue *)ins.operands[2]);
 			}
@@ -454,6 +1289,8 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 			if (!y)
 				throw NullRefError();
 
+			feedback.recordOperands(x.get(), y.get());
+
 			switch (x->getType().typeId) {
 				case TypeId::I8:
 					out->setData(_execBinaryOp<std::int8_t>(x, y, ins.opcode));
@@ -491,6 +1328,20 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 				default:
 					throw InvalidOperandsError("Invalid operand combination");
 			}
+
+			// Specialize the instruction if only a single type was observed.
+			if (!(feedback.lhsTypes & (feedback.lhsTypes - 1)) &&
+				feedback.lhsTypes == feedback.rhsTypes &&
+				_isVarOperand(srcIns.operands[0])) {
+				auto body = curMajorFrame.curFn->body;
+				uint32_t nIns = curMajorFrame.curFn->nIns, offIns = curMajorFrame.curIns;
+				if (auto opcode = _getQuickOpcode(ins.opcode, x->getType().typeId); opcode != Opcode::OPCODE_MAX) {
+					srcIns.opcode = _fuseCompareJump(body, nIns, offIns, opcode);
+
+					if (offIns && body[offIns - 1].opcode == Opcode::LVALUE)
+						body[offIns - 1].opcode = _fuseLoadArith(body, nIns, offIns - 1);
+				}
+			}
 			break;
 		}
 		case Opcode::INCF:
@@ -534,6 +1385,8 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 			if (!x)
 				throw NullRefError();
 
+			feedback.recordOperands(x);
+
 			switch (x->getType().typeId) {
 				case TypeId::I8:
 					value = _execUnaryOp<std::int8_t>(x, ins.opcode);
@@ -580,6 +1433,12 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 				case Opcode::INCF:
 				case Opcode::DECF:
 					varIn->setData(value.get());
+
+					if (!(feedback.lhsTypes & (feedback.lhsTypes - 1)) &&
+						_isVarOperand(srcIns.operands[0]) && _isVarOperand(srcIns.operands[1])) {
+						if (auto opcode = _getQuickOpcode(ins.opcode, x->getType().typeId); opcode != Opcode::OPCODE_MAX)
+							srcIns.opcode = opcode;
+					}
 					break;
 				default:
 					((VarValue *)varOut)->setData(value.get());
@@ -625,7 +1484,11 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 
 			_checkOperandType(ins, { TypeId::U32 });
 
+			uint32_t offIns = curMajorFrame.curIns;
 			curMajorFrame.curIns = ((U32Value *)ins.operands[0])->getData();
+
+			if (curMajorFrame.curIns <= offIns)
+				_pollBudget(context);
 			return;
 		}
 		case Opcode::JT:
@@ -634,13 +1497,15 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 
 			_checkOperandType(ins, { TypeId::U32, TypeId::Bool });
 
-			if (((BoolValue *)ins.operands[1])->getData()) {
-				if (ins.opcode == Opcode::JT) {
-					curMajorFrame.curIns = ((U32Value *)ins.operands[0])->getData();
-					return;
-				}
-			} else if (ins.opcode == Opcode::JF) {
+			bool cond = ((BoolValue *)ins.operands[1])->getData();
+			feedback.recordBranch(cond == (ins.opcode == Opcode::JT));
+
+			if (cond == (ins.opcode == Opcode::JT)) {
+				uint32_t offIns = curMajorFrame.curIns;
 				curMajorFrame.curIns = ((U32Value *)ins.operands[0])->getData();
+
+				if (curMajorFrame.curIns <= offIns)
+					_pollBudget(context);
 				return;
 			}
 
@@ -653,8 +1518,12 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 			break;
 		}
 		case Opcode::MCALL:
-		case Opcode::CALL: {
-			if (ins.opcode == Opcode::MCALL) {
+		case Opcode::CALL:
+		case Opcode::MTAILCALL:
+		case Opcode::TAILCALL: {
+			bool isMethodCall = ins.opcode == Opcode::MCALL || ins.opcode == Opcode::MTAILCALL;
+
+			if (isMethodCall) {
 				_checkOperandCount(ins, 2);
 
 				_checkOperandType(ins, { TypeId::Fn, TypeId::Any });
@@ -669,19 +1538,42 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 			if (!fn)
 				throw NullRefError();
 
+			// Preempted calls are executed again on resuming.
+			_pollBudget(context);
+			if (context->flags & CTX_PREEMPTED)
+				return;
+
+			if (isMethodCall)
+				_recordReceiver(feedback, ins.operands[1]);
+
 			if (fn->isNative()) {
+#if SLAKE_ENABLE_STATS
+				_countStat(_getAllocBuffer()->nNativeCalls);
+#endif
+				bool isTraced = _shouldTrace(TRACE_NATIVE_CALLS);
+				auto beginTime = isTraced ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
 				curMajorFrame.returnValue = ((NativeFnValue *)fn)->call(
-					ins.opcode == Opcode::MCALL
+					isMethodCall
 					? (curMajorFrame.scopeValue = ins.operands[1])
 					: nullptr,
-					curMajorFrame.nextArgStack).get();
+					{ curMajorFrame.nextArgStack.begin(), curMajorFrame.nextArgStack.end() }).get();
 				curMajorFrame.nextArgStack.clear();
+
+				if (isTraced)
+					_addTraceEvent('X', "native", getFullName(fn), beginTime, std::chrono::steady_clock::now());
 			} else {
-				_callFn(context, fn);
+				// Native functions do not take frames, tail calls to them are
+				// performed as normal calls and the following instructions
+				// return their results.
+				if ((ins.opcode == Opcode::TAILCALL || ins.opcode == Opcode::MTAILCALL) && _isTailCallable(curMajorFrame))
+					_tailCallFn(context, fn);
+				else
+					_callFn(context, fn);
 
 				auto &newCurFrame = context->getCurFrame();
 
-				if (ins.opcode == Opcode::MCALL)
+				if (isMethodCall)
 					newCurFrame.thisObject = (newCurFrame.scopeValue = ins.operands[1]);
 				return;
 			}
@@ -691,7 +1583,9 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 		case Opcode::RET: {
 			_checkOperandCount(ins, 1);
 
-			context->majorFrames.pop_back();
+			if (curMajorFrame.isTraced)
+				_traceReturn(curMajorFrame);
+			_popFrame(context);
 			context->majorFrames.back().returnValue = ins.operands[0];
 			++context->majorFrames.back().curIns;
 			break;
@@ -705,6 +1599,31 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 		}
 		case Opcode::ACALL:
 		case Opcode::AMCALL: {
+			bool isMethodCall = ins.opcode == Opcode::AMCALL;
+
+			if (isMethodCall) {
+				_checkOperandCount(ins, 2);
+
+				_checkOperandType(ins, { TypeId::Fn, TypeId::Any });
+			} else {
+				_checkOperandCount(ins, 1);
+
+				_checkOperandType(ins, { TypeId::Fn });
+			}
+
+			FnValue *fn = (FnValue *)ins.operands[0];
+
+			if (!fn)
+				throw NullRefError();
+
+			if (isMethodCall)
+				_recordReceiver(feedback, ins.operands[1]);
+
+			// The coroutine is started by the first AWAIT on it.
+			curMajorFrame.returnValue = _newCoroutine(
+				curMajorFrame,
+				fn,
+				isMethodCall ? ins.operands[1] : nullptr);
 			break;
 		}
 		case Opcode::YIELD: {
@@ -715,6 +1634,33 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 			break;
 		}
 		case Opcode::AWAIT: {
+			_checkOperandCount(ins, 1);
+
+			_checkOperandType(ins, { TypeId::Context });
+
+			auto coroutineValue = (ContextValue *)ins.operands[0];
+
+			if (!coroutineValue)
+				throw NullRefError();
+
+			Context *coroutine = coroutineValue->_context.get();
+
+			// Contexts which are executed or queued by other threads, e.g.
+			// by the scheduler, cannot be awaited.
+			ContextFlags flags = coroutine->claim(CTX_RUNNING, CTX_YIELDED);
+			if (flags & CTX_DONE) {
+				curMajorFrame.returnValue = coroutine->getCurFrame().returnValue;
+				break;
+			}
+
+			if (flags & (CTX_RUNNING | CTX_SCHEDULED))
+				throw InvalidOperandsError("Awaiting a running or scheduled context");
+
+			// Switching is done by the execution loop, the result is
+			// received once the coroutine yielded or returned.
+			coroutine->resumer = context;
+			context->awaitee = coroutineValue;
+			context->flags |= _CTX_AWAITING;
 			break;
 		}
 		case Opcode::LTHIS: {
@@ -772,6 +1718,12 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 					tmpContext.majorFrames.back().leave();
 
 					if (found) {
+						// End spans of the unwound frames.
+						for (size_t i = context->majorFrames.size(); i > tmpContext.majorFrames.size(); --i) {
+							if (context->majorFrames[i - 1].isTraced)
+								_traceReturn(context->majorFrames[i - 1]);
+						}
+
 						*context = tmpContext;
 						// Do not increase the current instruction offset,
 						// the offset has been set to offset to first instruction
@@ -858,8 +1810,31 @@ void slake::Runtime::_execIns(Context *context, Instruction ins) {
 			((VarValue *)ins.operands[0])->setData(v.get());
 			break;
 		}
+		case Opcode::CONSTSW: {
+			_checkOperandCount(ins, 3);
+
+			_checkOperandType(ins, { TypeId::Any, TypeId::Array, TypeId::U32 });
+
+			if (!ins.operands[1] || !ins.operands[2])
+				throw InvalidOperandsError("Invalid operand combination");
+
+			// Lookup tables are built when the body is verified, the case
+			// table is invalid if there is none, which is thrown here.
+			const SwitchTable *table = srcIns.switchTable;
+			SwitchTable builtTable;
+			if (!table) {
+				builtTable = _buildSwitchTable(
+					(ArrayValue *)ins.operands[1],
+					((U32Value *)ins.operands[2])->getData(),
+					curMajorFrame.curFn->nIns);
+				table = &builtTable;
+			}
+
+			curMajorFrame.curIns = _lookupSwitchTable(*table, ins.operands[0]);
+			return;
+		}
 		default:
-			throw InvalidOpcodeError("Invalid opcode " + std::to_string((uint8_t)ins.opcode));
+			throw InvalidOpcodeError("Invalid opcode " + std::to_string((uint8_t)ins.opcode.load()));
 	}
 	++curMajorFrame.curIns;
 }
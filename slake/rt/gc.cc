@@ -2,32 +2,32 @@
 
 using namespace slake;
 
-void Runtime::_gcWalk(Scope *scope) {
+void Runtime::_walkRefs(Scope *scope, const ValueVisitor &visit) {
 	for (auto &i : scope->members) {
-		_gcWalk(i.second);
+		visit(i.second);
 	}
 
 	if (scope->owner)
-		_gcWalk(scope->owner);
+		visit(scope->owner);
 
 	if (scope->parent)
-		_gcWalk(scope->parent);
+		_walkRefs(scope->parent, visit);
 }
 
-void Runtime::_gcWalk(Type &type) {
+void Runtime::_walkRefs(Type &type, const ValueVisitor &visit) {
 	switch (type.typeId) {
 		case TypeId::Object:
 		case TypeId::Class:
 		case TypeId::Interface:
 		case TypeId::Trait:
-			_gcWalk(type.getCustomTypeExData());
+			visit(type.getCustomTypeExData());
 			break;
 		case TypeId::Array:
-			_gcWalk(type.getArrayExData());
+			_walkRefs(type.getArrayExData(), visit);
 			break;
 		case TypeId::Map: {
-			_gcWalk(*type.getMapExData().first);
-			_gcWalk(*type.getMapExData().second);
+			_walkRefs(*type.getMapExData().first, visit);
+			_walkRefs(*type.getMapExData().second, visit);
 			break;
 		}
 		case TypeId::Var:
@@ -61,26 +61,35 @@ void Runtime::_gcWalk(Type &type) {
 }
 
 void Runtime::_gcWalk(Value *v) {
-	if (_walkedValues.count(v))
+	// Elements of arrays may be null.
+	if (!v || _walkedValues.count(v))
 		return;
 
 	_walkedValues.insert(v);
 	_createdValues.erase(v);
 
+	_walkRefs(v, [this](Value *i) { _gcWalk(i); });
+}
+
+void Runtime::_gcWalk(Context &ctxt) {
+	_walkRefs(ctxt, [this](Value *i) { _gcWalk(i); });
+}
+
+void Runtime::_walkRefs(Value *v, const ValueVisitor &visit) {
 	if (v->scope)
-		_gcWalk(v->scope);
+		_walkRefs(v->scope, visit);
 
 	switch (auto typeId = v->getType().typeId; typeId) {
 		case TypeId::Object: {
 			auto value = (ObjectValue *)v;
-			_gcWalk(value->_class);
+			visit(value->_class);
 			if (value->_parent)
-				_gcWalk(value->_parent);
+				visit(value->_parent);
 			break;
 		}
 		case TypeId::Array:
 			for (auto &i : ((ArrayValue *)v)->values)
-				_gcWalk(i);
+				visit(i);
 			break;
 		case TypeId::Map:
 			break;
@@ -89,31 +98,35 @@ void Runtime::_gcWalk(Value *v) {
 		case TypeId::Trait:
 		case TypeId::Interface: {
 			if (((ModuleValue *)v)->_parent)
-				_gcWalk(((ModuleValue *)v)->_parent);
+				visit(((ModuleValue *)v)->_parent);
 
 			for (auto &i : ((ModuleValue *)v)->imports)
-				_gcWalk(i.second);
+				visit(i.second);
+			for (auto i : ((ModuleValue *)v)->consts) {
+				if (i)
+					visit(i);
+			}
 
 			switch (typeId) {
 				case TypeId::Class:
 					for (auto &i : ((ClassValue *)v)->implInterfaces) {
 						i.loadDeferredType(this);
-						_gcWalk(i);
+						_walkRefs(i, visit);
 					}
 					((ClassValue *)v)->parentClass.loadDeferredType(this);
 					if (auto p = ((ClassValue *)v)->parentClass.resolveCustomType(); p)
-						_gcWalk(p);
+						visit(p);
 					break;
 				case TypeId::Trait:
 					for (auto &i : ((TraitValue *)v)->parents) {
 						i.loadDeferredType(this);
-						_gcWalk(i.getCustomTypeExData());
+						visit(i.getCustomTypeExData());
 					}
 					break;
 				case TypeId::Interface:
 					for (auto &i : ((InterfaceValue *)v)->parents) {
 						i.loadDeferredType(this);
-						_gcWalk(i.getCustomTypeExData());
+						visit(i.getCustomTypeExData());
 					}
 					break;
 			}
@@ -123,13 +136,13 @@ void Runtime::_gcWalk(Value *v) {
 		case TypeId::Var: {
 			VarValue *value = (VarValue *)v;
 
-			_gcWalk(value->type);
+			_walkRefs(value->type, visit);
 
 			if (auto v = value->getData(); v)
-				_gcWalk(v);
+				visit(v);
 
 			if (value->_parent)
-				_gcWalk(value->_parent);
+				visit(value->_parent);
 			break;
 		}
 		case TypeId::RootValue:
@@ -138,28 +151,37 @@ void Runtime::_gcWalk(Value *v) {
 			auto basicFn = (BasicFnValue *)v;
 
 			if (basicFn->_parent)
-				_gcWalk(basicFn->_parent);
+				visit(basicFn->_parent);
 
-			_gcWalk(basicFn->returnType);
+			_walkRefs(basicFn->returnType, visit);
 			for (auto &i : basicFn->paramTypes)
-				_gcWalk(i);
+				_walkRefs(i, visit);
 
 			if (!((BasicFnValue *)v)->isNative()) {
 				auto value = (FnValue *)basicFn;
-				for (size_t i = 0; i < value->nIns; ++i) {
+
+				// Undecoded bodies do not refer to any value.
+				for (size_t i = 0; value->body && i < value->nIns; ++i) {
 					auto &ins = value->body[i];
 					for (auto j : ins.operands) {
 						if (j)
-							_gcWalk(j);
+							visit(j);
 					}
 				}
+
+				// Keep receiver classes in the feedback alive.
+				auto feedback = value->_feedback.load(std::memory_order_relaxed);
+				for (size_t i = 0; feedback && i < value->nIns; ++i) {
+					for (uint8_t j = 0; j < feedback[i].nReceivers; ++j)
+						visit((Value *)feedback[i].receivers[j].load());
+				}
 			}
 			break;
 		}
 		case TypeId::TypeName: {
 			auto value = (TypeNameValue *)v;
 
-			_gcWalk(value->_data);
+			_walkRefs(value->_data, visit);
 			break;
 		}
 		case TypeId::Ref: {
@@ -167,20 +189,20 @@ void Runtime::_gcWalk(Value *v) {
 
 			for (auto &i : value->entries)
 				for (auto &j : i.genericArgs) {
-					_gcWalk(j);
+					_walkRefs(j, visit);
 				}
 			break;
 		}
 		case TypeId::Alias: {
 			auto value = (AliasValue *)v;
 
-			_gcWalk(value->src);
+			visit(value->src);
 			break;
 		}
 		case TypeId::Context: {
 			auto value = (ContextValue *)v;
 
-			_gcWalk(*value->_context);
+			_walkRefs(*value->_context, visit);
 			break;
 		}
 		case TypeId::I8:
@@ -195,6 +217,9 @@ void Runtime::_gcWalk(Value *v) {
 		case TypeId::F64:
 		case TypeId::Bool:
 		case TypeId::String:
+		case TypeId::WString:
+		case TypeId::Char:
+		case TypeId::WChar:
 		case TypeId::RegRef:
 		case TypeId::LocalVarRef:
 		case TypeId::ArgRef:
@@ -204,44 +229,186 @@ void Runtime::_gcWalk(Value *v) {
 	}
 }
 
-void Runtime::_gcWalk(Context &ctxt) {
+void Runtime::_walkRefs(Context &ctxt, const ValueVisitor &visit) {
 	for (auto &j : ctxt.majorFrames) {
-		_gcWalk(const_cast<FnValue *>(j.curFn));
+		visit(const_cast<FnValue *>(j.curFn));
 		if (j.scopeValue)
-			_gcWalk(j.scopeValue);
+			visit(j.scopeValue);
 		if (j.returnValue)
-			_gcWalk(j.returnValue);
+			visit(j.returnValue);
 		if (j.thisObject)
-			_gcWalk(j.thisObject);
+			visit(j.thisObject);
 		if (j.curExcept)
-			_gcWalk(j.curExcept);
+			visit(j.curExcept);
 		for (auto &k : j.argStack)
-			_gcWalk(k);
+			visit(k);
 		for (auto &k : j.nextArgStack)
-			_gcWalk(k);
+			visit(k);
 		for (auto &k : j.localVars)
-			_gcWalk(k);
+			visit(k);
 		for (auto &k : j.regs)
-			_gcWalk(k);
+			visit(k);
 		for (auto &k : j.minorFrames) {
 			for (auto &l : k.exceptHandlers)
-				_gcWalk(l.type);
+				_walkRefs(l.type, visit);
+		}
+	}
+
+	// Contexts which were preempted in coroutines are resumed from them.
+	if (ctxt.awaitee)
+		visit(ctxt.awaitee);
+}
+
+void Runtime::_destroyValue(Value *v) {
+	if (!(v->_flags & VF_ARENA)) {
+		delete v;
+		return;
+	}
+
+	v->~Value();
+
+	std::lock_guard<std::mutex> lock(_valueArenasMutex);
+
+	auto it = std::prev(_valueArenas.upper_bound((char *)v));
+	if (!--it->second.nLive) {
+		::operator delete(it->first);
+		_valueArenas.erase(it);
+	}
+}
+
+bool Runtime::_enterExecution() {
+	std::unique_lock<std::mutex> lock(_safepointMutex);
+
+	// Destructors are called by the collecting thread.
+	if (_collectingThread == std::this_thread::get_id())
+		return false;
+
+	_safepointCond.wait(lock, [this]() { return !_safepointRequested; });
+	++_nExecutingThreads;
+	return true;
+}
+
+void Runtime::_leaveExecution() {
+	std::lock_guard<std::mutex> lock(_safepointMutex);
+
+	--_nExecutingThreads;
+	_safepointCond.notify_all();
+}
+
+void Runtime::_stopAtSafepoint() {
+	std::unique_lock<std::mutex> lock(_safepointMutex);
+
+	if (!_safepointRequested || _collectingThread == std::this_thread::get_id())
+		return;
+
+	++_nStoppedThreads;
+	_safepointCond.notify_all();
+	_safepointCond.wait(lock, [this]() { return !_safepointRequested; });
+	--_nStoppedThreads;
+}
+
+bool Runtime::_stopTheWorld() {
+	std::unique_lock<std::mutex> lock(_safepointMutex);
+
+	bool isExecuting = _execRuntime == this;
+
+	if (_safepointRequested) {
+		// Another thread is collecting, stop as if at a safepoint.
+		if (isExecuting) {
+			++_nStoppedThreads;
+			_safepointCond.notify_all();
 		}
+		_safepointCond.wait(lock, [this]() { return !_safepointRequested; });
+		if (isExecuting)
+			--_nStoppedThreads;
+		return false;
 	}
+
+	_safepointRequested = true;
+	_collectingThread = std::this_thread::get_id();
+
+	_safepointCond.wait(lock, [this, isExecuting]() {
+		return _nStoppedThreads + isExecuting == _nExecutingThreads;
+	});
+	return true;
+}
+
+void Runtime::_resumeTheWorld() {
+	std::lock_guard<std::mutex> lock(_safepointMutex);
+
+	_safepointRequested = false;
+	_collectingThread = {};
+	_safepointCond.notify_all();
 }
 
 void Runtime::gc() {
+	// Pauses include the time to bring the other threads to safepoints.
+	auto beginTime = std::chrono::steady_clock::now();
+
+	// Other executing threads must not touch any value during the cycle.
+	if (!_stopTheWorld())
+		return;
+
+	bool isTraced = _shouldTrace(TRACE_GC);
+	auto phaseBeginTime = beginTime;
+	auto tracePhase = [this, isTraced, &phaseBeginTime](const char *name) {
+		if (!isTraced)
+			return;
+
+		auto now = std::chrono::steady_clock::now();
+		_addTraceEvent('X', "gc", name, phaseBeginTime, now);
+		phaseBeginTime = now;
+	};
+	tracePhase("safepoint");
+
 	_flags |= _RT_INGC;
 
+	_flushAllocBuffers();
+
+#if SLAKE_ENABLE_JIT
+	// Pending functions are not referenced by the batch.
+	{
+		std::lock_guard<std::mutex> lock(_jitMutex);
+		_flushJITCode();
+	}
+#endif
+
+#if SLAKE_ENABLE_STATS
+	size_t szMemInUseBefore = _szMemInUse;
+#endif
+
 	bool foundDestructibleValues = false;
 
 rescan:
 	if (_rootValue)
 		_gcWalk(_rootValue);
 
-	// Walk contexts for each thread.
-	for (auto &i : activeContexts)
-		_gcWalk(*i.second);
+#if SLAKE_ENABLE_JIT
+	for (auto i : _jitBoolValues)
+		_gcWalk(i);
+#endif
+
+	// Walk values which are referenced by the host, e.g. suspended coroutines
+	// which are resumed by the host later.
+	{
+		std::vector<Value *> hostRefValues;
+		for (auto i : _createdValues) {
+			if (i->hostRefCount)
+				hostRefValues.push_back(i);
+		}
+		for (auto i : hostRefValues)
+			_gcWalk(i);
+	}
+
+	// Walk contexts which are being executed, and coroutines which are
+	// resumed by them.
+	for (auto i = _runningContexts; i; i = i->nextRunning) {
+		_gcWalk(*i);
+		for (auto j = i->awaitee; j; j = j->_context->awaitee)
+			_gcWalk(j);
+	}
+
+	tracePhase("mark");
 
 	// Execute destructors for all destructible objects.
 	destructingThreads.insert(std::this_thread::get_id());
@@ -259,22 +426,47 @@ rescan:
 	}
 	destructingThreads.erase(std::this_thread::get_id());
 
+	tracePhase("finalize");
+
 	for (auto i : _createdValues) {
 		if(i->hostRefCount) {
 			_walkedValues.insert(i);
 		} else
-			delete i;
+			_destroyValue(i);
 	}
 
 	_createdValues.swap(_walkedValues);
 	_walkedValues.clear();
 	_destructedValues.clear();
 
+	tracePhase("sweep");
+
 	if (foundDestructibleValues) {
 		foundDestructibleValues = false;
 		goto rescan;
 	}
 
+	// Register values created by the destructors and add sizes freed by the
+	// cycle.
+	_flushAllocBuffers();
+
+#if SLAKE_ENABLE_STATS
+	{
+		auto pauseTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - beginTime);
+
+		++_stats.nGcCycles;
+		_stats.gcPauseTime += pauseTime;
+		_stats.maxGcPauseTime = std::max(_stats.maxGcPauseTime, pauseTime);
+		if (_szMemInUse < szMemInUseBefore)
+			_stats.szReclaimed += szMemInUseBefore - _szMemInUse;
+	}
+#endif
+
 	_szMemUsedAfterLastGc = _szMemInUse;
 	_flags &= ~_RT_INGC;
+
+	if (isTraced)
+		_addTraceEvent('X', "gc", "gc", beginTime, std::chrono::steady_clock::now());
+
+	_resumeTheWorld();
 }
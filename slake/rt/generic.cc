@@ -85,6 +85,7 @@ void slake::Runtime::_instantiateGenericValue(Value *v, const GenericArgList &ge
 			for (auto &i : value->paramTypes)
 				_instantiateGenericValue(i, genericArgs);
 
+			value->loadBody();
 			for (size_t i = 0; i < value->nIns; ++i) {
 				auto &ins = value->body[i];
 				for (size_t j = 0; j < ins.operands.size(); ++j) {
@@ -124,16 +125,27 @@ void slake::Runtime::_instantiateGenericValue(Value *v, const GenericArgList &ge
 }
 
 Value *Runtime::instantiateGenericValue(const Value *v, const GenericArgList &genericArgs) const {
+	// Instances are cached before they are instantiated, other threads have to
+	// wait until the instantiation is done.
+	auto lock = _lockLazyState();
+
 	// Try to look up in the cache.
 	if (_genericCacheDir.count(v)) {
 		auto &table = _genericCacheDir.at(v);
 		if (table.count(genericArgs)) {
 			// Cache hit, return.
+#if SLAKE_ENABLE_STATS
+			_countStat(const_cast<Runtime *>(this)->_getAllocBuffer()->nGenericCacheHits);
+#endif
 			return table.at(genericArgs);
 		}
 		// Cache missed, go to the fallback.
 	}
 
+#if SLAKE_ENABLE_STATS
+	_countStat(const_cast<Runtime *>(this)->_getAllocBuffer()->nGenericCacheMisses);
+#endif
+
 	// Cache missed, instantiate the value.
 	auto value = v->duplicate();				   // Make a duplicate of the original value.
 	_genericCacheDir[v][genericArgs] = value;	   // Store the instance into the cache.
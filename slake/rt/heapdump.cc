@@ -0,0 +1,156 @@
+#include <slake/runtime.h>
+#include <slake/slhfmt.h>
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+using namespace slake;
+
+namespace slake {
+	/// @brief State for writing a heap dump.
+	struct HeapDumpWriter final {
+		std::unordered_map<const Value *, uint32_t> indices;
+		std::unordered_map<std::string, uint32_t> stringIndices;
+		std::vector<const std::string *> strings;
+
+		std::string records;
+
+		template <typename T>
+		inline void put(const T &value) {
+			records.append((const char *)&value, sizeof(T));
+		}
+
+		inline uint32_t getStringIndex(const std::string &s) {
+			if (auto it = stringIndices.find(s); it != stringIndices.end())
+				return it->second;
+
+			uint32_t index = (uint32_t)strings.size();
+			auto it = stringIndices.insert({ s, index }).first;
+			strings.push_back(&it->first);
+			return index;
+		}
+	};
+}
+
+static bool _isMemberValue(Value *v) {
+	switch (v->getType().typeId) {
+		case TypeId::Module:
+		case TypeId::Class:
+		case TypeId::Interface:
+		case TypeId::Trait:
+		case TypeId::Var:
+		case TypeId::Fn:
+		case TypeId::Alias:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// @brief Get name of a value in the dump, which is the full name of member
+/// values or of the classes of objects.
+///
+/// Members which are detached from the root value are named relative to
+/// their outermost parents.
+static std::string _getDumpName(Value *v) {
+	if (v->getType() == TypeId::Object)
+		v = v->getType().getCustomTypeExData();
+
+	std::string s;
+	for (; v && _isMemberValue(v); v = ((MemberValue *)v)->getParent()) {
+		auto name = ((MemberValue *)v)->getName();
+		// Local variables and arguments are not named.
+		if (name.empty())
+			break;
+		s = s.empty() ? name : name + "." + s;
+	}
+	return s;
+}
+
+void Runtime::dumpHeap(std::ostream &fs) {
+	HeapDumpWriter w;
+	std::vector<slhfmt::RootRecord> roots;
+	uint32_t nValues;
+
+	// Values in the allocation buffers are not registered until they are
+	// flushed.
+	_stopTheWorldForUpdate();
+	try {
+		_flushAllocBuffers();
+
+		nValues = (uint32_t)_createdValues.size();
+		for (auto i : _createdValues)
+			w.indices[i] = (uint32_t)w.indices.size();
+
+		auto addRoot = [&roots, &w](uint8_t kind, Value *v) {
+			if (auto it = w.indices.find(v); it != w.indices.end())
+				roots.push_back({ kind, {}, it->second });
+		};
+
+		if (_rootValue)
+			addRoot(slhfmt::ROOT_RUNTIME, _rootValue);
+#if SLAKE_ENABLE_JIT
+		for (auto i : _jitBoolValues)
+			addRoot(slhfmt::ROOT_RUNTIME, i);
+#endif
+
+		for (auto i : _createdValues) {
+			if (i->hostRefCount)
+				addRoot(slhfmt::ROOT_HOST, i);
+		}
+
+		for (auto i = _runningContexts; i; i = i->nextRunning) {
+			_walkRefs(*i, [&addRoot](Value *v) { addRoot(slhfmt::ROOT_CONTEXT, v); });
+			for (auto j = i->awaitee; j; j = j->_context->awaitee)
+				addRoot(slhfmt::ROOT_CONTEXT, j);
+		}
+
+		std::vector<uint32_t> refs;
+		for (auto i : _createdValues) {
+			uint32_t index = w.indices.at(i);
+
+			refs.clear();
+			_walkRefs(i, [&refs, &w, index](Value *v) {
+				if (auto it = w.indices.find(v); it != w.indices.end() && it->second != index)
+					refs.push_back(it->second);
+			});
+
+			// Scopes of the parents are walked for each value.
+			std::sort(refs.begin(), refs.end());
+			refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+
+			auto name = _getDumpName(i);
+
+			slhfmt::ValueRecordHeader vrh = {};
+			vrh.typeId = (uint8_t)i->getType().typeId;
+			vrh.szShallow = i->_szReported;
+			vrh.name = name.empty() ? slhfmt::IDX_NULL : w.getStringIndex(name);
+			vrh.nRefs = (uint32_t)refs.size();
+
+			w.put(vrh);
+			w.records.append((const char *)refs.data(), refs.size() * sizeof(uint32_t));
+		}
+	} catch (...) {
+		_resumeTheWorld();
+		throw;
+	}
+	_resumeTheWorld();
+
+	slhfmt::HeapDumpHeader hdh = {};
+	memcpy(hdh.magic, slhfmt::HDH_MAGIC, sizeof(hdh.magic));
+	hdh.fmtVer = slhfmt::FMTVER_CURRENT;
+	hdh.nStrings = (uint32_t)w.strings.size();
+	hdh.nRoots = (uint32_t)roots.size();
+	hdh.nValues = nValues;
+
+	fs.write((const char *)&hdh, sizeof(hdh));
+	for (auto i : w.strings) {
+		uint32_t len = (uint32_t)i->size();
+		fs.write((const char *)&len, sizeof(len));
+		fs.write(i->data(), len);
+	}
+	fs.write((const char *)roots.data(), roots.size() * sizeof(slhfmt::RootRecord));
+	fs.write(w.records.data(), w.records.size());
+}
@@ -0,0 +1,206 @@
+#include <slake/runtime.h>
+
+#include <utility>
+
+using namespace slake;
+
+#if SLAKE_ENABLE_JIT
+
+/// @brief Exception thrown by an instruction which was executed by compiled
+/// code, exceptions cannot be propagated through the compiled code.
+static thread_local std::exception_ptr _jitPendingExcept;
+
+static void _fillJITFrameSlots(MajorFrame *frame, JITFrameSlots *slots) {
+	slots->regs = (void **)frame->regs.data();
+	slots->localVars = (void **)frame->localVars.data();
+	slots->args = (void **)frame->argStack.data();
+	slots->nRegs = (uint32_t)frame->regs.size();
+	slots->nLocalVars = (uint32_t)frame->localVars.size();
+	slots->nArgs = (uint32_t)frame->argStack.size();
+}
+
+template <typename T>
+static uint32_t _getLiteralDataOffset(T *v) {
+	return (uint32_t)((const char *)&v->getData() - (const char *)v);
+}
+
+void Runtime::_initJIT() {
+	_jitInfo.executor = _jitExecIns;
+	_jitInfo.poll = _jitPoll;
+	_jitInfo.stores[QV_I32] = _jitStore<int32_t>;
+	_jitInfo.stores[QV_I64] = _jitStore<int64_t>;
+	_jitInfo.stores[QV_U32] = _jitStore<uint32_t>;
+	_jitInfo.stores[QV_U64] = _jitStore<uint64_t>;
+
+	// Compiled code checks types of the literals by their virtual tables,
+	// the literals are collected later since nothing refers to them.
+	Value *literals[N_JIT_INT_TYPES] = {
+		new I32Value(this, 0),
+		new I64Value(this, 0),
+		new U32Value(this, 0),
+		new U64Value(this, 0)
+	};
+	for (size_t i = 0; i < N_JIT_INT_TYPES; ++i)
+		_jitInfo.literalVtables[i] = *(const void *const *)literals[i];
+	_jitInfo.offLiteralData[QV_I32] = _getLiteralDataOffset((I32Value *)literals[QV_I32]);
+	_jitInfo.offLiteralData[QV_I64] = _getLiteralDataOffset((I64Value *)literals[QV_I64]);
+	_jitInfo.offLiteralData[QV_U32] = _getLiteralDataOffset((U32Value *)literals[QV_U32]);
+	_jitInfo.offLiteralData[QV_U64] = _getLiteralDataOffset((U64Value *)literals[QV_U64]);
+
+	_jitBoolValues[0] = new BoolValue(this, false);
+	_jitBoolValues[1] = new BoolValue(this, true);
+	_jitInfo.boolValues[0] = _jitBoolValues[0];
+	_jitInfo.boolValues[1] = _jitBoolValues[1];
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+	_jitInfo.offVarValue = (uint32_t)offsetof(VarValue, value);
+	_jitInfo.offCurIns = (uint32_t)offsetof(MajorFrame, curIns);
+	_jitInfo.offNExecutedIns = (uint32_t)offsetof(Context, nExecutedIns);
+#pragma GCC diagnostic pop
+}
+
+void Runtime::_countFnCall(FnValue *fn) {
+	if ((_flags & (RT_NOJIT | RT_DEBUG)) || fn->_jitCode)
+		return;
+
+	// The count is not incremented atomically, which is too expensive for
+	// every call. Lost increments only delay the compilation, the count
+	// cannot skip the threshold since each store is one greater than a
+	// previous value.
+	uint32_t nCalls = fn->_nCalls.load(std::memory_order_relaxed) + 1;
+	fn->_nCalls.store(nCalls, std::memory_order_relaxed);
+
+	// The function is still interpreted, do not wait for the batch to be
+	// full.
+	if (nCalls == SLAKE_JIT_THRESHOLD + SLAKE_JIT_BATCH_DELAY) {
+		std::lock_guard<std::mutex> lock(_jitMutex);
+		_flushJITCode();
+		return;
+	}
+
+	if (nCalls != SLAKE_JIT_THRESHOLD)
+		return;
+
+	std::lock_guard<std::mutex> lock(_jitMutex);
+
+	// Several threads may reach the threshold concurrently, the function is
+	// compiled once.
+	if (fn->_pendingJITCode || fn->_jitCode)
+		return;
+
+	if (_pendingJITFns.empty())
+		_codeHeap.beginWrite();
+
+	// Functions which cannot be compiled are interpreted, the compiler is not
+	// retried since the count never reaches the threshold again.
+	ICodePage *code;
+	try {
+		code = compileFn(_codeHeap, fn, _jitInfo);
+	} catch (...) {
+		if (_pendingJITFns.empty())
+			_codeHeap.endWrite();
+		throw;
+	}
+	if (!code) {
+		if (_pendingJITFns.empty())
+			_codeHeap.endWrite();
+		return;
+	}
+
+	fn->_pendingJITCode = code;
+	_pendingJITFns.push_back(fn);
+
+	if (_pendingJITFns.size() >= SLAKE_JIT_BATCH_SIZE)
+		_flushJITCode();
+}
+
+void Runtime::_flushJITCode() {
+	if (_pendingJITFns.empty())
+		return;
+
+	_codeHeap.endWrite();
+
+	// Code of functions which were assigned since they were compiled was
+	// dropped by the assignments.
+	for (auto i : _pendingJITFns) {
+		if (auto code = std::exchange(i->_pendingJITCode, nullptr); code)
+			i->_jitCode.store(code, std::memory_order_release);
+	}
+	_pendingJITFns.clear();
+}
+
+bool Runtime::_isJITExitRequested(Context *context) {
+	return (context->flags & (CTX_YIELDED | CTX_PREEMPTED | _CTX_AWAITING)) ||
+		   _safepointRequested.load(std::memory_order_relaxed) ||
+		   _profilerTick.load(std::memory_order_relaxed) != _sampledProfilerTick ||
+		   (_szMemInUse > (_szMemUsedAfterLastGc << 1));
+}
+
+uint32_t Runtime::_jitExecIns(Runtime *rt, Context *context, MajorFrame *frame, JITFrameSlots *slots, uint32_t offIns) {
+	auto fn = frame->curFn;
+
+	try {
+		frame->curIns = offIns;
+		rt->_execIns(context, frame->curFn->body[offIns]);
+	} catch (...) {
+		_jitPendingExcept = std::current_exception();
+		return UINT32_MAX;
+	}
+
+	// Return to the interpreter if the instruction entered or left a frame,
+	// replaced the function of current frame with a tail call, or the
+	// runtime requested so.
+	if (&context->majorFrames.back() != frame ||
+		frame->curFn != fn ||
+		rt->_isJITExitRequested(context))
+		return UINT32_MAX;
+
+	// The instruction may have added registers or local variables.
+	_fillJITFrameSlots(frame, slots);
+	return frame->curIns;
+}
+
+uint32_t Runtime::_jitPoll(Runtime *rt, Context *context, MajorFrame *frame, uint32_t offIns) {
+	frame->curIns = offIns;
+
+	try {
+		rt->_pollBudget(context);
+	} catch (...) {
+		_jitPendingExcept = std::current_exception();
+		return UINT32_MAX;
+	}
+
+	if (rt->_isJITExitRequested(context))
+		return UINT32_MAX;
+	return offIns;
+}
+
+template <typename T>
+uint32_t Runtime::_jitStore(Runtime *rt, Context *context, MajorFrame *frame, void *var, uint64_t bits, uint32_t offIns) {
+	try {
+		((VarValue *)var)->setData(new LiteralValue<T, getValueType<T>()>(rt, (T)bits));
+	} catch (...) {
+		frame->curIns = offIns;
+		_jitPendingExcept = std::current_exception();
+		return UINT32_MAX;
+	}
+	return offIns + 1;
+}
+
+void Runtime::_execJITCode(Context *context) {
+	auto &frame = context->majorFrames.back();
+
+	JITFrameSlots slots;
+	_fillJITFrameSlots(&frame, &slots);
+
+	((JITFnEntry)frame.curFn->_jitCode.load(std::memory_order_acquire)->getPtr())(this, context, &frame, &slots, frame.curIns);
+
+	if (_jitPendingExcept) {
+		auto e = _jitPendingExcept;
+		_jitPendingExcept = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+#endif
@@ -0,0 +1,214 @@
+#include <slake/runtime.h>
+
+#include <set>
+
+using namespace slake;
+
+/// @brief Check if a reference can be resolved statically.
+/// @param ref Reference to check.
+/// @return true if the reference does not depend on the execution.
+static bool _isStaticRef(const RefValue *ref) {
+	for (auto &i : ref->entries) {
+		// Generic arguments may refer to generic parameters, and `base' is
+		// resolved from the current object.
+		if (i.genericArgs.size() || i.name == "base")
+			return false;
+	}
+	return true;
+}
+
+void Runtime::_linkType(const Type &type, std::deque<ValueRef<RefValue>> *unresolvedRefs) {
+	switch (type.typeId) {
+		case TypeId::Class:
+		case TypeId::Interface:
+		case TypeId::Trait:
+		case TypeId::Object: {
+			if (!type.isLoadingDeferred())
+				break;
+
+			auto ref = (RefValue *)type.getCustomTypeExData();
+			if (!_isStaticRef(ref))
+				break;
+
+			// Unresolvable types are left for loadDeferredType().
+			if (auto value = resolveRef(ref); value)
+				type.exData = value;
+			else if (unresolvedRefs)
+				unresolvedRefs->push_back(ref);
+			break;
+		}
+		case TypeId::Array:
+			_linkType(type.getArrayExData(), unresolvedRefs);
+			break;
+		case TypeId::Map:
+			_linkType(*type.getMapExData().first, unresolvedRefs);
+			_linkType(*type.getMapExData().second, unresolvedRefs);
+			break;
+		default:;
+	}
+}
+
+/// @brief Collect offsets of instructions which are jump destinations.
+/// @param fn Function to be scanned.
+/// @return Offsets of the destinations.
+static std::set<uint32_t> _collectJumpDests(const FnValue *fn) {
+	std::set<uint32_t> dests;
+
+	auto body = fn->getBody();
+	for (uint32_t i = 0; i < fn->getInsCount(); ++i) {
+		auto &ins = body[i];
+		switch (ins.opcode) {
+			case Opcode::JMP:
+			case Opcode::JT:
+			case Opcode::JF:
+			case Opcode::PUSHXH:
+			case Opcode::CONSTSW:
+				// Treat every offset-like operand as a destination.
+				for (auto j : ins.operands) {
+					if (j && j->getType() == TypeId::U32)
+						dests.insert(((U32Value *)j)->getData());
+				}
+				break;
+			default:;
+		}
+	}
+
+	return dests;
+}
+
+void Runtime::_linkFnBody(FnValue *fn, std::deque<ValueRef<RefValue>> *unresolvedRefs) {
+	_linkType(fn->returnType, unresolvedRefs);
+	for (auto &i : fn->paramTypes)
+		_linkType(i, unresolvedRefs);
+
+	// Instructions of methods and generic functions are duplicated for each
+	// object and instance, and references in them are resolved with the
+	// object, so only functions of modules are linked.
+	if (!fn->_parent || fn->_parent->getType() != TypeId::Module || fn->genericParams.size())
+		return;
+
+	auto body = fn->body;
+	if (!body)
+		return;
+
+	std::set<uint32_t> jumpDests = _collectJumpDests(fn);
+
+	for (uint32_t i = 0; i < fn->nIns; ++i) {
+		auto &ins = body[i];
+
+		for (auto j : ins.operands) {
+			if (j && j->getType() == TypeId::TypeName)
+				_linkType(((TypeNameValue *)j)->_data, unresolvedRefs);
+		}
+
+		if (ins.opcode != Opcode::LOAD || ins.operands.size() != 2)
+			continue;
+
+		auto ref = (RefValue *)ins.operands[1];
+		if (!ref || ref->getType() != TypeId::Ref || !_isStaticRef(ref))
+			continue;
+
+		// The reference is resolved from the module if the function was called
+		// by the host, and from the root value if it was called by CALL. Link it
+		// only if both of them get the same target.
+		Value *target = resolveRef(ref, fn->_parent);
+		if (!target) {
+			if (unresolvedRefs)
+				unresolvedRefs->push_back(ref);
+			continue;
+		}
+		if (target != resolveRef(ref))
+			continue;
+
+		ins.opcode = Opcode::STORE;
+		ins.operands[1] = target;
+
+		// Bind the function to the following call if it calls the register
+		// which the function was just stored into.
+		if (target->getType() != TypeId::Fn || i + 1 >= fn->nIns || jumpDests.count(i + 1))
+			continue;
+
+		auto dest = ins.operands[0];
+		auto &nextIns = body[i + 1];
+		if ((nextIns.opcode != Opcode::CALL && nextIns.opcode != Opcode::MCALL) || nextIns.operands.empty())
+			continue;
+
+		auto callee = nextIns.operands[0];
+		if (dest && callee &&
+			dest->getType() == TypeId::RegRef && callee->getType() == TypeId::RegRef &&
+			!((RegRefValue *)dest)->unwrapValue && ((RegRefValue *)callee)->unwrapValue &&
+			((RegRefValue *)dest)->index == ((RegRefValue *)callee)->index)
+			nextIns.operands[0] = target;
+	}
+}
+
+void Runtime::_linkScope(Scope *scope, std::deque<ValueRef<RefValue>> *unresolvedRefs) {
+	for (auto &i : scope->members) {
+		auto member = i.second;
+
+		switch (member->getType().typeId) {
+			case TypeId::Var:
+				_linkType(((VarValue *)member)->type, unresolvedRefs);
+				break;
+			case TypeId::Fn:
+				if (((BasicFnValue *)member)->isNative())
+					break;
+
+				// Lazily loaded bodies are linked on decoding.
+				if (((FnValue *)member)->isBodyLoaded())
+					_linkFnBody((FnValue *)member, unresolvedRefs);
+				else {
+					((FnValue *)member)->_linkBody = true;
+
+					_linkType(((FnValue *)member)->returnType, unresolvedRefs);
+					for (auto &j : ((FnValue *)member)->paramTypes)
+						_linkType(j, unresolvedRefs);
+				}
+				break;
+			case TypeId::Class: {
+				auto cls = (ClassValue *)member;
+
+				_linkType(cls->parentClass, unresolvedRefs);
+				for (auto &j : cls->implInterfaces)
+					_linkType(j, unresolvedRefs);
+				_linkScope(cls->scope, unresolvedRefs);
+				break;
+			}
+			case TypeId::Interface: {
+				auto value = (InterfaceValue *)member;
+
+				for (auto &j : value->parents)
+					_linkType(j, unresolvedRefs);
+				_linkScope(value->scope, unresolvedRefs);
+				break;
+			}
+			case TypeId::Trait: {
+				auto value = (TraitValue *)member;
+
+				for (auto &j : value->parents)
+					_linkType(j, unresolvedRefs);
+				_linkScope(value->scope, unresolvedRefs);
+				break;
+			}
+			default:;
+		}
+	}
+}
+
+std::deque<ValueRef<RefValue>> Runtime::linkModule(ModuleValue *mod) {
+	std::deque<ValueRef<RefValue>> unresolvedRefs;
+
+	// Bodies which may be executed by other threads are rewritten.
+	ExecScope execScope(this);
+	_stopTheWorldForUpdate();
+
+	try {
+		_linkScope(mod->scope, &unresolvedRefs);
+	} catch (...) {
+		_resumeTheWorld();
+		throw;
+	}
+	_resumeTheWorld();
+
+	return unresolvedRefs;
+}
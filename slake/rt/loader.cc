@@ -1,34 +1,217 @@
 #include <slake/runtime.h>
 
+#include <condition_variable>
+#include <functional>
+#include <map>
 #include <memory>
-#include <slake/util/stream.hh>
+#include <mutex>
 
 using namespace slake;
 
-/// @brief Read a single element from a stream.
+/// @brief Read a single element from an image.
 /// @tparam T Type of element to read.
-/// @param fs Stream to be read.
-/// @return Element read from the stream.
+/// @param fs Reader of the image.
+/// @return Element read from the image.
 template <typename T>
-static T _read(std::istream &fs) {
-	T value;
-	fs.read((char *)&value, sizeof(value));
-	return value;
+static inline T _read(ImageReader &fs) {
+	return fs.read<T>();
 }
 
-/// @brief Load a single reference value from a stream.
+/// @brief Read the image header and the section directory, and set the
+/// layout of the reader.
+/// @param fs Reader of the image, which is at the beginning of the image.
+/// @return Image header read from the image.
+static slxfmt::ImgHeader _readImgHeader(ImageReader &fs) {
+	slxfmt::ImgHeader ih = _read<slxfmt::ImgHeader>(fs);
+	if (memcmp(ih.magic, slxfmt::IMH_MAGIC, sizeof(slxfmt::IMH_MAGIC)))
+		throw LoaderError("Bad SLX magic");
+
+	ImageLayout layout;
+	layout.fmtVer = ih.fmtVer;
+
+	switch (ih.fmtVer) {
+		case 0:
+			break;
+		case 1: {
+			for (auto nSections = _read<uint32_t>(fs); nSections; --nSections) {
+				auto scd = _read<slxfmt::SectionDesc>(fs);
+
+				// Ignore unknown sections for compatibility.
+				if (scd.kind >= slxfmt::SCT_MAX)
+					continue;
+
+				if ((size_t)scd.off + scd.size > fs.getSize())
+					throw LoaderError("SLX section out of the image");
+
+				layout.sections[scd.kind] = { scd.off, scd.size, true };
+			}
+
+			for (auto i : { slxfmt::SCT_STRTAB, slxfmt::SCT_CONSTS, slxfmt::SCT_MAIN, slxfmt::SCT_CODE }) {
+				if (!layout.sections[i].present)
+					throw LoaderError("Missing required SLX section");
+			}
+
+			fs.seek(layout.sections[slxfmt::SCT_MAIN].off);
+			break;
+		}
+		default:
+			throw LoaderError("Bad SLX format version");
+	}
+
+	fs.setLayout(layout);
+	return ih;
+}
+
+/// @brief Get an entry of the string table.
+/// @param fs Reader of the image, the position will not be changed.
+/// @param index Index of the entry.
+/// @return View of the entry.
+static std::string_view _getStrTabEntry(ImageReader &fs, uint32_t index) {
+	auto &section = fs.getLayout().sections[slxfmt::SCT_STRTAB];
+	size_t savedOff = fs.tell();
+
+	fs.seek(section.off);
+	auto nStrings = _read<uint32_t>(fs);
+	if (index >= nStrings)
+		throw LoaderError("Invalid string index");
+
+	fs.skip(sizeof(uint32_t) * index);
+	auto begin = _read<uint32_t>(fs), end = _read<uint32_t>(fs);
+	if (end < begin)
+		throw LoaderError("Malformed string table");
+
+	fs.seek(section.off + sizeof(uint32_t) * (nStrings + 2) + begin);
+	auto s = fs.readView(end - begin);
+
+	fs.seek(savedOff);
+	return s;
+}
+
+/// @brief Read a name from an image.
+/// @param fs Reader of the image.
+/// @param len Length of the name, only used by v0 images.
+/// @return Name read from the image.
+static inline std::string _readName(ImageReader &fs, size_t len) {
+	if (fs.getLayout().fmtVer)
+		return std::string(_getStrTabEntry(fs, _read<uint32_t>(fs)));
+	return std::string(fs.readView(len));
+}
+
+/// @brief Skip a name in an image.
+/// @param fs Reader of the image.
+/// @param len Length of the name, only used by v0 images.
+static inline void _skipName(ImageReader &fs, size_t len) {
+	fs.skip(fs.getLayout().fmtVer ? sizeof(uint32_t) : len);
+}
+
+static void _skipType(ImageReader &fs, slxfmt::Type vt);
+
+/// @brief Skip a single reference value in an image.
+/// @param fs Reader of the image.
+static void _skipRef(ImageReader &fs) {
+	slxfmt::RefEntryDesc i;
+	do {
+		i = _read<slxfmt::RefEntryDesc>(fs);
+		_skipName(fs, i.lenName);
+		for (size_t j = i.nGenericArgs; j; --j)
+			_skipType(fs, _read<slxfmt::Type>(fs));
+	} while (i.flags & slxfmt::RSD_NEXT);
+}
+
+/// @brief Skip a single type name in an image.
+/// @param fs Reader of the image.
+/// @param vt Previous read value type.
+static void _skipType(ImageReader &fs, slxfmt::Type vt) {
+	switch (vt) {
+		case slxfmt::Type::Object:
+			_skipRef(fs);
+			break;
+		case slxfmt::Type::Array:
+			_skipType(fs, _read<slxfmt::Type>(fs));
+			break;
+		case slxfmt::Type::Map:
+			_skipType(fs, _read<slxfmt::Type>(fs));
+			_skipType(fs, _read<slxfmt::Type>(fs));
+			break;
+		case slxfmt::Type::GenericArg:
+			fs.skip(sizeof(uint8_t));
+			break;
+		default:;
+	}
+}
+
+/// @brief Skip a single value in an image without creating it.
+/// @param fs Reader of the image.
+static void _skipValue(ImageReader &fs) {
+	slxfmt::ValueDesc i = _read<slxfmt::ValueDesc>(fs);
+	switch (i.type) {
+		case slxfmt::Type::None:
+			break;
+		case slxfmt::Type::I8:
+		case slxfmt::Type::U8:
+			fs.skip(sizeof(uint8_t));
+			break;
+		case slxfmt::Type::I16:
+		case slxfmt::Type::U16:
+			fs.skip(sizeof(uint16_t));
+			break;
+		case slxfmt::Type::I32:
+		case slxfmt::Type::U32:
+		case slxfmt::Type::Reg:
+		case slxfmt::Type::RegValue:
+		case slxfmt::Type::LocalVar:
+		case slxfmt::Type::LocalVarValue:
+		case slxfmt::Type::Arg:
+		case slxfmt::Type::ArgValue:
+			fs.skip(sizeof(uint32_t));
+			break;
+		case slxfmt::Type::I64:
+		case slxfmt::Type::U64:
+			fs.skip(sizeof(uint64_t));
+			break;
+		case slxfmt::Type::Bool:
+			fs.skip(sizeof(bool));
+			break;
+		case slxfmt::Type::F32:
+			fs.skip(sizeof(float));
+			break;
+		case slxfmt::Type::F64:
+			fs.skip(sizeof(double));
+			break;
+		case slxfmt::Type::String:
+			fs.skip(fs.getLayout().fmtVer ? sizeof(uint32_t) : _read<uint32_t>(fs));
+			break;
+		case slxfmt::Type::Const:
+			fs.skip(sizeof(uint32_t));
+			break;
+		case slxfmt::Type::Ref:
+			_skipRef(fs);
+			break;
+		case slxfmt::Type::TypeName:
+			_skipType(fs, _read<slxfmt::Type>(fs));
+			break;
+		case slxfmt::Type::Array:
+			_skipType(fs, _read<slxfmt::Type>(fs));
+			for (auto n = _read<uint32_t>(fs); n; --n)
+				_skipValue(fs);
+			break;
+		default:
+			throw LoaderError("Invalid value type detected");
+	}
+}
+
+/// @brief Load a single reference value from an image.
 /// @param rt Runtime for the new value.
-/// @param fs Stream to be read.
-/// @return Reference value loaded from the stream.
-RefValue *Runtime::_loadRef(std::istream &fs) {
+/// @param fs Reader of the image.
+/// @return Reference value loaded from the image.
+RefValue *Runtime::_loadRef(ImageReader &fs) {
 	auto ref = std::make_unique<RefValue>(this);
 
 	slxfmt::RefEntryDesc i = { 0 };
 	while (true) {
 		i = _read<slxfmt::RefEntryDesc>(fs);
 
-		std::string name(i.lenName, '\0');
-		fs.read(name.data(), i.lenName);
+		std::string name = _readName(fs, i.lenName);
 
 		GenericArgList genericArgs;
 		for (size_t j = i.nGenericArgs; j; --j)
@@ -42,13 +225,12 @@ RefValue *Runtime::_loadRef(std::istream &fs) {
 	return ref.release();
 }
 
-/// @brief Load a single value from a stream.
+/// @brief Load a single value from an image.
 /// @param rt Runtime for the new value.
-/// @param fs Stream to be read.
-/// @return Value loaded from the stream.
-Value *Runtime::_loadValue(std::istream &fs) {
-	slxfmt::ValueDesc i = {};
-	fs.read((char *)&i, sizeof(i));
+/// @param fs Reader of the image.
+/// @return Value loaded from the image.
+Value *Runtime::_loadValue(ImageReader &fs) {
+	slxfmt::ValueDesc i = _read<slxfmt::ValueDesc>(fs);
 	switch (i.type) {
 		case slxfmt::Type::None:
 			return nullptr;
@@ -75,15 +257,62 @@ Value *Runtime::_loadValue(std::istream &fs) {
 		case slxfmt::Type::F64:
 			return new F64Value(this, _read<double>(fs));
 		case slxfmt::Type::String: {
-			auto len = _read<uint32_t>(fs);
-			std::string s(len, '\0');
-			fs.read(&(s[0]), len);
-			return new StringValue(this, s);
+			StringValue *value;
+			if (fs.getLayout().fmtVer)
+				value = new StringValue(this, std::string(_getStrTabEntry(fs, _read<uint32_t>(fs))));
+			else {
+				auto len = _read<uint32_t>(fs);
+				value = new StringValue(this, std::string(fs.readView(len)));
+			}
+
+			// Literals are not moved out by transferring clones.
+			value->_flags |= VF_LITERAL;
+			return value;
+		}
+		case slxfmt::Type::Const: {
+			if (!fs.getLayout().fmtVer)
+				throw LoaderError("Invalid value type detected");
+
+			auto &section = fs.getLayout().sections[slxfmt::SCT_CONSTS];
+			auto index = _read<uint32_t>(fs);
+			size_t savedOff = fs.tell();
+
+			auto consts = fs.getConsts();
+			if (consts && index < consts->size() && (*consts)[index])
+				return (*consts)[index];
+
+			fs.seek(section.off);
+			auto nConsts = _read<uint32_t>(fs);
+			if (index >= nConsts)
+				throw LoaderError("Invalid constant index");
+			fs.skip(sizeof(uint32_t) * index);
+			fs.seek(section.off + _read<uint32_t>(fs));
+
+			// Constants cannot refer to other constants.
+			if (_read<slxfmt::ValueDesc>(fs).type == slxfmt::Type::Const)
+				throw LoaderError("Invalid constant");
+			fs.seek(fs.tell() - sizeof(slxfmt::ValueDesc));
+
+			Value *value = _loadValue(fs);
+
+			if (consts) {
+				consts->resize(nConsts);
+				(*consts)[index] = value;
+			}
+
+			fs.seek(savedOff);
+			return value;
 		}
 		case slxfmt::Type::Ref:
 			return _loadRef(fs);
 		case slxfmt::Type::TypeName:
 			return new TypeNameValue(this, _loadType(fs, _read<slxfmt::Type>(fs)));
+		case slxfmt::Type::Array: {
+			auto value = std::make_unique<ArrayValue>(this, _loadType(fs, _read<slxfmt::Type>(fs)));
+			for (auto n = _read<uint32_t>(fs); n; --n)
+				value->values.push_back(_loadValue(fs));
+			return value.release();
+		}
 		case slxfmt::Type::Reg:
 			return new RegRefValue(this, _read<uint32_t>(fs));
 		case slxfmt::Type::RegValue:
@@ -101,12 +330,12 @@ Value *Runtime::_loadValue(std::istream &fs) {
 	}
 }
 
-/// @brief Load a single type name from a stream.
+/// @brief Load a single type name from an image.
 /// @param rt Runtime for the new type.
-/// @param fs Stream to be read.
+/// @param fs Reader of the image.
 /// @param vt Previous read value type.
 /// @return Loaded complete type name.
-Type Runtime::_loadType(std::istream &fs, slxfmt::Type vt) {
+Type Runtime::_loadType(ImageReader &fs, slxfmt::Type vt) {
 	switch (vt) {
 		case slxfmt::Type::I8:
 			return TypeId::I8;
@@ -153,14 +382,11 @@ Type Runtime::_loadType(std::istream &fs, slxfmt::Type vt) {
 	}
 }
 
-GenericParam Runtime::_loadGenericParam(std::istream &fs) {
+GenericParam Runtime::_loadGenericParam(ImageReader &fs) {
 	auto gpd = _read<slxfmt::GenericParamDesc>(fs);
 
-	std::string name(gpd.lenName, '\0');
-	fs.read(&(name[0]), gpd.lenName);
-
 	GenericParam param;
-	param.name = name;
+	param.name = _readName(fs, gpd.lenName);
 
 	if (gpd.hasBaseType)
 		param.baseType = _loadType(fs, _read<slxfmt::Type>(fs));
@@ -176,21 +402,102 @@ GenericParam Runtime::_loadGenericParam(std::istream &fs) {
 	return param;
 }
 
+/// @brief Decode a function body.
+/// @param fn Function to be decoded, the body will be allocated if it was not.
+/// @param fs Reader of the image, which is at the beginning of the body.
+void Runtime::_loadFnBody(FnValue *fn, ImageReader &fs) {
+	if (!fn->body) {
+		fn->body = new Instruction[fn->nIns];
+		fn->reportSizeAllocatedToRuntime(sizeof(Instruction) * fn->nIns);
+	}
+
+	auto body = fn->body;
+	for (uint32_t j = 0; j < fn->nIns; j++) {
+		slxfmt::InsHeader ih = _read<slxfmt::InsHeader>(fs);
+		if (!isValidOpcode(ih.opcode))
+			throw LoaderError("Invalid opcode");
+		body[j].opcode = ih.opcode;
+		// Operands may be left by a previous decoding which failed.
+		body[j].operands.clear();
+		for (uint8_t k = 0; k < ih.nOperands; k++)
+			body[j].operands.push_back(_loadValue(fs));
+	}
+
+	_verifyFnBody(fn);
+}
+
+/// @brief Decode a body which was left in the image by the loader.
+/// @param fn Function to be decoded.
+///
+/// @note This is the single place where a lazily loaded body becomes
+/// executable, any verification of the body should be done here.
+void Runtime::_loadLazyFnBody(FnValue *fn) {
+	auto lock = _lockLazyState();
+
+	// Decoded by another thread, or being linked by current thread.
+	if (!fn->_bodyImage)
+		return;
+
+	// The image is detached before linking, which reads the body again.
+	auto image = std::move(fn->_bodyImage);
+	try {
+		ImageReader fs(image);
+		_readImgHeader(fs);
+		fs.seek(fn->_offBody);
+
+		// Members of modules and their types share constants with the
+		// module, other copies of the function decode their own ones.
+		for (Value *i = fn->_parent; i; i = ((MemberValue *)i)->_parent) {
+			auto typeId = i->getType().typeId;
+			if (typeId == TypeId::Module) {
+				fs.setConsts(&((ModuleValue *)i)->consts);
+				break;
+			}
+			if (typeId != TypeId::Class && typeId != TypeId::Interface && typeId != TypeId::Trait)
+				break;
+		}
+
+		_loadFnBody(fn, fs);
+
+		if (fn->_linkBody)
+			_linkFnBody(fn);
+	} catch (...) {
+		// Keep the body undecoded, it is decoded from scratch by the next
+		// call, which throws the error again.
+		fn->_bodyImage = std::move(image);
+		throw;
+	}
+
+	fn->_offBody = 0;
+	fn->_isBodyLoaded.store(true, std::memory_order_release);
+}
+
+/// @brief Skip a function body without decoding it.
+/// @param fs Reader of the image.
+/// @param nIns Number of instructions in the body.
+static void _skipFnBody(ImageReader &fs, uint32_t nIns) {
+	while (nIns--) {
+		slxfmt::InsHeader ih = _read<slxfmt::InsHeader>(fs);
+		for (uint8_t k = 0; k < ih.nOperands; k++)
+			_skipValue(fs);
+	}
+}
+
 /// @brief Load a single scope.
 /// @param mod Module value which is treated as a scope.
-/// @param fs The input stream.
-void Runtime::_loadScope(ModuleValue *mod, std::istream &fs) {
+/// @param fs Reader of the image.
+void Runtime::_loadScope(ModuleValue *mod, ImageReader &fs) {
 	uint32_t nItemsToRead;
 
 	//
 	// Load variables.
 	//
 	nItemsToRead = _read<uint32_t>(fs);
+	mod->scope->members.reserve(mod->scope->members.size() + nItemsToRead);
 	for (slxfmt::VarDesc i = { 0 }; nItemsToRead--;) {
 		i = _read<slxfmt::VarDesc>(fs);
 
-		std::string name(i.lenName, '\0');
-		fs.read(name.data(), i.lenName);
+		std::string name = _readName(fs, i.lenName);
 
 		AccessModifier access = 0;
 		if (i.flags & slxfmt::VAD_PUB)
@@ -219,11 +526,11 @@ void Runtime::_loadScope(ModuleValue *mod, std::istream &fs) {
 	// Load functions.
 	//
 	nItemsToRead = _read<uint32_t>(fs);
+	mod->scope->members.reserve(mod->scope->members.size() + nItemsToRead);
 	for (slxfmt::FnDesc i = { 0 }; nItemsToRead--;) {
 		i = _read<slxfmt::FnDesc>(fs);
 
-		std::string name(i.lenName, '\0');
-		fs.read(name.data(), i.lenName);
+		std::string name = _readName(fs, i.lenName);
 
 		AccessModifier access = 0;
 		if (i.flags & slxfmt::FND_PUB)
@@ -237,7 +544,9 @@ void Runtime::_loadScope(ModuleValue *mod, std::istream &fs) {
 		// if (i.flags & slxfmt::FND_NATIVE)
 		//	access |= ACCESS_NATIVE;
 
-		std::unique_ptr<FnValue> fn = std::make_unique<FnValue>(this, (uint32_t)i.lenBody, access, _loadType(fs, _read<slxfmt::Type>(fs)));
+		// The body is allocated on decoding.
+		std::unique_ptr<FnValue> fn = std::make_unique<FnValue>(this, 0, access, _loadType(fs, _read<slxfmt::Type>(fs)));
+		fn->nIns = i.lenBody;
 
 		for (size_t j = 0; j < i.nGenericParams; ++j) {
 			fn->genericParams.push_back(_loadGenericParam(fs));
@@ -250,20 +559,47 @@ void Runtime::_loadScope(ModuleValue *mod, std::istream &fs) {
 		if (i.flags & slxfmt::FND_VARG)
 			/* stub */;
 
-		if (i.lenBody) {
-			auto body = fn->getBody();
+		if (auto &layout = fs.getLayout(); layout.fmtVer) {
+			// Bodies and SLDs are stored in their own sections.
+			auto fbl = _read<slxfmt::FnBodyLocDesc>(fs);
+			size_t savedOff = fs.tell();
+
+			if (i.lenBody) {
+				if (fs.getImage()) {
+					// Leave the body in the image and decode it on the first call.
+					fn->_bodyImage = fs.getImage();
+					fn->_offBody = layout.sections[slxfmt::SCT_CODE].off + fbl.offBody;
+					fn->_isBodyLoaded = false;
+				} else {
+					fs.seek(layout.sections[slxfmt::SCT_CODE].off + fbl.offBody);
+					_loadFnBody(fn.get(), fs);
+				}
+			}
 
-			for (uint32_t j = 0; j < i.lenBody; j++) {
-				slxfmt::InsHeader ih = _read<slxfmt::InsHeader>(fs);
-				body[j].opcode = ih.opcode;
-				for (uint8_t k = 0; k < ih.nOperands; k++)
-					body[j].operands.push_back(_loadValue(fs));
+			// SLDs are dropped if the debugging section was stripped.
+			if (layout.sections[slxfmt::SCT_DBG].present && i.nSourceLocDescs) {
+				fs.seek(layout.sections[slxfmt::SCT_DBG].off + fbl.offSourceLocDescs);
+				for (uint32_t j = 0; j < i.nSourceLocDescs; ++j)
+					fn->sourceLocDescs.push_back(_read<slxfmt::SourceLocDesc>(fs));
+			}
+
+			fs.seek(savedOff);
+		} else {
+			if (i.lenBody) {
+				if (fs.getImage()) {
+					// Leave the body in the image and decode it on the first call.
+					fn->_bodyImage = fs.getImage();
+					fn->_offBody = fs.tell();
+					fn->_isBodyLoaded = false;
+					_skipFnBody(fs, i.lenBody);
+				} else
+					_loadFnBody(fn.get(), fs);
 			}
-		}
 
-		for (uint32_t j = 0; j < i.nSourceLocDescs; ++j) {
-			slxfmt::SourceLocDesc sld = _read<slxfmt::SourceLocDesc>(fs);
-			fn->sourceLocDescs.push_back(sld);
+			for (uint32_t j = 0; j < i.nSourceLocDescs; ++j) {
+				slxfmt::SourceLocDesc sld = _read<slxfmt::SourceLocDesc>(fs);
+				fn->sourceLocDescs.push_back(sld);
+			}
 		}
 
 		mod->scope->putMember(name, fn.release());
@@ -273,11 +609,11 @@ void Runtime::_loadScope(ModuleValue *mod, std::istream &fs) {
 	// Load classes.
 	//
 	nItemsToRead = _read<uint32_t>(fs);
+	mod->scope->members.reserve(mod->scope->members.size() + nItemsToRead);
 	for (slxfmt::ClassTypeDesc i = {}; nItemsToRead--;) {
 		i = _read<slxfmt::ClassTypeDesc>(fs);
 
-		std::string name(i.lenName, '\0');
-		fs.read(name.data(), i.lenName);
+		std::string name = _readName(fs, i.lenName);
 
 		AccessModifier access = 0;
 		if (i.flags & slxfmt::CTD_PUB)
@@ -307,11 +643,11 @@ void Runtime::_loadScope(ModuleValue *mod, std::istream &fs) {
 	// Load interfaces.
 	//
 	nItemsToRead = _read<uint32_t>(fs);
+	mod->scope->members.reserve(mod->scope->members.size() + nItemsToRead);
 	for (slxfmt::InterfaceTypeDesc i = {}; nItemsToRead--;) {
 		i = _read<slxfmt::InterfaceTypeDesc>(fs);
 
-		std::string name(i.lenName, '\0');
-		fs.read(name.data(), i.lenName);
+		std::string name = _readName(fs, i.lenName);
 
 		AccessModifier access = 0;
 		if (i.flags & slxfmt::ITD_PUB)
@@ -334,11 +670,11 @@ void Runtime::_loadScope(ModuleValue *mod, std::istream &fs) {
 	// Load traits.
 	//
 	nItemsToRead = _read<uint32_t>(fs);
+	mod->scope->members.reserve(mod->scope->members.size() + nItemsToRead);
 	for (slxfmt::TraitTypeDesc i = {}; nItemsToRead--;) {
 		i = _read<slxfmt::TraitTypeDesc>(fs);
 
-		std::string name(i.lenName, '\0');
-		fs.read(name.data(), i.lenName);
+		std::string name = _readName(fs, i.lenName);
 
 		AccessModifier access = 0;
 		if (i.flags & slxfmt::TTD_PUB)
@@ -358,86 +694,430 @@ void Runtime::_loadScope(ModuleValue *mod, std::istream &fs) {
 	}
 }
 
-ValueRef<ModuleValue> slake::Runtime::loadModule(std::istream &fs, LoadModuleFlags flags) {
-	std::unique_ptr<ModuleValue> mod = std::make_unique<ModuleValue>(this, ACCESS_PUB);
-
-	slxfmt::ImgHeader ih;
-	fs.read((char *)&ih, sizeof(ih));
-	if (memcmp(ih.magic, slxfmt::IMH_MAGIC, sizeof(slxfmt::IMH_MAGIC)))
-		throw LoaderError("Bad SLX magic");
-	if (ih.fmtVer != 0)
-		throw LoaderError("Bad SLX format version");
-
+/// @brief Decode a module without publishing it or loading its imports.
+/// @param fs Reader of the image, which is at the beginning of the image.
+/// @param modNameOut Where to store the module name, set to null if absent.
+/// @param onImport Callback for each imported module, with the alias and the
+/// name of the imported module.
+/// @return Decoded module.
+ValueRef<ModuleValue> Runtime::_decodeModule(
+	ImageReader &fs,
+	ValueRef<RefValue> &modNameOut,
+	const std::function<void(const std::string &, RefValue *)> &onImport) {
+	auto beginTime = std::chrono::steady_clock::now();
+
+	// Values are registered into the runtime once they are created, modules
+	// which failed to decode are released by the garbage collector.
+	ValueRef<ModuleValue> mod = new ModuleValue(this, ACCESS_PUB);
+
+	slxfmt::ImgHeader ih = _readImgHeader(fs);
+	fs.setConsts(&mod->consts);
+
+	modNameOut = nullptr;
 	if (ih.flags & slxfmt::IMH_MODNAME) {
-		auto modName = _loadRef(fs);
-		if (!modName->entries.size())
+		modNameOut = _loadRef(fs);
+		if (!modNameOut->entries.size())
 			throw LoaderError("Empty module name with module name flag set");
+	}
+
+	for (uint8_t i = 0; i < ih.nImports; i++) {
+		std::string name = _readName(fs, fs.getLayout().fmtVer ? 0 : _read<uint32_t>(fs));
+
+		ValueRef<RefValue> moduleName = _loadRef(fs);
+
+		mod->imports[name] = moduleName.get();
+		onImport(name, moduleName.get());
+	}
+
+	_loadScope(mod.get(), fs);
+
+	{
+		auto endTime = std::chrono::steady_clock::now();
+		std::string name = modNameOut ? std::to_string(modNameOut.get()) : "<anonymous>";
+
+#if SLAKE_ENABLE_STATS
+		{
+			std::lock_guard<std::mutex> lock(_statsMutex);
+			_stats.moduleLoadTimes[name] += endTime - beginTime;
+		}
+#endif
+		if (_shouldTrace(TRACE_LOADS))
+			_addTraceEvent('X', "load", std::move(name), beginTime, endTime);
+	}
 
-		ValueRef<> curValue = (Value *)_rootValue;
+	return mod;
+}
+
+void Runtime::_publishModule(ModuleValue *mod, RefValue *modName, LoadModuleFlags flags) {
+	ValueRef<> curValue = (Value *)_rootValue;
 
-		// Create parent modules.
-		for (size_t i = 0; i < modName->entries.size() - 1; ++i) {
-			auto &name = modName->entries[i].name;
+	// Create parent modules.
+	for (size_t i = 0; i < modName->entries.size() - 1; ++i) {
+		auto &name = modName->entries[i].name;
 
-			if (!curValue->getMember(name)) {
-				// Create a new one if corresponding module does not present.
-				auto mod = new ModuleValue(this, ACCESS_PUB);
+		if (!curValue->getMember(name)) {
+			// Create a new one if corresponding module does not present.
+			auto mod = new ModuleValue(this, ACCESS_PUB);
 
-				if (curValue->getType() == TypeId::RootValue)
-					((RootValue *)curValue.get())->scope->putMember(name, mod);
-				else
-					((ModuleValue *)curValue.get())->scope->putMember(name, mod);
+			if (curValue->getType() == TypeId::RootValue)
+				((RootValue *)curValue.get())->scope->putMember(name, mod);
+			else
+				((ModuleValue *)curValue.get())->scope->putMember(name, mod);
 
-				curValue = (Value *)mod;
-			} else {
-				// Continue if the module presents.
-				curValue = curValue->getMember(name);
+			curValue = (Value *)mod;
+		} else {
+			// Continue if the module presents.
+			curValue = curValue->getMember(name);
+		}
+	}
+
+	auto lastName = modName->entries.back().name;
+	// Add current module.
+	if (curValue->getType() == TypeId::RootValue)
+		((RootValue *)curValue.get())->scope->putMember(lastName, mod);
+	else {
+		auto moduleValue = (ModuleValue *)curValue.get();
+
+		if (auto member = moduleValue->getMember(lastName); member) {
+			if (flags & LMOD_NORELOAD) {
+				if (member->getType() != TypeId::Module)
+					throw LoaderError(
+						"Value which corresponds to module name \"" + std::to_string(modName, this) + "\" was found, but is not a module");
 			}
+			if (flags & LMOD_NOCONFLICT)
+				throw LoaderError("Module \"" + std::to_string(modName, this) + "\" conflicted with existing value which is on the same path");
 		}
 
-		auto lastName = modName->entries.back().name;
-		// Add current module.
-		if (curValue->getType() == TypeId::RootValue)
-			((RootValue *)curValue.get())->scope->putMember(lastName, mod.get());
-		else {
-			auto moduleValue = (ModuleValue *)curValue.get();
-
-			if (auto member = moduleValue->getMember(lastName); member) {
-				if (flags & LMOD_NORELOAD) {
-					if (member->getType() != TypeId::Module)
-						throw LoaderError(
-							"Value which corresponds to module name \"" + std::to_string(modName, this) + "\" was found, but is not a module");
-				}
-				if (flags & LMOD_NOCONFLICT)
-					throw LoaderError("Module \"" + std::to_string(modName, this) + "\" conflicted with existing value which is on the same path");
+		moduleValue->scope->putMember(modName->entries.back().name, mod);
+	}
+}
+
+/// @brief Find a loaded module in the root value.
+/// @param root Root value of the runtime.
+/// @param ref Name of the module.
+/// @return The module, or null if it was not loaded.
+static ModuleValue *_findLoadedModule(RootValue *root, RefValue *ref) {
+	Value *curValue = root;
+	for (auto &i : ref->entries) {
+		if (!(curValue = curValue->getMember(i.name)))
+			return nullptr;
+	}
+	return curValue->getType() == TypeId::Module ? (ModuleValue *)curValue : nullptr;
+}
+
+namespace {
+	/// @brief A module in an import graph.
+	struct ModuleGraphNode final {
+		ValueRef<RefValue> ref;
+		std::shared_ptr<ModuleImage> image;
+
+		// Module which was loaded before, nodes with it are not decoded.
+		ModuleValue *loadedModule = nullptr;
+
+		ValueRef<ModuleValue> mod;
+		ValueRef<RefValue> modName;
+		std::deque<std::pair<std::string, ModuleGraphNode *>> imports;
+
+		inline ModuleValue *getModule() { return loadedModule ? loadedModule : mod.get(); }
+	};
+}
+
+ValueRef<ModuleValue> slake::Runtime::_loadModule(ImageReader &fs, LoadModuleFlags flags) {
+	// Decoded values are not reachable until they are published, so GC cycles
+	// are not started by other threads during loading.
+	ExecScope execScope(this);
+
+	if (flags & LMOD_NOIMPORT) {
+		ValueRef<RefValue> modName;
+		// The module is not reachable until it is published, the reference
+		// keeps it alive in case that another thread is collecting.
+		ValueRef<ModuleValue> mod = _decodeModule(fs, modName, [](const std::string &, RefValue *) {});
+
+		if (modName) {
+			_stopTheWorldForUpdate();
+			try {
+				_publishModule(mod.get(), modName.get(), flags);
+			} catch (...) {
+				_resumeTheWorld();
+				throw;
+			}
+			_resumeTheWorld();
+		}
+
+		return mod;
+	}
+
+	// Modules are loaded in three steps:
+	//
+	// 1. Imports are discovered from headers of the modules, and each module
+	//    is located and decoded once on the loader threads. Values are not
+	//    reachable from the root value during this step.
+	// 2. Modules are published into the root value in dependency order.
+	// 3. Modules are linked after all of them were published.
+	//
+	// Values are created by the loader threads without any lock since each
+	// thread has its own allocation buffer. Other executing threads are
+	// stopped during the last two steps.
+	//
+	// Imports which are discovered by the workers are looked up in the root
+	// value by the calling thread, which is the only one in an execution
+	// scope, so no module can be published by other threads meanwhile.
+	ModuleGraphNode root;
+	std::deque<std::unique_ptr<ModuleGraphNode>> depNodes;
+	std::map<std::string, ModuleGraphNode *> nodes;
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<ModuleGraphNode *> queue, lookupQueue;
+	std::deque<std::thread> threads;
+	size_t nRunning = 1;  // The root module is decoded by the calling thread.
+	bool done = false;
+	std::exception_ptr except;
+
+	unsigned int nMaxThreads = _nLoaderThreads ? _nLoaderThreads : std::thread::hardware_concurrency();
+	unsigned int nMaxWorkers = nMaxThreads > 1 ? nMaxThreads - 1 : 0;
+
+	std::function<void()> work;
+
+	// Workers are shared by concurrent loads of the runtime.
+	auto reserveWorker = [&]() {
+		unsigned int n = _nLoaderWorkers.load();
+		do {
+			if (n >= nMaxWorkers)
+				return false;
+		} while (!_nLoaderWorkers.compare_exchange_weak(n, n + 1));
+		return true;
+	};
+
+	// Called with the mutex locked.
+	auto checkDone = [&]() {
+		if (!nRunning && queue.empty() && lookupQueue.empty()) {
+			done = true;
+			cond.notify_all();
+		}
+	};
+
+	// Called by the calling thread with the mutex locked.
+	auto lookUp = [&]() {
+		while (!lookupQueue.empty()) {
+			auto node = lookupQueue.front();
+			lookupQueue.pop_front();
+
+			if ((node->loadedModule = _findLoadedModule(_rootValue, node->ref.get())) || except)
+				continue;
+
+			queue.push_back(node);
+			if (reserveWorker())
+				threads.emplace_back(work);
+			cond.notify_one();
+		}
+		checkDone();
+	};
+
+	auto decode = [&](ModuleGraphNode *node, ImageReader &fs) {
+		node->mod = _decodeModule(fs, node->modName, [&](const std::string &name, RefValue *ref) {
+			std::string fullName = std::to_string(ref);
+
+			std::lock_guard<std::mutex> lock(mutex);
+
+			// The root module may be imported by its dependencies.
+			if (node == &root && root.modName)
+				nodes.insert({ std::to_string(root.modName.get()), &root });
+
+			if (auto it = nodes.find(fullName); it != nodes.end()) {
+				node->imports.push_back({ name, it->second });
+				return;
+			}
+
+			auto dep = std::make_unique<ModuleGraphNode>();
+			dep->ref = ref;
+			node->imports.push_back({ name, dep.get() });
+
+			if (!except) {
+				lookupQueue.push_back(dep.get());
+				cond.notify_all();
 			}
 
-			moduleValue->scope->putMember(modName->entries.back().name, mod.get());
+			nodes[fullName] = dep.get();
+			depNodes.push_back(std::move(dep));
+		});
+	};
+
+	auto runTask = [&](ModuleGraphNode *node) {
+		try {
+			node->image = _locateModule(node->ref);
+
+			ImageReader fs(node->image);
+			decode(node, fs);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!except)
+				except = std::current_exception();
+			queue.clear();
+		}
+	};
+
+	work = [&]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			cond.wait(lock, [&]() { return done || !queue.empty(); });
+			if (done)
+				return;
+
+			auto node = queue.front();
+			queue.pop_front();
+			++nRunning;
+
+			lock.unlock();
+			runTask(node);
+			lock.lock();
+
+			--nRunning;
+			checkDone();
 		}
+	};
+
+	try {
+		decode(&root, fs);
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(mutex);
+		except = std::current_exception();
+		queue.clear();
 	}
 
-	for (uint8_t i = 0; i < ih.nImports; i++) {
-		auto len = _read<uint32_t>(fs);
-		std::string name(len, '\0');
-		fs.read(name.data(), len);
+	// Look imports up and help the workers until every module is decoded.
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		--nRunning;
+		checkDone();
+		while (true) {
+			cond.wait(lock, [&]() { return done || !queue.empty() || !lookupQueue.empty(); });
+			if (!lookupQueue.empty()) {
+				lookUp();
+				continue;
+			}
+			if (done)
+				break;
 
-		ValueRef<RefValue> moduleName = _loadRef(fs);
+			auto node = queue.front();
+			queue.pop_front();
+			++nRunning;
 
-		if (!(flags & LMOD_NOIMPORT)) {
-			std::unique_ptr<std::istream> moduleStream(_moduleLocator(this, moduleName));
-			if (!moduleStream)
-				throw LoaderError("Error finding module `" + std::to_string(moduleName) + "' for dependencies");
-			mod->scope->putMember(name, (MemberValue *)new AliasValue(this, 0, loadModule(*moduleStream.get(), LMOD_NORELOAD).get()));
+			lock.unlock();
+			runTask(node);
+			lock.lock();
+
+			--nRunning;
+			checkDone();
 		}
+	}
 
-		mod->imports[name] = moduleName.get();
+	for (auto &i : threads)
+		i.join();
+	_nLoaderWorkers -= (unsigned int)threads.size();
+
+	if (except)
+		std::rethrow_exception(except);
+
+	// Sort the modules in dependency order, dependencies come first.
+	std::deque<ModuleGraphNode *> sortedNodes;
+	std::set<ModuleGraphNode *> walkedNodes;
+	std::function<void(ModuleGraphNode *)> walk = [&](ModuleGraphNode *node) {
+		if (walkedNodes.count(node) || node->loadedModule)
+			return;
+		walkedNodes.insert(node);
+
+		for (auto &i : node->imports)
+			walk(i.second);
+		sortedNodes.push_back(node);
+	};
+	walk(&root);
+
+	// The modules are not reachable until they are published, references of
+	// the nodes keep them alive in case that another thread is collecting.
+	_stopTheWorldForUpdate();
+	try {
+		for (auto i : sortedNodes) {
+			if (i->modName)
+				_publishModule(i->mod.get(), i->modName.get(), i == &root ? flags : LMOD_NORELOAD);
+
+			// Members of the module take precedence over the aliases.
+			for (auto &j : i->imports) {
+				if (!i->mod->scope->members.count(j.first))
+					i->mod->scope->putMember(j.first, (MemberValue *)new AliasValue(this, 0, j.second->getModule()));
+			}
+		}
+
+		if (!(flags & LMOD_NOLINK)) {
+			for (auto i : sortedNodes)
+				_linkScope(i->mod->scope);
+		}
+	} catch (...) {
+		_resumeTheWorld();
+		throw;
 	}
+	_resumeTheWorld();
 
-	_loadScope(mod.get(), fs);
-	return mod.release();
+	return root.mod;
+}
+
+std::shared_ptr<ModuleImage> slake::Runtime::_locateModule(ValueRef<RefValue> moduleName) {
+	std::string name = std::to_string(moduleName.get());
+
+	std::shared_ptr<ModuleImage> image = _moduleImageCache->get(name);
+	if (image)
+		return image;
+
+	// Prefer the image locator, images can be parsed in place.
+	if (_moduleImageLocator)
+		image = _moduleImageLocator(this, moduleName);
+
+	if (!image && _moduleLocator) {
+		if (std::unique_ptr<std::istream> moduleStream = _moduleLocator(this, moduleName); moduleStream)
+			image = BufferedModuleImage::fromStream(*moduleStream);
+	}
+
+	if (!image)
+		throw LoaderError("Error finding module `" + name + "' for dependencies");
+
+	return _moduleImageCache->insert(name, image);
+}
+
+ValueRef<ModuleValue> slake::Runtime::importModule(ValueRef<RefValue> name, LoadModuleFlags flags) {
+	{
+		ExecScope execScope(this);
+		if (auto mod = _findLoadedModule(_rootValue, name.get()); mod)
+			return mod;
+	}
+
+	return loadModule(_locateModule(name), flags);
+}
+
+void slake::Runtime::clearModuleImageCache() {
+	_moduleImageCache->clear();
+}
+
+void slake::Runtime::setModuleImageCache(std::shared_ptr<ModuleImageCache> cache) {
+	if (!cache)
+		throw std::logic_error("Module image cache cannot be null");
+	_moduleImageCache = cache;
+}
+
+ValueRef<ModuleValue> slake::Runtime::loadModule(std::shared_ptr<ModuleImage> image, LoadModuleFlags flags) {
+	ImageReader fs(image);
+	return _loadModule(fs, flags);
+}
+
+ValueRef<ModuleValue> slake::Runtime::loadModule(std::istream &fs, LoadModuleFlags flags) {
+	return loadModule(BufferedModuleImage::fromStream(fs), flags);
 }
 
 ValueRef<ModuleValue> slake::Runtime::loadModule(const void *buf, size_t size, LoadModuleFlags flags) {
-	util::InputMemStream fs(buf, size);
-	return loadModule(fs, flags);
+	// The buffer is borrowed, so function bodies are decoded eagerly.
+	ImageReader fs(buf, size);
+	return _loadModule(fs, flags);
+}
+
+ValueRef<ModuleValue> slake::Runtime::loadModuleFile(const std::string &path, LoadModuleFlags flags) {
+	return loadModule(mapModuleFile(path), flags);
 }
@@ -0,0 +1,79 @@
+#include <slake/runtime.h>
+
+using namespace slake;
+
+void Runtime::startProfiler(unsigned int frequency) {
+	if (_profilerThread.joinable())
+		throw std::logic_error("The profiler is already running");
+	if (!frequency)
+		throw std::invalid_argument("Invalid profiler frequency");
+
+	auto interval = std::chrono::microseconds(1000000 / frequency);
+
+	{
+		std::lock_guard<std::mutex> lock(_profilerMutex);
+		_profilerStopping = false;
+		_profile.interval = interval;
+	}
+
+	_isProfiling = true;
+	_profilerThread = std::thread([this, interval]() { _profilerWork(interval); });
+}
+
+void Runtime::stopProfiler() {
+	if (!_profilerThread.joinable())
+		throw std::logic_error("The profiler is not running");
+
+	{
+		std::lock_guard<std::mutex> lock(_profilerMutex);
+		_profilerStopping = true;
+	}
+	_profilerCond.notify_all();
+
+	_profilerThread.join();
+	_isProfiling = false;
+}
+
+void Runtime::clearProfile() {
+	std::lock_guard<std::mutex> lock(_profilerMutex);
+	_profile.clear();
+}
+
+void Runtime::writeFoldedStacks(std::ostream &os) {
+	std::lock_guard<std::mutex> lock(_profilerMutex);
+	_profile.writeFoldedStacks(os);
+}
+
+void Runtime::writeProfileReport(std::ostream &os) {
+	std::lock_guard<std::mutex> lock(_profilerMutex);
+	_profile.writeReport(os);
+}
+
+void Runtime::_profilerWork(std::chrono::microseconds interval) {
+	std::unique_lock<std::mutex> lock(_profilerMutex);
+
+	while (!_profilerCond.wait_for(lock, interval, [this]() { return _profilerStopping; }))
+		_profilerTick.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Runtime::_takeSample(Context *context) {
+	if (!_isProfiling.load(std::memory_order_relaxed))
+		return;
+
+	// Names are resolved here since the functions may be released before the
+	// samples are written.
+	std::vector<ProfileFrame> frames;
+	for (Context *i = context; i; i = i->awaitee ? i->awaitee->_context.get() : nullptr) {
+		for (auto &j : i->majorFrames) {
+			// Bottom frames of the contexts and returned frames.
+			if (j.curIns >= j.curFn->nIns)
+				continue;
+
+			auto sld = j.curFn->getSourceLocationInfo(j.curIns);
+			frames.push_back({ getFullName(j.curFn), sld ? (uint32_t)sld->line : UINT32_MAX });
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(_profilerMutex);
+	_profile.addSample(std::this_thread::get_id(), frames);
+}
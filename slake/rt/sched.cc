@@ -0,0 +1,215 @@
+#include <slake/runtime.h>
+
+#include <algorithm>
+
+using namespace slake;
+
+void Runtime::startScheduler(unsigned int nWorkers) {
+	if (_schedWorkers.size())
+		throw std::logic_error("The scheduler is already running");
+
+	if (!nWorkers)
+		nWorkers = std::max(std::thread::hardware_concurrency(), 1u);
+
+	// Lazily initialized state is shared by the workers from now on, the
+	// runtime stays in multi-threaded mode after the workers were stopped.
+	_flags |= RT_MULTITHREADED;
+	_schedStopping = false;
+
+	for (unsigned int i = 0; i < nWorkers; ++i) {
+		_schedWorkers.push_back(std::make_unique<SchedWorker>());
+		_schedWorkers.back()->rt = this;
+	}
+	for (auto &i : _schedWorkers)
+		i->thread = std::thread([this, worker = i.get()]() { _schedWork(worker); });
+}
+
+void Runtime::stopScheduler() {
+	if (!_schedWorkers.size())
+		throw std::logic_error("The scheduler is not running");
+
+	auto except = _waitForTasks();
+
+	{
+		std::lock_guard<std::mutex> lock(_schedMutex);
+		_schedStopping = true;
+	}
+	_schedCond.notify_all();
+
+	for (auto &i : _schedWorkers)
+		i->thread.join();
+	_schedWorkers.clear();
+
+	if (except)
+		std::rethrow_exception(except);
+}
+
+ValueRef<ContextValue> Runtime::spawn(FnValue *fn, Value *thisObject, std::deque<Value *> args) {
+	if (!_schedWorkers.size())
+		throw std::logic_error("The scheduler is not running");
+
+	ValueRef<ContextValue> context;
+	{
+		// Values are created by the host thread, which has to be stopped by
+		// the garbage collector like the workers.
+		ExecScope execScope(this);
+
+		MajorFrame callerFrame(this);
+		callerFrame.nextArgStack.assign(args.begin(), args.end());
+		context = _newCoroutine(callerFrame, fn, thisObject);
+	}
+
+	// Native functions have been called synchronously.
+	if (!context->isDone())
+		schedule(context.get());
+
+	return context;
+}
+
+void Runtime::schedule(ContextValue *context) {
+	if (!_schedWorkers.size())
+		throw std::logic_error("The scheduler is not running");
+
+	// Contexts which are awaited or executed by other threads are rejected
+	// atomically.
+	ContextFlags flags = context->_context->claim(CTX_SCHEDULED, CTX_YIELDED | CTX_PREEMPTED);
+	if (flags & CTX_DONE)
+		throw std::logic_error("Scheduling a done context");
+	if (flags & (CTX_RUNNING | CTX_SCHEDULED))
+		throw std::logic_error("Scheduling a running context");
+
+	{
+		std::lock_guard<std::mutex> lock(_schedMutex);
+		++_nPendingTasks;
+	}
+	_pushTask(context, false);
+}
+
+void Runtime::waitForTasks() {
+	if (auto except = _waitForTasks(); except)
+		std::rethrow_exception(except);
+}
+
+std::exception_ptr Runtime::_waitForTasks() {
+	std::unique_lock<std::mutex> lock(_schedMutex);
+
+	_schedIdleCond.wait(lock, [this]() { return !_nPendingTasks; });
+
+	auto except = _schedExcept;
+	_schedExcept = nullptr;
+	return except;
+}
+
+void Runtime::_pushTask(ValueRef<ContextValue> task, bool yielded) {
+	SchedWorker *worker;
+	{
+		std::lock_guard<std::mutex> lock(_schedMutex);
+
+		// Contexts scheduled by a worker are queued to itself.
+		if (_curSchedWorker && _curSchedWorker->rt == this)
+			worker = _curSchedWorker;
+		else
+			worker = _schedWorkers[_nextSchedWorker++ % _schedWorkers.size()].get();
+
+		++_nQueuedTasks;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(worker->mutex);
+
+		// Workers take new contexts first, yielded ones are queued at the
+		// front to let the other contexts run, and are stolen first.
+		if (yielded)
+			worker->queue.push_front(std::move(task));
+		else
+			worker->queue.push_back(std::move(task));
+	}
+
+	_schedCond.notify_one();
+}
+
+bool Runtime::_popTask(SchedWorker *worker, ValueRef<ContextValue> &taskOut) {
+	bool found = false;
+
+	{
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		if (worker->queue.size()) {
+			taskOut = std::move(worker->queue.back());
+			worker->queue.pop_back();
+			found = true;
+		}
+	}
+
+	// Steal from the other workers.
+	if (!found) {
+		size_t nWorkers = _schedWorkers.size(), idx = 0;
+		while (_schedWorkers[idx].get() != worker)
+			++idx;
+
+		for (size_t i = 1; i < nWorkers && !found; ++i) {
+			auto victim = _schedWorkers[(idx + i) % nWorkers].get();
+
+			std::lock_guard<std::mutex> lock(victim->mutex);
+			if (victim->queue.size()) {
+				taskOut = std::move(victim->queue.front());
+				victim->queue.pop_front();
+				found = true;
+			}
+		}
+	}
+
+	if (found) {
+		std::lock_guard<std::mutex> lock(_schedMutex);
+		--_nQueuedTasks;
+	}
+
+	return found;
+}
+
+void Runtime::_runTask(ValueRef<ContextValue> task) {
+	auto context = task->_context;
+
+	// Queued contexts are owned by the scheduler, which passes them to the
+	// execution without releasing them.
+	context->flags = (context->flags & ~(CTX_SCHEDULED | CTX_YIELDED)) | CTX_RUNNING;
+
+	try {
+		context->majorFrames.back().curFn->_exec(context);
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(_schedMutex);
+		if (!_schedExcept)
+			_schedExcept = std::current_exception();
+	}
+
+	// Preempted contexts are left to the host, which may extend their
+	// budgets and schedule them again.
+	if (!(context->flags & (CTX_DONE | CTX_PREEMPTED))) {
+		context->flags = (context->flags & ~CTX_RUNNING) | CTX_SCHEDULED;
+		_pushTask(std::move(task), true);
+		return;
+	}
+	context->flags &= ~CTX_RUNNING;
+
+	std::lock_guard<std::mutex> lock(_schedMutex);
+	if (!--_nPendingTasks)
+		_schedIdleCond.notify_all();
+}
+
+void Runtime::_schedWork(SchedWorker *worker) {
+	_curSchedWorker = worker;
+
+	while (true) {
+		ValueRef<ContextValue> task;
+		if (_popTask(worker, task)) {
+			_runTask(std::move(task));
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_schedMutex);
+		_schedCond.wait(lock, [this]() { return _nQueuedTasks || _schedStopping; });
+		if (_schedStopping && !_nQueuedTasks)
+			break;
+	}
+
+	_curSchedWorker = nullptr;
+}
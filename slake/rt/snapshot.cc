@@ -0,0 +1,1001 @@
+#include <slake/runtime.h>
+#include <slake/slsfmt.h>
+
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace slake;
+
+/// @brief Get size of the values of a type in snapshot arenas.
+/// @return Size of the values, or 0 if the values cannot be written into
+/// snapshots.
+static size_t _getSnapshotValueSize(TypeId typeId) {
+	size_t size;
+	switch (typeId) {
+		case TypeId::RootValue:
+			size = sizeof(RootValue);
+			break;
+		case TypeId::Module:
+			size = sizeof(ModuleValue);
+			break;
+		case TypeId::Class:
+			size = sizeof(ClassValue);
+			break;
+		case TypeId::Interface:
+			size = sizeof(InterfaceValue);
+			break;
+		case TypeId::Trait:
+			size = sizeof(TraitValue);
+			break;
+		case TypeId::Object:
+			size = sizeof(ObjectValue);
+			break;
+		case TypeId::Var:
+			size = sizeof(VarValue);
+			break;
+		case TypeId::Fn:
+			size = sizeof(FnValue);
+			break;
+		case TypeId::Alias:
+			size = sizeof(AliasValue);
+			break;
+		case TypeId::Ref:
+			size = sizeof(RefValue);
+			break;
+		case TypeId::I8:
+			size = sizeof(I8Value);
+			break;
+		case TypeId::I16:
+			size = sizeof(I16Value);
+			break;
+		case TypeId::I32:
+			size = sizeof(I32Value);
+			break;
+		case TypeId::I64:
+			size = sizeof(I64Value);
+			break;
+		case TypeId::U8:
+			size = sizeof(U8Value);
+			break;
+		case TypeId::U16:
+			size = sizeof(U16Value);
+			break;
+		case TypeId::U32:
+			size = sizeof(U32Value);
+			break;
+		case TypeId::U64:
+			size = sizeof(U64Value);
+			break;
+		case TypeId::F32:
+			size = sizeof(F32Value);
+			break;
+		case TypeId::F64:
+			size = sizeof(F64Value);
+			break;
+		case TypeId::Bool:
+			size = sizeof(BoolValue);
+			break;
+		case TypeId::String:
+			size = sizeof(StringValue);
+			break;
+		case TypeId::WString:
+			size = sizeof(WStringValue);
+			break;
+		case TypeId::Char:
+			size = sizeof(CharValue);
+			break;
+		case TypeId::WChar:
+			size = sizeof(WCharValue);
+			break;
+		case TypeId::TypeName:
+			size = sizeof(TypeNameValue);
+			break;
+		case TypeId::Array:
+			size = sizeof(ArrayValue);
+			break;
+		case TypeId::RegRef:
+			size = sizeof(RegRefValue);
+			break;
+		case TypeId::LocalVarRef:
+			size = sizeof(LocalVarRefValue);
+			break;
+		case TypeId::ArgRef:
+			size = sizeof(ArgRefValue);
+			break;
+		default:
+			// Contexts hold native execution states.
+			return 0;
+	}
+
+	// Keep every value in the arenas aligned.
+	constexpr size_t align = alignof(std::max_align_t);
+	return (size + align - 1) & ~(align - 1);
+}
+
+namespace slake {
+	/// @brief State for writing a snapshot.
+	struct SnapshotWriter final {
+		std::unordered_map<const Value *, uint32_t> indices;
+		std::deque<Value *> values;
+
+		/// @brief Values which cannot be written, references to them are
+		/// written as null.
+		std::unordered_set<Value *> skippedValues;
+
+		std::string records;
+
+		template <typename T>
+		inline void put(const T &value) {
+			records.append((const char *)&value, sizeof(T));
+		}
+
+		inline void putString(const std::string &s) {
+			put((uint32_t)s.size());
+			records += s;
+		}
+
+		/// @brief Get index of a value, the value will be written later if
+		/// it was not seen before.
+		inline void putIndex(const Value *v) {
+			if (!v) {
+				put(slsfmt::IDX_NULL);
+				return;
+			}
+
+			if (!_getSnapshotValueSize(v->getType().typeId)) {
+				skippedValues.insert((Value *)v);
+				put(slsfmt::IDX_NULL);
+				return;
+			}
+
+			if (auto it = indices.find(v); it != indices.end()) {
+				put(it->second);
+				return;
+			}
+
+			uint32_t index = (uint32_t)values.size();
+			indices[v] = index;
+			values.push_back((Value *)v);
+			put(index);
+		}
+
+		void putType(const Type &type) {
+			put(type.typeId);
+			put(type.flags);
+
+			switch (type.typeId) {
+				case TypeId::Class:
+				case TypeId::Interface:
+				case TypeId::Trait:
+				case TypeId::Object:
+					putIndex(std::holds_alternative<Value *>(type.exData) ? type.getCustomTypeExData() : nullptr);
+					break;
+				case TypeId::Array: {
+					bool hasElementType = std::holds_alternative<Type *>(type.exData);
+					put(hasElementType);
+					if (hasElementType)
+						putType(type.getArrayExData());
+					break;
+				}
+				case TypeId::Map:
+					putType(*type.getMapExData().first);
+					putType(*type.getMapExData().second);
+					break;
+				case TypeId::GenericArg:
+					put(type.getGenericArgExData());
+					break;
+				default:;
+			}
+		}
+
+		inline void putTypes(const std::deque<Type> &types) {
+			put((uint32_t)types.size());
+			for (auto &i : types)
+				putType(i);
+		}
+
+		void putGenericParams(const GenericParamList &params) {
+			put((uint32_t)params.size());
+			for (auto &i : params) {
+				putString(i.name);
+				putType(i.baseType);
+				putTypes(i.interfaces);
+				putTypes(i.traits);
+			}
+		}
+	};
+
+	/// @brief State for restoring a snapshot.
+	struct SnapshotReader final {
+		ImageReader fs;
+		std::vector<slsfmt::ValueRecordDesc> dir;
+
+		// Values which correspond to the indices.
+		std::vector<Value *> values;
+		// Offsets of the new values in the arena.
+		std::vector<size_t> arenaOffsets;
+		char *arena = nullptr;
+		// Values which were bound to existing values in the runtime.
+		std::vector<bool> bound;
+		// Members to be put into existing modules after restoring.
+		std::deque<std::tuple<Scope *, std::string, uint32_t>> pendingMembers;
+
+		inline SnapshotReader(std::shared_ptr<ModuleImage> image) : fs(image) {}
+
+		template <typename T>
+		inline T read() {
+			return fs.read<T>();
+		}
+
+		inline std::string readString() {
+			return std::string(fs.readView(read<uint32_t>()));
+		}
+
+		inline uint32_t readIndex() {
+			auto index = read<uint32_t>();
+			if (index != slsfmt::IDX_NULL && index >= dir.size())
+				throw LoaderError("Invalid value index in snapshot");
+			return index;
+		}
+
+		inline Value *readValue() {
+			auto index = readIndex();
+			return index == slsfmt::IDX_NULL ? nullptr : values[index];
+		}
+
+		Type readType() {
+			auto typeId = read<TypeId>();
+			auto flags = read<TypeFlags>();
+
+			switch (typeId) {
+				case TypeId::Class:
+				case TypeId::Interface:
+				case TypeId::Trait:
+				case TypeId::Object:
+					return Type(typeId, readValue(), flags);
+				case TypeId::Array: {
+					Type type(TypeId::Array, flags);
+					if (read<bool>())
+						type.exData = new Type(readType());
+					return type;
+				}
+				case TypeId::Map: {
+					auto k = readType();
+					return Type(k, readType(), flags);
+				}
+				case TypeId::GenericArg:
+					return Type(read<uint8_t>(), flags);
+				default:
+					return Type(typeId, flags);
+			}
+		}
+
+		inline std::deque<Type> readTypes() {
+			std::deque<Type> types;
+			for (auto n = read<uint32_t>(); n; --n)
+				types.push_back(readType());
+			return types;
+		}
+
+		GenericParamList readGenericParams() {
+			GenericParamList params;
+			for (auto n = read<uint32_t>(); n; --n) {
+				GenericParam param;
+				param.name = readString();
+				param.baseType = readType();
+				param.interfaces = readTypes();
+				param.traits = readTypes();
+				params.push_back(param);
+			}
+			return params;
+		}
+	};
+}
+
+/// @brief Check if a type of values owns a scope in snapshots.
+static bool _isScopedSnapshotValue(TypeId typeId) {
+	switch (typeId) {
+		case TypeId::RootValue:
+		case TypeId::Module:
+		case TypeId::Class:
+		case TypeId::Interface:
+		case TypeId::Trait:
+		case TypeId::Object:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// @brief Check if a type of values are members in snapshots.
+static bool _isMemberSnapshotValue(TypeId typeId) {
+	switch (typeId) {
+		case TypeId::Module:
+		case TypeId::Class:
+		case TypeId::Interface:
+		case TypeId::Trait:
+		case TypeId::Var:
+		case TypeId::Fn:
+		case TypeId::Alias:
+			return true;
+		default:
+			return false;
+	}
+}
+
+void Runtime::_saveSnapshotValue(SnapshotWriter &w, Value *v) {
+	auto typeId = v->getType().typeId;
+
+	if (_isScopedSnapshotValue(typeId)) {
+		w.put((uint32_t)v->scope->members.size());
+		for (auto &i : v->scope->members) {
+			w.putString(i.first);
+			w.putIndex(i.second);
+		}
+	}
+
+	if (_isMemberSnapshotValue(typeId)) {
+		auto value = (MemberValue *)v;
+
+		w.put(value->getAccess());
+		w.putIndex(value->_parent);
+		w.putString(value->_name);
+		w.putTypes(value->_genericArgs);
+	}
+
+	switch (typeId) {
+		case TypeId::RootValue:
+			break;
+		case TypeId::Module: {
+			auto value = (ModuleValue *)v;
+
+			w.put((uint32_t)value->imports.size());
+			for (auto &i : value->imports) {
+				w.putString(i.first);
+				w.putIndex(i.second);
+			}
+			break;
+		}
+		case TypeId::Class: {
+			auto value = (ClassValue *)v;
+
+			w.putGenericParams(value->genericParams);
+			w.putType(value->parentClass);
+			w.putTypes(value->implInterfaces);
+			break;
+		}
+		case TypeId::Interface: {
+			auto value = (InterfaceValue *)v;
+
+			w.putGenericParams(value->genericParams);
+			w.putTypes(value->parents);
+			break;
+		}
+		case TypeId::Trait: {
+			auto value = (TraitValue *)v;
+
+			w.putGenericParams(((InterfaceValue *)value)->genericParams);
+			w.putTypes(value->parents);
+			w.putGenericParams(value->genericParams);
+			break;
+		}
+		case TypeId::Object: {
+			auto value = (ObjectValue *)v;
+
+			w.putIndex(value->_class);
+			w.putIndex(value->_parent);
+			w.put(value->objectFlags);
+			w.putTypes(value->_genericArgs);
+			break;
+		}
+		case TypeId::Var: {
+			auto value = (VarValue *)v;
+
+			w.putType(value->type);
+			w.put(value->flags);
+			w.putIndex(value->value);
+			break;
+		}
+		case TypeId::Fn: {
+			// Native functions cannot be serialized, they are bound to the
+			// functions registered by the host on restoring.
+			if (((BasicFnValue *)v)->isNative())
+				break;
+
+			auto value = (FnValue *)v;
+
+			w.putGenericParams(value->genericParams);
+			w.putTypes(value->paramTypes);
+			w.putType(value->returnType);
+
+			auto body = value->getBody();
+			w.put(value->nIns);
+			for (uint32_t i = 0; i < value->nIns; ++i) {
+				w.put(getGenericOpcode(body[i].opcode));
+				w.put((uint32_t)body[i].operands.size());
+				for (auto j : body[i].operands)
+					w.putIndex(j);
+			}
+
+			w.put((uint32_t)value->sourceLocDescs.size());
+			for (auto &i : value->sourceLocDescs)
+				w.put(i);
+			break;
+		}
+		case TypeId::Alias:
+			w.putIndex(((AliasValue *)v)->src);
+			break;
+		case TypeId::Ref: {
+			auto value = (RefValue *)v;
+
+			w.put((uint32_t)value->entries.size());
+			for (auto &i : value->entries) {
+				w.putString(i.name);
+				w.putTypes(i.genericArgs);
+			}
+			break;
+		}
+		case TypeId::I8:
+			w.put(((I8Value *)v)->getData());
+			break;
+		case TypeId::I16:
+			w.put(((I16Value *)v)->getData());
+			break;
+		case TypeId::I32:
+			w.put(((I32Value *)v)->getData());
+			break;
+		case TypeId::I64:
+			w.put(((I64Value *)v)->getData());
+			break;
+		case TypeId::U8:
+			w.put(((U8Value *)v)->getData());
+			break;
+		case TypeId::U16:
+			w.put(((U16Value *)v)->getData());
+			break;
+		case TypeId::U32:
+			w.put(((U32Value *)v)->getData());
+			break;
+		case TypeId::U64:
+			w.put(((U64Value *)v)->getData());
+			break;
+		case TypeId::F32:
+			w.put(((F32Value *)v)->getData());
+			break;
+		case TypeId::F64:
+			w.put(((F64Value *)v)->getData());
+			break;
+		case TypeId::Bool:
+			w.put(((BoolValue *)v)->getData());
+			break;
+		case TypeId::String:
+			w.putString(((StringValue *)v)->getData());
+			break;
+		case TypeId::WString: {
+			auto &data = ((WStringValue *)v)->getData();
+			w.put((uint32_t)data.size());
+			w.records.append((const char *)data.data(), data.size() * sizeof(char32_t));
+			break;
+		}
+		case TypeId::Char:
+			w.put(((CharValue *)v)->getData());
+			break;
+		case TypeId::WChar:
+			w.put(((WCharValue *)v)->getData());
+			break;
+		case TypeId::TypeName:
+			w.putType(((TypeNameValue *)v)->getData());
+			break;
+		case TypeId::Array: {
+			auto value = (ArrayValue *)v;
+
+			w.putType(value->type);
+			w.put((uint32_t)value->values.size());
+			for (auto i : value->values)
+				w.putIndex(i);
+			break;
+		}
+		case TypeId::RegRef:
+			w.put(((RegRefValue *)v)->index);
+			w.put(((RegRefValue *)v)->unwrapValue);
+			break;
+		case TypeId::LocalVarRef:
+			w.put(((LocalVarRefValue *)v)->index);
+			w.put(((LocalVarRefValue *)v)->unwrapValue);
+			break;
+		case TypeId::ArgRef:
+			w.put(((ArgRefValue *)v)->index);
+			w.put(((ArgRefValue *)v)->unwrapValue);
+			break;
+		default:
+			throw std::logic_error("Unhandled value type");
+	}
+}
+
+void Runtime::_bindSnapshotValue(SnapshotReader &r, uint32_t idx, Value *value) {
+	if (r.bound[idx])
+		return;
+
+	auto &vrd = r.dir[idx];
+	if ((TypeId)vrd.typeId != value->getType().typeId)
+		throw LoaderError("Value in snapshot conflicted with existing value which is on the same path");
+
+	r.values[idx] = value;
+	r.bound[idx] = true;
+
+	if (!_isScopedSnapshotValue((TypeId)vrd.typeId) || (TypeId)vrd.typeId == TypeId::Object)
+		return;
+
+	std::deque<std::pair<std::string, uint32_t>> members;
+
+	r.fs.seek(vrd.off);
+	for (auto n = r.read<uint32_t>(); n; --n) {
+		auto name = r.readString();
+		members.push_back({ name, r.readIndex() });
+	}
+
+	for (auto &i : members) {
+		if (i.second == slsfmt::IDX_NULL)
+			continue;
+
+		if (auto it = value->scope->members.find(i.first); it != value->scope->members.end())
+			_bindSnapshotValue(r, i.second, it->second);
+		else if (value->getType() == TypeId::Module || value->getType() == TypeId::RootValue) {
+			// New members of existing modules are merged into them.
+			r.pendingMembers.push_back({ value->scope, i.first, i.second });
+		}
+	}
+}
+
+Value *Runtime::_allocSnapshotValue(SnapshotReader &r, uint32_t idx) {
+	auto &vrd = r.dir[idx];
+	void *p = r.arena + r.arenaOffsets[idx];
+	Value *v;
+
+	switch ((TypeId)vrd.typeId) {
+		case TypeId::Module:
+			v = new (p) ModuleValue(this, 0);
+			break;
+		case TypeId::Class:
+			v = new (p) ClassValue(this, 0);
+			break;
+		case TypeId::Interface:
+			v = new (p) InterfaceValue(this, 0);
+			break;
+		case TypeId::Trait:
+			v = new (p) TraitValue(this, 0);
+			break;
+		case TypeId::Object:
+			v = new (p) ObjectValue(this, nullptr);
+			break;
+		case TypeId::Var:
+			v = new (p) VarValue(this, 0, TypeId::Any);
+			break;
+		case TypeId::Fn:
+			if (vrd.flags & slsfmt::VRD_NATIVE)
+				throw LoaderError("Native function in snapshot was not registered");
+			v = new (p) FnValue(this, 0, 0, TypeId::None);
+			break;
+		case TypeId::Alias:
+			// The source is set after all values are allocated.
+			v = new (p) AliasValue(this, 0, _rootValue);
+			break;
+		case TypeId::Ref:
+			v = new (p) RefValue(this);
+			break;
+		case TypeId::I8:
+			v = new (p) I8Value(this, 0);
+			break;
+		case TypeId::I16:
+			v = new (p) I16Value(this, 0);
+			break;
+		case TypeId::I32:
+			v = new (p) I32Value(this, 0);
+			break;
+		case TypeId::I64:
+			v = new (p) I64Value(this, 0);
+			break;
+		case TypeId::U8:
+			v = new (p) U8Value(this, 0);
+			break;
+		case TypeId::U16:
+			v = new (p) U16Value(this, 0);
+			break;
+		case TypeId::U32:
+			v = new (p) U32Value(this, 0);
+			break;
+		case TypeId::U64:
+			v = new (p) U64Value(this, 0);
+			break;
+		case TypeId::F32:
+			v = new (p) F32Value(this, 0);
+			break;
+		case TypeId::F64:
+			v = new (p) F64Value(this, 0);
+			break;
+		case TypeId::Bool:
+			v = new (p) BoolValue(this, false);
+			break;
+		case TypeId::String:
+			v = new (p) StringValue(this, "");
+			break;
+		case TypeId::WString:
+			v = new (p) WStringValue(this, U"");
+			break;
+		case TypeId::Char:
+			v = new (p) CharValue(this, 0);
+			break;
+		case TypeId::WChar:
+			v = new (p) WCharValue(this, 0);
+			break;
+		case TypeId::TypeName:
+			v = new (p) TypeNameValue(this, Type());
+			break;
+		case TypeId::Array:
+			v = new (p) ArrayValue(this, Type());
+			break;
+		case TypeId::RegRef:
+			v = new (p) RegRefValue(this, 0);
+			break;
+		case TypeId::LocalVarRef:
+			v = new (p) LocalVarRefValue(this, 0);
+			break;
+		case TypeId::ArgRef:
+			v = new (p) ArgRefValue(this, 0);
+			break;
+		default:
+			throw LoaderError("Invalid value type in snapshot");
+	}
+
+	v->_flags |= VF_ARENA;
+	return v;
+}
+
+void Runtime::_loadSnapshotValue(SnapshotReader &r, uint32_t idx) {
+	auto &vrd = r.dir[idx];
+	auto typeId = (TypeId)vrd.typeId;
+	auto v = r.values[idx];
+
+	r.fs.seek(vrd.off);
+
+	if (_isScopedSnapshotValue(typeId)) {
+		for (auto n = r.read<uint32_t>(); n; --n) {
+			auto name = r.readString();
+			auto member = r.readValue();
+			if (!member)
+				throw LoaderError("Null member in snapshot");
+
+			// Parents of the members are restored by themselves.
+			v->scope->members[name] = (MemberValue *)member;
+		}
+	}
+
+	if (_isMemberSnapshotValue(typeId)) {
+		auto value = (MemberValue *)v;
+
+		value->setAccess(r.read<AccessModifier>());
+		value->_parent = r.readValue();
+		value->_name = r.readString();
+		value->_genericArgs = r.readTypes();
+	}
+
+	switch (typeId) {
+		case TypeId::Module: {
+			auto value = (ModuleValue *)v;
+
+			for (auto n = r.read<uint32_t>(); n; --n) {
+				auto name = r.readString();
+				value->imports[name] = (RefValue *)r.readValue();
+			}
+			break;
+		}
+		case TypeId::Class: {
+			auto value = (ClassValue *)v;
+
+			value->genericParams = r.readGenericParams();
+			value->parentClass = r.readType();
+			value->implInterfaces = r.readTypes();
+			break;
+		}
+		case TypeId::Interface: {
+			auto value = (InterfaceValue *)v;
+
+			value->genericParams = r.readGenericParams();
+			value->parents = r.readTypes();
+			break;
+		}
+		case TypeId::Trait: {
+			auto value = (TraitValue *)v;
+
+			((InterfaceValue *)value)->genericParams = r.readGenericParams();
+			value->parents = r.readTypes();
+			value->genericParams = r.readGenericParams();
+			break;
+		}
+		case TypeId::Object: {
+			auto value = (ObjectValue *)v;
+
+			value->_class = (ClassValue *)r.readValue();
+			value->_parent = (ObjectValue *)r.readValue();
+			value->objectFlags = r.read<ObjectFlags>();
+			value->_genericArgs = r.readTypes();
+
+			if (value->_parent)
+				value->scope->parent = value->_parent->scope;
+			break;
+		}
+		case TypeId::Var: {
+			auto value = (VarValue *)v;
+
+			value->type = r.readType();
+			value->flags = r.read<VarFlags>();
+			value->value = r.readValue();
+			break;
+		}
+		case TypeId::Fn: {
+			auto value = (FnValue *)v;
+
+			value->genericParams = r.readGenericParams();
+			value->paramTypes = r.readTypes();
+			value->returnType = r.readType();
+
+			// Operands are relocated from the index table directly, so bodies
+			// which were linked are restored as linked.
+			if ((value->nIns = r.read<uint32_t>())) {
+				value->body = new Instruction[value->nIns];
+				value->reportSizeAllocatedToRuntime(sizeof(Instruction) * value->nIns);
+			}
+			for (uint32_t i = 0; i < value->nIns; ++i) {
+				auto &ins = value->body[i];
+
+				// Operands may not be restored yet, type-specialized
+				// instructions are not verified but restored as generic ones.
+				auto opcode = r.read<Opcode>();
+				if (!isValidOpcode(opcode))
+					throw LoaderError("Invalid opcode in snapshot");
+				ins.opcode = getGenericOpcode(opcode);
+				for (auto nOperands = r.read<uint32_t>(); nOperands; --nOperands)
+					ins.operands.push_back(r.readValue());
+			}
+
+			for (auto n = r.read<uint32_t>(); n; --n)
+				value->sourceLocDescs.push_back(r.read<slxfmt::SourceLocDesc>());
+			break;
+		}
+		case TypeId::Alias: {
+			auto value = (AliasValue *)v;
+
+			if (!(value->src = r.readValue()))
+				throw LoaderError("Null alias source in snapshot");
+			value->scope = value->src->scope;
+			break;
+		}
+		case TypeId::Ref: {
+			auto value = (RefValue *)v;
+
+			for (auto n = r.read<uint32_t>(); n; --n) {
+				auto name = r.readString();
+				value->entries.push_back(RefEntry(name, r.readTypes()));
+			}
+			break;
+		}
+		case TypeId::I8:
+			((I8Value *)v)->_data = r.read<int8_t>();
+			break;
+		case TypeId::I16:
+			((I16Value *)v)->_data = r.read<int16_t>();
+			break;
+		case TypeId::I32:
+			((I32Value *)v)->_data = r.read<int32_t>();
+			break;
+		case TypeId::I64:
+			((I64Value *)v)->_data = r.read<int64_t>();
+			break;
+		case TypeId::U8:
+			((U8Value *)v)->_data = r.read<uint8_t>();
+			break;
+		case TypeId::U16:
+			((U16Value *)v)->_data = r.read<uint16_t>();
+			break;
+		case TypeId::U32:
+			((U32Value *)v)->_data = r.read<uint32_t>();
+			break;
+		case TypeId::U64:
+			((U64Value *)v)->_data = r.read<uint64_t>();
+			break;
+		case TypeId::F32:
+			((F32Value *)v)->_data = r.read<float>();
+			break;
+		case TypeId::F64:
+			((F64Value *)v)->_data = r.read<double>();
+			break;
+		case TypeId::Bool:
+			((BoolValue *)v)->_data = r.read<bool>();
+			break;
+		case TypeId::String: {
+			auto s = r.readString();
+			((StringValue *)v)->setData(s);
+			break;
+		}
+		case TypeId::WString: {
+			auto len = r.read<uint32_t>();
+			auto bytes = r.fs.readView(len * sizeof(char32_t));
+			std::u32string s(len, U'\0');
+			memcpy(s.data(), bytes.data(), bytes.size());
+			((WStringValue *)v)->setData(s);
+			break;
+		}
+		case TypeId::Char:
+			((CharValue *)v)->_data = r.read<uint8_t>();
+			break;
+		case TypeId::WChar:
+			((WCharValue *)v)->_data = r.read<char32_t>();
+			break;
+		case TypeId::TypeName:
+			((TypeNameValue *)v)->_data = r.readType();
+			break;
+		case TypeId::Array: {
+			auto value = (ArrayValue *)v;
+
+			value->type = r.readType();
+			for (auto n = r.read<uint32_t>(); n; --n)
+				value->values.push_back(r.readValue());
+			break;
+		}
+		case TypeId::RegRef:
+			((RegRefValue *)v)->index = r.read<int32_t>();
+			((RegRefValue *)v)->unwrapValue = r.read<bool>();
+			break;
+		case TypeId::LocalVarRef:
+			((LocalVarRefValue *)v)->index = r.read<int32_t>();
+			((LocalVarRefValue *)v)->unwrapValue = r.read<bool>();
+			break;
+		case TypeId::ArgRef:
+			((ArgRefValue *)v)->index = r.read<uint32_t>();
+			((ArgRefValue *)v)->unwrapValue = r.read<bool>();
+			break;
+		default:;
+	}
+}
+
+std::deque<ValueRef<>> Runtime::saveSnapshot(std::ostream &fs) {
+	SnapshotWriter w;
+	std::vector<slsfmt::ValueRecordDesc> dir;
+
+	w.indices[_rootValue] = 0;
+	w.values.push_back(_rootValue);
+
+	// Values are appended while writing the records, so the directory is in
+	// the same order as the indices.
+	for (size_t i = 0; i < w.values.size(); ++i) {
+		auto v = w.values[i];
+
+		slsfmt::ValueRecordDesc vrd = {};
+		vrd.typeId = (uint8_t)v->getType().typeId;
+		vrd.off = (uint32_t)w.records.size();
+
+		if (v->getType() == TypeId::Fn && ((BasicFnValue *)v)->isNative())
+			vrd.flags |= slsfmt::VRD_NATIVE;
+		if (v->_flags & VF_LITERAL)
+			vrd.flags |= slsfmt::VRD_LITERAL;
+
+		_saveSnapshotValue(w, v);
+		dir.push_back(vrd);
+	}
+
+	size_t offRecords = sizeof(slsfmt::SnapshotHeader) + sizeof(slsfmt::ValueRecordDesc) * dir.size();
+	for (auto &i : dir)
+		i.off += (uint32_t)offRecords;
+
+	slsfmt::SnapshotHeader ssh = {};
+	memcpy(ssh.magic, slsfmt::SSH_MAGIC, sizeof(ssh.magic));
+	ssh.fmtVer = slsfmt::FMTVER_CURRENT;
+	ssh.nValues = (uint32_t)dir.size();
+
+	fs.write((const char *)&ssh, sizeof(ssh));
+	fs.write((const char *)dir.data(), sizeof(slsfmt::ValueRecordDesc) * dir.size());
+	fs.write(w.records.data(), w.records.size());
+
+	return std::deque<ValueRef<>>(w.skippedValues.begin(), w.skippedValues.end());
+}
+
+void Runtime::loadSnapshot(std::shared_ptr<ModuleImage> image) {
+	SnapshotReader r(image);
+
+	auto ssh = r.read<slsfmt::SnapshotHeader>();
+	if (memcmp(ssh.magic, slsfmt::SSH_MAGIC, sizeof(ssh.magic)))
+		throw LoaderError("Bad snapshot magic");
+	if (ssh.fmtVer != slsfmt::FMTVER_CURRENT)
+		throw LoaderError("Bad snapshot format version");
+	if (!ssh.nValues)
+		throw LoaderError("Empty snapshot");
+
+	r.dir.resize(ssh.nValues);
+	for (auto &i : r.dir) {
+		i = r.read<slsfmt::ValueRecordDesc>();
+		if (i.off >= r.fs.getSize())
+			throw LoaderError("Value record out of the snapshot");
+	}
+
+	r.values.resize(ssh.nValues);
+	r.bound.resize(ssh.nValues);
+
+	// Values on the paths which already present are bound to the existing
+	// values, e.g. native functions and modules registered by the host.
+	_bindSnapshotValue(r, 0, _rootValue);
+
+	// New values are laid out in a single arena, so the indices are
+	// relocated by adding their offsets to the arena instead of allocating
+	// the values one by one.
+	size_t szArena = 0;
+	uint32_t nNewValues = 0;
+	r.arenaOffsets.resize(ssh.nValues);
+	for (uint32_t i = 0; i < ssh.nValues; ++i) {
+		if (r.bound[i])
+			continue;
+
+		if (r.dir[i].flags & slsfmt::VRD_NATIVE)
+			throw LoaderError("Native function in snapshot was not registered");
+
+		size_t size = _getSnapshotValueSize((TypeId)r.dir[i].typeId);
+		if (!size || (TypeId)r.dir[i].typeId == TypeId::RootValue)
+			throw LoaderError("Invalid value type in snapshot");
+
+		r.arenaOffsets[i] = szArena;
+		szArena += size;
+		++nNewValues;
+	}
+
+	if (nNewValues) {
+		r.arena = (char *)::operator new(szArena);
+		{
+			std::lock_guard<std::mutex> lock(_valueArenasMutex);
+			_valueArenas[r.arena] = { szArena, nNewValues };
+		}
+
+		// New values are unreachable until they are put into the scopes,
+		// and will be collected by the GC if restoring fails.
+		uint32_t nConstructed = 0;
+		try {
+			for (uint32_t i = 0; i < ssh.nValues; ++i) {
+				if (!r.bound[i]) {
+					r.values[i] = _allocSnapshotValue(r, i);
+					++nConstructed;
+				}
+			}
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(_valueArenasMutex);
+
+			auto it = _valueArenas.find(r.arena);
+			if (!(it->second.nLive -= nNewValues - nConstructed)) {
+				::operator delete(r.arena);
+				_valueArenas.erase(it);
+			}
+			throw;
+		}
+	}
+
+	for (uint32_t i = 0; i < ssh.nValues; ++i) {
+		if (r.bound[i])
+			continue;
+
+		_loadSnapshotValue(r, i);
+		if (r.dir[i].flags & slsfmt::VRD_LITERAL)
+			r.values[i]->_flags |= VF_LITERAL;
+	}
+
+	// Lookup tables are built once the operands were restored.
+	for (uint32_t i = 0; i < ssh.nValues; ++i) {
+		if (!r.bound[i] && (TypeId)r.dir[i].typeId == TypeId::Fn)
+			_buildSwitchTables((FnValue *)r.values[i]);
+	}
+
+	for (auto &i : r.pendingMembers)
+		std::get<0>(i)->putMember(std::get<1>(i), (MemberValue *)r.values[std::get<2>(i)]);
+}
+
+void Runtime::loadSnapshotFile(const std::string &path) {
+	loadSnapshot(mapModuleFile(path));
+}
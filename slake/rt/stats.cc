@@ -0,0 +1,107 @@
+#include <slake/runtime.h>
+
+using namespace slake;
+
+#if SLAKE_ENABLE_STATS
+
+RuntimeStats Runtime::getStats() {
+	RuntimeStats stats;
+
+	// Values in the allocation buffers are counted once they are flushed.
+	_stopTheWorldForUpdate();
+
+	_flushAllocBuffers();
+
+	{
+		std::lock_guard<std::mutex> lock(_statsMutex);
+		stats = _stats;
+	}
+	stats.szInUse = _szMemInUse;
+
+	{
+		std::lock_guard<std::mutex> lock(_allocBuffersMutex);
+
+		for (auto &i : _allocBuffers) {
+			auto &buffer = *i.second;
+
+			for (size_t j = 0; j < N_OPCODES; ++j)
+				stats.nExecutedIns[j] += buffer.nExecutedIns[j].load(std::memory_order_relaxed);
+			stats.szAllocated += buffer.szAllocated.load(std::memory_order_relaxed);
+			stats.nGenericCacheHits += buffer.nGenericCacheHits.load(std::memory_order_relaxed);
+			stats.nGenericCacheMisses += buffer.nGenericCacheMisses.load(std::memory_order_relaxed);
+			stats.nQuickInsHits += buffer.nQuickInsHits.load(std::memory_order_relaxed);
+			stats.nQuickInsMisses += buffer.nQuickInsMisses.load(std::memory_order_relaxed);
+			stats.nInlineCacheHits += buffer.nInlineCacheHits.load(std::memory_order_relaxed);
+			stats.nInlineCacheMisses += buffer.nInlineCacheMisses.load(std::memory_order_relaxed);
+			stats.nNativeCalls += buffer.nNativeCalls.load(std::memory_order_relaxed);
+		}
+	}
+
+	_resumeTheWorld();
+
+#if SLAKE_ENABLE_JIT
+	{
+		auto codeHeapStats = _codeHeap.getStats();
+		stats.szCodeReserved = codeHeapStats.szReserved;
+		stats.szCodeInUse = codeHeapStats.szInUse;
+		stats.nCodeBlobs = codeHeapStats.nBlobs;
+		stats.nCodePages = codeHeapStats.nPages;
+		stats.nCodeProtectCalls = codeHeapStats.nProtectCalls;
+	}
+#endif
+
+	return stats;
+}
+
+void Runtime::startStatsDump(std::ostream &os, std::chrono::milliseconds interval, StatsFormat format) {
+	if (_statsDumpThread.joinable())
+		throw std::logic_error("Statistics are already being dumped");
+	if (interval.count() <= 0)
+		throw std::invalid_argument("Invalid statistics dump interval");
+
+	{
+		std::lock_guard<std::mutex> lock(_statsDumpMutex);
+		_statsDumpStopping = false;
+	}
+
+	_statsDumpThread = std::thread([this, &os, interval, format]() { _statsDumpWork(os, interval, format); });
+}
+
+void Runtime::stopStatsDump() {
+	if (!_statsDumpThread.joinable())
+		throw std::logic_error("Statistics are not being dumped");
+
+	{
+		std::lock_guard<std::mutex> lock(_statsDumpMutex);
+		_statsDumpStopping = true;
+	}
+	_statsDumpCond.notify_all();
+
+	_statsDumpThread.join();
+}
+
+void Runtime::_statsDumpWork(std::ostream &os, std::chrono::milliseconds interval, StatsFormat format) {
+	std::unique_lock<std::mutex> lock(_statsDumpMutex);
+
+	while (!_statsDumpCond.wait_for(lock, interval, [this]() { return _statsDumpStopping; })) {
+		// Threads which are stopping the dump may be waited by getStats().
+		lock.unlock();
+		auto stats = getStats();
+
+		switch (format) {
+			case StatsFormat::Text:
+				stats.writeText(os);
+				os << '\n';
+				break;
+			case StatsFormat::JSON:
+				stats.writeJSON(os);
+				os << '\n';
+				break;
+		}
+		os.flush();
+
+		lock.lock();
+	}
+}
+
+#endif
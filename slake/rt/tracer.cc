@@ -0,0 +1,104 @@
+#include <slake/runtime.h>
+
+using namespace slake;
+
+void Runtime::startTracing(const TraceOptions &options) {
+	std::lock_guard<std::mutex> lock(_traceMutex);
+
+	if (_isTracing)
+		throw std::logic_error("The tracer is already running");
+
+	_traceOptions = options;
+	_isTracing.store(true, std::memory_order_release);
+}
+
+void Runtime::stopTracing() {
+	std::lock_guard<std::mutex> lock(_traceMutex);
+
+	if (!_isTracing)
+		throw std::logic_error("The tracer is not running");
+
+	_isTracing = false;
+}
+
+void Runtime::clearTrace() {
+	std::lock_guard<std::mutex> lock(_traceMutex);
+	_trace.clear();
+}
+
+void Runtime::writeTrace(std::ostream &os) {
+	std::lock_guard<std::mutex> lock(_traceMutex);
+	_trace.writeJSON(os);
+}
+
+void Runtime::_addTraceEvent(
+	char phase,
+	const char *category,
+	std::string name,
+	std::chrono::steady_clock::time_point beginTime,
+	std::chrono::steady_clock::time_point endTime) {
+	std::lock_guard<std::mutex> lock(_traceMutex);
+
+	// The tracer may be stopped since the event was decided to be traced.
+	if (_isTracing.load(std::memory_order_relaxed))
+		_trace.addEvent(phase, category, std::move(name), beginTime, endTime);
+}
+
+void Runtime::_traceCall(Context *context, MajorFrame &frame) {
+	if (!_shouldTrace(TRACE_CALLS))
+		return;
+
+	if (++_nUnsampledCalls < _traceOptions.callSampleInterval)
+		return;
+	_nUnsampledCalls = 0;
+
+	std::string name = getFullName(frame.curFn);
+
+	if (_traceOptions.modules.size()) {
+		bool isIncluded = false;
+		for (auto &i : _traceOptions.modules) {
+			if (!name.compare(0, i.size(), i) && name.size() > i.size() && name[i.size()] == '.') {
+				isIncluded = true;
+				break;
+			}
+		}
+		if (!isIncluded)
+			return;
+	}
+
+	frame.isTraced = true;
+	if (context == _curContext)
+		_addTraceEvent('B', "call", std::move(name), std::chrono::steady_clock::now());
+}
+
+void Runtime::_traceReturn(MajorFrame &frame) {
+	frame.isTraced = false;
+	if (_shouldTrace(TRACE_CALLS))
+		_addTraceEvent('E', "call", {}, std::chrono::steady_clock::now());
+}
+
+void Runtime::_traceSwitchIn(Context *context, const char *reason) {
+	auto now = std::chrono::steady_clock::now();
+
+	if (reason && _shouldTrace(TRACE_SWITCHES))
+		_addTraceEvent('i', "switch", reason, now);
+
+	if (!_shouldTrace(TRACE_CALLS))
+		return;
+
+	for (auto &i : context->majorFrames) {
+		if (i.isTraced)
+			_addTraceEvent('B', "call", getFullName(i.curFn), now);
+	}
+}
+
+void Runtime::_traceSwitchOut(Context *context) {
+	if (!_shouldTrace(TRACE_CALLS))
+		return;
+
+	auto now = std::chrono::steady_clock::now();
+	for (auto i = context->majorFrames.rbegin(); i != context->majorFrames.rend(); ++i) {
+		if (i->isTraced)
+			_addTraceEvent('E', "call", {}, now);
+	}
+}
@@ -9,12 +9,63 @@ MajorFrame::MajorFrame(Runtime *rt) {
 	minorFrames.push_back(MinorFrame(0, 0));
 }
 
-Runtime::Runtime(RuntimeFlags flags) : _flags(flags) {
+thread_local Context *Runtime::_curContext = nullptr;
+thread_local Runtime *Runtime::_execRuntime = nullptr;
+thread_local Runtime::SchedWorker *Runtime::_curSchedWorker = nullptr;
+thread_local Runtime::AllocBufferCacheEntry Runtime::_curAllocBuffer;
+thread_local uint32_t Runtime::_sampledProfilerTick = 0;
+thread_local uint32_t Runtime::_nUnsampledCalls = 0;
+
+std::atomic_uint64_t Runtime::_nextId = 0;
+
+Runtime::Runtime(RuntimeFlags flags)
+	: _id(_nextId++),
+	  _moduleImageCache(std::make_shared<ModuleImageCache>()),
+	  _flags(flags) {
 	_rootValue = new RootValue(this);
+#if SLAKE_ENABLE_JIT
+	_initJIT();
+#endif
 }
 
 Runtime::~Runtime() {
+	if (_schedWorkers.size()) {
+		try {
+			stopScheduler();
+		} catch (...) {
+		}
+	}
+
+	if (_profilerThread.joinable())
+		stopProfiler();
+
+#if SLAKE_ENABLE_STATS
+	if (_statsDumpThread.joinable())
+		stopStatsDump();
+#endif
+
+	// States of native libraries may wait for their threads, or hold values
+	// of the runtime.
+	{
+		std::unordered_map<std::string, std::shared_ptr<NativeLibState>> nativeLibStates;
+		{
+			std::lock_guard<std::mutex> lock(_nativeLibStatesMutex);
+			nativeLibStates.swap(_nativeLibStates);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_callHandlesMutex);
+		for (auto i : _callHandles)
+			i->_detach();
+		_callHandles.clear();
+	}
+
 	_rootValue = nullptr;
+#if SLAKE_ENABLE_JIT
+	_jitBoolValues[0] = nullptr;
+	_jitBoolValues[1] = nullptr;
+#endif
 
 	gc();
 
@@ -22,6 +73,93 @@ Runtime::~Runtime() {
 	assert(!_szMemInUse);
 }
 
+Runtime::ExecScope::ExecScope(Runtime *rt) : _rt(rt), _savedRuntime(_execRuntime) {
+	_isCounted = _savedRuntime != rt && rt->_enterExecution();
+	_execRuntime = rt;
+}
+
+Runtime::ExecScope::~ExecScope() {
+	_execRuntime = _savedRuntime;
+	if (_isCounted)
+		_rt->_leaveExecution();
+}
+
+Runtime::BlockingScope::BlockingScope(Runtime *rt) : _rt(rt) {
+	// Executing threads are counted once by their outermost scopes.
+	_isUncounted = _execRuntime == rt;
+	if (_isUncounted) {
+		_execRuntime = nullptr;
+		rt->_leaveExecution();
+	}
+}
+
+Runtime::BlockingScope::~BlockingScope() {
+	if (_isUncounted) {
+		// Waits for the cycle which is in progress.
+		_rt->_enterExecution();
+		_execRuntime = _rt;
+	}
+}
+
+Runtime::AllocBuffer *Runtime::_lookupAllocBuffer() {
+	std::lock_guard<std::mutex> lock(_allocBuffersMutex);
+
+	auto &buffer = _allocBuffers[std::this_thread::get_id()];
+	if (!buffer)
+		buffer = std::make_unique<AllocBuffer>();
+
+	_curAllocBuffer = { _id, buffer.get() };
+	return buffer.get();
+}
+
+void Runtime::_flushAllocSize(AllocBuffer *buffer) {
+	// Sizes are added in modular arithmetic, the sum is exact once every
+	// buffer was flushed.
+	_szMemInUse.fetch_add((size_t)buffer->szDelta, std::memory_order_relaxed);
+	buffer->szDelta = 0;
+}
+
+void Runtime::_flushAllocBuffers() {
+	std::lock_guard<std::mutex> lock(_allocBuffersMutex);
+
+	for (auto &i : _allocBuffers) {
+		auto &buffer = *i.second;
+
+#if SLAKE_ENABLE_STATS
+		for (auto j : buffer.values)
+			++_stats.nAllocs[(size_t)j->getType().typeId];
+#endif
+
+		_createdValues.insert(buffer.values.begin(), buffer.values.end());
+		buffer.values.clear();
+		_flushAllocSize(&buffer);
+	}
+}
+
+void Runtime::_addRunningContext(Context *context) {
+	std::lock_guard<std::mutex> lock(_runningContextsMutex);
+
+	context->prevRunning = nullptr;
+	context->nextRunning = _runningContexts;
+	if (_runningContexts)
+		_runningContexts->prevRunning = context;
+	_runningContexts = context;
+}
+
+void Runtime::_removeRunningContext(Context *context) {
+	std::lock_guard<std::mutex> lock(_runningContextsMutex);
+
+	if (context->prevRunning)
+		context->prevRunning->nextRunning = context->nextRunning;
+	else
+		_runningContexts = context->nextRunning;
+	if (context->nextRunning)
+		context->nextRunning->prevRunning = context->prevRunning;
+
+	context->prevRunning = nullptr;
+	context->nextRunning = nullptr;
+}
+
 std::string Runtime::mangleName(
 	std::string name,
 	std::deque<Type> params,
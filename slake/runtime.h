@@ -1,19 +1,35 @@
 #ifndef _SLAKE_RUNTIME_H_
 #define _SLAKE_RUNTIME_H_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <sstream>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <set>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <slake/slxfmt.h>
 
 #include "except.h"
+#include "image.h"
 #include "generated/config.h"
+#include "util/atomic.hh"
 #include "util/debug.h"
 #include "value.h"
+#include "clone.h"
+#include "profile.h"
+#include "stats.h"
+#include "trace.h"
 #include "dbg/adapter.h"
 
+#if SLAKE_ENABLE_JIT
+	#include "jit/base.hh"
+#endif
+
 namespace slake {
 	struct ExceptionHandler final {
 		Type type;
@@ -22,10 +38,13 @@ namespace slake {
 
 	/// @brief Minor frames which are created by ENTER instructions and
 	/// destroyed by LEAVE instructions.
+	///
+	/// Frames use vectors, which do not allocate until they are used, so
+	/// frame stacks of suspended coroutines stay small.
 	struct MinorFrame final {
-		std::deque<ExceptionHandler> exceptHandlers;  // Exception handlers
+		std::vector<ExceptionHandler> exceptHandlers;  // Exception handlers
 
-		std::deque<Value *> dataStack;	// Data stack
+		std::vector<Value *> dataStack;	// Data stack
 		uint32_t nLocalVars = 0, nRegs = 0;
 
 		MinorFrame(uint32_t nLocalVars, uint32_t nRegs);
@@ -50,14 +69,15 @@ namespace slake {
 		Value *scopeValue = nullptr;		 // Scope value.
 		const FnValue *curFn = nullptr;		 // Current function.
 		uint32_t curIns = 0;				 // Offset of current instruction in function body.
-		std::deque<Value *> argStack;		 // Argument stack.
-		std::deque<Value *> nextArgStack;	 // Argument stack for next call.
-		std::deque<VarValue *> localVars;	 // Local variables.
-		std::deque<VarValue *> regs;		 // Local registers.
+		std::vector<Value *> argStack;		 // Argument stack.
+		std::vector<Value *> nextArgStack;	 // Argument stack for next call.
+		std::vector<VarValue *> localVars;	 // Local variables.
+		std::vector<VarValue *> regs;		 // Local registers.
 		Value *thisObject = nullptr;		 // `this' object.
 		Value *returnValue = nullptr;		 // Return value.
-		std::deque<MinorFrame> minorFrames;	 // Minor frames.
+		std::vector<MinorFrame> minorFrames;	 // Minor frames.
 		Value *curExcept = nullptr;			 // Current exception.
+		bool isTraced = false;				 // Whether the call is traced, see Runtime::startTracing().
 
 		MajorFrame(Runtime *rt);
 
@@ -81,15 +101,89 @@ namespace slake {
 		// Context execution has done (cannot be resumed).
 		CTX_DONE = 0x01,
 		// Yielded
-		CTX_YIELDED = 0x02;
+		CTX_YIELDED = 0x02,
+		// The context is being executed, by the host or by an AWAIT instruction.
+		CTX_RUNNING = 0x04,
+		// The context is queued by the scheduler.
+		CTX_SCHEDULED = 0x08,
+		// The context yielded since its budget was exhausted, see ExecBudget.
+		CTX_PREEMPTED = 0x10,
+		// The context is switching to the coroutine which it is awaiting.
+		_CTX_AWAITING = 0x80;
+
+	class ContextValue;
+
+	using BudgetAction = uint8_t;
+	constexpr static BudgetAction
+		// Yield the context, which can be resumed once the budget was extended.
+		BUDGET_YIELD = 0,
+		// Throw an InterruptedError, the context cannot be resumed.
+		BUDGET_INTERRUPT = 1;
+
+	/// @brief Budget of a context which is executed by the host.
+	///
+	/// Budgets are checked at backward branches and calls only, so loops and
+	/// recursions cannot run past them, and straight-line code between the
+	/// checks runs to the next check. Coroutines which are awaited by the
+	/// context are executed on its budget.
+	struct ExecBudget final {
+		using Clock = std::chrono::steady_clock;
 
+		/// @brief Number of instructions which may be executed, UINT64_MAX
+		/// for unlimited. Decreased by the executed instructions.
+		uint64_t fuel = UINT64_MAX;
+		/// @brief Time after which the execution is stopped.
+		Clock::time_point deadline = Clock::time_point::max();
+		/// @brief Action on exhaustion of the fuel or the deadline.
+		BudgetAction action = BUDGET_YIELD;
+
+		inline bool isLimited() const {
+			return fuel != UINT64_MAX || deadline != Clock::time_point::max();
+		}
+	};
+
+	/// @brief Execution context with its own stack of frames.
+	///
+	/// Contexts created by ACALL instructions are coroutines, which are
+	/// resumed by AWAIT instructions on the thread of the awaiting context
+	/// and run until they yield or return. Switching between them is done
+	/// by the execution loop, which only swaps the current context.
+	///
+	/// A context is executed by a single thread at a time, executions and
+	/// the scheduler claim it with claim() first.
 	struct Context final {
-		std::deque<MajorFrame> majorFrames;	 // Major frames, aka calling frames
-		ContextFlags flags = 0;				 // Flags
+		std::deque<MajorFrame> majorFrames;			 // Major frames, aka calling frames
+		util::CopyableAtomic<ContextFlags> flags = 0;	 // Flags
+		Context *resumer = nullptr;			 // Context which is awaiting the coroutine
+		ContextValue *awaitee = nullptr;	 // Coroutine which the context is awaiting
+		Context *prevRunning = nullptr;		 // Previous context executed by the host
+		Context *nextRunning = nullptr;		 // Next context executed by the host
+
+		ExecBudget budget;				   // Budget of executions by the host
+		uint64_t nExecutedIns = 0;		   // Number of instructions executed by the context
+		uint64_t nChargedIns = 0;		   // Number of executed instructions which were charged to a budget
+		std::chrono::nanoseconds execTime{};  // Wall time spent on executing the context
+
+		/// @brief Frames which were left by returns, storage of them is
+		/// reused by following calls.
+		std::vector<MajorFrame> freeFrames;
 
 		inline MajorFrame &getCurFrame() {
 			return majorFrames.back();
 		}
+
+		/// @brief Claim the context for an execution or for the scheduler.
+		/// @param flag CTX_RUNNING or CTX_SCHEDULED, which is set by the claim.
+		/// @param clearedFlags Flags which are cleared by the claim.
+		/// @return Flags before the claim, the claim failed if CTX_DONE,
+		/// CTX_RUNNING or CTX_SCHEDULED was set.
+		inline ContextFlags claim(ContextFlags flag, ContextFlags clearedFlags = 0) {
+			ContextFlags oldFlags = flags.load();
+			while (!(oldFlags & (CTX_DONE | CTX_RUNNING | CTX_SCHEDULED)) &&
+				   !flags.compare_exchange_weak(oldFlags, (ContextFlags)((oldFlags & ~clearedFlags) | flag)))
+				;
+			return oldFlags;
+		}
 	};
 
 	using RuntimeFlags = uint32_t;
@@ -102,6 +196,9 @@ namespace slake {
 		RT_GCDBG = 0x0000004,
 		// Enable strict mode
 		RT_STRICT = 0x00000008,
+		// Multi-threaded mode, set for runtimes which are used by several
+		// threads concurrently, see Runtime::ExecScope.
+		RT_MULTITHREADED = 0x00000010,
 		// The runtime is in a GC cycle.
 		_RT_INGC = 0x40000000,
 		// The runtime is destructing.
@@ -109,6 +206,8 @@ namespace slake {
 
 	using ModuleLocatorFn = std::function<
 		std::unique_ptr<std::istream>(Runtime *rt, ValueRef<RefValue> ref)>;
+	using ModuleImageLocatorFn = std::function<
+		std::shared_ptr<ModuleImage>(Runtime *rt, ValueRef<RefValue> ref)>;
 
 	using LoadModuleFlags = uint8_t;
 	constexpr LoadModuleFlags
@@ -119,16 +218,141 @@ namespace slake {
 		// Throw an exception if module that corresponds to the module name exists.
 		LMOD_NOCONFLICT = 0x04,
 		// Do not import modules automatically.
-		LMOD_NOIMPORT = 0x08;
+		LMOD_NOIMPORT = 0x08,
+		// Do not resolve references to direct pointers after loading, it is
+		// implied by LMOD_NOIMPORT.
+		LMOD_NOLINK = 0x10;
+
+	struct SnapshotWriter;
+	struct SnapshotReader;
+	class CallHandle;
+
+	/// @brief Base of states which native libraries keep per runtime, see
+	/// Runtime::getNativeLibState().
+	class NativeLibState {
+	public:
+		virtual ~NativeLibState() = default;
+	};
 
+	/// @brief Runtime which loads and executes modules.
+	///
+	/// A runtime can be shared by several threads in multi-threaded mode
+	/// (RT_MULTITHREADED), which is set by startScheduler() implicitly:
+	///
+	/// - Threads which touch values outside executions, e.g. host threads
+	///   which create arguments or read results, have to do it in an
+	///   ExecScope. Executions and loadModule() enter their own scopes.
+	/// - Each thread registers created values and reports sizes into its own
+	///   allocation buffer, the buffers are flushed into the runtime by the
+	///   garbage collector only.
+	/// - A GC cycle stops every thread in a scope at its next safepoint.
+	///   Modules are published and linked with the threads stopped as well.
+	/// - Lazily decoded bodies, deferred types and the generic cache are
+	///   guarded by a single lock. Lookup tables of CONSTSW are built when
+	///   the bodies are decoded.
+	/// - Feedback of instructions and in-place rewrites of opcodes are
+	///   relaxed atomics without further synchronization. Every variant of
+	///   an instruction checks its operands, so threads which see a stale
+	///   opcode execute the instruction correctly either way.
+	///
+	/// Values are not locked, synchronizing accesses of scripts to shared
+	/// objects is up to the scripts.
 	class Runtime final {
 	private:
 		/// @brief Root value of the runtime.
 		RootValue *_rootValue;
 
+		/// @brief Unique ID of the runtime, addresses of runtimes are reused
+		/// and cannot be used as keys of the thread-local caches.
+		const uint64_t _id;
+		static std::atomic_uint64_t _nextId;
+
 		/// @brief Contains all created values.
 		std::set<Value *> _createdValues, _walkedValues, _destructedValues;
 
+		/// @brief Block of memory which values are constructed in together,
+		/// see VF_ARENA.
+		struct ValueArena {
+			size_t size;
+			/// @brief Number of values which are not destructed yet, the
+			/// arena is freed once it reaches zero.
+			size_t nLive = 0;
+		};
+		/// @brief Arenas of the values restored from snapshots, keyed by
+		/// their beginnings.
+		std::map<char *, ValueArena> _valueArenas;
+		std::mutex _valueArenasMutex;
+
+		/// @brief Destruct a value which is not referenced any more and free
+		/// its memory.
+		void _destroyValue(Value *v);
+
+		/// @brief Values created by a thread and sizes reported by it, which
+		/// were not flushed into the runtime yet.
+		struct AllocBuffer {
+			std::vector<Value *> values;
+			ptrdiff_t szDelta = 0;
+
+#if SLAKE_ENABLE_STATS
+			/// @brief Counters of the thread, which are only written by the
+			/// thread and summed up by getStats().
+			std::atomic_uint64_t nExecutedIns[N_OPCODES] = {};
+			std::atomic_uint64_t szAllocated = 0;
+			std::atomic_uint64_t nGenericCacheHits = 0, nGenericCacheMisses = 0;
+			std::atomic_uint64_t nQuickInsHits = 0, nQuickInsMisses = 0;
+			std::atomic_uint64_t nInlineCacheHits = 0, nInlineCacheMisses = 0;
+			std::atomic_uint64_t nNativeCalls = 0;
+#endif
+		};
+
+		/// @brief Sizes reported by a thread are added to _szMemInUse once
+		/// they exceed the threshold.
+		static constexpr ptrdiff_t SZ_ALLOC_BUFFER_FLUSH = 64 * 1024;
+
+		std::map<std::thread::id, std::unique_ptr<AllocBuffer>> _allocBuffers;
+		std::mutex _allocBuffersMutex;
+
+		struct AllocBufferCacheEntry {
+			uint64_t rtId = UINT64_MAX;
+			AllocBuffer *buffer = nullptr;
+		};
+		/// @brief Allocation buffer of the runtime which current thread used
+		/// last time.
+		static thread_local AllocBufferCacheEntry _curAllocBuffer;
+
+		inline AllocBuffer *_getAllocBuffer() {
+			if (_curAllocBuffer.rtId == _id)
+				return _curAllocBuffer.buffer;
+			return _lookupAllocBuffer();
+		}
+		AllocBuffer *_lookupAllocBuffer();
+		/// @brief Add sizes reported by current thread to _szMemInUse.
+		void _flushAllocSize(AllocBuffer *buffer);
+		/// @brief Move values in every allocation buffer into _createdValues,
+		/// only called with other threads stopped.
+		void _flushAllocBuffers();
+
+#if SLAKE_ENABLE_STATS
+		/// @brief Add to a counter of current thread, the counter is only
+		/// written by the thread so no atomic read-modify-write is needed.
+		static inline void _countStat(std::atomic_uint64_t &counter, uint64_t n = 1) {
+			counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		/// @brief Statistics which are not counted per thread. GC statistics
+		/// and numbers of allocations are updated with other threads stopped,
+		/// module load times are guarded by _statsMutex.
+		RuntimeStats _stats;
+		std::mutex _statsMutex;
+
+		std::thread _statsDumpThread;
+		std::mutex _statsDumpMutex;
+		std::condition_variable _statsDumpCond;
+		bool _statsDumpStopping = false;
+
+		void _statsDumpWork(std::ostream &os, std::chrono::milliseconds interval, StatsFormat format);
+#endif
+
 		struct GenericLookupEntry {
 			Value *originalValue;
 			GenericArgList genericArgs;
@@ -148,6 +372,19 @@ namespace slake {
 		/// @brief Cached instances of generic values.
 		mutable GenericCacheDirectory _genericCacheDir;
 
+		/// @brief Guards lazily initialized state which is shared between
+		/// threads: undecoded bodies, deferred types and the generic cache.
+		mutable std::recursive_mutex _lazyStateMutex;
+
+		/// @brief Lock _lazyStateMutex in multi-threaded mode.
+		inline std::unique_lock<std::recursive_mutex> _lockLazyState() const {
+			if (_flags & RT_MULTITHREADED)
+				return std::unique_lock<std::recursive_mutex>(_lazyStateMutex);
+			return {};
+		}
+
+		/// @note Only called by destructors in GC cycles, which are done with
+		/// the other threads stopped.
 		inline void invalidateGenericCache(Value *i) {
 			if (_genericCacheLookupTable.count(i)) {
 				// Remove the value from generic cache if it is unreachable.
@@ -163,30 +400,140 @@ namespace slake {
 			}
 		}
 
-		/// @brief Size of memory allocated for values.
-		size_t _szMemInUse = 0;
+		/// @brief Size of memory allocated for values, sizes which were not
+		/// flushed from the allocation buffers are not included.
+		std::atomic_size_t _szMemInUse = 0;
 		/// @brief Size of memory allocated for values after last GC cycle.
 		size_t _szMemUsedAfterLastGc = 0;
 
 		/// @brief Module locator for importing.
 		ModuleLocatorFn _moduleLocator;
+		/// @brief Module image locator for importing, preferred over the module locator.
+		ModuleImageLocatorFn _moduleImageLocator;
+
+		/// @brief Images of imported modules, which may be shared with other
+		/// runtimes.
+		std::shared_ptr<ModuleImageCache> _moduleImageCache;
+
+		/// @brief Maximum number of threads for loading modules, 0 for number of hardware threads.
+		unsigned int _nLoaderThreads = 0;
+		/// @brief Number of worker threads which are loading modules.
+		std::atomic_uint _nLoaderWorkers = 0;
+
+		RefValue *_loadRef(ImageReader &fs);
+		Value *_loadValue(ImageReader &fs);
+		Type _loadType(ImageReader &fs, slxfmt::Type vt);
+		GenericParam _loadGenericParam(ImageReader &fs);
+		void _loadScope(ModuleValue *mod, ImageReader &fs);
+		void _loadFnBody(FnValue *fn, ImageReader &fs);
+		/// @brief Verify type-specialized instructions and tail calls of a
+		/// decoded body, the ones which are not safe are rewritten into the
+		/// generic ones. Specialized comparisons followed by jumps on their
+		/// results are fused into superinstructions.
+		void _verifyFnBody(FnValue *fn);
+		/// @brief Build lookup tables of the CONSTSW instructions of a body,
+		/// which are read by the executions without locking.
+		void _buildSwitchTables(FnValue *fn);
+		void _loadLazyFnBody(FnValue *fn);
+		ValueRef<ModuleValue> _decodeModule(
+			ImageReader &fs,
+			ValueRef<RefValue> &modNameOut,
+			const std::function<void(const std::string &, RefValue *)> &onImport);
+		void _publishModule(ModuleValue *mod, RefValue *modName, LoadModuleFlags flags);
+		ValueRef<ModuleValue> _loadModule(ImageReader &fs, LoadModuleFlags flags);
+		std::shared_ptr<ModuleImage> _locateModule(ValueRef<RefValue> moduleName);
+
+		void _linkType(const Type &type, std::deque<ValueRef<RefValue>> *unresolvedRefs = nullptr);
+		void _linkFnBody(FnValue *fn, std::deque<ValueRef<RefValue>> *unresolvedRefs = nullptr);
+		void _linkScope(Scope *scope, std::deque<ValueRef<RefValue>> *unresolvedRefs = nullptr);
 
-		RefValue *_loadRef(std::istream &fs);
-		Value *_loadValue(std::istream &fs);
-		Type _loadType(std::istream &fs, slxfmt::Type vt);
-		GenericParam _loadGenericParam(std::istream &fs);
-		void _loadScope(ModuleValue *mod, std::istream &fs);
+		std::deque<std::string> _getClonedPath(const MemberValue *v);
+		ClonedType _cloneType(const Type &type);
+		Type _restoreType(const ClonedType &type);
+		/// @brief Resolve a full name of a custom type in a structured clone.
+		Value *_resolveClonedPath(const std::deque<std::string> &path);
+
+		void _saveSnapshotValue(SnapshotWriter &w, Value *v);
+		void _bindSnapshotValue(SnapshotReader &r, uint32_t idx, Value *value);
+		Value *_allocSnapshotValue(SnapshotReader &r, uint32_t idx);
+		void _loadSnapshotValue(SnapshotReader &r, uint32_t idx);
 
 		/// @brief Execute a single instruction.
+		///
+		/// Arithmetic instructions are rewritten in place into type-specialized
+		/// variants after executions with a single type of operands, and are
+		/// rewritten back once the types changed.
+		///
 		/// @param context Context for execution.
-		/// @param ins Instruction to be executed.
+		/// @param srcIns Instruction to be executed.
 		///
 		/// @note Opcode-callback map was not introduced because designated initialization
 		/// was not introduced into ISO C++17.
-		void _execIns(Context *context, Instruction ins);
+		void _execIns(Context *context, Instruction &srcIns);
+		/// @brief Execute a type-specialized instruction.
+		/// @return false if the operands did not match, the instruction was
+		/// rewritten back into the generic one and has to be executed again.
+		bool _execQuickIns(Context *context, Instruction &ins);
+		/// @brief Record a receiver of an instruction site, lookups of its
+		/// class in the receiver slots of the site are counted as
+		/// inline-cache hits and misses.
+		void _recordReceiver(InsFeedback &feedback, const Value *receiver);
+
+#if SLAKE_ENABLE_JIT
+		/// @brief Executable memory for compiled functions.
+		CodeHeap _codeHeap;
+
+		/// @brief Functions which were compiled in current write batch of the
+		/// code heap, see _countFnCall().
+		std::vector<FnValue *> _pendingJITFns;
+		std::mutex _jitMutex;
+
+		/// @brief Count a call of a function and compile it once it was called
+		/// SLAKE_JIT_THRESHOLD times.
+		///
+		/// Functions are compiled in write batches, so that code of several
+		/// functions shares pages and the pages are made executable at once.
+		/// The code is used once the batch is flushed, which is done when
+		/// SLAKE_JIT_BATCH_SIZE functions were compiled, when a compiled
+		/// function was called SLAKE_JIT_BATCH_DELAY more times, or by the GC.
+		void _countFnCall(FnValue *fn);
+		/// @brief Make the pages of current write batch executable and
+		/// install the code of the functions, called with _jitMutex locked.
+		void _flushJITCode();
+		/// @brief Layouts and helpers which are used by compiled code.
+		JITRuntimeInfo _jitInfo;
+		/// @brief Shared false and true values which are stored by compiled
+		/// comparisons, they are walked by the garbage collector and must
+		/// never be modified.
+		BoolValue *_jitBoolValues[2] = {};
+
+		/// @brief Fill _jitInfo, called by the constructor.
+		void _initJIT();
+		/// @brief Check if compiled code has to return to the interpreter
+		/// since the context was preempted or is switching, a GC cycle is
+		/// required or requested by another thread, or the profiler ticked.
+		bool _isJITExitRequested(Context *context);
+		/// @brief Slow path of compiled code, see JITInsExecutor.
+		static uint32_t _jitExecIns(Runtime *rt, Context *context, MajorFrame *frame, JITFrameSlots *slots, uint32_t offIns);
+		/// @brief Check budgets at backward jumps of compiled code, see JITPoll.
+		static uint32_t _jitPoll(Runtime *rt, Context *context, MajorFrame *frame, uint32_t offIns);
+		/// @brief Box and store results of compiled code, see JITStore.
+		template <typename T>
+		static uint32_t _jitStore(Runtime *rt, Context *context, MajorFrame *frame, void *var, uint64_t bits, uint32_t offIns);
+		/// @brief Execute compiled code of the function on the top frame until
+		/// it has to return to the interpreter.
+		void _execJITCode(Context *context);
+#endif
+
+		using ValueVisitor = std::function<void(Value *)>;
+
+		/// @brief Visit values which are referenced by a value, a scope, a
+		/// type or a context, which are walked by the garbage collector.
+		void _walkRefs(Scope *scope, const ValueVisitor &visit);
+		void _walkRefs(Type &type, const ValueVisitor &visit);
+		void _walkRefs(Value *v, const ValueVisitor &visit);
+		void _walkRefs(Context &ctxt, const ValueVisitor &visit);
 
-		void _gcWalk(Scope *scope);
-		void _gcWalk(Type &type);
 		void _gcWalk(Value *i);
 		void _gcWalk(Context &i);
 
@@ -196,26 +543,209 @@ namespace slake {
 		ObjectValue *_newClassInstance(ClassValue *cls);
 		ObjectValue *_newGenericClassInstance(ClassValue *cls, GenericArgList &genericArgs);
 
+		/// @brief Maximum number of left frames which are kept by a context.
+		static constexpr size_t MAX_FREE_FRAMES = 4;
+
+		/// @brief Push a frame onto a context, storage of a left frame is
+		/// reused if there is one.
+		/// @return The frame, which is empty.
+		MajorFrame &_pushFrame(Context *context);
+		/// @brief Leave the top frame of a context, which is kept for reusing.
+		static void _popFrame(Context *context);
+
 		void _callFn(Context *context, FnValue *fn);
+		/// @brief Create a suspended coroutine for an asynchronous call,
+		/// arguments are taken from the argument stack of the caller.
+		/// @param callerFrame Frame of the caller.
+		/// @param fn Function to be called.
+		/// @param thisObject `this' object for method calls.
+		/// @return Created coroutine, native functions are called
+		/// synchronously and their coroutines are done.
+		ContextValue *_newCoroutine(MajorFrame &callerFrame, FnValue *fn, Value *thisObject);
+		/// @brief Switch back from a coroutine which yielded or returned to
+		/// its resumer, which receives the yielded or returned value.
+		/// @return The resumer.
+		Context *_switchToResumer(Context *coroutine);
+		/// @brief Call a function with current frame, which is reset for the
+		/// callee and returns to the caller of current function.
+		void _tailCallFn(Context *context, FnValue *fn);
 		VarValue *_addLocalVar(MajorFrame &frame, Type type);
 		VarValue *_addLocalReg(MajorFrame &frame);
 
 		bool _findAndDispatchExceptHandler(Context *context) const;
 
+		/// @brief Check the budget which a context is executed on, called at
+		/// backward branches and calls.
+		inline void _pollBudget(Context *context) {
+			Context *root = context;
+			while (root->resumer)
+				root = root->resumer;
+
+			if (root->budget.isLimited())
+				_checkBudget(context, root);
+		}
+		/// @brief Charge the instructions executed by a context to the budget
+		/// of the context executed by the host, which may be itself.
+		static void _chargeBudget(Context *context, Context *root);
+		/// @brief Charge the budget and preempt or interrupt the context if
+		/// the budget was exhausted.
+		void _checkBudget(Context *context, Context *root);
+
+		/// @brief Contexts which are being executed by the host, the garbage
+		/// collector walks them and the coroutines which they are awaiting.
+		Context *_runningContexts = nullptr;
+		std::mutex _runningContextsMutex;
+
+		/// @brief Context which is being executed on current thread.
+		static thread_local Context *_curContext;
+
+		void _addRunningContext(Context *context);
+		void _removeRunningContext(Context *context);
+
+		/// @brief Runtime which current thread is executing in.
+		static thread_local Runtime *_execRuntime;
+
+		/// @brief Safepoint state. Threads which are executing are counted,
+		/// and the garbage collector waits for the other ones to stop at
+		/// their safepoints before walking.
+		std::mutex _safepointMutex;
+		std::condition_variable _safepointCond;
+		std::atomic_bool _safepointRequested = false;
+		size_t _nExecutingThreads = 0, _nStoppedThreads = 0;
+		std::thread::id _collectingThread;
+
+		/// @brief Count current thread as an executing thread, waits if a GC
+		/// cycle is in progress.
+		/// @return false if current thread is the collecting one, which is
+		/// not counted.
+		bool _enterExecution();
+		void _leaveExecution();
+		/// @brief Stop at a safepoint if a GC cycle was requested.
+		inline void _pollSafepoint() {
+			if (_safepointRequested.load(std::memory_order_relaxed))
+				_stopAtSafepoint();
+		}
+		void _stopAtSafepoint();
+		/// @brief Wait for every other executing thread to stop.
+		/// @return false if another thread is collecting, the cycle has been
+		/// done once it returns.
+		bool _stopTheWorld();
+		void _resumeTheWorld();
+		/// @brief Stop every other executing thread for updating the values
+		/// which they may read, e.g. publishing a module.
+		inline void _stopTheWorldForUpdate() {
+			// Retry if another thread was collecting.
+			while (!_stopTheWorld())
+				;
+		}
+
+		struct SchedWorker {
+			Runtime *rt;
+			std::mutex mutex;
+			std::deque<ValueRef<ContextValue>> queue;  // Back for new contexts, front for stealing
+			std::thread thread;
+		};
+
+		/// @brief Workers of the scheduler, see startScheduler().
+		std::vector<std::unique_ptr<SchedWorker>> _schedWorkers;
+		std::mutex _schedMutex;
+		std::condition_variable _schedCond, _schedIdleCond;
+		/// @brief Number of queued contexts, and number of scheduled contexts
+		/// which are not done.
+		size_t _nQueuedTasks = 0, _nPendingTasks = 0;
+		size_t _nextSchedWorker = 0;
+		bool _schedStopping = false;
+		std::exception_ptr _schedExcept;
+
+		/// @brief Worker which current thread is running as.
+		static thread_local SchedWorker *_curSchedWorker;
+
+		/// @brief Sampling profiler, see startProfiler(). The profiler thread
+		/// only advances the tick, executing threads sample their own stacks
+		/// once they see a new tick.
+		std::thread _profilerThread;
+		std::mutex _profilerMutex;
+		std::condition_variable _profilerCond;
+		bool _profilerStopping = false;
+		std::atomic_bool _isProfiling = false;
+		std::atomic_uint32_t _profilerTick = 0;
+		Profile _profile;
+
+		/// @brief Tick of the profiler which current thread sampled last time.
+		static thread_local uint32_t _sampledProfilerTick;
+
+		/// @brief Sample the stack of a context if the profiler ticked since
+		/// the last sample of current thread.
+		inline void _pollProfiler(Context *context) {
+			if (uint32_t tick = _profilerTick.load(std::memory_order_relaxed); tick != _sampledProfilerTick) {
+				_sampledProfilerTick = tick;
+				_takeSample(context);
+			}
+		}
+		void _takeSample(Context *context);
+		void _profilerWork(std::chrono::microseconds interval);
+
+		/// @brief Tracer, see startTracing(). Options are only changed while
+		/// the tracer is stopped.
+		std::mutex _traceMutex;
+		std::atomic_bool _isTracing = false;
+		TraceOptions _traceOptions;
+		Trace _trace;
+
+		/// @brief Number of calls of current thread which were not sampled by
+		/// the tracer since the last sampled one.
+		static thread_local uint32_t _nUnsampledCalls;
+
+		inline bool _shouldTrace(TraceFlags flags) {
+			return _isTracing.load(std::memory_order_acquire) && (_traceOptions.flags & flags);
+		}
+		void _addTraceEvent(
+			char phase,
+			const char *category,
+			std::string name,
+			std::chrono::steady_clock::time_point beginTime,
+			std::chrono::steady_clock::time_point endTime = {});
+		/// @brief Decide if a call to a script function is traced, the span
+		/// begins at once if the context is current one, or when it is
+		/// switched to otherwise.
+		void _traceCall(Context *context, MajorFrame &frame);
+		/// @brief End the span of a traced frame which is being left.
+		void _traceReturn(MajorFrame &frame);
+		/// @brief Begin spans of the traced frames of a context which is
+		/// switched to, outermost first.
+		void _traceSwitchIn(Context *context, const char *reason);
+		/// @brief End spans of the traced frames of a context which is
+		/// switched from, innermost first.
+		void _traceSwitchOut(Context *context);
+
+		/// @brief States of native libraries keyed by their names.
+		std::mutex _nativeLibStatesMutex;
+		std::unordered_map<std::string, std::shared_ptr<NativeLibState>> _nativeLibStates;
+
+		/// @brief Call handles which are alive, they are detached once the
+		/// runtime is destroyed.
+		std::mutex _callHandlesMutex;
+		std::unordered_set<CallHandle *> _callHandles;
+
+		void _pushTask(ValueRef<ContextValue> task, bool yielded);
+		bool _popTask(SchedWorker *worker, ValueRef<ContextValue> &taskOut);
+		void _runTask(ValueRef<ContextValue> task);
+		void _schedWork(SchedWorker *worker);
+		std::exception_ptr _waitForTasks();
+
 		friend class Value;
 		friend class FnValue;
+		friend struct Type;
 		friend class ObjectValue;
 		friend class MemberValue;
 		friend class ModuleValue;
 		friend class ValueRef<ObjectValue>;
+		friend class CallHandle;
 
 	public:
 		/// @brief Runtime flags.
 		RuntimeFlags _flags = 0;
 
-		/// @brief Active context on threads.
-		std::map<std::thread::id, std::shared_ptr<Context>> activeContexts;
-
 		/// @brief Thread IDs of threads which are executing destructors.
 		std::unordered_set<std::thread::id> destructingThreads;
 
@@ -227,6 +757,62 @@ namespace slake {
 		Runtime(RuntimeFlags flags = 0);
 		virtual ~Runtime();
 
+		/// @brief Scope in which current thread is counted as a thread which
+		/// touches values of the runtime, the garbage collector does not
+		/// start a cycle until the thread leaves the scope or stops at a
+		/// safepoint. Scopes can be nested.
+		///
+		/// Required in multi-threaded mode for threads which create, read or
+		/// modify values outside executions.
+		class ExecScope final {
+		private:
+			Runtime *_rt;
+			Runtime *_savedRuntime;
+			bool _isCounted;
+
+		public:
+			ExecScope(Runtime *rt);
+			~ExecScope();
+
+			ExecScope(const ExecScope &) = delete;
+			ExecScope &operator=(const ExecScope &) = delete;
+		};
+
+		/// @brief Scope in which an executing thread is not counted, for
+		/// native functions which block, e.g. waiting for other threads.
+		/// GC cycles do not wait for the thread in the scope, which must not
+		/// touch any value until it leaves the scope.
+		///
+		/// Values which are only referenced by locals of the native function
+		/// may be collected in the scope, arguments are kept by the frames.
+		class BlockingScope final {
+		private:
+			Runtime *_rt;
+			bool _isUncounted;
+
+		public:
+			BlockingScope(Runtime *rt);
+			~BlockingScope();
+
+			BlockingScope(const BlockingScope &) = delete;
+			BlockingScope &operator=(const BlockingScope &) = delete;
+		};
+
+		/// @brief Get the state of a native library in the runtime, which is
+		/// created on first access and destroyed with the runtime before its
+		/// values are released.
+		/// @tparam T Type of the state, which is default constructible.
+		/// @param name Name of the library, e.g. std.worker.
+		template <typename T>
+		inline std::shared_ptr<T> getNativeLibState(const std::string &name) {
+			std::lock_guard<std::mutex> lock(_nativeLibStatesMutex);
+
+			auto &state = _nativeLibStates[name];
+			if (!state)
+				state = std::make_shared<T>();
+			return std::static_pointer_cast<T>(state);
+		}
+
 		/// @brief Instantiate an generic value (e.g. generic class, etc).
 		/// @param v Value to be instantiated.
 		/// @param genericArgs Generic arguments for instantiation.
@@ -240,28 +826,245 @@ namespace slake {
 		Value *resolveRef(RefValue *ref, Value *scopeValue = nullptr) const;
 
 		ValueRef<ModuleValue> loadModule(std::istream &fs, LoadModuleFlags flags);
+		/// @brief Load a module from a buffer, the buffer is parsed in place
+		/// and is not used after the call returns.
 		ValueRef<ModuleValue> loadModule(const void *buf, size_t size, LoadModuleFlags flags);
+		ValueRef<ModuleValue> loadModule(std::shared_ptr<ModuleImage> image, LoadModuleFlags flags);
+		/// @brief Load a module from a file by mapping it into memory.
+		/// @param path Path to the module file.
+		/// @param flags Flags for loading.
+		/// @return Loaded module.
+		ValueRef<ModuleValue> loadModuleFile(const std::string &path, LoadModuleFlags flags);
+
+		/// @brief Locate a module with the module locators and load it.
+		/// @param name Full name of the module.
+		/// @param flags Flags for loading.
+		/// @return The module, which is returned directly if it was loaded.
+		ValueRef<ModuleValue> importModule(ValueRef<RefValue> name, LoadModuleFlags flags = 0);
+
+		/// @brief Resolve static references in a module to direct pointers.
+		///
+		/// `LOAD's of resolvable references in functions of the module are
+		/// replaced by `STORE's of the targets, calls of them are bound to the
+		/// functions directly, and deferred types are resolved. Unresolvable
+		/// references are left for resolving on execution.
+		///
+		/// Modules are linked after loading unless LMOD_NOLINK or LMOD_NOIMPORT
+		/// was specified, call this again after registering members which the
+		/// module refers to.
+		///
+		/// @param mod Module to be linked.
+		/// @return Static references which cannot be resolved. Bodies which
+		/// are not decoded yet are linked on decoding and are not checked.
+		std::deque<ValueRef<RefValue>> linkModule(ModuleValue *mod);
+
+		/// @brief Write every value which is reachable from the root value
+		/// into a snapshot.
+		///
+		/// Function bodies are decoded before writing, and values refer to
+		/// each other by indices, so restoring a snapshot is done by laying
+		/// the values out in an arena and relocating the indices in a single
+		/// pass without loading or linking any module.
+		///
+		/// Native functions are written by their paths only, the host has to
+		/// register them again before restoring. Values which hold native
+		/// states, i.e. contexts, are skipped and references to them are
+		/// restored as null.
+		///
+		/// @param fs Stream to write into.
+		/// @return Values which were skipped.
+		std::deque<ValueRef<>> saveSnapshot(std::ostream &fs);
+		/// @brief Restore values from a snapshot.
+		///
+		/// Values on the paths which present in the runtime are bound to the
+		/// existing ones, and new members of existing modules are merged into
+		/// them. Other values are constructed in a single arena, which is
+		/// freed after all of them were collected.
+		///
+		/// @param image Image of the snapshot.
+		void loadSnapshot(std::shared_ptr<ModuleImage> image);
+		void loadSnapshotFile(const std::string &path);
+
+		/// @brief Write every value of the runtime into a heap dump, see
+		/// slhfmt.h.
+		///
+		/// Values are written with their sizes and the values which they
+		/// refer to, as walked by the garbage collector. Values which were
+		/// not collected yet are included as well. Executing threads are
+		/// stopped at safepoints while the heap is walked.
+		///
+		/// @param fs Stream to write into.
+		void dumpHeap(std::ostream &fs);
+
+		/// @brief Clone a graph of values for restoring it in another
+		/// runtime, see StructuredClone.
+		/// @param v Root of the graph, may be null.
+		/// @param transfer Move data of strings into the clone instead of
+		/// copying them, the strings in the graph are emptied. Literals of
+		/// the modules (VF_LITERAL) are copied anyway, the caller must not
+		/// transfer strings which are still used elsewhere.
+		/// @return The clone.
+		/// @throw CloneError The graph contains a value which cannot be
+		/// cloned, e.g. a function or an instance of a generic class.
+		StructuredClone cloneValue(Value *v, bool transfer = false);
+		/// @brief Restore a graph of values from a structured clone.
+		///
+		/// Data of strings are moved out of the clone. Threads which restore
+		/// clones outside executions have to do it in an ExecScope in
+		/// multi-threaded mode.
+		///
+		/// @param clone Clone to be restored.
+		/// @return Root of the restored graph.
+		/// @throw CloneError A class which was referred by the clone was not
+		/// found.
+		ValueRef<> restoreClone(StructuredClone &&clone);
 
 		inline RootValue *getRootValue() { return _rootValue; }
 
 		inline void setModuleLocator(ModuleLocatorFn locator) { _moduleLocator = locator; }
 		inline ModuleLocatorFn getModuleLocator() { return _moduleLocator; }
 
+		inline void setModuleImageLocator(ModuleImageLocatorFn locator) { _moduleImageLocator = locator; }
+		inline ModuleImageLocatorFn getModuleImageLocator() { return _moduleImageLocator; }
+
+		/// @brief Set maximum number of threads for loading modules.
+		///
+		/// Modules in an import graph are located and decoded concurrently,
+		/// so the module locators have to be thread-safe unless it is set to 1.
+		/// Workers are shared by concurrent loads, each load decodes modules
+		/// on its calling thread as well.
+		///
+		/// @param nThreads Number of threads, 0 for number of hardware threads.
+		inline void setLoaderThreadCount(unsigned int nThreads) { _nLoaderThreads = nThreads; }
+		inline unsigned int getLoaderThreadCount() { return _nLoaderThreads; }
+
+		/// @brief Drop cached images of imported modules, modules are located
+		/// again on next import.
+		///
+		/// @note The images are dropped for every runtime which shares the
+		/// cache.
+		void clearModuleImageCache();
+
+		/// @brief Share a cache of module images with other runtimes, modules
+		/// which were imported by any of them are not located again. See
+		/// ModuleImageCache.
+		///
+		/// Modules which were imported before are not affected. Only the
+		/// images are shared, the modules are still loaded into values of
+		/// each runtime.
+		///
+		/// @param cache Cache to be used, must not be null.
+		void setModuleImageCache(std::shared_ptr<ModuleImageCache> cache);
+		inline std::shared_ptr<ModuleImageCache> getModuleImageCache() { return _moduleImageCache; }
+
 		std::string getFullName(const MemberValue *v) const;
 		std::string getFullName(const RefValue *v) const;
 
 		std::deque<RefEntry> getFullRef(const MemberValue *v) const;
 
-		/// @brief Get active context on specified thread.
-		/// @param id ID of specified thread.
-		/// @return Active context on specified thread.
-		inline std::shared_ptr<Context> getActiveContext(std::thread::id id = std::this_thread::get_id()) {
-			return activeContexts.at(id);
-		}
+		/// @brief Get the context which is being executed on current thread,
+		/// which is the innermost coroutine if it was resumed by an AWAIT.
+		/// @return Active context, nullptr if no context is being executed.
+		inline Context *getActiveContext() { return _curContext; }
 
 		/// @brief Do a GC cycle.
+		///
+		/// Other threads which are executing are stopped at their next
+		/// safepoints during the cycle. Native functions which block have to
+		/// return before the cycle can start.
 		void gc();
 
+		/// @brief Start worker threads which execute scheduled contexts.
+		///
+		/// Each worker has its own queue and steals contexts from the other
+		/// ones once its queue is empty. A context runs on a worker until it
+		/// returns or yields, yielded contexts are queued again.
+		///
+		/// The runtime is switched into multi-threaded mode, see Runtime.
+		/// Host threads which touch values concurrently with the workers
+		/// have to do it in ExecScope's, and must not wait for the tasks in
+		/// them since the workers cannot be stopped for GC cycles then.
+		///
+		/// @param nWorkers Number of workers, 0 for number of hardware threads.
+		void startScheduler(unsigned int nWorkers = 0);
+		/// @brief Wait for every scheduled context to finish and stop the
+		/// workers.
+		void stopScheduler();
+		/// @brief Call a function in a new context which is executed by the
+		/// scheduler.
+		/// @param fn Function to be called.
+		/// @param thisObject `this' object for method calls.
+		/// @param args Arguments of the call.
+		/// @return The context, its result is available once it is done.
+		ValueRef<ContextValue> spawn(FnValue *fn, Value *thisObject = nullptr, std::deque<Value *> args = {});
+		/// @brief Queue a suspended context, e.g. a coroutine created by an
+		/// ACALL, to be resumed by the scheduler.
+		/// @param context Context to be scheduled.
+		void schedule(ContextValue *context);
+		/// @brief Wait for every scheduled context to finish.
+		///
+		/// Exceptions which escaped from the contexts are not propagated to
+		/// the workers, the first one is rethrown here.
+		void waitForTasks();
+
+		/// @brief Start sampling stacks of executing contexts.
+		///
+		/// A profiler thread ticks at the frequency, and each thread which is
+		/// executing samples the stack of its context once it sees a new tick
+		/// between two instructions. Threads which are blocked in native
+		/// functions are not sampled. Stacks of coroutines include the ones
+		/// of the contexts which are awaiting them.
+		///
+		/// Samples are accumulated until clearProfile() is called.
+		///
+		/// @param frequency Number of ticks per second.
+		void startProfiler(unsigned int frequency = 99);
+		void stopProfiler();
+		/// @brief Drop accumulated samples.
+		void clearProfile();
+		/// @brief Write the accumulated samples in folded format, see
+		/// Profile::writeFoldedStacks().
+		void writeFoldedStacks(std::ostream &os);
+		/// @brief Write self and total time of each function, see
+		/// Profile::writeReport().
+		void writeProfileReport(std::ostream &os);
+
+		/// @brief Start recording a timeline of the execution.
+		///
+		/// Calls to script functions are recorded as spans on the threads
+		/// which execute them. Spans of a context end when it switches to
+		/// another context, e.g. awaiting a coroutine, and begin again when
+		/// it is switched back, so spans on each thread are always nested.
+		///
+		/// Events are accumulated until clearTrace() is called.
+		///
+		/// @param options Options of the tracer.
+		void startTracing(const TraceOptions &options = {});
+		void stopTracing();
+		/// @brief Drop recorded events.
+		void clearTrace();
+		/// @brief Write the recorded events, see Trace::writeJSON().
+		void writeTrace(std::ostream &os);
+
+#if SLAKE_ENABLE_STATS
+		/// @brief Get statistics of the runtime.
+		///
+		/// Executing threads are stopped at safepoints while the counters are
+		/// collected.
+		RuntimeStats getStats();
+		/// @brief Start writing statistics to a stream periodically, from a
+		/// thread of the runtime.
+		///
+		/// @param os Stream to be written, which must outlive the dumping.
+		/// @param interval Interval between the dumps.
+		/// @param format Format of the dumps, JSON dumps are written one per
+		/// line.
+		void startStatsDump(std::ostream &os, std::chrono::milliseconds interval, StatsFormat format = StatsFormat::Text);
+		/// @note Not to be called by native functions, the dumping thread may
+		/// be waiting for the calling thread to stop at a safepoint.
+		void stopStatsDump();
+#endif
+
 		std::string mangleName(
 			std::string name,
 			std::deque<Type> params,
@@ -281,6 +1084,63 @@ namespace slake {
 			return mangleName(name, params, {}, false);
 		}
 	};
+
+	/// @brief Handle for calling a function from the host repeatedly.
+	///
+	/// Each call reuses the context of the handle, whose frames and argument
+	/// variables are reset instead of being allocated again. Calls which
+	/// yielded or were preempted keep the context, the handle allocates a
+	/// new one for the next call.
+	///
+	/// A handle must not be used by several threads concurrently, or be
+	/// called again by the function which it is calling. Handles which
+	/// outlive their runtime are detached from it by the runtime, and throw
+	/// on calls.
+	class CallHandle final {
+	private:
+		Runtime *_rt;
+		ValueRef<FnValue> _fn;
+		std::shared_ptr<Context> _context;
+		std::vector<ValueRef<VarValue>> _argVars;
+		ExecBudget _budget;
+
+		void _newContext();
+		/// @brief Release values of the runtime, called by the runtime
+		/// which is being destroyed.
+		void _detach();
+
+		friend class Runtime;
+
+	public:
+		/// @brief Create a handle for a function, the body of the function is
+		/// decoded once here.
+		/// @param fn Function to be called.
+		CallHandle(FnValue *fn);
+		~CallHandle();
+
+		CallHandle(const CallHandle &) = delete;
+		CallHandle &operator=(const CallHandle &) = delete;
+
+		inline FnValue *getFn() { return _fn.get(); }
+		/// @brief Check if the runtime of the handle is still alive.
+		inline bool isAttached() const { return _rt; }
+
+		/// @brief Set budget of each following call, see ExecBudget.
+		inline void setBudget(const ExecBudget &budget) { _budget = budget; }
+		inline const ExecBudget &getBudget() const { return _budget; }
+
+		/// @brief Call the function.
+		/// @param thisObject `this' object for method calls.
+		/// @param args Arguments of the call.
+		/// @param nArgs Number of the arguments.
+		/// @return Result of the call, or the context if it yielded or was
+		/// preempted.
+		/// @throw std::logic_error The runtime was destroyed.
+		ValueRef<> call(Value *thisObject, Value *const *args, size_t nArgs);
+		inline ValueRef<> call(Value *thisObject, std::initializer_list<Value *> args) {
+			return call(thisObject, args.begin(), args.size());
+		}
+	};
 }
 
 #endif
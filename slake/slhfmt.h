@@ -0,0 +1,72 @@
+///
+/// @file slhfmt.h
+/// @brief Definitions for Slake Heap dump (SLH) format.
+///
+/// @copyright Copyright (c) 2022-2023 Slake Contributors
+///
+#ifndef _SLAKE_SLHFMT_H_
+#define _SLAKE_SLHFMT_H_
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+	#pragma pack(push)
+	#pragma pack(1)
+#endif
+
+namespace slake {
+	namespace slhfmt {
+		///
+		/// @brief Heap Dump Header (HDH)
+		///
+		/// The header is followed by the string table, the root records and
+		/// the value records. Strings are 32-bit lengths followed by the
+		/// bytes, values refer to each other and to the strings by their
+		/// indices.
+		///
+		struct HeapDumpHeader final {
+			uint8_t magic[4];	   // Magic number
+			uint8_t fmtVer;		   // Format version
+			uint8_t reserved[3];  // Reserved
+			uint32_t nStrings;	   // Number of strings
+			uint32_t nRoots;	   // Number of root records
+			uint32_t nValues;	   // Number of values
+		};
+		constexpr static uint8_t HDH_MAGIC[] = { 'S', 'L', 'H', 'D' };
+		constexpr static uint8_t FMTVER_CURRENT = 0;
+
+		/// @brief Index of null strings.
+		constexpr static uint32_t IDX_NULL = UINT32_MAX;
+
+		/// @brief Root Record (RR)
+		struct RootRecord final {
+			uint8_t kind;		   // Kind of the root
+			uint8_t reserved[3];  // Reserved
+			uint32_t index;		   // Index of the value
+		};
+		constexpr static uint8_t
+			ROOT_RUNTIME = 0,  // The root value of the runtime
+			ROOT_HOST = 1,	   // Value which is referenced by the host
+			ROOT_CONTEXT = 2   // Value which is referenced by an executing context
+			;
+
+		/// @brief Value Record Header (VRH), followed by indices of the
+		/// values which are referenced by the value.
+		///
+		/// Values which are not reachable from any root were not collected
+		/// yet when the heap was dumped.
+		struct ValueRecordHeader final {
+			uint8_t typeId;		  // Type ID of the value
+			uint8_t reserved[3];  // Reserved
+			uint32_t szShallow;	  // Size of memory reported by the value
+			uint32_t name;		  // Index of full name of member values, or of the classes of objects
+			uint32_t nRefs;		  // Number of referenced values
+		};
+	}
+}
+
+#ifdef _MSC_VER
+	#pragma pack(pop)
+#endif
+
+#endif
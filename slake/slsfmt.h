@@ -0,0 +1,66 @@
+///
+/// @file slsfmt.h
+/// @brief Definitions for Slake Snapshot (SLS) format.
+///
+/// @copyright Copyright (c) 2022-2023 Slake Contributors
+///
+#ifndef _SLAKE_SLSFMT_H_
+#define _SLAKE_SLSFMT_H_
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+	#pragma pack(push)
+	#pragma pack(1)
+#endif
+
+namespace slake {
+	namespace slsfmt {
+		///
+		/// @brief Snapshot Header (SSH)
+		///
+		/// The header is followed by the value directory, which has a VRD for
+		/// each value, and the value records. Values refer to each other by
+		/// their indices in the directory, the first value is the root value.
+		///
+		struct SnapshotHeader final {
+			uint8_t magic[4];	   // Magic number
+			uint8_t fmtVer;		   // Format version
+			uint8_t reserved[3];  // Reserved
+			uint32_t nValues;	   // Number of values
+		};
+		constexpr static uint8_t SSH_MAGIC[] = { 'S', 'L', 'S', 'S' };
+		constexpr static uint8_t FMTVER_CURRENT = 0;
+
+		/// @brief Index of null values.
+		constexpr static uint32_t IDX_NULL = UINT32_MAX;
+
+		/// @brief Value Record Descriptor (VRD)
+		struct ValueRecordDesc final {
+			uint8_t typeId;	   // Type ID of the value
+			uint8_t flags;	   // Flags
+			uint16_t reserved;  // Reserved
+			uint32_t off;	   // Offset of the record from the beginning of the snapshot
+		};
+		constexpr static uint8_t
+			VRD_NATIVE = 0x01,	// Native function, which has to be registered before restoring
+			VRD_LITERAL = 0x02	// Literal of a module, see VF_LITERAL
+			;
+
+		// Records are laid out as below, strings are 32-bit lengths followed by
+		// the bytes, and types are type IDs and type flags followed by the
+		// extra data:
+		//
+		// - Members of the scope, for root values, modules, classes,
+		//   interfaces, traits and objects: count, then names and indices.
+		// - Member header, for members: access, index of the parent, name,
+		//   count of generic arguments and the arguments.
+		// - Data of the value.
+	}
+}
+
+#ifdef _MSC_VER
+	#pragma pack(pop)
+#endif
+
+#endif
@@ -0,0 +1,388 @@
+#include "slxconv.h"
+#include "runtime.h"
+
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace slake {
+	namespace slxfmt {
+		namespace {
+			/// @brief Converter from v0 images to v1 images.
+			class ImageUpgrader final {
+			private:
+				ImageReader _fs;
+				bool _stripDebugInfo;
+
+				std::string _strTab;
+				std::vector<uint32_t> _strOffs;
+				std::unordered_map<std::string, uint32_t> _strIndices;
+
+				std::string _consts;
+				std::vector<uint32_t> _constOffs;
+				std::unordered_map<std::string, uint32_t> _constIndices;
+
+				std::string _main, _code, _dbg;
+
+				template <typename T>
+				static inline void _put(std::string &s, const T &value) {
+					s.append((const char *)&value, sizeof(T));
+				}
+
+				template <typename T>
+				inline T _copy(std::string &s) {
+					T value = _fs.read<T>();
+					_put(s, value);
+					return value;
+				}
+
+				uint32_t _addString(std::string_view s) {
+					std::string key(s);
+					if (auto it = _strIndices.find(key); it != _strIndices.end())
+						return it->second;
+
+					uint32_t index = (uint32_t)_strOffs.size();
+					_strOffs.push_back((uint32_t)_strTab.size());
+					_strTab += key;
+					_strIndices[std::move(key)] = index;
+					return index;
+				}
+
+				uint32_t _addConst(std::string &&encoded) {
+					if (auto it = _constIndices.find(encoded); it != _constIndices.end())
+						return it->second;
+
+					uint32_t index = (uint32_t)_constOffs.size();
+					_constOffs.push_back((uint32_t)_consts.size());
+					_consts += encoded;
+					_constIndices[std::move(encoded)] = index;
+					return index;
+				}
+
+				inline uint32_t _copyName(std::string &s, size_t len) {
+					uint32_t index = _addString(_fs.readView(len));
+					_put(s, index);
+					return index;
+				}
+
+				void _copyRef(std::string &s) {
+					RefEntryDesc i;
+					do {
+						i = _fs.read<RefEntryDesc>();
+						auto lenName = i.lenName;
+
+						i.lenName = 0;
+						_put(s, i);
+						_copyName(s, lenName);
+
+						for (size_t j = i.nGenericArgs; j; --j)
+							_copyType(s, _copy<Type>(s));
+					} while (i.flags & RSD_NEXT);
+				}
+
+				void _copyType(std::string &s, Type vt) {
+					switch (vt) {
+						case Type::Object:
+							_copyRef(s);
+							break;
+						case Type::Array:
+							_copyType(s, _copy<Type>(s));
+							break;
+						case Type::Map:
+							_copyType(s, _copy<Type>(s));
+							_copyType(s, _copy<Type>(s));
+							break;
+						case Type::GenericArg:
+							_copy<uint8_t>(s);
+							break;
+						default:;
+					}
+				}
+
+				void _copyValue(std::string &s) {
+					auto vd = _copy<ValueDesc>(s);
+					switch (vd.type) {
+						case Type::None:
+							break;
+						case Type::I8:
+						case Type::U8:
+							_copy<uint8_t>(s);
+							break;
+						case Type::I16:
+						case Type::U16:
+							_copy<uint16_t>(s);
+							break;
+						case Type::I32:
+						case Type::U32:
+						case Type::Reg:
+						case Type::RegValue:
+						case Type::LocalVar:
+						case Type::LocalVarValue:
+						case Type::Arg:
+						case Type::ArgValue:
+							_copy<uint32_t>(s);
+							break;
+						case Type::I64:
+						case Type::U64:
+							_copy<uint64_t>(s);
+							break;
+						case Type::Bool:
+							_copy<bool>(s);
+							break;
+						case Type::F32:
+							_copy<float>(s);
+							break;
+						case Type::F64:
+							_copy<double>(s);
+							break;
+						case Type::String:
+							_copyName(s, _fs.read<uint32_t>());
+							break;
+						case Type::Ref:
+							_copyRef(s);
+							break;
+						case Type::TypeName:
+							_copyType(s, _copy<Type>(s));
+							break;
+						case Type::Array:
+							_copyType(s, _copy<Type>(s));
+							for (auto n = _copy<uint32_t>(s); n; --n)
+								_copyValue(s);
+							break;
+						default:
+							throw LoaderError("Invalid value type detected");
+					}
+				}
+
+				/// @brief Copy an operand, literals, references and type names are
+				/// moved into the constant pool.
+				void _copyOperand(std::string &s) {
+					size_t off = _fs.tell();
+					switch (_fs.read<ValueDesc>().type) {
+						case Type::None:
+						case Type::Reg:
+						case Type::RegValue:
+						case Type::LocalVar:
+						case Type::LocalVarValue:
+						case Type::Arg:
+						case Type::ArgValue:
+							_fs.seek(off);
+							_copyValue(s);
+							break;
+						default: {
+							_fs.seek(off);
+
+							std::string encoded;
+							_copyValue(encoded);
+
+							ValueDesc vd = {};
+							vd.type = Type::Const;
+							_put(s, vd);
+							_put(s, _addConst(std::move(encoded)));
+						}
+					}
+				}
+
+				void _copyGenericParam(std::string &s) {
+					auto gpd = _fs.read<GenericParamDesc>();
+					auto lenName = gpd.lenName;
+
+					gpd.lenName = 0;
+					_put(s, gpd);
+					_copyName(s, lenName);
+
+					if (gpd.hasBaseType)
+						_copyType(s, _copy<Type>(s));
+					for (size_t i = 0; i < gpd.nInterfaces; ++i)
+						_copyType(s, _copy<Type>(s));
+					for (size_t i = 0; i < gpd.nTraits; ++i)
+						_copyType(s, _copy<Type>(s));
+				}
+
+				template <typename T>
+				void _copyCompositeType() {
+					for (auto nItems = _copy<uint32_t>(_main); nItems; --nItems) {
+						T desc = _fs.read<T>();
+						auto lenName = desc.lenName;
+
+						desc.lenName = 0;
+						_put(_main, desc);
+						_copyName(_main, lenName);
+
+						for (size_t j = 0; j < desc.nGenericParams; ++j)
+							_copyGenericParam(_main);
+
+						if constexpr (std::is_same_v<T, ClassTypeDesc>) {
+							if (desc.flags & CTD_DERIVED)
+								_copyRef(_main);
+							for (size_t j = desc.nImpls; j; --j)
+								_copyRef(_main);
+						} else {
+							for (size_t j = desc.nParents; j; --j)
+								_copyRef(_main);
+						}
+
+						_copyScope();
+					}
+				}
+
+				void _copyScope() {
+					//
+					// Variables.
+					//
+					for (auto nItems = _copy<uint32_t>(_main); nItems; --nItems) {
+						auto vad = _fs.read<VarDesc>();
+						auto lenName = vad.lenName;
+
+						vad.lenName = 0;
+						_put(_main, vad);
+						_copyName(_main, lenName);
+
+						_copyType(_main, _copy<Type>(_main));
+						if (vad.flags & VAD_INIT)
+							_copyValue(_main);
+					}
+
+					//
+					// Functions.
+					//
+					for (auto nItems = _copy<uint32_t>(_main); nItems; --nItems) {
+						auto fnd = _fs.read<FnDesc>();
+						auto lenName = fnd.lenName;
+						auto nSourceLocDescs = fnd.nSourceLocDescs;
+
+						fnd.lenName = 0;
+						if (_stripDebugInfo)
+							fnd.nSourceLocDescs = 0;
+						_put(_main, fnd);
+						_copyName(_main, lenName);
+
+						for (size_t j = 0; j < fnd.nGenericParams; ++j)
+							_copyGenericParam(_main);
+
+						_copyType(_main, _copy<Type>(_main));
+
+						for (size_t j = 0; j < fnd.nParams; ++j)
+							_copyType(_main, _copy<Type>(_main));
+
+						FnBodyLocDesc fbl = {};
+						fbl.offBody = (uint32_t)_code.size();
+						fbl.offSourceLocDescs = (uint32_t)_dbg.size();
+						_put(_main, fbl);
+
+						for (uint32_t j = 0; j < fnd.lenBody; ++j) {
+							auto ih = _copy<InsHeader>(_code);
+							for (uint8_t k = 0; k < ih.nOperands; ++k)
+								_copyOperand(_code);
+						}
+
+						for (uint32_t j = 0; j < nSourceLocDescs; ++j) {
+							auto sld = _fs.read<SourceLocDesc>();
+							if (!_stripDebugInfo)
+								_put(_dbg, sld);
+						}
+					}
+
+					_copyCompositeType<ClassTypeDesc>();
+					_copyCompositeType<InterfaceTypeDesc>();
+					_copyCompositeType<TraitTypeDesc>();
+				}
+
+			public:
+				inline ImageUpgrader(const void *data, size_t size, bool stripDebugInfo)
+					: _fs(data, size), _stripDebugInfo(stripDebugInfo) {}
+
+				std::string upgrade() {
+					auto ih = _fs.read<ImgHeader>();
+					if (memcmp(ih.magic, IMH_MAGIC, sizeof(IMH_MAGIC)))
+						throw LoaderError("Bad SLX magic");
+
+					switch (ih.fmtVer) {
+						case 0:
+							break;
+						case FMTVER_CURRENT:
+							return std::string(_fs.getBegin(), _fs.getSize());
+						default:
+							throw LoaderError("Bad SLX format version");
+					}
+
+					if (ih.flags & IMH_MODNAME)
+						_copyRef(_main);
+
+					for (size_t i = 0; i < ih.nImports; ++i) {
+						_copyName(_main, _fs.read<uint32_t>());
+						_copyRef(_main);
+					}
+
+					_copyScope();
+
+					//
+					// Build the sections.
+					//
+					std::string sections[SCT_MAX];
+
+					_put(sections[SCT_STRTAB], (uint32_t)_strOffs.size());
+					for (auto i : _strOffs)
+						_put(sections[SCT_STRTAB], i);
+					_put(sections[SCT_STRTAB], (uint32_t)_strTab.size());
+					sections[SCT_STRTAB] += _strTab;
+
+					uint32_t szConstsHeader = (uint32_t)(sizeof(uint32_t) * (_constOffs.size() + 1));
+					_put(sections[SCT_CONSTS], (uint32_t)_constOffs.size());
+					for (auto i : _constOffs)
+						_put(sections[SCT_CONSTS], szConstsHeader + i);
+					sections[SCT_CONSTS] += _consts;
+
+					sections[SCT_MAIN] = std::move(_main);
+					sections[SCT_CODE] = std::move(_code);
+
+					bool withDebugInfo = !_stripDebugInfo && _dbg.size();
+					if (withDebugInfo)
+						sections[SCT_DBG] = std::move(_dbg);
+
+					//
+					// Write the image.
+					//
+					ih.fmtVer = FMTVER_CURRENT;
+					if (withDebugInfo)
+						ih.flags |= IMH_DBG;
+					else
+						ih.flags &= ~IMH_DBG;
+
+					std::vector<uint8_t> kinds = { SCT_STRTAB, SCT_CONSTS, SCT_MAIN, SCT_CODE };
+					if (withDebugInfo)
+						kinds.push_back(SCT_DBG);
+
+					std::string image;
+					_put(image, ih);
+					_put(image, (uint32_t)kinds.size());
+
+					// Sections are aligned to 4 bytes.
+					size_t off = image.size() + sizeof(SectionDesc) * kinds.size();
+					for (auto i : kinds) {
+						off = (off + 3) & ~(size_t)3;
+
+						SectionDesc scd = {};
+						scd.kind = i;
+						scd.off = (uint32_t)off;
+						scd.size = (uint32_t)sections[i].size();
+						_put(image, scd);
+
+						off += sections[i].size();
+					}
+
+					for (auto i : kinds) {
+						image.resize((image.size() + 3) & ~(size_t)3, '\0');
+						image += sections[i];
+					}
+
+					return image;
+				}
+			};
+		}
+	}
+}
+
+std::string slake::slxfmt::upgradeImage(const void *data, size_t size, bool stripDebugInfo) {
+	return ImageUpgrader(data, size, stripDebugInfo).upgrade();
+}
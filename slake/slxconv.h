@@ -0,0 +1,24 @@
+#ifndef _SLAKE_SLXCONV_H_
+#define _SLAKE_SLXCONV_H_
+
+#include <string>
+
+#include "slxfmt.h"
+
+namespace slake {
+	namespace slxfmt {
+		/// @brief Convert an image into the newest format version.
+		///
+		/// Compilers emit v0 images which are easy to write in a single pass,
+		/// and convert them before writing them out.
+		///
+		/// @param data Image to be converted.
+		/// @param size Size of the image.
+		/// @param stripDebugInfo Do not emit the debugging section.
+		/// @return Converted image, or a copy of the image if it is in the newest version.
+		/// @throw LoaderError The image is malformed.
+		std::string upgradeImage(const void *data, size_t size, bool stripDebugInfo = false);
+	}
+}
+
+#endif
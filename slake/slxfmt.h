@@ -38,6 +38,41 @@ namespace slake {
 		};
 		constexpr static uint8_t IMH_MAGIC[] = { 'S', 'L', 'A', 'X' };
 
+		/// @brief Newest format version.
+		///
+		/// Version 0 inlines every name and literal at each use.
+		///
+		/// Version 1 images are followed by a section directory. Names and
+		/// string literals are indices into the string table, literals, refs
+		/// and type names used by instructions are indices into the constant
+		/// pool, and function bodies and source location descriptors are
+		/// moved into their own sections. Function descriptors locate their
+		/// bodies in the code section, so bodies are decoded on demand.
+		constexpr static uint8_t FMTVER_CURRENT = 1;
+
+		/// @brief Section Descriptor (SCD), only presents in v1 images.
+		struct SectionDesc final {
+			uint8_t kind;		   // Kind of the section
+			uint8_t reserved[3];  // Reserved
+			uint32_t off;		   // Offset of the section from the beginning of the image
+			uint32_t size;		   // Size of the section
+		};
+		constexpr static uint8_t
+			SCT_STRTAB = 0,	 // String table: count, count + 1 offsets and the bytes
+			SCT_CONSTS = 1,	 // Constant pool: count, offsets of each constant and the values
+			SCT_MAIN = 2,	 // Module name, imports and member descriptors
+			SCT_CODE = 3,	 // Function bodies
+							 // 4 was the member index, which is reserved and ignored
+			SCT_DBG = 5,	 // Debugging information, optional
+			SCT_MAX = 6;
+
+		/// @brief Function Body Locator (FBL), follows parameter types of
+		/// function descriptors in v1 images.
+		struct FnBodyLocDesc final {
+			uint32_t offBody;			   // Offset of the body in the code section
+			uint32_t offSourceLocDescs;  // Offset of SLDs in the debugging section
+		};
+
 		///
 		/// @brief Instruction Header (IH)
 		///
@@ -47,7 +82,7 @@ namespace slake {
 
 			inline InsHeader() : opcode(Opcode::NOP), nOperands(0) {}
 			inline InsHeader(Opcode opcode, uint8_t nOperands) {
-				assert((uint8_t)opcode < (1 << 6));
+				assert(isValidOpcode(opcode));
 				assert(nOperands < 4);
 				this->opcode = opcode;
 				this->nOperands = nOperands;
@@ -69,7 +104,7 @@ namespace slake {
 			F64,			// f64
 			String,			// String
 			Bool,			// Boolean
-			Array,			// Array
+			Array,			// Array, as values they are followed by the element type, number of elements and the elements
 			Map,			// Map
 			Object,			// Object
 			Ref,			// Reference
@@ -81,8 +116,13 @@ namespace slake {
 			LocalVarValue,	// Local variable value
 			Arg,			// Argument
 			ArgValue,		// Argument
+			Const,			// Constant pool entry, only used by v1 images
 		};
 
+		// In v1 images, names of all descriptors below and contents of string
+		// literals are 32-bit string table indices, and length of names are
+		// not used.
+
 		/// @brief Value Descriptor (VD)
 		struct ValueDesc final {
 			Type type : 5;		// Data Type
@@ -0,0 +1,149 @@
+#include "stats.h"
+
+#include <iomanip>
+#include <sstream>
+
+using namespace slake;
+
+static std::string _getOpcodeName(size_t opcode) {
+	if (auto it = OPCODE_MNEMONIC_MAP.find((Opcode)opcode); it != OPCODE_MNEMONIC_MAP.end())
+		return it->second;
+
+	std::ostringstream ss;
+	ss << "0x" << std::hex << opcode;
+	return ss.str();
+}
+
+static void _writeJSONString(std::ostream &os, const std::string &s) {
+	os << '"';
+	for (char c : s) {
+		switch (c) {
+			case '"':
+				os << "\\\"";
+				break;
+			case '\\':
+				os << "\\\\";
+				break;
+			default:
+				if ((unsigned char)c < 0x20)
+					os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+				else
+					os << c;
+		}
+	}
+	os << '"';
+}
+
+uint64_t RuntimeStats::getExecutedInsCount() const {
+	uint64_t n = 0;
+	for (auto i : nExecutedIns)
+		n += i;
+	return n;
+}
+
+uint64_t RuntimeStats::getAllocCount() const {
+	uint64_t n = 0;
+	for (auto i : nAllocs)
+		n += i;
+	return n;
+}
+
+void RuntimeStats::writeText(std::ostream &os) const {
+	auto toMs = [](std::chrono::nanoseconds t) {
+		return (double)t.count() / 1000000.0;
+	};
+	auto toPercent = [](uint64_t n, uint64_t total) {
+		return total ? (double)n * 100.0 / total : 0.0;
+	};
+
+	os << std::fixed << std::setprecision(3);
+
+	os << "instructions: " << getExecutedInsCount() << '\n';
+	for (size_t i = 0; i < N_OPCODES; ++i) {
+		if (nExecutedIns[i])
+			os << "  " << std::setw(16) << std::left << _getOpcodeName(i) << std::right << ' ' << nExecutedIns[i] << '\n';
+	}
+
+	os << "allocations: " << getAllocCount() << ", " << szAllocated << " bytes, " << szInUse << " bytes in use\n";
+	for (size_t i = 0; i < N_TYPE_IDS; ++i) {
+		if (nAllocs[i])
+			os << "  " << std::setw(16) << std::left << getTypeIdName((TypeId)i) << std::right << ' ' << nAllocs[i] << '\n';
+	}
+
+	os << "gc: " << nGcCycles << " cycles, "
+	   << toMs(gcPauseTime) << "ms paused, "
+	   << toMs(maxGcPauseTime) << "ms max pause, "
+	   << szReclaimed << " bytes reclaimed\n";
+
+	os << "generic cache: " << nGenericCacheHits << " hits, " << nGenericCacheMisses << " misses ("
+	   << toPercent(nGenericCacheHits, nGenericCacheHits + nGenericCacheMisses) << "% hit)\n";
+	os << "quickened instructions: " << nQuickInsHits << " hits, " << nQuickInsMisses << " misses ("
+	   << toPercent(nQuickInsHits, nQuickInsHits + nQuickInsMisses) << "% hit)\n";
+	os << "inline caches: " << nInlineCacheHits << " hits, " << nInlineCacheMisses << " misses ("
+	   << toPercent(nInlineCacheHits, nInlineCacheHits + nInlineCacheMisses) << "% hit)\n";
+	os << "native calls: " << nNativeCalls << '\n';
+	os << "code heap: " << nCodeBlobs << " blobs in " << nCodePages << " pages, "
+	   << szCodeInUse << " bytes in use, "
+	   << szCodeReserved << " bytes reserved, "
+	   << nCodeProtectCalls << " protection changes\n";
+
+	os << "modules: " << moduleLoadTimes.size() << '\n';
+	for (auto &i : moduleLoadTimes)
+		os << "  " << i.first << ' ' << toMs(i.second) << "ms\n";
+
+	os << std::defaultfloat;
+}
+
+void RuntimeStats::writeJSON(std::ostream &os) const {
+	bool isFirst;
+
+	os << "{\"executedIns\":{";
+	isFirst = true;
+	for (size_t i = 0; i < N_OPCODES; ++i) {
+		if (!nExecutedIns[i])
+			continue;
+		if (!isFirst)
+			os << ',';
+		isFirst = false;
+		_writeJSONString(os, _getOpcodeName(i));
+		os << ':' << nExecutedIns[i];
+	}
+
+	os << "},\"allocs\":{";
+	isFirst = true;
+	for (size_t i = 0; i < N_TYPE_IDS; ++i) {
+		if (!nAllocs[i])
+			continue;
+		if (!isFirst)
+			os << ',';
+		isFirst = false;
+		os << '"' << getTypeIdName((TypeId)i) << "\":" << nAllocs[i];
+	}
+
+	os << "},\"szAllocated\":" << szAllocated
+	   << ",\"szInUse\":" << szInUse
+	   << ",\"gc\":{\"cycles\":" << nGcCycles
+	   << ",\"pauseNs\":" << gcPauseTime.count()
+	   << ",\"maxPauseNs\":" << maxGcPauseTime.count()
+	   << ",\"szReclaimed\":" << szReclaimed
+	   << "},\"genericCache\":{\"hits\":" << nGenericCacheHits << ",\"misses\":" << nGenericCacheMisses
+	   << "},\"quickIns\":{\"hits\":" << nQuickInsHits << ",\"misses\":" << nQuickInsMisses
+	   << "},\"inlineCaches\":{\"hits\":" << nInlineCacheHits << ",\"misses\":" << nInlineCacheMisses
+	   << "},\"nativeCalls\":" << nNativeCalls
+	   << ",\"codeHeap\":{\"szReserved\":" << szCodeReserved
+	   << ",\"szInUse\":" << szCodeInUse
+	   << ",\"blobs\":" << nCodeBlobs
+	   << ",\"pages\":" << nCodePages
+	   << ",\"protectCalls\":" << nCodeProtectCalls << '}';
+
+	os << ",\"moduleLoadNs\":{";
+	isFirst = true;
+	for (auto &i : moduleLoadTimes) {
+		if (!isFirst)
+			os << ',';
+		isFirst = false;
+		_writeJSONString(os, i.first);
+		os << ':' << i.second.count();
+	}
+	os << "}}";
+}
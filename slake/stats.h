@@ -0,0 +1,81 @@
+#ifndef _SLAKE_STATS_H_
+#define _SLAKE_STATS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+#include "opcode.h"
+#include "type.h"
+
+namespace slake {
+	constexpr size_t N_OPCODES = (size_t)Opcode::QUICK_OPCODE_MAX;
+
+	/// @brief Statistics of a runtime, see Runtime::getStats().
+	///
+	/// Every counter is accumulated since the runtime was created.
+	struct RuntimeStats final {
+		/// @brief Numbers of instructions executed by the interpreter,
+		/// indexed by opcode. Instructions executed by compiled code are not
+		/// counted.
+		uint64_t nExecutedIns[N_OPCODES] = {};
+
+		/// @brief Numbers of created values, indexed by type ID.
+		uint64_t nAllocs[N_TYPE_IDS] = {};
+		/// @brief Size of memory allocated for values, in bytes.
+		uint64_t szAllocated = 0;
+		/// @brief Size of memory which is in use by values, in bytes.
+		size_t szInUse = 0;
+
+		uint64_t nGcCycles = 0;
+		std::chrono::nanoseconds gcPauseTime{}, maxGcPauseTime{};
+		/// @brief Size of memory freed by the GC cycles, in bytes.
+		uint64_t szReclaimed = 0;
+
+		/// @brief Lookups of instantiated generic values.
+		uint64_t nGenericCacheHits = 0, nGenericCacheMisses = 0;
+
+		/// @brief Executions of type-specialized instructions, which missed
+		/// if the operands did not match the specialized types and the
+		/// instructions were rewritten back into the generic ones.
+		uint64_t nQuickInsHits = 0, nQuickInsMisses = 0;
+
+		/// @brief Lookups of receiver classes of MCALL and RLOAD in the
+		/// receiver slots of their sites, which missed if the class was not
+		/// recorded by the site yet or the site is megamorphic. Receivers
+		/// which are not objects are not counted.
+		uint64_t nInlineCacheHits = 0, nInlineCacheMisses = 0;
+
+		/// @brief Calls to native functions by the interpreter.
+		uint64_t nNativeCalls = 0;
+
+		/// @brief Executable memory of the JIT compiler: size of the mapped
+		/// regions and of the code in them in bytes, number of compiled
+		/// functions and of the pages which hold their code, and number of
+		/// protection changes of the pages.
+		size_t szCodeReserved = 0, szCodeInUse = 0;
+		size_t nCodeBlobs = 0, nCodePages = 0;
+		uint64_t nCodeProtectCalls = 0;
+
+		/// @brief Time spent on loading each module, keyed by full name.
+		std::map<std::string, std::chrono::nanoseconds> moduleLoadTimes;
+
+		uint64_t getExecutedInsCount() const;
+		uint64_t getAllocCount() const;
+
+		/// @brief Write the statistics in human-readable text, counters
+		/// which are zero are omitted.
+		void writeText(std::ostream &os) const;
+		/// @brief Write the statistics as a JSON object.
+		void writeJSON(std::ostream &os) const;
+	};
+
+	enum class StatsFormat : uint8_t {
+		Text,
+		JSON
+	};
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <iomanip>
+
+using namespace slake;
+
+static void _writeJSONString(std::ostream &os, const std::string &s) {
+	os << '"';
+	for (char c : s) {
+		switch (c) {
+			case '"':
+				os << "\\\"";
+				break;
+			case '\\':
+				os << "\\\\";
+				break;
+			default:
+				if ((unsigned char)c < 0x20)
+					os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+				else
+					os << c;
+		}
+	}
+	os << '"';
+}
+
+/// @brief Write a time in microseconds, which are used by the format.
+static void _writeTime(std::ostream &os, std::chrono::nanoseconds time) {
+	os << time.count() / 1000 << '.' << std::setw(3) << std::setfill('0') << time.count() % 1000 << std::setfill(' ');
+}
+
+uint32_t Trace::_getThreadIndex(std::thread::id thread) {
+	if (auto it = _threadIndices.find(thread); it != _threadIndices.end())
+		return it->second;
+
+	uint32_t index = (uint32_t)_threadIndices.size();
+	_threadIndices[thread] = index;
+	return index;
+}
+
+void Trace::addEvent(
+	char phase,
+	const char *category,
+	std::string name,
+	std::chrono::steady_clock::time_point beginTime,
+	std::chrono::steady_clock::time_point endTime) {
+	TraceEvent event;
+	event.phase = phase;
+	event.category = category;
+	event.name = std::move(name);
+	event.thread = _getThreadIndex(std::this_thread::get_id());
+	// Events which began before clearing are clamped.
+	event.time = std::max(beginTime - _beginTime, std::chrono::steady_clock::duration{});
+	event.duration = phase == 'X' ? endTime - beginTime : std::chrono::nanoseconds{};
+
+	_events.push_back(std::move(event));
+}
+
+void Trace::clear() {
+	_events.clear();
+	_threadIndices.clear();
+	_beginTime = std::chrono::steady_clock::now();
+}
+
+void Trace::writeJSON(std::ostream &os) const {
+	os << "{\"traceEvents\":[";
+
+	bool isFirst = true;
+	for (auto &i : _threadIndices) {
+		if (!isFirst)
+			os << ",\n";
+		isFirst = false;
+
+		os << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << i.second
+		   << ",\"args\":{\"name\":\"thread-" << i.second << "\"}}";
+	}
+
+	for (auto &i : _events) {
+		if (!isFirst)
+			os << ",\n";
+		isFirst = false;
+
+		os << "{\"ph\":\"" << i.phase << "\",\"cat\":\"" << i.category << "\",\"pid\":1,\"tid\":" << i.thread << ",\"ts\":";
+		_writeTime(os, i.time);
+
+		if (i.phase == 'X') {
+			os << ",\"dur\":";
+			_writeTime(os, i.duration);
+		}
+		// Instant events are shown on their threads.
+		if (i.phase == 'i')
+			os << ",\"s\":\"t\"";
+		if (i.phase != 'E') {
+			os << ",\"name\":";
+			_writeJSONString(os, i.name);
+		}
+
+		os << '}';
+	}
+
+	os << "],\"displayTimeUnit\":\"ns\"}\n";
+}
@@ -0,0 +1,83 @@
+#ifndef _SLAKE_TRACE_H_
+#define _SLAKE_TRACE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace slake {
+	using TraceFlags = uint8_t;
+	constexpr static TraceFlags
+		// Calls to script functions.
+		TRACE_CALLS = 0x01,
+		// Phases of GC cycles.
+		TRACE_GC = 0x02,
+		// Decoding of modules.
+		TRACE_LOADS = 0x04,
+		// Calls to native functions.
+		TRACE_NATIVE_CALLS = 0x08,
+		// Switches between contexts and coroutines.
+		TRACE_SWITCHES = 0x10,
+		TRACE_ALL = 0xff;
+
+	/// @brief Options of the tracer, see Runtime::startTracing().
+	struct TraceOptions final {
+		TraceFlags flags = TRACE_ALL;
+		/// @brief Full names of modules whose functions are traced, functions
+		/// of every module are traced if empty. Submodules are included.
+		std::vector<std::string> modules;
+		/// @brief Trace one of every N calls to script functions of each
+		/// thread, calls which are not sampled are still executed as usual
+		/// but their callees may be sampled.
+		uint32_t callSampleInterval = 1;
+	};
+
+	/// @brief Event of a trace, see Trace.
+	struct TraceEvent final {
+		char phase;				// 'B' for begin, 'E' for end, 'X' for complete and 'i' for instant events
+		const char *category;	// Category of the event
+		std::string name;		// Name of the event, not used by end events
+		uint32_t thread;		// Index of the thread
+		std::chrono::nanoseconds time;		// Time since the trace was started
+		std::chrono::nanoseconds duration;	// Duration of complete events
+	};
+
+	/// @brief Timeline recorded by the tracer, see Runtime::startTracing().
+	class Trace final {
+	private:
+		std::vector<TraceEvent> _events;
+		std::map<std::thread::id, uint32_t> _threadIndices;
+		std::chrono::steady_clock::time_point _beginTime = std::chrono::steady_clock::now();
+
+		uint32_t _getThreadIndex(std::thread::id thread);
+
+	public:
+		/// @brief Add an event of current thread.
+		/// @param phase Phase of the event, see TraceEvent.
+		/// @param category Category of the event, which must be a literal.
+		/// @param name Name of the event.
+		/// @param beginTime Time when the event began.
+		/// @param endTime Time when complete events ended.
+		void addEvent(
+			char phase,
+			const char *category,
+			std::string name,
+			std::chrono::steady_clock::time_point beginTime,
+			std::chrono::steady_clock::time_point endTime = {});
+		/// @brief Drop every event, times of new events are relative to the
+		/// time of clearing.
+		void clear();
+
+		inline size_t getEventCount() const { return _events.size(); }
+
+		/// @brief Write the events in Chrome trace event format, which can be
+		/// opened by chrome://tracing and Perfetto.
+		void writeJSON(std::ostream &os) const;
+	};
+}
+
+#endif
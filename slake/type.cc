@@ -9,15 +9,19 @@ Type::Type(RefValue *ref, TypeFlags flags) : typeId(TypeId::Object), flags(flags
 }
 
 Type::~Type() {
+	// Types of array and map values, e.g. returned by getType(), do not have
+	// element types.
 	switch (typeId) {
 		case TypeId::Array: {
-			delete std::get<Type *>(exData);
+			if (auto elementType = std::get_if<Type *>(&exData); elementType)
+				delete *elementType;
 			break;
 		}
 		case TypeId::Map: {
-			auto pair = std::get<std::pair<Type *, Type *>>(exData);
-			delete pair.first;
-			delete pair.second;
+			if (auto pair = std::get_if<std::pair<Type *, Type *>>(&exData); pair) {
+				delete pair->first;
+				delete pair->second;
+			}
 		}
 	}
 }
@@ -38,6 +42,12 @@ void Type::loadDeferredType(const Runtime *rt) const {
 	if (!isLoadingDeferred())
 		return;
 
+	auto lock = rt->_lockLazyState();
+
+	// Resolved by another thread.
+	if (!isLoadingDeferred())
+		return;
+
 	auto ref = (RefValue *)getCustomTypeExData();
 	auto typeValue = rt->resolveRef(ref);
 	if (!typeValue)
@@ -217,6 +227,50 @@ bool slake::isCompatible(Type a, Type b) {
 	}
 }
 
+static const char *_typeIdNames[N_TYPE_IDS] = {
+	"none",
+	"u8",
+	"u16",
+	"u32",
+	"u64",
+	"i8",
+	"i16",
+	"i32",
+	"i64",
+	"f32",
+	"f64",
+	"bool",
+	"string",
+	"wstring",
+	"char",
+	"wchar",
+	"fn",
+	"module",
+	"var",
+	"array",
+	"map",
+	"class",
+	"interface",
+	"trait",
+	"object",
+	"any",
+	"alias",
+	"ref",
+	"generic-arg",
+	"root",
+	"typename",
+	"context",
+	"lvar-ref",
+	"reg-ref",
+	"arg-ref"
+};
+
+const char *slake::getTypeIdName(TypeId typeId) {
+	if ((size_t)typeId >= N_TYPE_IDS)
+		return "<unknown>";
+	return _typeIdNames[(size_t)typeId];
+}
+
 std::string std::to_string(const slake::Type &type, const slake::Runtime *rt) {
 	switch (type.typeId) {
 		case TypeId::I8:
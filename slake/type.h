@@ -54,6 +54,12 @@ namespace slake {
 		ArgRef,		  // Argument reference
 	};
 
+	constexpr size_t N_TYPE_IDS = (size_t)TypeId::ArgRef + 1;
+
+	/// @brief Get name of a type ID, which is used by statistics and heap
+	/// dumps.
+	const char *getTypeIdName(TypeId typeId);
+
 	template <typename T>
 	constexpr inline TypeId getValueType() {
 		if constexpr (std::is_same<T, std::int8_t>::value)
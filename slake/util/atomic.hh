@@ -0,0 +1,77 @@
+#ifndef _SLAKE_UTIL_ATOMIC_HH_
+#define _SLAKE_UTIL_ATOMIC_HH_
+
+#include <atomic>
+
+namespace slake {
+	namespace util {
+		/// @brief Atomic variable which can be copied with the structure
+		/// which contains it.
+		///
+		/// Copying loads the source and stores into the destination, which is
+		/// not atomic as a whole.
+		template <typename T>
+		class CopyableAtomic : public std::atomic<T> {
+		public:
+			inline CopyableAtomic() noexcept = default;
+			inline CopyableAtomic(T x) noexcept : std::atomic<T>(x) {}
+			inline CopyableAtomic(const CopyableAtomic &x) noexcept : std::atomic<T>(x.load()) {}
+
+			inline CopyableAtomic &operator=(const CopyableAtomic &x) noexcept {
+				this->store(x.load());
+				return *this;
+			}
+			inline CopyableAtomic &operator=(T x) noexcept {
+				this->store(x);
+				return *this;
+			}
+		};
+
+		/// @brief Variable which is read and written by several threads
+		/// without ordering, e.g. profiles and rewritten instructions.
+		///
+		/// Increments are a load and a store, increments from concurrent
+		/// threads may be lost, like the ones of compiled code.
+		template <typename T>
+		class RelaxedAtomic {
+		private:
+			std::atomic<T> _value;
+
+		public:
+			inline RelaxedAtomic() noexcept : _value(T()) {}
+			inline RelaxedAtomic(T x) noexcept : _value(x) {}
+			inline RelaxedAtomic(const RelaxedAtomic &x) noexcept : _value(x.load()) {}
+
+			inline T load() const noexcept {
+				return _value.load(std::memory_order_relaxed);
+			}
+			inline void store(T x) noexcept {
+				_value.store(x, std::memory_order_relaxed);
+			}
+
+			inline operator T() const noexcept {
+				return load();
+			}
+
+			inline RelaxedAtomic &operator=(const RelaxedAtomic &x) noexcept {
+				store(x.load());
+				return *this;
+			}
+			inline RelaxedAtomic &operator=(T x) noexcept {
+				store(x);
+				return *this;
+			}
+
+			inline T operator++() noexcept {
+				T x = load() + 1;
+				store(x);
+				return x;
+			}
+			inline T operator|=(T x) noexcept {
+				return _value.fetch_or(x, std::memory_order_relaxed) | x;
+			}
+		};
+	}
+}
+
+#endif
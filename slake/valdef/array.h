@@ -10,7 +10,7 @@ namespace slake {
 		std::deque<Value*> values;
 		Type type;
 
-		inline ArrayValue(Runtime *rt, Type type);
+		ArrayValue(Runtime *rt, Type type);
 		virtual ~ArrayValue();
 
 		virtual inline Type getType() const override { return TypeId::Array; }
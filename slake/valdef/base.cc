@@ -7,7 +7,7 @@ bool slake::_isRuntimeInDestruction(Runtime *runtime) {
 }
 
 Value::Value(Runtime *rt) : _rt(rt) {
-	rt->_createdValues.insert(this);
+	rt->_getAllocBuffer()->values.push_back(this);
 	reportSizeAllocatedToRuntime(sizeof(*this));
 }
 
@@ -38,17 +38,27 @@ std::deque<std::pair<Scope *, MemberValue *>> slake::Value::getMemberChain(const
 
 Value &slake::Value::operator=(const Value &x) {
 	_rt = x._rt;
-	_flags = x._flags & ~VF_WALKED;
+	_flags = x._flags & ~(VF_WALKED | VF_ARENA);
 	scope = x.scope ? x.scope->duplicate() : nullptr;
 
 	return *this;
 }
 
 void Value::reportSizeAllocatedToRuntime(size_t size) {
-	_rt->_szMemInUse += size;
+	_szReported += (uint32_t)size;
+
+	auto buffer = _rt->_getAllocBuffer();
+#if SLAKE_ENABLE_STATS
+	Runtime::_countStat(buffer->szAllocated, size);
+#endif
+	if ((buffer->szDelta += size) > Runtime::SZ_ALLOC_BUFFER_FLUSH)
+		_rt->_flushAllocSize(buffer);
 }
 
 void Value::reportSizeFreedToRuntime(size_t size) {
-	assert(_rt->_szMemInUse >= size);
-	_rt->_szMemInUse -= size;
+	_szReported -= (uint32_t)size;
+
+	auto buffer = _rt->_getAllocBuffer();
+	if ((buffer->szDelta -= size) < -Runtime::SZ_ALLOC_BUFFER_FLUSH)
+		_rt->_flushAllocSize(buffer);
 }
@@ -107,7 +107,9 @@ namespace slake {
 	using ValueFlags = uint8_t;
 	constexpr static ValueFlags
 		VF_WALKED = 0x01,  // The value has been walked by the garbage collector.
-		VF_ALIAS = 0x02	   // The value is an alias thus the scope should not be deleted.
+		VF_ALIAS = 0x02,   // The value is an alias thus the scope should not be deleted.
+		VF_ARENA = 0x04,   // The value was constructed in a value arena and cannot be deleted directly.
+		VF_LITERAL = 0x08  // The value is a literal of a module, e.g. an operand, which is shared by every execution.
 		;
 
 	struct Type;
@@ -126,6 +128,9 @@ namespace slake {
 
 		Runtime *_rt;
 		ValueFlags _flags = 0;
+		/// @brief Size of memory reported by the value, see
+		/// reportSizeAllocatedToRuntime().
+		uint32_t _szReported = 0;
 
 		Scope *scope = nullptr;
 
@@ -14,7 +14,6 @@ ContextValue::~ContextValue() {
 }
 
 ValueRef<> ContextValue::resume() {
-	_context->flags &= ~CTX_YIELDED;
 	return _context->majorFrames.back().curFn->exec(_context);
 }
 
@@ -25,3 +24,23 @@ ValueRef<> ContextValue::getResult() {
 bool ContextValue::isDone() {
 	return _context->flags & CTX_DONE;
 }
+
+bool ContextValue::isPreempted() {
+	return _context->flags & CTX_PREEMPTED;
+}
+
+void ContextValue::setBudget(const ExecBudget &budget) {
+	_context->budget = budget;
+}
+
+const ExecBudget &ContextValue::getBudget() {
+	return _context->budget;
+}
+
+uint64_t ContextValue::getExecutedInsCount() {
+	return _context->nExecutedIns;
+}
+
+std::chrono::nanoseconds ContextValue::getExecTime() {
+	return _context->execTime;
+}
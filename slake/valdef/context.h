@@ -2,16 +2,19 @@
 #define _SLAKE_VALDEF_CONTEXT_H_
 
 #include "base.h"
+#include <chrono>
 #include <memory>
 
 namespace slake {
 	struct Context;
+	struct ExecBudget;
 
 	class ContextValue final : public Value {
 	private:
 		std::shared_ptr<Context> _context;
 
 		friend class Runtime;
+		friend class FnValue;
 
 	public:
 		ContextValue(Runtime *rt, std::shared_ptr<Context> context);
@@ -25,6 +28,24 @@ namespace slake {
 		ValueRef<> getResult();
 		bool isDone();
 
+		/// @brief Check if the context was preempted since its budget was
+		/// exhausted, it can be resumed after extending the budget.
+		bool isPreempted();
+
+		/// @brief Set budget of the context, which is used for following
+		/// resumptions.
+		void setBudget(const ExecBudget &budget);
+		const ExecBudget &getBudget();
+
+		/// @brief Get number of instructions executed by the context, the
+		/// coroutines which it awaited are not included.
+		uint64_t getExecutedInsCount();
+		/// @brief Get wall time spent on executing the context, which
+		/// includes time blocked in native functions and time the thread was
+		/// preempted by the system. Like the deadlines of budgets, it is
+		/// measured with ExecBudget::Clock.
+		std::chrono::nanoseconds getExecTime();
+
 		inline ContextValue &operator=(const ContextValue &x) {
 			((Value &)*this) = (Value &)x;
 
@@ -20,49 +20,216 @@ slake::FnValue::FnValue(Runtime *rt, uint32_t nIns, AccessModifier access, Type
 FnValue::~FnValue() {
 	// Because the runtime will release all values, so we just fill the body with 0
 	// (because the references do not release objects they held).
-	if (_rt->_flags & _RT_DELETING)
-		memset((void *)body, 0, sizeof(Instruction) * nIns);
-
 	if (body) {
+		if (_rt->_flags & _RT_DELETING)
+			memset((void *)body, 0, sizeof(Instruction) * nIns);
+
 		delete[] body;
 		body = nullptr;
+
+		reportSizeFreedToRuntime(sizeof(Instruction) * nIns);
+	}
+
+	resetFeedback();
+
+#if SLAKE_ENABLE_JIT
+	delete _jitCode.load();
+	delete _pendingJITCode;
+#endif
+
+	reportSizeFreedToRuntime(sizeof(*this) - sizeof(BasicFnValue));
+}
+
+void InsFeedback::recordOperands(const Value *lhs, const Value *rhs) {
+	if (lhs)
+		lhsTypes |= typeBit(lhs->getType().typeId);
+	if (rhs)
+		rhsTypes |= typeBit(rhs->getType().typeId);
+}
+
+bool InsFeedback::recordReceiver(const Value *receiver) {
+	if (!receiver)
+		return false;
+
+	recordOperands(receiver);
+
+	if (megamorphic || receiver->getType() != TypeId::Object)
+		return false;
+
+	auto cls = (const ClassValue *)((const ObjectValue *)receiver)->getType().getCustomTypeExData();
+	uint8_t n = nReceivers;
+	for (uint8_t i = 0; i < n; ++i) {
+		if (receivers[i] == cls)
+			return true;
 	}
 
-	reportSizeFreedToRuntime(sizeof(*this) - sizeof(BasicFnValue) + sizeof(Instruction) * nIns);
+	if (n < MAX_RECEIVERS) {
+		receivers[n] = cls;
+		nReceivers = n + 1;
+	} else
+		megamorphic = true;
+	return false;
+}
+
+InsFeedback &FnValue::_getFeedback(uint32_t offIns) const {
+	auto feedback = _feedback.load(std::memory_order_acquire);
+	if (!feedback) {
+		// Threads which are executing the function concurrently may allocate
+		// the slots at the same time, the first one is used.
+		auto newFeedback = new InsFeedback[nIns]();
+		if (_feedback.compare_exchange_strong(feedback, newFeedback, std::memory_order_acq_rel)) {
+			feedback = newFeedback;
+			((FnValue *)this)->reportSizeAllocatedToRuntime(sizeof(InsFeedback) * nIns);
+		} else
+			delete[] newFeedback;
+	}
+	return feedback[offIns];
+}
+
+void FnValue::resetFeedback() {
+	if (auto feedback = _feedback.exchange(nullptr); feedback) {
+		delete[] feedback;
+		reportSizeFreedToRuntime(sizeof(InsFeedback) * nIns);
+	}
+}
+
+void FnValue::loadBody() const {
+	if (!isBodyLoaded())
+		_rt->_loadLazyFnBody((FnValue *)this);
 }
 
 ValueRef<> FnValue::exec(std::shared_ptr<Context> context) const {
-	if (context->flags & CTX_DONE)
+	// Contexts which are awaited, executed or queued by other threads are
+	// rejected atomically.
+	ContextFlags flags = context->claim(CTX_RUNNING, CTX_YIELDED | CTX_PREEMPTED);
+	if (flags & CTX_DONE)
 		throw std::logic_error("Executing with a done context");
+	if (flags & (CTX_RUNNING | CTX_SCHEDULED))
+		throw std::logic_error("Executing with a running context");
 
+	// Failed executions release the context themselves.
+	ValueRef<> result = _exec(context);
+	context->flags &= ~CTX_RUNNING;
+	return result;
+}
+
+ValueRef<> FnValue::_exec(std::shared_ptr<Context> context) const {
 	// Save previous context
-	std::shared_ptr<Context> savedContext;
-	if (_rt->activeContexts.count(std::this_thread::get_id()))
-		savedContext = _rt->activeContexts.at(std::this_thread::get_id());
+	Context *savedContext = Runtime::_curContext;
+	Runtime *savedRuntime = Runtime::_execRuntime;
 
-	_rt->activeContexts[std::this_thread::get_id()] = context;
+	// Nested executions on a thread are counted once for the safepoints.
+	bool isCounted = savedRuntime != _rt && _rt->_enterExecution();
+	Runtime::_execRuntime = _rt;
+
+	_rt->_addRunningContext(context.get());
 
 	bool isDestructing = _rt->destructingThreads.count(std::this_thread::get_id());
 
+	// Context which is being executed, it is switched to the coroutines which
+	// are awaited and back to their resumers without leaving the loop.
+	// Contexts which were preempted in a coroutine resume the coroutine.
+	Context *curContext = context.get();
+	while (curContext->awaitee)
+		curContext = curContext->awaitee->_context.get();
+	Runtime::_curContext = curContext;
+
+	if (_rt->_isTracing.load(std::memory_order_relaxed))
+		_rt->_traceSwitchIn(curContext, nullptr);
+
+	// Time is accounted to the contexts on switching between them.
+	auto timeSwitched = ExecBudget::Clock::now();
+	auto accountTime = [&timeSwitched](Context *context) {
+		auto now = ExecBudget::Clock::now();
+		context->execTime += now - timeSwitched;
+		timeSwitched = now;
+	};
+
 	try {
-		while (context->majorFrames.back().curIns != UINT32_MAX) {
-			if (context->majorFrames.back().curIns >= context->majorFrames.back().curFn->nIns)
-				throw OutOfFnBodyError("Out of function body");
+		while (true) {
+			auto &curFrame = curContext->majorFrames.back();
+
+			if ((curContext->flags & (CTX_YIELDED | CTX_PREEMPTED | _CTX_AWAITING)) || curFrame.curIns == UINT32_MAX) {
+				accountTime(curContext);
+
+				bool isTracing = _rt->_isTracing.load(std::memory_order_relaxed);
+				if (isTracing)
+					_rt->_traceSwitchOut(curContext);
+
+				if (curContext->flags & CTX_PREEMPTED) {
+					curContext->flags &= ~CTX_PREEMPTED;
+					context->flags |= CTX_PREEMPTED;
+					break;
+				}
+
+				const char *switchReason;
+				if (curContext->flags & _CTX_AWAITING) {
+					curContext->flags &= (ContextFlags)~_CTX_AWAITING;
+					curContext = curContext->awaitee->_context.get();
+					switchReason = "await";
+				} else if (curContext->resumer) {
+					curContext = _rt->_switchToResumer(curContext);
+					switchReason = "resume";
+				} else
+					break;
+
+				Runtime::_curContext = curContext;
+				if (isTracing)
+					_rt->_traceSwitchIn(curContext, switchReason);
+				continue;
+			}
 
-			if (context->flags & CTX_YIELDED)
-				break;
+			if (curFrame.curIns >= curFrame.curFn->nIns)
+				throw OutOfFnBodyError("Out of function body");
 
-			// Pause if the runtime is in GC
-			while ((getRuntime()->_flags & _RT_INGC) && !isDestructing)
-				std::this_thread::yield();
+			// Stop if another thread is collecting.
+			_rt->_pollSafepoint();
+			_rt->_pollProfiler(context.get());
 
-			getRuntime()->_execIns(context.get(), context->majorFrames.back().curFn->body[context->majorFrames.back().curIns]);
+#if SLAKE_ENABLE_JIT
+			if (curFrame.curFn->_jitCode)
+				getRuntime()->_execJITCode(curContext);
+			else
+#endif
+				getRuntime()->_execIns(curContext, curFrame.curFn->body[curFrame.curIns]);
 
 			if ((_rt->_szMemInUse > (_rt->_szMemUsedAfterLastGc << 1)) && !isDestructing)
 				_rt->gc();
 		}
 	} catch (...) {
-		context->flags |= CTX_DONE;
+		accountTime(curContext);
+
+		// Current context is restored before rethrowing, keep the failed one
+		// reachable from the error.
+		try {
+			throw;
+		} catch (RuntimeExecError &e) {
+			if (!e.context) {
+				e.context = context;
+				while (e.context.get() != curContext && e.context->awaitee)
+					e.context = e.context->awaitee->_context;
+			}
+		} catch (...) {
+		}
+
+		if (_rt->_isTracing.load(std::memory_order_relaxed))
+			_rt->_traceSwitchOut(curContext);
+
+		// Coroutines which were being awaited cannot be resumed either.
+		for (Context *i = curContext, *resumer; i; i = resumer) {
+			resumer = i->resumer;
+
+			i->flags = (i->flags & ~(CTX_RUNNING | _CTX_AWAITING)) | CTX_DONE;
+			i->resumer = nullptr;
+			i->awaitee = nullptr;
+		}
+
+		_rt->_removeRunningContext(context.get());
+		Runtime::_curContext = savedContext;
+		Runtime::_execRuntime = savedRuntime;
+		if (isCounted)
+			_rt->_leaveExecution();
+
 		std::rethrow_exception(std::current_exception());
 	}
 
@@ -70,21 +237,39 @@ ValueRef<> FnValue::exec(std::shared_ptr<Context> context) const {
 	if (((_rt->_szMemInUse >> 1) > _rt->_szMemUsedAfterLastGc) && !isDestructing)
 		_rt->gc();
 
-	// Restore previous context
-	if (savedContext)
-		_rt->activeContexts[std::this_thread::get_id()] = savedContext;
-	else
-		_rt->activeContexts.erase(std::this_thread::get_id());
+	ValueRef<> result;
+	if (context->flags & (CTX_YIELDED | CTX_PREEMPTED))
+		result = new ContextValue(_rt, context);
+	else {
+		context->flags |= CTX_DONE;
+		result = context->majorFrames.back().returnValue;
+	}
 
-	if (context->flags & CTX_YIELDED)
-		return new ContextValue(_rt, context);
+	// Restore previous context
+	_rt->_removeRunningContext(context.get());
+	Runtime::_curContext = savedContext;
+	Runtime::_execRuntime = savedRuntime;
+	if (isCounted)
+		_rt->_leaveExecution();
 
-	context->flags |= CTX_DONE;
-	return context->majorFrames.back().returnValue;
+	return result;
 }
 
 ValueRef<> FnValue::call(Value *thisObject, std::deque<Value *> args) const {
+	return call(thisObject, args, {});
+}
+
+ValueRef<> FnValue::call(Value *thisObject, std::deque<Value *> args, const ExecBudget &budget) const {
+	// Variables of the arguments are not reachable until the execution starts.
+	Runtime::ExecScope execScope(_rt);
+
+	loadBody();
+#if SLAKE_ENABLE_JIT
+	_rt->_countFnCall((FnValue *)this);
+#endif
+
 	std::shared_ptr<Context> context = std::make_shared<Context>();
+	context->budget = budget;
 
 	{
 		auto frame = MajorFrame(_rt);
@@ -97,7 +282,17 @@ ValueRef<> FnValue::call(Value *thisObject, std::deque<Value *> args) const {
 		frame.curIns = 0;
 		frame.scopeValue = _parent;
 		frame.thisObject = thisObject;
+
+		for (size_t i = 0; i < args.size(); ++i) {
+			VarValue *argVar = new VarValue(_rt, ACCESS_PUB, i < paramTypes.size() ? paramTypes[i] : TypeId::Any);
+			argVar->setData(args[i]);
+			frame.argStack.push_back(argVar);
+		}
+
 		context->majorFrames.push_back(frame);
+
+		if (_rt->_isTracing.load(std::memory_order_relaxed))
+			_rt->_traceCall(context.get(), context->majorFrames.back());
 	}
 
 	return exec(context);
@@ -124,15 +319,53 @@ Value *FnValue::duplicate() const {
 	return (Value *)v;
 }
 
+/// @brief Check if an operand is a target of a reference which was
+/// resolved by the linker.
+static bool _isLinkedOperand(const Value *operand) {
+	switch (operand->getType().typeId) {
+		case TypeId::Var:
+		case TypeId::Fn:
+		case TypeId::Class:
+		case TypeId::Interface:
+		case TypeId::Trait:
+		case TypeId::Module:
+		case TypeId::Alias:
+		case TypeId::RootValue:
+			return true;
+		default:
+			return false;
+	}
+}
+
 FnValue &slake::FnValue::operator=(const FnValue &x) {
 	((BasicFnValue &)*this) = (BasicFnValue &)x;
 
+#if SLAKE_ENABLE_JIT
+	// Compiled code refers to the old body, compile the new one again if it
+	// is called frequently.
+	delete _jitCode.load();
+	_jitCode = nullptr;
+	delete _pendingJITCode;
+	_pendingJITCode = nullptr;
+	_nCalls = 0;
+#endif
+
+	resetFeedback();
+
 	// Delete existing function body.
 	if (body) {
 		delete[] body;
 		body = nullptr;
+		reportSizeFreedToRuntime(sizeof(Instruction) * nIns);
 	}
 
+	// Share the undecoded body, each copy decodes it by itself.
+	_bodyImage = x._bodyImage;
+	_offBody = x._offBody;
+	_linkBody = x._linkBody;
+	_isBodyLoaded = !_bodyImage;
+	_switchTables = x._switchTables;
+
 	// Copy the function body if the source function is not abstract.
 	if (x.body) {
 		body = new Instruction[x.nIns];
@@ -142,22 +375,20 @@ FnValue &slake::FnValue::operator=(const FnValue &x) {
 			// Duplicate current instruction from the source function.
 			auto ins = x.body[i];
 
-			// Copy each operand.
+			// Copy each operand, members are targets of linked references
+			// and are shared.
 			for (size_t j = 0; j < ins.operands.size(); ++j) {
 				auto &operand = ins.operands[j];
-				if (operand)
+				if (operand && !_isLinkedOperand(operand))
 					operand = operand->duplicate();
 			}
 
 			// Move current instruction into the function body.
 			body[i] = ins;
 		}
-	}
 
-	if (nIns > x.nIns)
-		reportSizeFreedToRuntime(sizeof(Instruction) * (nIns - x.nIns));
-	else
-		reportSizeAllocatedToRuntime(sizeof(Instruction) * (x.nIns - nIns));
+		reportSizeAllocatedToRuntime(sizeof(Instruction) * x.nIns);
+	}
 
 	nIns = x.nIns;
 
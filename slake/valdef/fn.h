@@ -3,20 +3,101 @@
 
 #include <slake/opcode.h>
 #include <slake/slxfmt.h>
+#include <slake/util/atomic.hh>
 
+#include <atomic>
 #include <functional>
 #include <deque>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "member.h"
 #include "generic.h"
 
 namespace slake {
 	struct Context;
+	struct ExecBudget;
+	class ModuleImage;
+	class ICodePage;
+	class CodeHeap;
+	struct JITRuntimeInfo;
+
+	/// @brief Lookup table of a CONSTSW instruction, which is built from its
+	/// case table when the body is verified.
+	struct SwitchTable final {
+		TypeId keyType = TypeId::None;	// Type of the case keys
+		uint32_t defaultDest = 0;		// Destination if no case matched
+
+		// Integral keys in a dense range are looked up with an array, where
+		// UINT32_MAX marks the holes, the others with hash tables.
+		uint64_t minKey = 0;
+		std::vector<uint32_t> denseDests;
+		std::unordered_map<uint64_t, uint32_t> intDests;
+		std::unordered_map<std::string, uint32_t> strDests;
+	};
 
 	struct Instruction final {
-		Opcode opcode = (Opcode)0xffff;
+		/// @brief Opcode, which is rewritten in place by the interpreter
+		/// while other threads may be executing the instruction.
+		util::RelaxedAtomic<Opcode> opcode = (Opcode)0xffff;
 		std::deque<Value *> operands;
+
+		/// @brief Lookup table of CONSTSW, which is owned by the function,
+		/// null if the case table is invalid.
+		const SwitchTable *switchTable = nullptr;
+	};
+
+	class ClassValue;
+
+	/// @brief Profile of an instruction site which is recorded by the
+	/// interpreter, for specializing the instruction.
+	struct InsFeedback final {
+		/// @brief Maximum number of receiver classes, sites with more classes
+		/// are megamorphic.
+		static constexpr uint8_t MAX_RECEIVERS = 4;
+
+		// Slots are updated by concurrent executions without ordering,
+		// increments and receivers may be lost.
+		util::RelaxedAtomic<uint32_t> nExecs = 0;  // Number of executions
+
+		// Bitmasks of TypeIds of the source operands, e.g. operands of
+		// arithmetic and comparison instructions, and receivers.
+		util::RelaxedAtomic<uint64_t> lhsTypes = 0, rhsTypes = 0;
+
+		// Classes of object receivers of MCALL and RLOAD.
+		util::RelaxedAtomic<const ClassValue *> receivers[MAX_RECEIVERS] = {};
+		util::RelaxedAtomic<uint8_t> nReceivers = 0;
+		util::RelaxedAtomic<bool> megamorphic = false;
+
+		// Branch directions of JT and JF.
+		util::RelaxedAtomic<uint32_t> nTaken = 0, nNotTaken = 0;
+
+		inline static uint64_t typeBit(TypeId typeId) noexcept { return (uint64_t)1 << (uint8_t)typeId; }
+
+		inline bool hasLhsType(TypeId typeId) const noexcept { return lhsTypes & typeBit(typeId); }
+		inline bool hasRhsType(TypeId typeId) const noexcept { return rhsTypes & typeBit(typeId); }
+
+		/// @brief Check if the site observed at most a single type for each
+		/// operand and at most a single receiver class.
+		inline bool isMonomorphic() const noexcept {
+			return !(lhsTypes & (lhsTypes - 1)) &&
+				   !(rhsTypes & (rhsTypes - 1)) &&
+				   nReceivers <= 1 && !megamorphic;
+		}
+
+		void recordOperands(const Value *lhs, const Value *rhs = nullptr);
+		/// @brief Record a receiver of MCALL or RLOAD.
+		/// @return true if the receiver is an object whose class was recorded
+		/// by the site before.
+		bool recordReceiver(const Value *receiver);
+		inline void recordBranch(bool taken) noexcept {
+			if (taken)
+				++nTaken;
+			else
+				++nNotTaken;
+		}
 	};
 
 	class BasicFnValue : public MemberValue {
@@ -27,6 +108,7 @@ namespace slake {
 
 		friend class Runtime;
 		friend class ClassValue;
+		friend class CallHandle;
 
 	public:
 		inline BasicFnValue(
@@ -68,9 +150,48 @@ namespace slake {
 		Instruction *body = nullptr;
 		uint32_t nIns;
 
+		/// @brief Image which contains the undecoded body, null if the body
+		/// was decoded.
+		std::shared_ptr<ModuleImage> _bodyImage;
+		/// @brief Offset of the undecoded body in the image.
+		size_t _offBody = 0;
+		/// @brief Link the body after decoding it.
+		bool _linkBody = false;
+		/// @brief Set once the body was decoded and linked, checked before
+		/// locking for decoding.
+		std::atomic_bool _isBodyLoaded = true;
+
+		/// @brief Feedback slots of the instructions, allocated on first
+		/// execution.
+		mutable std::atomic<InsFeedback *> _feedback = nullptr;
+
+		InsFeedback &_getFeedback(uint32_t offIns) const;
+
+		/// @brief Lookup tables of CONSTSW instructions, which are immutable
+		/// once the body was verified and shared by copies of the function.
+		std::vector<std::shared_ptr<const SwitchTable>> _switchTables;
+
+		/// @brief Execute a context which was claimed with CTX_RUNNING, see
+		/// Context::claim().
+		ValueRef<> _exec(std::shared_ptr<Context> context) const;
+
+#if SLAKE_ENABLE_JIT
+		/// @brief Number of calls, the function is compiled once it reaches
+		/// SLAKE_JIT_THRESHOLD, increments from concurrent calls may be lost.
+		std::atomic_uint32_t _nCalls = 0;
+		/// @brief Compiled code, null if the function was not compiled.
+		std::atomic<ICodePage *> _jitCode = nullptr;
+		/// @brief Code which was compiled in a write batch of the code heap,
+		/// it is moved into _jitCode once the batch is flushed.
+		ICodePage *_pendingJITCode = nullptr;
+#endif
+
 		friend class Runtime;
 		friend class ObjectValue;
 		friend struct FnComparator;
+#if SLAKE_ENABLE_JIT
+		friend ICodePage *compileFn(CodeHeap &heap, const FnValue *fn, const JITRuntimeInfo &info);
+#endif
 
 	public:
 		std::deque<slxfmt::SourceLocDesc> sourceLocDescs;
@@ -98,11 +219,44 @@ namespace slake {
 		virtual ~FnValue();
 
 		inline uint32_t getInsCount() const noexcept { return nIns; }
-		inline const Instruction *getBody() const noexcept { return body; }
-		inline Instruction *getBody() noexcept { return body; }
+		inline const Instruction *getBody() const {
+			loadBody();
+			return body;
+		}
+		inline Instruction *getBody() {
+			loadBody();
+			return body;
+		}
+
+		/// @brief Check if the body was decoded.
+		inline bool isBodyLoaded() const noexcept { return _isBodyLoaded.load(std::memory_order_acquire); }
+
+		/// @brief Decode the body if it was left in the image by the loader.
+		void loadBody() const;
+
+		/// @brief Get feedback of an instruction.
+		/// @param offIns Offset of the instruction.
+		/// @return Feedback of the instruction, nullptr if the function was
+		/// never executed.
+		inline const InsFeedback *getFeedback(uint32_t offIns) const {
+			auto feedback = _feedback.load(std::memory_order_acquire);
+			if (!feedback || offIns >= nIns)
+				return nullptr;
+			return &feedback[offIns];
+		}
+
+		/// @brief Drop recorded feedback of the function.
+		void resetFeedback();
 
 		ValueRef<> exec(std::shared_ptr<Context> context) const;
 		virtual ValueRef<> call(Value *thisObject, std::deque<Value *> args) const override;
+		/// @brief Call the function on a budget.
+		/// @param thisObject `this' object for method calls.
+		/// @param args Arguments of the call.
+		/// @param budget Budget of the execution, see ExecBudget.
+		/// @return Result of the call, or the context if it yielded or was
+		/// preempted, which can be resumed with ContextValue::resume().
+		ValueRef<> call(Value *thisObject, std::deque<Value *> args, const ExecBudget &budget) const;
 
 		virtual bool isAbstract() const override {
 			return nIns == 0;
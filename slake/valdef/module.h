@@ -4,11 +4,15 @@
 #include "member.h"
 #include <unordered_map>
 #include <map>
+#include <vector>
 
 namespace slake {
 	class ModuleValue : public MemberValue {
 	public:
 		std::unordered_map<std::string, RefValue *> imports;
+		/// @brief Values of the constant pool of the image, which are shared
+		/// by instructions of the module. Entries are decoded on first uses.
+		std::vector<Value *> consts;
 
 		ModuleValue(Runtime *rt, AccessModifier access);
 		virtual ~ModuleValue();
@@ -1,6 +1,8 @@
 #include <bcparse.hh>
 #include <bclex.h>
+#include <slake/slxconv.h>
 #include <fstream>
+#include <sstream>
 
 using namespace slake;
 #define printmsg(msg, ...) std::printf("slkbcc: " msg, ##__VA_ARGS__)
@@ -109,7 +111,13 @@ int main(int argc, char **argv) {
 			}
 			fs.exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
 
-			slake::bcc::compile(fs);
+			// The compiler emits v0 images, convert them before writing.
+			std::stringstream ss;
+			slake::bcc::compile(ss);
+
+			std::string image = ss.str();
+			image = slake::slxfmt::upgradeImage(image.data(), image.size());
+			fs.write(image.data(), image.size());
 
 			fs.close();
 		} catch (slake::bcc::parser::syntax_error e) {
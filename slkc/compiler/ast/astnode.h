@@ -26,6 +26,7 @@ namespace slake {
 
 			CompiledFn,
 			LabelRef,
+			SwitchTable,
 			LocalVar,
 			ArgRef,
 			GenericArgRef,
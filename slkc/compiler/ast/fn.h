@@ -146,6 +146,22 @@ namespace slake {
 			virtual inline NodeType getNodeType() const override { return NodeType::LabelRef; }
 		};
 
+		/// @brief Case table of CONSTSW instructions, destinations of the cases
+		/// are labels which are resolved with the other label references.
+		class SwitchTableNode final : public AstNode {
+		public:
+			deque<pair<shared_ptr<ExprNode>, string>> cases;
+
+			inline SwitchTableNode() = default;
+			virtual ~SwitchTableNode() = default;
+
+			virtual inline Location getLocation() const override {
+				throw std::logic_error("Should not get location of a switch table");
+			}
+
+			virtual inline NodeType getNodeType() const override { return NodeType::SwitchTable; }
+		};
+
 		class RegRefNode final : public AstNode {
 		public:
 			uint32_t index;
@@ -319,7 +319,7 @@ namespace slake {
 
 			virtual inline Location getLocation() const override { return _loc; }
 
-			virtual inline StmtType getStmtType() const override { return StmtType::CodeBlock; }
+			virtual inline StmtType getStmtType() const override { return StmtType::Switch; }
 		};
 	}
 }
@@ -88,6 +88,45 @@ static map<BinaryOp, BinaryOp> _assignBinaryOpToOrdinaryBinaryOpMap = {
 	{ BinaryOp::AssignRsh, BinaryOp::Rsh }
 };
 
+/// @brief Select the type-specialized variant of an instruction for operands
+/// whose type is statically known.
+/// @param opcode Generic opcode.
+/// @param type Type of the operands.
+/// @return Specialized opcode, or the generic opcode if there is no variant
+/// for the type.
+static slake::Opcode _selectTypedOpcode(slake::Opcode opcode, shared_ptr<TypeNameNode> type) {
+	if (!type)
+		return opcode;
+
+	slake::QuickVariant variant;
+	switch (type->getTypeId()) {
+		case Type::I32:
+			variant = slake::QV_I32;
+			break;
+		case Type::I64:
+			variant = slake::QV_I64;
+			break;
+		case Type::U32:
+			variant = slake::QV_U32;
+			break;
+		case Type::U64:
+			variant = slake::QV_U64;
+			break;
+		case Type::F32:
+			variant = slake::QV_F32;
+			break;
+		case Type::F64:
+			variant = slake::QV_F64;
+			break;
+		default:
+			return opcode;
+	}
+
+	if (auto typedOpcode = slake::getQuickOpcode(opcode, variant); typedOpcode != slake::Opcode::OPCODE_MAX)
+		return typedOpcode;
+	return opcode;
+}
+
 void Compiler::compileExpr(shared_ptr<ExprNode> expr) {
 	slxfmt::SourceLocDesc sld;
 	sld.offIns = curFn->body.size();
@@ -159,8 +198,9 @@ void Compiler::compileExpr(shared_ptr<ExprNode> expr) {
 						Opcode::STORE,
 						make_shared<RegRefNode>(lhsValueRegIndex),
 						make_shared<RegRefNode>(lhsRegIndex, true));
+					// The RHS was converted into the type of the LHS.
 					curFn->insertIns(
-						opcode,
+						_selectTypedOpcode(opcode, lhsType),
 						make_shared<RegRefNode>(rhsRegIndex),
 						make_shared<RegRefNode>(lhsValueRegIndex, true),
 						make_shared<RegRefNode>(rhsRegIndex, true));
@@ -172,14 +212,15 @@ void Compiler::compileExpr(shared_ptr<ExprNode> expr) {
 				if ((curMajorContext.curMinorContext.evalPurpose != EvalPurpose::Stmt) && (curMajorContext.curMinorContext.evalDest))
 					curFn->insertIns(Opcode::STORE, curMajorContext.curMinorContext.evalDest, make_shared<RegRefNode>(rhsRegIndex, true));
 			} else if (curMajorContext.curMinorContext.evalPurpose != EvalPurpose::Stmt) {
+				// The RHS was converted into the type of the LHS.
 				curFn->insertIns(
-					_binaryOpRegs.at(e->op).opcode,
+					_selectTypedOpcode(_binaryOpRegs.at(e->op).opcode, lhsType),
 					curMajorContext.curMinorContext.evalDest,
 					make_shared<RegRefNode>(lhsRegIndex, true),
 					make_shared<RegRefNode>(rhsRegIndex, true));
 			} else
 				curFn->insertIns(
-					_binaryOpRegs.at(e->op).opcode,
+					_selectTypedOpcode(_binaryOpRegs.at(e->op).opcode, lhsType),
 					make_shared<RegRefNode>(lhsRegIndex),
 					make_shared<RegRefNode>(lhsRegIndex, true),
 					make_shared<RegRefNode>(rhsRegIndex, true));
@@ -327,12 +368,18 @@ void Compiler::compileExpr(shared_ptr<ExprNode> expr) {
 
 			auto e = static_pointer_cast<AwaitExprNode>(expr);
 
-			if (auto ce = evalConstExpr(e); ce) {
+			if (auto ce = evalConstExpr(e->target); ce) {
 				curFn->insertIns(Opcode::AWAIT, ce);
 			} else {
-				// TODO: Check if the target is a method.
-				// compileExpr(e->target, curMajorContext.curMinorContext.evalPurpose, make_shared<RegRefNode>(RegId::R0));
-				// curFn->insertIns(Opcode::AWAIT, make_shared<RegRefNode>(RegId::R0));
+				compileExpr(e->target, EvalPurpose::RValue, make_shared<RegRefNode>(awaitTargetRegIndex));
+				curFn->insertIns(Opcode::AWAIT, make_shared<RegRefNode>(awaitTargetRegIndex, true));
+			}
+
+			// The yielded or returned value is received like results of calls.
+			if (curMajorContext.curMinorContext.evalPurpose != EvalPurpose::Stmt) {
+				curFn->insertIns(
+					Opcode::LRET,
+					curMajorContext.curMinorContext.evalDest);
 			}
 
 			break;
@@ -188,9 +188,23 @@ void Compiler::compileStmt(shared_ptr<StmtNode> stmt) {
 				} else {
 					uint32_t tmpRegIndex = allocReg();
 
-					if (isSameType(evalExprType(s->returnValue), returnType))
+					if (isSameType(evalExprType(s->returnValue), returnType)) {
 						compileExpr(s->returnValue, EvalPurpose::RValue, make_shared<RegRefNode>(tmpRegIndex));
-					else
+
+						// Results of calls which are returned directly can reuse the
+						// caller's frame, the runtime falls back to normal calls if
+						// the frame has exception handlers.
+						if (s->returnValue->getExprType() == ExprType::Call) {
+							auto &body = curFn->body;
+							if (body.size() >= 2 && body.back().opcode == Opcode::LRET) {
+								auto &callIns = body[body.size() - 2];
+								if (callIns.opcode == Opcode::CALL)
+									callIns.opcode = Opcode::TAILCALL;
+								else if (callIns.opcode == Opcode::MCALL)
+									callIns.opcode = Opcode::MTAILCALL;
+							}
+						}
+					} else
 						compileExpr(make_shared<CastExprNode>(s->returnValue->getLocation(), returnType, s->returnValue), EvalPurpose::RValue, make_shared<RegRefNode>(tmpRegIndex));
 
 					curFn->insertIns(Opcode::RET, make_shared<RegRefNode>(tmpRegIndex, true));
@@ -300,8 +314,7 @@ void Compiler::compileStmt(shared_ptr<StmtNode> stmt) {
 			auto loc = s->getLocation();
 
 			string labelPrefix = "$switch_" + to_string(loc.line) + "_" + to_string(loc.column),
-				   condLocalVarName = labelPrefix + "_cond",
-				   defaultLabel = labelPrefix + "_label",
+				   defaultLabel = labelPrefix + "_default",
 				   endLabel = labelPrefix + "_end";
 
 			pushMinorContext();
@@ -314,14 +327,33 @@ void Compiler::compileStmt(shared_ptr<StmtNode> stmt) {
 
 			compileExpr(s->expr, EvalPurpose::RValue, make_shared<RegRefNode>(matcheeRegIndex));
 
+			auto matcheeType = evalExprType(s->expr);
+
+			// Switches whose cases are all constants of the matchee's type are
+			// dispatched by the runtime with a lookup table.
+			bool isConstSwitch;
+			switch (matcheeType->getTypeId()) {
+				case Type::I8:
+				case Type::I16:
+				case Type::I32:
+				case Type::I64:
+				case Type::U8:
+				case Type::U16:
+				case Type::U32:
+				case Type::U64:
+				case Type::Bool:
+				case Type::String:
+					isConstSwitch = true;
+					break;
+				default:
+					isConstSwitch = false;
+			}
+
 			SwitchCase *defaultCase = nullptr;
+			auto switchTable = make_shared<SwitchTableNode>();
 
 			for (size_t i = 0; i < s->cases.size(); ++i) {
 				auto &curCase = s->cases[i];
-				string caseBeginLabel = labelPrefix + "_case" + to_string(i) + "_end",
-					   caseEndLabel = labelPrefix + "_case" + to_string(i) + "_end";
-
-				curFn->insertLabel(caseBeginLabel);
 
 				if (!curCase.condition) {
 					if (defaultCase)
@@ -331,26 +363,54 @@ void Compiler::compileStmt(shared_ptr<StmtNode> stmt) {
 								MessageType::Error,
 								"Duplicated default case" });
 					defaultCase = &curCase;
+					continue;
+				}
+
+				if (isConstSwitch) {
+					if (auto ce = evalConstExpr(curCase.condition); ce && isSameType(evalExprType(ce), matcheeType))
+						switchTable->cases.push_back({ ce, labelPrefix + "_case" + to_string(i) });
+					else
+						isConstSwitch = false;
 				}
+			}
+
+			string noMatchLabel = defaultCase ? defaultLabel : endLabel;
 
-				compileExpr(curCase.condition, EvalPurpose::RValue, make_shared<RegRefNode>(conditionRegIndex));
+			if (isConstSwitch)
 				curFn->insertIns(
-					Opcode::EQ,
-					make_shared<RegRefNode>(conditionRegIndex),
+					Opcode::CONSTSW,
 					make_shared<RegRefNode>(matcheeRegIndex, true),
-					make_shared<RegRefNode>(conditionRegIndex, true));
-				curFn->insertIns(Opcode::JF, make_shared<LabelRefNode>(caseEndLabel), make_shared<RegRefNode>(conditionRegIndex));
+					switchTable,
+					make_shared<LabelRefNode>(noMatchLabel));
+			else {
+				for (size_t i = 0; i < s->cases.size(); ++i) {
+					auto &curCase = s->cases[i];
+					if (!curCase.condition)
+						continue;
+
+					compileExpr(curCase.condition, EvalPurpose::RValue, make_shared<RegRefNode>(conditionRegIndex));
+					curFn->insertIns(
+						Opcode::EQ,
+						make_shared<RegRefNode>(conditionRegIndex),
+						make_shared<RegRefNode>(matcheeRegIndex, true),
+						make_shared<RegRefNode>(conditionRegIndex, true));
+					curFn->insertIns(
+						Opcode::JT,
+						make_shared<LabelRefNode>(labelPrefix + "_case" + to_string(i)),
+						make_shared<RegRefNode>(conditionRegIndex, true));
+				}
+				curFn->insertIns(Opcode::JMP, make_shared<LabelRefNode>(noMatchLabel));
+			}
 
-				compileStmt(make_shared<BlockStmtNode>(curCase.loc, curCase.body));
+			for (size_t i = 0; i < s->cases.size(); ++i) {
+				auto &curCase = s->cases[i];
 
-				curFn->insertLabel(caseEndLabel);
+				curFn->insertLabel(curCase.condition ? labelPrefix + "_case" + to_string(i) : defaultLabel);
 
-				if (i + 1 < s->cases.size())
-					curFn->insertIns(Opcode::JMP, make_shared<LabelRefNode>(labelPrefix + "_case" + to_string(i + 1) + "_end"));
-			}
+				compileStmt(make_shared<BlockStmtNode>(curCase.loc, curCase.body));
 
-			if (defaultCase)
-				compileStmt(make_shared<BlockStmtNode>(defaultCase->loc, defaultCase->body));
+				curFn->insertIns(Opcode::JMP, make_shared<LabelRefNode>(endLabel));
+			}
 
 			curFn->insertLabel(endLabel);
 
@@ -376,17 +376,33 @@ void Compiler::compileScope(std::istream &is, std::ostream &os, shared_ptr<Scope
 
 			_write(os, ih);
 
+			auto resolveLabel = [&i](const string &label) -> shared_ptr<ExprNode> {
+				if (!i.second->labels.count(label))
+					throw FatalCompilationError(
+						Message(
+							i.second->getLocation(),
+							MessageType::Error,
+							"Undefined label: " + label));
+				return make_shared<U32LiteralExprNode>(i.second->getLocation(), i.second->labels.at(label));
+			};
+
 			for (auto &k : j.operands) {
 				if (k) {
-					if (k->getNodeType() == NodeType::LabelRef) {
-						auto &label = static_pointer_cast<LabelRefNode>(k)->label;
-						if (!i.second->labels.count(label))
-							throw FatalCompilationError(
-								Message(
-									i.second->getLocation(),
-									MessageType::Error,
-									"Undefined label: " + static_pointer_cast<LabelRefNode>(k)->label));
-						k = make_shared<U32LiteralExprNode>(i.second->getLocation(), i.second->labels.at(label));
+					switch (k->getNodeType()) {
+						case NodeType::LabelRef:
+							k = resolveLabel(static_pointer_cast<LabelRefNode>(k)->label);
+							break;
+						case NodeType::SwitchTable: {
+							// Case tables are written as arrays of keys and destinations.
+							deque<shared_ptr<ExprNode>> elements;
+							for (auto &l : static_pointer_cast<SwitchTableNode>(k)->cases) {
+								elements.push_back(l.first);
+								elements.push_back(resolveLabel(l.second));
+							}
+							k = make_shared<ArrayExprNode>(i.second->getLocation(), elements);
+							break;
+						}
+						default:;
 					}
 				}
 				compileValue(os, k);
@@ -746,6 +762,19 @@ void Compiler::compileValue(std::ostream &fs, shared_ptr<AstNode> value) {
 					compileRef(fs, static_pointer_cast<RefExprNode>(expr)->ref);
 					break;
 				}
+				case ExprType::Array: {
+					auto &elements = static_pointer_cast<ArrayExprNode>(expr)->elements;
+
+					vd.type = slxfmt::Type::Array;
+					_write(fs, vd);
+
+					// Elements of constant arrays may be of different types.
+					_write(fs, slxfmt::Type::Any);
+					_write(fs, (uint32_t)elements.size());
+					for (auto &i : elements)
+						compileValue(fs, i);
+					break;
+				}
 				default:
 					assert(false);
 			}
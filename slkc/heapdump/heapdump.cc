@@ -0,0 +1,372 @@
+#include "heapdump.h"
+
+#include <slake/type.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <unordered_map>
+#include <vector>
+
+using namespace slake;
+
+constexpr static uint32_t _NODE_NONE = UINT32_MAX;
+
+/// @brief Graph of a heap dump, node 0 is a virtual root which refers to
+/// every root and the values are the following nodes.
+struct HeapGraph final {
+	std::vector<std::string> strings;
+	std::vector<slhfmt::RootRecord> roots;
+
+	std::vector<uint8_t> typeIds;
+	std::vector<uint32_t> szShallow;
+	std::vector<uint32_t> names;
+
+	// Successors of each node, in compressed rows.
+	std::vector<uint32_t> succOffsets;
+	std::vector<uint32_t> succs;
+
+	inline size_t getNodeCount() const { return typeIds.size(); }
+};
+
+template <typename T>
+static T _read(std::istream &fs) {
+	T value;
+	if (!fs.read((char *)&value, sizeof(T)))
+		throw heapdump::HeapDumpError("Premature end of the heap dump");
+	return value;
+}
+
+static void _readGraph(std::istream &fs, HeapGraph &g) {
+	auto hdh = _read<slhfmt::HeapDumpHeader>(fs);
+	if (memcmp(hdh.magic, slhfmt::HDH_MAGIC, sizeof(hdh.magic)))
+		throw heapdump::HeapDumpError("Bad heap dump magic");
+	if (hdh.fmtVer != slhfmt::FMTVER_CURRENT)
+		throw heapdump::HeapDumpError("Unsupported heap dump version " + std::to_string(hdh.fmtVer));
+
+	for (uint32_t i = 0; i < hdh.nStrings; ++i) {
+		uint32_t len = _read<uint32_t>(fs);
+		std::string s(len, '\0');
+		if (!fs.read(s.data(), len))
+			throw heapdump::HeapDumpError("Premature end of the heap dump");
+		g.strings.push_back(std::move(s));
+	}
+
+	for (uint32_t i = 0; i < hdh.nRoots; ++i) {
+		auto rr = _read<slhfmt::RootRecord>(fs);
+		if (rr.index >= hdh.nValues)
+			throw heapdump::HeapDumpError("Root refers to an invalid value");
+		g.roots.push_back(rr);
+	}
+
+	g.typeIds.push_back(0);
+	g.szShallow.push_back(0);
+	g.names.push_back(slhfmt::IDX_NULL);
+	g.succOffsets.push_back(0);
+	for (auto &i : g.roots)
+		g.succs.push_back(i.index + 1);
+
+	for (uint32_t i = 0; i < hdh.nValues; ++i) {
+		auto vrh = _read<slhfmt::ValueRecordHeader>(fs);
+		if (vrh.name != slhfmt::IDX_NULL && vrh.name >= hdh.nStrings)
+			throw heapdump::HeapDumpError("Value #" + std::to_string(i) + " refers to an invalid string");
+
+		g.typeIds.push_back(vrh.typeId);
+		g.szShallow.push_back(vrh.szShallow);
+		g.names.push_back(vrh.name);
+		g.succOffsets.push_back((uint32_t)g.succs.size());
+
+		for (uint32_t j = 0; j < vrh.nRefs; ++j) {
+			uint32_t index = _read<uint32_t>(fs);
+			if (index >= hdh.nValues)
+				throw heapdump::HeapDumpError("Value #" + std::to_string(i) + " refers to an invalid value");
+			g.succs.push_back(index + 1);
+		}
+	}
+	g.succOffsets.push_back((uint32_t)g.succs.size());
+}
+
+/// @brief Compute immediate dominators of the nodes which are reachable from
+/// the virtual root, with the algorithm by Cooper, Harvey and Kennedy.
+///
+/// @param g Graph to be analyzed.
+/// @param postorder Where the reachable nodes are stored in postorder.
+/// @return Immediate dominators, or _NODE_NONE for unreachable nodes.
+static std::vector<uint32_t> _computeDominators(const HeapGraph &g, std::vector<uint32_t> &postorder) {
+	size_t nNodes = g.getNodeCount();
+
+	std::vector<uint32_t> postIndices(nNodes, _NODE_NONE);
+
+	// Heaps are usually too deep to be walked recursively.
+	{
+		std::vector<bool> visited(nNodes);
+		std::vector<std::pair<uint32_t, uint32_t>> stack;
+
+		visited[0] = true;
+		stack.push_back({ 0, g.succOffsets[0] });
+		while (stack.size()) {
+			auto &top = stack.back();
+			if (top.second < g.succOffsets[top.first + 1]) {
+				uint32_t succ = g.succs[top.second++];
+				if (!visited[succ]) {
+					visited[succ] = true;
+					stack.push_back({ succ, g.succOffsets[succ] });
+				}
+				continue;
+			}
+
+			postIndices[top.first] = (uint32_t)postorder.size();
+			postorder.push_back(top.first);
+			stack.pop_back();
+		}
+	}
+
+	std::vector<uint32_t> predOffsets(nNodes + 1), preds;
+	for (auto i : postorder) {
+		for (uint32_t j = g.succOffsets[i]; j < g.succOffsets[i + 1]; ++j)
+			++predOffsets[g.succs[j] + 1];
+	}
+	for (size_t i = 0; i < nNodes; ++i)
+		predOffsets[i + 1] += predOffsets[i];
+	preds.resize(predOffsets[nNodes]);
+	{
+		std::vector<uint32_t> fill(predOffsets.begin(), predOffsets.end() - 1);
+		for (auto i : postorder) {
+			for (uint32_t j = g.succOffsets[i]; j < g.succOffsets[i + 1]; ++j)
+				preds[fill[g.succs[j]]++] = i;
+		}
+	}
+
+	std::vector<uint32_t> idoms(nNodes, _NODE_NONE);
+	idoms[0] = 0;
+
+	auto intersect = [&idoms, &postIndices](uint32_t a, uint32_t b) {
+		while (a != b) {
+			while (postIndices[a] < postIndices[b])
+				a = idoms[a];
+			while (postIndices[b] < postIndices[a])
+				b = idoms[b];
+		}
+		return a;
+	};
+
+	for (bool changed = true; changed;) {
+		changed = false;
+
+		// Walk in reverse postorder, the virtual root is the last one.
+		for (size_t i = postorder.size() - 1; i-- > 0;) {
+			uint32_t node = postorder[i], newIdom = _NODE_NONE;
+
+			for (uint32_t j = predOffsets[node]; j < predOffsets[node + 1]; ++j) {
+				uint32_t pred = preds[j];
+				if (idoms[pred] == _NODE_NONE)
+					continue;
+				newIdom = newIdom == _NODE_NONE ? pred : intersect(pred, newIdom);
+			}
+
+			if (idoms[node] != newIdom) {
+				idoms[node] = newIdom;
+				changed = true;
+			}
+		}
+	}
+
+	return idoms;
+}
+
+static std::string _getGroupName(const HeapGraph &g, uint32_t node) {
+	if ((TypeId)g.typeIds[node] == TypeId::Object && g.names[node] != slhfmt::IDX_NULL)
+		return g.strings[g.names[node]];
+	return getTypeIdName((TypeId)g.typeIds[node]);
+}
+
+static std::string _getNodeLabel(const HeapGraph &g, uint32_t node) {
+	std::string s = "#" + std::to_string(node - 1) + " " + getTypeIdName((TypeId)g.typeIds[node]);
+	if (g.names[node] != slhfmt::IDX_NULL)
+		s += " " + g.strings[g.names[node]];
+	return s;
+}
+
+static const char *_getRootKindName(uint8_t kind) {
+	switch (kind) {
+		case slhfmt::ROOT_RUNTIME:
+			return "runtime";
+		case slhfmt::ROOT_HOST:
+			return "host";
+		case slhfmt::ROOT_CONTEXT:
+			return "context";
+		default:
+			return "unknown";
+	}
+}
+
+void slake::heapdump::analyze(std::istream &fs, std::ostream &os, size_t nTop) {
+	HeapGraph g;
+	_readGraph(fs, g);
+
+	size_t nNodes = g.getNodeCount();
+
+	std::vector<uint32_t> postorder;
+	auto idoms = _computeDominators(g, postorder);
+
+	// Dominated nodes are finished before their dominators in postorder.
+	std::vector<uint64_t> retainedSizes(g.szShallow.begin(), g.szShallow.end());
+	for (auto i : postorder) {
+		if (i)
+			retainedSizes[idoms[i]] += retainedSizes[i];
+	}
+
+	uint64_t szTotal = 0, szReachable = retainedSizes[0];
+	for (auto i : g.szShallow)
+		szTotal += i;
+
+	os << "Values: " << nNodes - 1 << ", " << szTotal << " bytes\n";
+	os << "Reachable: " << postorder.size() - 1 << ", " << szReachable << " bytes\n";
+	os << "Unreachable: " << nNodes - postorder.size() << ", " << szTotal - szReachable << " bytes\n";
+
+	//
+	// Classes
+	//
+	struct Group {
+		std::string name;
+		uint64_t nValues = 0, szShallow = 0, szRetained = 0;
+		size_t nActive = 0;
+	};
+	std::vector<Group> groups;
+	std::vector<uint32_t> groupIndices(nNodes, _NODE_NONE);
+	{
+		std::unordered_map<std::string, uint32_t> groupMap;
+		for (auto i : postorder) {
+			if (!i)
+				continue;
+
+			auto name = _getGroupName(g, i);
+			auto it = groupMap.find(name);
+			if (it == groupMap.end()) {
+				it = groupMap.insert({ name, (uint32_t)groups.size() }).first;
+				groups.push_back({ name });
+			}
+			groupIndices[i] = it->second;
+
+			auto &group = groups[it->second];
+			++group.nValues;
+			group.szShallow += g.szShallow[i];
+		}
+	}
+
+	// Instances which are dominated by other instances of the same group
+	// are retained by them, count only the outermost ones.
+	{
+		std::vector<uint32_t> childOffsets(nNodes + 1), children;
+		for (auto i : postorder) {
+			if (i)
+				++childOffsets[idoms[i] + 1];
+		}
+		for (size_t i = 0; i < nNodes; ++i)
+			childOffsets[i + 1] += childOffsets[i];
+		children.resize(childOffsets[nNodes]);
+		{
+			std::vector<uint32_t> fill(childOffsets.begin(), childOffsets.end() - 1);
+			for (auto i : postorder) {
+				if (i)
+					children[fill[idoms[i]]++] = i;
+			}
+		}
+
+		std::vector<std::pair<uint32_t, uint32_t>> stack;
+		stack.push_back({ 0, childOffsets[0] });
+		while (stack.size()) {
+			auto &top = stack.back();
+			if (top.second < childOffsets[top.first + 1]) {
+				uint32_t child = children[top.second++];
+
+				auto &group = groups[groupIndices[child]];
+				if (!group.nActive++)
+					group.szRetained += retainedSizes[child];
+
+				stack.push_back({ child, childOffsets[child] });
+				continue;
+			}
+
+			if (top.first)
+				--groups[groupIndices[top.first]].nActive;
+			stack.pop_back();
+		}
+	}
+
+	std::sort(groups.begin(), groups.end(), [](const Group &a, const Group &b) {
+		return a.szRetained > b.szRetained;
+	});
+
+	os << "\nClasses:\n";
+	os << std::setw(12) << "Retained" << std::setw(12) << "Shallow" << std::setw(10) << "Count"
+	   << "  Class\n";
+	for (auto &i : groups) {
+		os << std::setw(12) << i.szRetained << std::setw(12) << i.szShallow << std::setw(10) << i.nValues
+		   << "  " << i.name << "\n";
+	}
+
+	//
+	// Roots
+	//
+	{
+		std::vector<uint8_t> rootKinds(nNodes, UINT8_MAX);
+		std::vector<uint32_t> rootNodes;
+		for (auto &i : g.roots) {
+			if (rootKinds[i.index + 1] == UINT8_MAX)
+				rootNodes.push_back(i.index + 1);
+			rootKinds[i.index + 1] = std::min(rootKinds[i.index + 1], i.kind);
+		}
+
+		std::sort(rootNodes.begin(), rootNodes.end(), [&retainedSizes](uint32_t a, uint32_t b) {
+			return retainedSizes[a] > retainedSizes[b];
+		});
+		if (rootNodes.size() > nTop)
+			rootNodes.resize(nTop);
+
+		// Roots which are retained by other roots are not retaining their
+		// values exclusively.
+		os << "\nRoots:\n";
+		os << std::setw(12) << "Retained" << std::setw(10) << "Kind"
+		   << "  Value\n";
+		for (auto i : rootNodes) {
+			os << std::setw(12) << retainedSizes[i] << std::setw(10) << _getRootKindName(rootKinds[i])
+			   << "  " << _getNodeLabel(g, i);
+			if (idoms[i])
+				os << " (retained by " << _getNodeLabel(g, idoms[i]) << ")";
+			os << "\n";
+		}
+	}
+
+	//
+	// Top retainers
+	//
+	{
+		std::vector<uint32_t> topNodes;
+		for (auto i : postorder) {
+			if (i)
+				topNodes.push_back(i);
+		}
+
+		auto nReported = std::min(nTop, topNodes.size());
+		std::partial_sort(topNodes.begin(), topNodes.begin() + nReported, topNodes.end(), [&retainedSizes](uint32_t a, uint32_t b) {
+			return retainedSizes[a] > retainedSizes[b];
+		});
+		topNodes.resize(nReported);
+
+		os << "\nTop retainers:\n";
+		for (auto i : topNodes) {
+			os << std::setw(12) << retainedSizes[i] << "  " << _getNodeLabel(g, i) << "\n";
+
+			std::vector<uint32_t> path;
+			for (auto j = idoms[i]; j; j = idoms[j])
+				path.push_back(j);
+
+			os << std::setw(14) << ""
+			   << "path: <root>";
+			for (auto j = path.rbegin(); j != path.rend(); ++j)
+				os << " > " << _getNodeLabel(g, *j);
+			os << "\n";
+		}
+	}
+}
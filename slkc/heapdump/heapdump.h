@@ -0,0 +1,34 @@
+#ifndef _SLKC_HEAPDUMP_HEAPDUMP_H_
+#define _SLKC_HEAPDUMP_HEAPDUMP_H_
+
+#include <slake/slhfmt.h>
+
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace slake {
+	namespace heapdump {
+		class HeapDumpError : public std::runtime_error {
+		public:
+			inline HeapDumpError(std::string msg) : runtime_error(msg) {}
+			virtual ~HeapDumpError() = default;
+		};
+
+		/// @brief Analyze a heap dump which was written by
+		/// Runtime::dumpHeap() and write a report.
+		///
+		/// Retained sizes are computed from the dominator tree of the values
+		/// which are reachable from the roots, and are summarized by classes,
+		/// by roots and by the largest retainers with their dominator paths.
+		///
+		/// @param fs Stream of the heap dump.
+		/// @param os Stream to write the report into.
+		/// @param nTop Number of the largest retainers to be reported.
+		/// @throw HeapDumpError The heap dump is malformed.
+		void analyze(std::istream &fs, std::ostream &os, size_t nTop = 20);
+	}
+}
+
+#endif
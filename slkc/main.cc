@@ -1,7 +1,9 @@
 #include <slake/util/debug.h>
+#include <slake/slxconv.h>
 
 #include "compiler/compiler.h"
 #include "decompiler/decompiler.h"
+#include "heapdump/heapdump.h"
 
 #include <config.h>
 
@@ -11,6 +13,7 @@
 
 #include <filesystem>
 #include <fstream>
+#include <sstream>
 
 using namespace slake::slkc;
 
@@ -29,6 +32,7 @@ static inline char *fetchArg(int argc, char **argv, int &i) {
 enum class AppAction : uint8_t {
 	Compile = 0,
 	Dump,
+	AnalyzeHeap,
 	LspServer
 };
 
@@ -37,6 +41,8 @@ std::string srcPath = "", outPath = "";
 AppAction action = AppAction::Compile;
 std::deque<std::string> modulePaths;
 uint16_t lspServerPort = 8080;
+bool stripDebugInfo = false;
+size_t nTopRetainers = 20;
 
 struct CmdLineAction {
 	const char *options;
@@ -54,6 +60,20 @@ CmdLineAction cmdLineActions[] = {
 		[](int argc, char **argv, int &i) {
 			action = AppAction::Dump;
 		} },
+	{ "-H\0"
+	  "--analyze-heap\0",
+		[](int argc, char **argv, int &i) {
+			action = AppAction::AnalyzeHeap;
+		} },
+	{ "--top\0",
+		[](int argc, char **argv, int &i) {
+			nTopRetainers = strtoul(fetchArg(argc, argv, i), nullptr, 10);
+		} },
+	{ "-S\0"
+	  "--strip-debug-info\0",
+		[](int argc, char **argv, int &i) {
+			stripDebugInfo = true;
+		} },
 	{ "-l\0"
 	  "--no-source-location-info\0",
 		[](int argc, char **argv, int &i) {
@@ -131,7 +151,13 @@ int main(int argc, char **argv) {
 				compiler->modulePaths = modulePaths;
 
 				try {
-					compiler->compile(is, os);
+					// The compiler emits v0 images, convert them before writing.
+					std::ostringstream ss;
+					compiler->compile(is, ss);
+
+					std::string image = ss.str();
+					image = slake::slxfmt::upgradeImage(image.data(), image.size(), stripDebugInfo);
+					os.write(image.data(), image.size());
 				} catch (FatalCompilationError e) {
 					fprintf(stderr, "Error at %zd, %zd: %s\n", e.message.loc.line, e.message.loc.column, e.message.msg.c_str());
 					return -1;
@@ -146,6 +172,28 @@ int main(int argc, char **argv) {
 
 				slake::decompiler::decompile(fs, std::cout);
 
+				fs.close();
+				break;
+			}
+			case AppAction::AnalyzeHeap: {
+				if (!srcPath.length()) {
+					fputs("Error: Missing input file\n", stderr);
+					return EINVAL;
+				}
+
+				std::ifstream fs(srcPath, std::ios::binary);
+				if (!fs) {
+					fprintf(stderr, "Error: Cannot open %s\n", srcPath.c_str());
+					return ENOENT;
+				}
+
+				try {
+					slake::heapdump::analyze(fs, std::cout, nTopRetainers);
+				} catch (slake::heapdump::HeapDumpError e) {
+					fprintf(stderr, "Error: %s\n", e.what());
+					return -1;
+				}
+
 				fs.close();
 				break;
 			}
@@ -0,0 +1,123 @@
+// Calls functions repeatedly through call handles, which keep their
+// contexts between calls and across errors, and are detached from their
+// runtime once it is destroyed.
+
+#include "test.h"
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 3);
+
+	// add(x, y): x + y.
+	w.beginFn("add", T::I32, { T::I32, T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::ADD, 3); w.reg(0); w.argValue(0); w.argValue(1);
+	w.ins(Opcode::RET, 1); w.regValue(0);
+	w.endFn();
+
+	w.beginFn("thrower", T::I32);
+	w.ins(Opcode::NOP);
+	w.ins(Opcode::ABORT);
+	w.endFn();
+
+	// twice(x): x * 2, calls thrower() if x is negative.
+	w.beginFn("twice", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(2);
+	w.ins(Opcode::LT, 3); w.reg(0); w.argValue(0); w.i32(0);
+	w.ins(Opcode::JT, 2); w.label(5); w.regValue(0);
+	w.ins(Opcode::MUL, 3); w.reg(1); w.argValue(0); w.i32(2);
+	w.ins(Opcode::RET, 1); w.regValue(1);
+	w.ins(Opcode::LOAD, 2); w.reg(1); w.ref({ "test", "thrower" });
+	w.ins(Opcode::CALL, 1); w.regValue(1);
+	w.ins(Opcode::RET, 1); w.i32(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+/// @brief Call a handle which must throw, and get the context of the error.
+static std::shared_ptr<Context> callThrowing(CallHandle &handle, Value *arg) {
+	try {
+		handle.call(nullptr, { arg });
+	} catch (UncaughtExceptionError &e) {
+		SLAKE_TEST_CHECK(e.context);
+		return e.context;
+	}
+	SLAKE_TEST_CHECK(false);
+	return {};
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	std::string image = buildModule();
+
+	{
+		Runtime rt(flags);
+		auto mod = rt.loadModule(image.data(), image.size(), 0);
+
+		// Calls through the handle cross the JIT threshold.
+		CallHandle add((FnValue *)mod->scope->getMember("add"));
+		SLAKE_TEST_CHECK(add.isAttached());
+		for (int32_t i = 0; i < N_WARMUP_CALLS; ++i) {
+			ValueRef<> x = new I32Value(&rt, i), y = new I32Value(&rt, 1);
+			SLAKE_TEST_CHECK(getI32(add.call(nullptr, { x.get(), y.get() })) == i + 1);
+			SLAKE_TEST_CHECK(!rt.getActiveContext());
+		}
+
+		// Errors leave the frames of the context, which are kept for
+		// tracebacks until the next call, and the context is reused by the
+		// following calls.
+		CallHandle twice((FnValue *)mod->scope->getMember("twice"));
+		ValueRef<> negative = new I32Value(&rt, -1);
+		auto context = callThrowing(twice, negative.get());
+		SLAKE_TEST_CHECK(context->majorFrames.size() == 3);
+		SLAKE_TEST_CHECK(rt.getFullName(context->majorFrames.back().curFn) == "test.thrower");
+		SLAKE_TEST_CHECK(!rt.getActiveContext());
+
+		for (int32_t i = 0; i < N_WARMUP_CALLS; ++i) {
+			ValueRef<> x = new I32Value(&rt, i);
+			SLAKE_TEST_CHECK(getI32(twice.call(nullptr, { x.get() })) == i * 2);
+			SLAKE_TEST_CHECK(context->majorFrames.size() == 1);
+
+			if (!(i % 16))
+				SLAKE_TEST_CHECK(callThrowing(twice, negative.get()) == context);
+		}
+
+		// Arguments are not kept alive by the handles.
+		rt.gc();
+		ValueRef<> x = new I32Value(&rt, 20);
+		SLAKE_TEST_CHECK(getI32(twice.call(nullptr, { x.get() })) == 40);
+	}
+
+	// Handles which outlive their runtime throw on calls.
+	{
+		std::unique_ptr<CallHandle> handle;
+		{
+			Runtime rt(flags);
+			auto mod = rt.loadModule(image.data(), image.size(), 0);
+			handle = std::make_unique<CallHandle>((FnValue *)mod->scope->getMember("add"));
+
+			ValueRef<> x = new I32Value(&rt, 1), y = new I32Value(&rt, 2);
+			SLAKE_TEST_CHECK(getI32(handle->call(nullptr, { x.get(), y.get() })) == 3);
+		}
+		SLAKE_TEST_CHECK(!handle->isAttached());
+		SLAKE_TEST_CHECK(!handle->getFn());
+
+		bool isThrown = false;
+		try {
+			handle->call(nullptr, {});
+		} catch (std::logic_error &) {
+			isThrown = true;
+		}
+		SLAKE_TEST_CHECK(isThrown);
+	}
+
+	return 0;
+}
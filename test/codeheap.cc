@@ -0,0 +1,80 @@
+// Compiles many small functions which get hot at the same time, code of them
+// shares pages of the code heap. Statistics are compiled in, see
+// test/CMakeLists.txt.
+
+#include "test.h"
+
+#if !SLAKE_ENABLE_STATS
+	#error Statistics must be enabled for this test
+#endif
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+constexpr int N_FNS = 48;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, N_FNS + 1);
+
+	for (int i = 0; i < N_FNS; ++i) {
+		w.beginFn("f" + std::to_string(i), T::I32);
+		w.ins(Opcode::RET, 1); w.i32(i);
+		w.endFn();
+	}
+
+	w.beginFn("single", T::I32);
+	w.ins(Opcode::RET, 1); w.i32(-1);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	std::string image = buildModule();
+
+	Runtime rt(flags);
+	auto mod = rt.loadModule(image.data(), image.size(), 0);
+
+	// Functions reach the threshold in the same round.
+	for (int i = 0; i < N_WARMUP_CALLS; ++i) {
+		for (int j = 0; j < N_FNS; ++j)
+			SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "f" + std::to_string(j))) == j);
+	}
+
+	auto stats = rt.getStats();
+#if SLAKE_ENABLE_JIT
+	if (!(flags & RT_NOJIT)) {
+		SLAKE_TEST_CHECK(stats.nCodeBlobs == N_FNS);
+		SLAKE_TEST_CHECK(stats.szCodeInUse > 0 && stats.szCodeInUse <= stats.szCodeReserved);
+
+		// Each batch wastes at most the rest of its last page.
+		size_t szPage = getCodePageSize(),
+			   nBatches = (N_FNS + SLAKE_JIT_BATCH_SIZE - 1) / SLAKE_JIT_BATCH_SIZE;
+		SLAKE_TEST_CHECK(stats.nCodePages <= (stats.szCodeInUse + szPage - 1) / szPage + nBatches);
+		SLAKE_TEST_CHECK(stats.nCodePages < stats.nCodeBlobs);
+	} else
+#endif
+		SLAKE_TEST_CHECK(stats.nCodeBlobs == 0 && stats.nCodePages == 0);
+
+	// A function which gets hot alone is installed without a full batch.
+	for (int i = 0; i < N_WARMUP_CALLS; ++i)
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "single")) == -1);
+#if SLAKE_ENABLE_JIT
+	if (!(flags & RT_NOJIT))
+		SLAKE_TEST_CHECK(rt.getStats().nCodeBlobs == N_FNS + 1);
+#endif
+
+	{
+		std::ostringstream ss;
+		stats.writeJSON(ss);
+		SLAKE_TEST_CHECK(ss.str().find("\"codeHeap\":{") != std::string::npos);
+	}
+
+	return 0;
+}
@@ -0,0 +1,128 @@
+// Dispatches CONSTSW with dense, sparse and string keys, with and without
+// default cases, in modules which are loaded from images of every format
+// version and restored from snapshots.
+
+#include "test.h"
+
+#include <functional>
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+/// @brief Write a switch with a default case, which returns index of the
+/// matched case, -1 if no case was matched.
+static void writeSwitch(ImageWriter &w, const std::string &name, T type, size_t nCases, std::function<void(size_t)> writeKey) {
+	w.beginFn(name, T::I32, { type });
+
+	w.ins(Opcode::CONSTSW, 3); w.argValue(0);
+	w.array((uint32_t)(nCases * 2));
+	for (size_t i = 0; i < nCases; ++i) {
+		writeKey(i);
+		w.label((uint32_t)(2 + i));
+	}
+	w.label(1);
+
+	w.ins(Opcode::RET, 1); w.i32(-1);
+	for (size_t i = 0; i < nCases; ++i) {
+		w.ins(Opcode::RET, 1); w.i32((int32_t)i);
+	}
+
+	w.endFn();
+}
+
+static const std::deque<int32_t> denseKeys = { 3, 4, 5, 7, 8, 6 };
+static const std::deque<int64_t> sparseKeys = { -5, 1000000, 1, -9000000000LL };
+static const std::deque<std::string> stringKeys = { "GET", "PUT", "POST", "" };
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 4);
+
+	writeSwitch(w, "dense", T::I32, denseKeys.size(), [&w](size_t i) { w.i32(denseKeys[i]); });
+	writeSwitch(w, "sparse", T::I64, sparseKeys.size(), [&w](size_t i) { w.i64(sparseKeys[i]); });
+	writeSwitch(w, "strings", T::String, stringKeys.size(), [&w](size_t i) { w.str(stringKeys[i]); });
+
+	// noDefault(x): Cases store 10 times their indices and jump to the end,
+	// where execution continues if no case was matched.
+	w.beginFn("noDefault", T::I32, { T::I32 });
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i32(-1);
+	w.ins(Opcode::CONSTSW, 3); w.argValue(0);
+	w.array(3 * 2);
+	for (uint32_t i = 0; i < 3; ++i) {
+		w.i32((int32_t)i);
+		w.label(3 + i * 2);
+	}
+	w.label(9);
+	for (uint32_t i = 0; i < 3; ++i) {
+		w.ins(Opcode::STORE, 2); w.localVar(0); w.i32((int32_t)i * 10);
+		w.ins(Opcode::JMP, 1); w.label(9);
+	}
+	w.ins(Opcode::RET, 1); w.localVarValue(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+template <typename T>
+static int32_t indexOf(const std::deque<T> &keys, const T &key) {
+	for (size_t i = 0; i < keys.size(); ++i) {
+		if (keys[i] == key)
+			return (int32_t)i;
+	}
+	return -1;
+}
+
+static void checkModule(Runtime *rt, ModuleValue *mod) {
+	// Tables are built when the bodies are decoded, or restored from the
+	// snapshot.
+	for (int i = 0; i < N_WARMUP_CALLS; ++i) {
+		for (int32_t j : { 3, 8, 6, 2, 9, -1 }) {
+			ValueRef<> key = new I32Value(rt, j);
+			SLAKE_TEST_CHECK(getI32(callFn(mod, "dense", { key.get() })) == indexOf(denseKeys, j));
+		}
+		for (int64_t j : { -5LL, 1000000LL, -9000000000LL, 0LL, 2LL }) {
+			ValueRef<> key = new I64Value(rt, j);
+			SLAKE_TEST_CHECK(getI32(callFn(mod, "sparse", { key.get() })) == indexOf(sparseKeys, j));
+		}
+		for (std::string j : { "POST", "", "get", "GET" }) {
+			ValueRef<> key = new StringValue(rt, j);
+			SLAKE_TEST_CHECK(getI32(callFn(mod, "strings", { key.get() })) == indexOf(stringKeys, j));
+		}
+		for (int32_t j : { 0, 1, 2, 3, -1 }) {
+			ValueRef<> key = new I32Value(rt, j);
+			SLAKE_TEST_CHECK(getI32(callFn(mod, "noDefault", { key.get() })) == (j >= 0 && j < 3 ? j * 10 : -1));
+		}
+	}
+
+	for (auto [name, offIns] : { std::pair<const char *, uint32_t>{ "dense", 0 }, { "sparse", 0 }, { "strings", 0 }, { "noDefault", 2 } })
+		SLAKE_TEST_CHECK(((FnValue *)mod->scope->getMember(name))->getBody()[offIns].switchTable);
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	std::string v0 = buildModule(), v1 = slxfmt::upgradeImage(v0.data(), v0.size());
+
+	std::string snapshot;
+	for (auto &i : { v0, v1 }) {
+		Runtime rt(flags);
+		auto mod = rt.loadModule(std::make_shared<BufferedModuleImage>(std::string(i)), 0);
+		checkModule(&rt, mod.get());
+
+		std::ostringstream os;
+		rt.saveSnapshot(os);
+		snapshot = os.str();
+	}
+
+	{
+		Runtime rt(flags);
+		rt.loadSnapshot(std::make_shared<BufferedModuleImage>(std::move(snapshot)));
+		checkModule(&rt, (ModuleValue *)rt.getRootValue()->getMember("test"));
+	}
+
+	return 0;
+}
@@ -0,0 +1,105 @@
+// Awaits coroutines which are started by ACALL, errors of the coroutines
+// are thrown by AWAIT and keep the contexts of the coroutines.
+
+#include "test.h"
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 4);
+
+	// gen(n): Yields 0 to n - 1 and returns -1.
+	w.beginFn("gen", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i32(0);
+	w.ins(Opcode::JMP, 1); w.label(6);
+	w.ins(Opcode::YIELD, 1); w.localVarValue(0);
+	w.ins(Opcode::ADD, 3); w.localVar(0); w.localVarValue(0); w.i32(1);
+	w.ins(Opcode::LT, 3); w.reg(0); w.localVarValue(0); w.argValue(0);
+	w.ins(Opcode::JT, 2); w.label(4); w.regValue(0);
+	w.ins(Opcode::RET, 1); w.i32(-1);
+	w.endFn();
+
+	// drain(n): Sum of the values yielded by gen(n).
+	w.beginFn("drain", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(3);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i32(0);
+	w.ins(Opcode::PUSHARG, 1); w.argValue(0);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "test", "gen" });
+	w.ins(Opcode::ACALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(1);
+	w.ins(Opcode::AWAIT, 1); w.regValue(1);
+	w.ins(Opcode::LRET, 1); w.reg(2);
+	w.ins(Opcode::EQ, 3); w.reg(0); w.regValue(2); w.i32(-1);
+	w.ins(Opcode::JT, 2); w.label(13); w.regValue(0);
+	w.ins(Opcode::ADD, 3); w.localVar(0); w.localVarValue(0); w.regValue(2);
+	w.ins(Opcode::JMP, 1); w.label(7);
+	w.ins(Opcode::RET, 1); w.localVarValue(0);
+	w.endFn();
+
+	w.beginFn("thrower", T::I32);
+	w.ins(Opcode::NOP);
+	w.ins(Opcode::ABORT);
+	w.endFn();
+
+	// awaitThrower(): Awaits a coroutine which throws.
+	w.beginFn("awaitThrower", T::I32);
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "test", "thrower" });
+	w.ins(Opcode::ACALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(0);
+	w.ins(Opcode::AWAIT, 1); w.regValue(0);
+	w.ins(Opcode::RET, 1); w.i32(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	Runtime rt(flags);
+
+	std::string image = buildModule();
+	auto mod = rt.loadModule(image.data(), image.size(), 0);
+
+	for (int i = 0; i < N_WARMUP_CALLS; ++i) {
+		ValueRef<> n = new I32Value(&rt, 100);
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "drain", { n.get() })) == 4950);
+	}
+
+	{
+		ValueRef<> n = new I32Value(&rt, 0);
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "drain", { n.get() })) == 0);
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		bool isThrown = false;
+		try {
+			callFn(mod.get(), "awaitThrower");
+		} catch (UncaughtExceptionError &e) {
+			// The error keeps the context of the coroutine, which is not
+			// active anymore.
+			SLAKE_TEST_CHECK(e.context && e.context->majorFrames.size());
+			SLAKE_TEST_CHECK(rt.getFullName(e.context->majorFrames.back().curFn) == "test.thrower");
+			SLAKE_TEST_CHECK(!rt.getActiveContext());
+			isThrown = true;
+		}
+		SLAKE_TEST_CHECK(isThrown);
+	}
+
+	rt.gc();
+	{
+		ValueRef<> n = new I32Value(&rt, 10);
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "drain", { n.get() })) == 45);
+	}
+
+	return 0;
+}
@@ -0,0 +1,118 @@
+// Instructions record types of their operands and classes of their
+// receivers, a site stays monomorphic until it sees a second type and
+// becomes megamorphic once it saw more than MAX_RECEIVERS classes.
+
+#include "test.h"
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 2);
+
+	// addMono(x, y), addPoly(x, y): x + y with untyped operands.
+	for (auto i : { "addMono", "addPoly" }) {
+		w.beginFn(i, T::Any, { T::Any, T::Any });
+		w.ins(Opcode::REG, 1); w.u32(1);
+		w.ins(Opcode::ADD, 3); w.reg(0); w.argValue(0); w.argValue(1);
+		w.ins(Opcode::RET, 1); w.regValue(0);
+		w.endFn();
+	}
+
+	w.endModule();
+	return w.getImage();
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	Runtime rt(flags);
+	std::string image = buildModule();
+	auto mod = rt.loadModule(image.data(), image.size(), 0);
+
+	auto addMono = (FnValue *)mod->scope->getMember("addMono"),
+		 addPoly = (FnValue *)mod->scope->getMember("addPoly");
+	SLAKE_TEST_CHECK(!addMono->getFeedback(1));
+
+	// Calls stay below the JIT threshold, so every call is interpreted.
+	for (int32_t i = 0; i < 8; ++i) {
+		ValueRef<> x = new I32Value(&rt, i), y = new I32Value(&rt, 1);
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "addMono", { x.get(), y.get() })) == i + 1);
+
+		ValueRef<> a = i & 1 ? (Value *)new I64Value(&rt, i) : (Value *)new I32Value(&rt, i),
+				   b = i & 1 ? (Value *)new I64Value(&rt, 1) : (Value *)new I32Value(&rt, 1);
+		callFn(mod.get(), "addPoly", { a.get(), b.get() });
+	}
+
+	auto mono = addMono->getFeedback(1);
+	SLAKE_TEST_CHECK(mono);
+	SLAKE_TEST_CHECK(mono->nExecs == 8);
+	SLAKE_TEST_CHECK(mono->hasLhsType(TypeId::I32) && mono->hasRhsType(TypeId::I32));
+	SLAKE_TEST_CHECK(!mono->hasLhsType(TypeId::I64));
+	SLAKE_TEST_CHECK(mono->isMonomorphic());
+
+	auto poly = addPoly->getFeedback(1);
+	SLAKE_TEST_CHECK(poly);
+	SLAKE_TEST_CHECK(poly->hasLhsType(TypeId::I32) && poly->hasLhsType(TypeId::I64));
+	SLAKE_TEST_CHECK(poly->hasRhsType(TypeId::I32) && poly->hasRhsType(TypeId::I64));
+	SLAKE_TEST_CHECK(!poly->isMonomorphic());
+
+	// Dropped feedback is recorded again from scratch.
+	addPoly->resetFeedback();
+	SLAKE_TEST_CHECK(!addPoly->getFeedback(1));
+	{
+		ValueRef<> x = new I64Value(&rt, 1), y = new I64Value(&rt, 2);
+		callFn(mod.get(), "addPoly", { x.get(), y.get() });
+	}
+	poly = addPoly->getFeedback(1);
+	SLAKE_TEST_CHECK(poly);
+	SLAKE_TEST_CHECK(poly->nExecs == 1);
+	SLAKE_TEST_CHECK(!poly->hasLhsType(TypeId::I32));
+	SLAKE_TEST_CHECK(poly->isMonomorphic());
+
+	// Receivers, each object has its own class.
+	std::deque<ValueRef<ClassValue>> classes;
+	std::deque<ValueRef<ObjectValue>> objects;
+	for (uint8_t i = 0; i <= InsFeedback::MAX_RECEIVERS; ++i) {
+		classes.push_back(new ClassValue(&rt, ACCESS_PUB));
+		objects.push_back(new ObjectValue(&rt, classes.back().get()));
+	}
+
+	InsFeedback feedback;
+
+	// Only the first receiver of a class misses.
+	SLAKE_TEST_CHECK(!feedback.recordReceiver(objects[0].get()));
+	for (int i = 0; i < 4; ++i)
+		SLAKE_TEST_CHECK(feedback.recordReceiver(objects[0].get()));
+	SLAKE_TEST_CHECK(feedback.nReceivers == 1);
+	SLAKE_TEST_CHECK(feedback.isMonomorphic());
+
+	// Values which are not objects have no class to be cached.
+	ValueRef<> n = new I32Value(&rt, 0);
+	SLAKE_TEST_CHECK(!feedback.recordReceiver(n.get()));
+	SLAKE_TEST_CHECK(!feedback.recordReceiver(nullptr));
+	SLAKE_TEST_CHECK(feedback.nReceivers == 1);
+
+	// Polymorphic sites keep every class up to the limit.
+	for (uint8_t i = 1; i < InsFeedback::MAX_RECEIVERS; ++i)
+		SLAKE_TEST_CHECK(!feedback.recordReceiver(objects[i].get()));
+	SLAKE_TEST_CHECK(feedback.nReceivers == InsFeedback::MAX_RECEIVERS);
+	SLAKE_TEST_CHECK(!feedback.megamorphic);
+	SLAKE_TEST_CHECK(!feedback.isMonomorphic());
+	for (uint8_t i = 0; i < InsFeedback::MAX_RECEIVERS; ++i) {
+		SLAKE_TEST_CHECK(feedback.receivers[i] == classes[i].get());
+		SLAKE_TEST_CHECK(feedback.recordReceiver(objects[i].get()));
+	}
+
+	// One more class saturates the site, which then misses on every class.
+	SLAKE_TEST_CHECK(!feedback.recordReceiver(objects[InsFeedback::MAX_RECEIVERS].get()));
+	SLAKE_TEST_CHECK(feedback.megamorphic);
+	SLAKE_TEST_CHECK(feedback.nReceivers == InsFeedback::MAX_RECEIVERS);
+	SLAKE_TEST_CHECK(!feedback.recordReceiver(objects[0].get()));
+	SLAKE_TEST_CHECK(!feedback.recordReceiver(objects[InsFeedback::MAX_RECEIVERS].get()));
+
+	return 0;
+}
@@ -0,0 +1,281 @@
+// Dumps the heap of a runtime and parses the dump, and checks retained
+// sizes computed by the analysis of slkc on a dump with a known graph.
+
+#include "test.h"
+
+#include <slkc/heapdump/heapdump.h>
+
+#include <set>
+#include <sstream>
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 1);
+
+	w.beginFn("main", T::I32);
+	w.ins(Opcode::RET, 1); w.i32(42);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+template <typename T>
+static T read(std::istream &fs) {
+	T value;
+	SLAKE_TEST_CHECK(fs.read((char *)&value, sizeof(T)));
+	return value;
+}
+
+/// @brief Heap dump which was parsed by the test.
+struct ParsedHeapDump {
+	std::vector<std::string> strings;
+	std::vector<slhfmt::RootRecord> roots;
+	std::vector<slhfmt::ValueRecordHeader> values;
+};
+
+/// @brief Parse a heap dump, every index in the dump must be valid and the
+/// records must end with the dump.
+static ParsedHeapDump parseHeapDump(const std::string &dump) {
+	ParsedHeapDump d;
+	std::istringstream fs(dump);
+
+	auto hdh = read<slhfmt::HeapDumpHeader>(fs);
+	SLAKE_TEST_CHECK(!memcmp(hdh.magic, slhfmt::HDH_MAGIC, sizeof(hdh.magic)));
+	SLAKE_TEST_CHECK(hdh.fmtVer == slhfmt::FMTVER_CURRENT);
+
+	for (uint32_t i = 0; i < hdh.nStrings; ++i) {
+		std::string s(read<uint32_t>(fs), '\0');
+		SLAKE_TEST_CHECK(fs.read(s.data(), s.size()));
+		d.strings.push_back(s);
+	}
+
+	for (uint32_t i = 0; i < hdh.nRoots; ++i) {
+		auto rr = read<slhfmt::RootRecord>(fs);
+		SLAKE_TEST_CHECK(rr.kind <= slhfmt::ROOT_CONTEXT);
+		SLAKE_TEST_CHECK(rr.index < hdh.nValues);
+		d.roots.push_back(rr);
+	}
+
+	for (uint32_t i = 0; i < hdh.nValues; ++i) {
+		auto vrh = read<slhfmt::ValueRecordHeader>(fs);
+		SLAKE_TEST_CHECK(vrh.name == slhfmt::IDX_NULL || vrh.name < hdh.nStrings);
+		for (uint32_t j = 0; j < vrh.nRefs; ++j)
+			SLAKE_TEST_CHECK(read<uint32_t>(fs) < hdh.nValues);
+		d.values.push_back(vrh);
+	}
+
+	SLAKE_TEST_CHECK(fs.peek() == EOF);
+	return d;
+}
+
+static bool isThrown(const std::string &dump) {
+	std::istringstream fs(dump);
+	std::ostringstream os;
+	try {
+		heapdump::analyze(fs, os);
+	} catch (heapdump::HeapDumpError &) {
+		return true;
+	}
+	return false;
+}
+
+/// @brief Writer of heap dumps with objects which are named by their classes.
+struct TestHeapDumpWriter {
+	std::vector<std::string> strings;
+	std::vector<slhfmt::RootRecord> roots;
+	std::string values;
+	uint32_t nValues = 0;
+
+	template <typename T>
+	void put(std::string &s, const T &value) {
+		s.append((const char *)&value, sizeof(T));
+	}
+
+	void addRoot(uint8_t kind, uint32_t index) {
+		roots.push_back({ kind, {}, index });
+	}
+
+	void addObject(const std::string &cls, uint32_t size, std::vector<uint32_t> refs) {
+		slhfmt::ValueRecordHeader vrh = {};
+		vrh.typeId = (uint8_t)TypeId::Object;
+		vrh.szShallow = size;
+		vrh.name = (uint32_t)strings.size();
+		vrh.nRefs = (uint32_t)refs.size();
+		strings.push_back(cls);
+
+		put(values, vrh);
+		for (auto i : refs)
+			put(values, i);
+		++nValues;
+	}
+
+	std::string getDump() {
+		std::string s;
+
+		slhfmt::HeapDumpHeader hdh = {};
+		memcpy(hdh.magic, slhfmt::HDH_MAGIC, sizeof(hdh.magic));
+		hdh.fmtVer = slhfmt::FMTVER_CURRENT;
+		hdh.nStrings = (uint32_t)strings.size();
+		hdh.nRoots = (uint32_t)roots.size();
+		hdh.nValues = nValues;
+		put(s, hdh);
+
+		for (auto &i : strings) {
+			put(s, (uint32_t)i.size());
+			s += i;
+		}
+		for (auto &i : roots)
+			put(s, i);
+		return s + values;
+	}
+};
+
+/// @brief Get lines of a section of a report.
+static std::vector<std::string> getReportSection(const std::string &report, const std::string &title) {
+	std::vector<std::string> lines;
+	std::istringstream is(report);
+
+	bool isInSection = false;
+	for (std::string line; std::getline(is, line);) {
+		if (line == title)
+			isInSection = true;
+		else if (isInSection) {
+			if (line.empty())
+				break;
+			lines.push_back(line);
+		}
+	}
+
+	SLAKE_TEST_CHECK(isInSection);
+	return lines;
+}
+
+/// @brief Get retained size of a value in the top retainers of a report.
+static uint64_t getRetainedSize(const std::vector<std::string> &topRetainers, const std::string &label) {
+	for (auto &i : topRetainers) {
+		auto off = i.find("  " + label);
+		if (off != std::string::npos && off + label.size() + 2 == i.size())
+			return std::stoull(i.substr(0, off));
+	}
+	SLAKE_TEST_CHECK(false);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	//
+	// Dump of a runtime.
+	//
+	std::string dump;
+	{
+		Runtime rt(flags);
+
+		std::string image = buildModule();
+		auto mod = rt.loadModule(image.data(), image.size(), 0);
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "main")) == 42);
+
+		ValueRef<> held = new I64Value(&rt, 1);
+
+		std::ostringstream os;
+		rt.dumpHeap(os);
+		dump = os.str();
+
+		auto d = parseHeapDump(dump);
+
+		bool isRootValueRooted = false, isHeldRooted = false;
+		for (auto &i : d.roots) {
+			if (i.kind == slhfmt::ROOT_RUNTIME && d.values[i.index].typeId == (uint8_t)TypeId::RootValue)
+				isRootValueRooted = true;
+			if (i.kind == slhfmt::ROOT_HOST && d.values[i.index].typeId == (uint8_t)TypeId::I64)
+				isHeldRooted = true;
+		}
+		SLAKE_TEST_CHECK(isRootValueRooted);
+		SLAKE_TEST_CHECK(isHeldRooted);
+
+		std::set<std::string> names(d.strings.begin(), d.strings.end());
+		SLAKE_TEST_CHECK(names.count("test.main"));
+	}
+
+	// The analysis reads the whole dump.
+	{
+		std::istringstream fs(dump);
+		std::ostringstream os;
+		heapdump::analyze(fs, os);
+		SLAKE_TEST_CHECK(!os.str().rfind("Values: " + std::to_string(parseHeapDump(dump).values.size()) + ", ", 0));
+	}
+
+	// Malformed dumps are rejected.
+	SLAKE_TEST_CHECK(isThrown(dump.substr(0, dump.size() - 1)));
+	SLAKE_TEST_CHECK(isThrown("SLHX" + dump.substr(4)));
+
+	//
+	// Dump with a known graph:
+	//
+	//   <runtime> -> A -> B -> D -> E
+	//                 \-> C -/
+	//   <host> ------------^
+	//
+	// and an unreachable F. D is reachable through both B and C, so it is
+	// dominated by the virtual root only.
+	//
+	{
+		TestHeapDumpWriter w;
+		w.addObject("A", 10, { 1, 2 });
+		w.addObject("B", 20, { 3 });
+		w.addObject("C", 30, { 3 });
+		w.addObject("D", 40, { 4 });
+		w.addObject("E", 50, {});
+		w.addObject("F", 7, { 0 });
+		w.addRoot(slhfmt::ROOT_RUNTIME, 0);
+		w.addRoot(slhfmt::ROOT_HOST, 2);
+
+		std::istringstream fs(w.getDump());
+		std::ostringstream os;
+		heapdump::analyze(fs, os);
+		std::string report = os.str();
+
+		SLAKE_TEST_CHECK(!report.rfind(
+			"Values: 6, 157 bytes\n"
+			"Reachable: 5, 150 bytes\n"
+			"Unreachable: 1, 7 bytes\n",
+			0));
+
+		auto getLabel = [](uint32_t index, const std::string &name) {
+			return "#" + std::to_string(index) + " " + getTypeIdName(TypeId::Object) + " " + name;
+		};
+
+		auto topRetainers = getReportSection(report, "Top retainers:");
+		SLAKE_TEST_CHECK(getRetainedSize(topRetainers, getLabel(0, "A")) == 30);
+		SLAKE_TEST_CHECK(getRetainedSize(topRetainers, getLabel(1, "B")) == 20);
+		SLAKE_TEST_CHECK(getRetainedSize(topRetainers, getLabel(2, "C")) == 30);
+		SLAKE_TEST_CHECK(getRetainedSize(topRetainers, getLabel(3, "D")) == 90);
+		SLAKE_TEST_CHECK(getRetainedSize(topRetainers, getLabel(4, "E")) == 50);
+
+		// Dominator paths of the retainers.
+		std::string pathE = "path: <root> > " + getLabel(3, "D"),
+					pathB = "path: <root> > " + getLabel(0, "A");
+		size_t nPaths = 0;
+		for (auto &i : topRetainers) {
+			if (i.find(pathE) != std::string::npos && i.size() - i.find(pathE) == pathE.size())
+				++nPaths;
+			if (i.find(pathB) != std::string::npos && i.size() - i.find(pathB) == pathB.size())
+				++nPaths;
+		}
+		SLAKE_TEST_CHECK(nPaths == 2);
+
+		// Neither root is retained by the other one.
+		auto roots = getReportSection(report, "Roots:");
+		SLAKE_TEST_CHECK(roots.size() == 3);
+		for (auto &i : roots)
+			SLAKE_TEST_CHECK(i.find("retained by") == std::string::npos);
+	}
+
+	return 0;
+}
@@ -0,0 +1,82 @@
+// Imports a module into runtimes which share a module image cache, the
+// module is located once while its bodies are decoded by each runtime.
+
+#include "test.h"
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 1);
+
+	w.beginFn("main", T::I32);
+	w.ins(Opcode::RET, 1); w.i32(42);
+	w.endFn();
+
+	w.endModule();
+	return slxfmt::upgradeImage(w.getImage().data(), w.getImage().size());
+}
+
+static ValueRef<ModuleValue> importTest(Runtime &rt) {
+	ValueRef<RefValue> ref = new RefValue(&rt);
+	ref->entries.push_back(RefEntry("test"));
+	return rt.importModule(ref);
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	std::string image = buildModule();
+
+	int nLocated = 0;
+	auto locator = [&image, &nLocated](Runtime *rt, ValueRef<RefValue> ref) {
+		++nLocated;
+		return std::make_shared<BufferedModuleImage>(std::string(image));
+	};
+
+	auto cache = std::make_shared<ModuleImageCache>();
+
+	Runtime rt1(flags), rt2(flags);
+	for (auto rt : { &rt1, &rt2 }) {
+		rt->setModuleImageCache(cache);
+		rt->setModuleImageLocator(locator);
+	}
+
+	auto mod1 = importTest(rt1);
+	SLAKE_TEST_CHECK(nLocated == 1);
+	SLAKE_TEST_CHECK(cache->getImageCount() == 1);
+	SLAKE_TEST_CHECK(cache->getSize() == image.size());
+
+	// The second runtime hits the cache.
+	auto mod2 = importTest(rt2);
+	SLAKE_TEST_CHECK(nLocated == 1);
+	SLAKE_TEST_CHECK(cache->getImageCount() == 1);
+
+	// Bodies are decoded by each runtime into its own values.
+	auto main1 = (FnValue *)mod1->scope->getMember("main"),
+		 main2 = (FnValue *)mod2->scope->getMember("main");
+	SLAKE_TEST_CHECK(getI32(callFn(mod1.get(), "main")) == 42);
+	SLAKE_TEST_CHECK(main1->isBodyLoaded());
+	SLAKE_TEST_CHECK(!main2->isBodyLoaded());
+	SLAKE_TEST_CHECK(getI32(callFn(mod2.get(), "main")) == 42);
+
+	// Cleared images are located again, runtimes which imported them keep
+	// using them.
+	rt1.clearModuleImageCache();
+	SLAKE_TEST_CHECK(cache->getImageCount() == 0);
+	SLAKE_TEST_CHECK(cache->getSize() == 0);
+	{
+		Runtime rt3(flags);
+		rt3.setModuleImageCache(cache);
+		rt3.setModuleImageLocator(locator);
+		auto mod3 = importTest(rt3);
+		SLAKE_TEST_CHECK(nLocated == 2);
+		SLAKE_TEST_CHECK(getI32(callFn(mod3.get(), "main")) == 42);
+	}
+	SLAKE_TEST_CHECK(getI32(callFn(mod2.get(), "main")) == 42);
+
+	return 0;
+}
@@ -0,0 +1,113 @@
+// Typed arithmetic, comparisons and jumps give the same results in the
+// interpreter and in compiled code, including after feedback was reset and
+// after executions were preempted by budgets.
+
+#include "test.h"
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 3);
+
+	// poly(x): Applies acc = acc * 3 - x for 20 times, with acc = 1 at first.
+	w.beginFn("poly", T::I64, { T::I64 });
+	w.ins(Opcode::REG, 1); w.u32(3);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I64);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::U32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i64(1);
+	w.ins(Opcode::STORE, 2); w.localVar(1); w.u32(0);
+	w.ins(Opcode::JMP, 1); w.label(10);
+	w.ins(Opcode::MUL, 3); w.localVar(0); w.localVarValue(0); w.i64(3);
+	w.ins(Opcode::SUB, 3); w.localVar(0); w.localVarValue(0); w.argValue(0);
+	w.ins(Opcode::INCF, 2); w.reg(0); w.localVar(1);
+	w.ins(Opcode::STORE, 2); w.reg(1); w.localVarValue(0);
+	w.ins(Opcode::LT, 3); w.reg(0); w.localVarValue(1); w.u32(20);
+	w.ins(Opcode::JT, 2); w.label(6); w.regValue(0);
+	w.ins(Opcode::LVALUE, 2); w.reg(2); w.localVar(0);
+	w.ins(Opcode::RET, 1); w.regValue(2);
+	w.endFn();
+
+	// down(n): Counts n down to 0 and returns -2 * n.
+	w.beginFn("down", T::I32, { T::U64 });
+	w.ins(Opcode::REG, 1); w.u32(2);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::U64);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.argValue(0);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(1); w.i32(0);
+	w.ins(Opcode::GT, 3); w.reg(0); w.localVarValue(0); w.u64(0);
+	w.ins(Opcode::JF, 2); w.label(10); w.regValue(0);
+	w.ins(Opcode::DECF, 2); w.reg(1); w.localVar(0);
+	w.ins(Opcode::ADD, 3); w.localVar(1); w.localVarValue(1); w.i32(-2);
+	w.ins(Opcode::JMP, 1); w.label(5);
+	w.ins(Opcode::RET, 1); w.localVarValue(1);
+	w.endFn();
+
+	// mismatched(): Stores an i32 into an i64 variable.
+	w.beginFn("mismatched", T::I32);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I64);
+	w.ins(Opcode::ADD, 3); w.localVar(0); w.i32(1); w.i32(2);
+	w.ins(Opcode::RET, 1); w.i32(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	Runtime rt(flags);
+
+	std::string image = buildModule();
+	auto mod = rt.loadModule(image.data(), image.size(), 0);
+
+	auto poly = (FnValue *)mod->scope->getMember("poly");
+
+	for (int i = 0; i < N_WARMUP_CALLS + 100; ++i) {
+		int64_t expected = 1;
+		for (int j = 0; j < 20; ++j)
+			expected = expected * 3 - i;
+
+		ValueRef<> x = new I64Value(&rt, i);
+		auto result = callFn(mod.get(), "poly", { x.get() });
+		SLAKE_TEST_CHECK(result && result->getType() == TypeId::I64);
+		SLAKE_TEST_CHECK(((I64Value *)result.get())->getData() == expected);
+
+		ValueRef<> n = new U64Value(&rt, (uint64_t)i);
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "down", { n.get() })) == -2 * i);
+
+		bool isThrown = false;
+		try {
+			callFn(mod.get(), "mismatched");
+		} catch (MismatchedTypeError &) {
+			isThrown = true;
+		}
+		SLAKE_TEST_CHECK(isThrown);
+
+		// Compiled code falls back to the interpreter until the feedback
+		// is collected again.
+		if (i == N_WARMUP_CALLS)
+			poly->resetFeedback();
+	}
+
+	// Compiled loops stop once the fuel is exhausted, and the executions are
+	// resumed from where they stopped.
+	ExecBudget budget;
+	budget.fuel = 1000;
+	ValueRef<> n = new U64Value(&rt, 100000);
+	auto result = ((FnValue *)mod->scope->getMember("down"))->call(nullptr, { n.get() }, budget);
+	SLAKE_TEST_CHECK(result && result->getType() == TypeId::Context);
+
+	auto context = (ContextValue *)result.get();
+	SLAKE_TEST_CHECK(context->isPreempted());
+	SLAKE_TEST_CHECK(context->getExecutedInsCount() >= 1000);
+
+	context->setBudget({});
+	SLAKE_TEST_CHECK(getI32(context->resume()) == -200000);
+
+	return 0;
+}
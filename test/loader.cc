@@ -0,0 +1,323 @@
+// Loads a module from images of every format version, bodies of functions
+// which are loaded from module images are decoded on their first calls.
+
+#include "test.h"
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 2);
+
+	// sum(n): Sum of 0 to n - 1.
+	w.beginFn("sum", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i32(0);
+	w.ins(Opcode::STORE, 2); w.localVar(1); w.i32(0);
+	w.ins(Opcode::JMP, 1); w.label(8);
+	w.ins(Opcode::ADD, 3); w.localVar(1); w.localVarValue(1); w.localVarValue(0);
+	w.ins(Opcode::INCF, 2); w.reg(0); w.localVar(0);
+	w.ins(Opcode::LT, 3); w.reg(0); w.localVarValue(0); w.argValue(0);
+	w.ins(Opcode::JT, 2); w.label(6); w.regValue(0);
+	w.ins(Opcode::RET, 1); w.localVarValue(1);
+	w.endFn();
+
+	w.beginFn("main", T::I32);
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::PUSHARG, 1); w.i32(100);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "test", "sum" });
+	w.ins(Opcode::CALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(0);
+	w.ins(Opcode::RET, 1); w.regValue(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+/// @brief Build a module with a body which fails to decode after some of its
+/// operands were decoded, bodies are not checked until they are decoded.
+static std::string buildBrokenModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 1);
+
+	w.beginFn("broken", T::I32);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i32(1);
+	w.ins(Opcode::LVAR, 1); w.typeName((T)0xee);
+	w.ins(Opcode::RET, 1); w.localVarValue(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+/// @brief Build a module with an instruction whose opcode is out of the
+/// range of valid opcodes.
+static std::string buildBadOpcodeModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 1);
+
+	w.beginFn("bad", T::I32);
+	w.rawIns(0x3fff);
+	w.ins(Opcode::RET, 1); w.i32(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+/// @brief Build a module whose functions use the same literal.
+static std::string buildConstModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 2);
+
+	for (auto i : { "one", "two" }) {
+		w.beginFn(i, T::I32);
+		w.ins(Opcode::RET, 1); w.i32(1234);
+		w.endFn();
+	}
+
+	w.endModule();
+	return w.getImage();
+}
+
+/// @brief Build a module whose get() returns a constant.
+static std::string buildGraphModule(
+	const std::string &name,
+	int32_t value,
+	const std::deque<std::pair<std::string, std::deque<std::string>>> &imports) {
+	ImageWriter w;
+	w.beginModule({ name }, 1, imports);
+
+	w.beginFn("get", T::I32);
+	w.ins(Opcode::RET, 1); w.i32(value);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+/// @brief Build a module which refers to functions of the module built by
+/// buildGraphModule("a", ...), one of which does not exist.
+static std::string buildLinkedModule() {
+	ImageWriter w;
+	w.beginModule({ "app" }, 2, { { "a", { "a" } } });
+
+	w.beginFn("main", T::I32);
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "a", "get" });
+	w.ins(Opcode::CALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(0);
+	w.ins(Opcode::RET, 1); w.regValue(0);
+	w.endFn();
+
+	w.beginFn("missing", T::I32);
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "a", "missing" });
+	w.ins(Opcode::CALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(0);
+	w.ins(Opcode::RET, 1); w.regValue(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+static void checkModule(ModuleValue *mod, bool isLazy) {
+	auto sum = (FnValue *)mod->scope->getMember("sum");
+	SLAKE_TEST_CHECK(sum->isBodyLoaded() == !isLazy);
+
+	for (int i = 0; i < N_WARMUP_CALLS; ++i)
+		SLAKE_TEST_CHECK(getI32(callFn(mod, "main")) == 4950);
+
+	SLAKE_TEST_CHECK(sum->isBodyLoaded());
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	std::string v0 = buildModule(),
+				v1 = slxfmt::upgradeImage(v0.data(), v0.size()),
+				v1Stripped = slxfmt::upgradeImage(v0.data(), v0.size(), true);
+	SLAKE_TEST_CHECK(v1 != v0);
+
+	for (auto &i : { v0, v1, v1Stripped }) {
+		{
+			Runtime rt(flags);
+			auto mod = rt.loadModule(std::make_shared<BufferedModuleImage>(std::string(i)), 0);
+			checkModule(mod.get(), true);
+		}
+		{
+			Runtime rt(flags);
+			std::istringstream is(i);
+			auto mod = rt.loadModule(is, 0);
+			checkModule(mod.get(), true);
+		}
+		{
+			// Borrowed buffers are decoded at once.
+			Runtime rt(flags);
+			auto mod = rt.loadModule(i.data(), i.size(), 0);
+			checkModule(mod.get(), false);
+		}
+	}
+
+	// Truncated images are rejected.
+	{
+		Runtime rt(flags);
+		bool isRejected = false;
+		try {
+			rt.loadModule(v1.data(), v1.size() / 2, 0);
+		} catch (LoaderError &) {
+			isRejected = true;
+		}
+		SLAKE_TEST_CHECK(isRejected);
+	}
+
+	// Bodies which failed to decode are decoded again by the following calls,
+	// which fail in the same way.
+	{
+		Runtime rt(flags);
+		auto mod = rt.loadModule(std::make_shared<BufferedModuleImage>(buildBrokenModule()), 0);
+		auto broken = (FnValue *)mod->scope->getMember("broken");
+
+		for (int i = 0; i < 2; ++i) {
+			bool isRejected = false;
+			try {
+				callFn(mod.get(), "broken");
+			} catch (LoaderError &) {
+				isRejected = true;
+			}
+			SLAKE_TEST_CHECK(isRejected);
+			SLAKE_TEST_CHECK(!broken->isBodyLoaded());
+		}
+	}
+
+	// Instructions with invalid opcodes are rejected before they are
+	// executed.
+	{
+		std::string v0Bad = buildBadOpcodeModule(),
+					v1Bad = slxfmt::upgradeImage(v0Bad.data(), v0Bad.size());
+
+		for (auto &i : { v0Bad, v1Bad }) {
+			Runtime rt(flags);
+			bool isRejected = false;
+			try {
+				auto mod = rt.loadModule(std::make_shared<BufferedModuleImage>(std::string(i)), 0);
+				callFn(mod.get(), "bad");
+			} catch (LoaderError &) {
+				isRejected = true;
+			}
+			SLAKE_TEST_CHECK(isRejected);
+		}
+	}
+
+	// Constants are decoded once for each module in v1 images, and are
+	// decoded at each use in v0 images.
+	{
+		std::string v0Const = buildConstModule(),
+					v1Const = slxfmt::upgradeImage(v0Const.data(), v0Const.size());
+
+		auto getOperand = [](ModuleValue *mod, const char *name) {
+			SLAKE_TEST_CHECK(getI32(callFn(mod, name)) == 1234);
+			return ((FnValue *)mod->scope->getMember(name))->getBody()[0].operands[0];
+		};
+
+		for (bool isLazy : { true, false }) {
+			Runtime rt(flags);
+			auto mod = isLazy
+						   ? rt.loadModule(std::make_shared<BufferedModuleImage>(std::string(v1Const)), 0)
+						   : rt.loadModule(v1Const.data(), v1Const.size(), 0);
+			SLAKE_TEST_CHECK(getOperand(mod.get(), "one") == getOperand(mod.get(), "two"));
+
+			rt.gc();
+			SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "one")) == 1234);
+		}
+
+		Runtime rt(flags);
+		auto mod = rt.loadModule(v0Const.data(), v0Const.size(), 0);
+		SLAKE_TEST_CHECK(getOperand(mod.get(), "one") != getOperand(mod.get(), "two"));
+	}
+
+	// Modules in an import graph are located once, modules which were
+	// loaded before are not located again.
+	{
+		std::map<std::string, std::string> images = {
+			{ "a", buildGraphModule("a", 1, { { "c", { "c" } } }) },
+			{ "b", buildGraphModule("b", 2, { { "c", { "c" } } }) },
+			{ "c", buildGraphModule("c", 3, {}) },
+			{ "d", buildGraphModule("d", 4, { { "c", { "c" } } }) }
+		};
+		std::string root = buildGraphModule("root", 0, { { "a", { "a" } }, { "b", { "b" } } });
+
+		std::mutex mutex;
+		std::map<std::string, int> nLocated;
+
+		Runtime rt(flags);
+		rt.setLoaderThreadCount(4);
+		rt.setModuleImageLocator([&](Runtime *rt, ValueRef<RefValue> ref) {
+			std::string name = std::to_string(ref.get());
+
+			std::lock_guard<std::mutex> lock(mutex);
+			++nLocated[name];
+			return std::make_shared<BufferedModuleImage>(std::string(images.at(name)));
+		});
+
+		auto mod = rt.loadModule(std::make_shared<BufferedModuleImage>(std::string(root)), 0);
+		SLAKE_TEST_CHECK(nLocated == (std::map<std::string, int>{ { "a", 1 }, { "b", 1 }, { "c", 1 } }));
+
+		for (auto [name, value] : { std::pair{ "a", 1 }, std::pair{ "b", 2 }, std::pair{ "c", 3 } }) {
+			ValueRef<RefValue> ref = new RefValue(&rt);
+			ref->entries.push_back(RefEntry(name));
+			SLAKE_TEST_CHECK(getI32(callFn(rt.importModule(ref).get(), "get")) == value);
+		}
+
+		ValueRef<RefValue> ref = new RefValue(&rt);
+		ref->entries.push_back(RefEntry("d"));
+		SLAKE_TEST_CHECK(getI32(callFn(rt.importModule(ref).get(), "get")) == 4);
+		SLAKE_TEST_CHECK(nLocated["c"] == 1 && nLocated["d"] == 1);
+	}
+
+	// References to other modules are linked to the targets, and the
+	// unresolvable ones are reported.
+	{
+		std::string a = buildGraphModule("a", 1, {}), app = buildLinkedModule();
+
+		Runtime rt(flags);
+		rt.setModuleImageLocator([&a](Runtime *rt, ValueRef<RefValue> ref) {
+			return std::make_shared<BufferedModuleImage>(std::string(a));
+		});
+
+		auto mod = rt.loadModule(app.data(), app.size(), LMOD_NOLINK);
+		auto unresolvedRefs = rt.linkModule(mod.get());
+		SLAKE_TEST_CHECK(unresolvedRefs.size() == 1);
+		SLAKE_TEST_CHECK(std::to_string(unresolvedRefs[0].get()) == "a.missing");
+
+		ValueRef<RefValue> ref = new RefValue(&rt);
+		ref->entries.push_back(RefEntry("a"));
+		auto get = rt.importModule(ref)->scope->getMember("get");
+
+		auto body = ((FnValue *)mod->scope->getMember("main"))->getBody();
+		SLAKE_TEST_CHECK(body[1].opcode == Opcode::STORE && body[1].operands[1] == get);
+		SLAKE_TEST_CHECK(body[2].operands[0] == get);
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "main")) == 1);
+
+		body = ((FnValue *)mod->scope->getMember("missing"))->getBody();
+		SLAKE_TEST_CHECK(body[1].opcode == Opcode::LOAD);
+
+		bool isThrown = false;
+		try {
+			callFn(mod.get(), "missing");
+		} catch (NotFoundError &) {
+			isThrown = true;
+		}
+		SLAKE_TEST_CHECK(isThrown);
+	}
+
+	return 0;
+}
@@ -0,0 +1,127 @@
+// Samples stacks of a busy loop with the profiler, and checks that the
+// samples are written as folded stacks which flame graph tools can read.
+
+#include "test.h"
+
+#include <chrono>
+#include <sstream>
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 2);
+
+	// spin(n): Counts from 0 to n.
+	w.beginFn("spin", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i32(0);
+	w.ins(Opcode::ADD, 3); w.localVar(0); w.localVarValue(0); w.i32(1);
+	w.ins(Opcode::LT, 3); w.reg(0); w.localVarValue(0); w.argValue(0);
+	w.ins(Opcode::JT, 2); w.label(3); w.regValue(0);
+	w.ins(Opcode::RET, 1); w.localVarValue(0);
+	w.endFn();
+
+	// outer(n): spin(n).
+	w.beginFn("outer", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(2);
+	w.ins(Opcode::PUSHARG, 1); w.argValue(0);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "test", "spin" });
+	w.ins(Opcode::CALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(1);
+	w.ins(Opcode::RET, 1); w.regValue(1);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+/// @brief Folded stack, frames outermost first.
+struct FoldedStack {
+	std::vector<std::string> frames;
+	size_t nSamples;
+};
+
+/// @brief Parse folded stacks, every line must have a thread, frames
+/// separated by semicolons and a positive number of samples.
+static std::vector<FoldedStack> parseFoldedStacks(const std::string &s) {
+	std::vector<FoldedStack> stacks;
+	std::istringstream is(s);
+
+	for (std::string line; std::getline(is, line);) {
+		auto space = line.rfind(' ');
+		SLAKE_TEST_CHECK(space != std::string::npos && space + 1 < line.size());
+
+		FoldedStack stack;
+		size_t nDigits;
+		stack.nSamples = std::stoul(line.substr(space + 1), &nDigits);
+		SLAKE_TEST_CHECK(nDigits == line.size() - space - 1);
+		SLAKE_TEST_CHECK(stack.nSamples > 0);
+
+		std::istringstream frames(line.substr(0, space));
+		for (std::string frame; std::getline(frames, frame, ';');) {
+			SLAKE_TEST_CHECK(frame.size());
+			SLAKE_TEST_CHECK(frame.find(' ') == std::string::npos);
+			stack.frames.push_back(frame);
+		}
+		SLAKE_TEST_CHECK(stack.frames.size() && !stack.frames[0].rfind("thread-", 0));
+
+		stacks.push_back(std::move(stack));
+	}
+
+	return stacks;
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	Runtime rt(flags);
+
+	std::string image = buildModule();
+	auto mod = rt.loadModule(image.data(), image.size(), 0);
+
+	rt.startProfiler(1000);
+
+	// Run until the loop was sampled, frames of the bottom of the stack are
+	// not included.
+	bool isSampled = false;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+	while (!isSampled && std::chrono::steady_clock::now() < deadline) {
+		ValueRef<> n = new I32Value(&rt, 100000);
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "outer", { n.get() })) == 100000);
+
+		std::ostringstream os;
+		rt.writeFoldedStacks(os);
+		for (auto &i : parseFoldedStacks(os.str())) {
+			if (i.frames.size() == 3 && i.frames[1] == "test.outer" && i.frames[2] == "test.spin")
+				isSampled = true;
+		}
+	}
+	SLAKE_TEST_CHECK(isSampled);
+
+	rt.stopProfiler();
+
+	{
+		std::ostringstream os;
+		rt.writeProfileReport(os);
+		SLAKE_TEST_CHECK(os.str().find("test.spin") != std::string::npos);
+	}
+
+	// Samples are kept until they are cleared.
+	{
+		std::ostringstream os;
+		rt.writeFoldedStacks(os);
+		SLAKE_TEST_CHECK(parseFoldedStacks(os.str()).size());
+
+		rt.clearProfile();
+		os.str({});
+		rt.writeFoldedStacks(os);
+		SLAKE_TEST_CHECK(os.str().empty());
+	}
+
+	return 0;
+}
@@ -0,0 +1,194 @@
+// Runs contexts on the scheduler, which requeues yielded contexts and lets
+// idle workers steal queued ones, with GC cycles started by the host while
+// the workers are executing. Contexts which are queued or executed by the
+// workers cannot be awaited.
+
+#include "test.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::mutex _childMutex;
+static std::condition_variable _childCond;
+static bool _hasChildRun = false;
+static std::thread::id _parentThread, _childThread;
+
+static std::atomic_bool _isReleased = false;
+
+static ValueRef<> _spawnChild(Runtime *rt, Value *thisObject, std::deque<Value *> args) {
+	// Contexts which are spawned by a worker are queued to itself.
+	auto mod = (ModuleValue *)rt->getRootValue()->getMember("test");
+	rt->spawn((FnValue *)mod->scope->getMember("child"));
+	return nullptr;
+}
+
+static ValueRef<> _waitChild(Runtime *rt, Value *thisObject, std::deque<Value *> args) {
+	_parentThread = std::this_thread::get_id();
+
+	// The worker of the parent is blocked, the child can only be executed
+	// by another worker which stole it.
+	Runtime::BlockingScope blockingScope(rt);
+	std::unique_lock<std::mutex> lock(_childMutex);
+	_childCond.wait(lock, []() { return _hasChildRun; });
+	return nullptr;
+}
+
+static ValueRef<> _markChild(Runtime *rt, Value *thisObject, std::deque<Value *> args) {
+	{
+		std::lock_guard<std::mutex> lock(_childMutex);
+		_childThread = std::this_thread::get_id();
+		_hasChildRun = true;
+	}
+	_childCond.notify_all();
+	return nullptr;
+}
+
+static ValueRef<> _isReleasedFn(Runtime *rt, Value *thisObject, std::deque<Value *> args) {
+	return new BoolValue(rt, _isReleased);
+}
+
+/// @brief Write a function which calls a native function of the module.
+static void writeNativeCall(ImageWriter &w, const std::string &name) {
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "test", name });
+	w.ins(Opcode::CALL, 1); w.regValue(0);
+}
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 5);
+
+	// sum(n): Sum of 0 to n - 1, yields after each addition.
+	w.beginFn("sum", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i32(0);
+	w.ins(Opcode::STORE, 2); w.localVar(1); w.i32(0);
+	w.ins(Opcode::JMP, 1); w.label(9);
+	w.ins(Opcode::ADD, 3); w.localVar(1); w.localVarValue(1); w.localVarValue(0);
+	w.ins(Opcode::INCF, 2); w.reg(0); w.localVar(0);
+	w.ins(Opcode::YIELD, 1); w.i32(0);
+	w.ins(Opcode::LT, 3); w.reg(0); w.localVarValue(0); w.argValue(0);
+	w.ins(Opcode::JT, 2); w.label(6); w.regValue(0);
+	w.ins(Opcode::RET, 1); w.localVarValue(1);
+	w.endFn();
+
+	// parent(): Spawns child() and waits until it was executed.
+	w.beginFn("parent", T::I32);
+	w.ins(Opcode::REG, 1); w.u32(1);
+	writeNativeCall(w, "spawnChild");
+	writeNativeCall(w, "waitChild");
+	w.ins(Opcode::RET, 1); w.i32(1);
+	w.endFn();
+
+	w.beginFn("child", T::I32);
+	w.ins(Opcode::REG, 1); w.u32(1);
+	writeNativeCall(w, "markChild");
+	w.ins(Opcode::RET, 1); w.i32(2);
+	w.endFn();
+
+	// held(): Yields until it was released by the host, returns 7.
+	w.beginFn("held", T::I32);
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::YIELD, 1); w.i32(0);
+	writeNativeCall(w, "isReleased");
+	w.ins(Opcode::LRET, 1); w.reg(0);
+	w.ins(Opcode::JF, 2); w.label(1); w.regValue(0);
+	w.ins(Opcode::RET, 1); w.i32(7);
+	w.endFn();
+
+	// awaitContext(context): Result of the context.
+	w.beginFn("awaitContext", T::Any, { T::Any });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::AWAIT, 1); w.argValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(0);
+	w.ins(Opcode::RET, 1); w.regValue(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	Runtime rt(flags);
+
+	std::string image = buildModule();
+	auto mod = rt.loadModule(image.data(), image.size(), LMOD_NOLINK);
+	mod->scope->putMember("spawnChild", new NativeFnValue(&rt, _spawnChild, ACCESS_PUB, TypeId::None));
+	mod->scope->putMember("waitChild", new NativeFnValue(&rt, _waitChild, ACCESS_PUB, TypeId::None));
+	mod->scope->putMember("markChild", new NativeFnValue(&rt, _markChild, ACCESS_PUB, TypeId::None));
+	mod->scope->putMember("isReleased", new NativeFnValue(&rt, _isReleasedFn, ACCESS_PUB, TypeId::Bool));
+	rt.linkModule(mod.get());
+
+	rt.startScheduler(4);
+
+	// Yielded contexts are requeued until they are done, the host collects
+	// garbage meanwhile.
+	std::deque<ValueRef<ContextValue>> contexts;
+	{
+		Runtime::ExecScope execScope(&rt);
+		for (int i = 0; i < 64; ++i) {
+			ValueRef<> n = new I32Value(&rt, 100 + i * 10);
+			contexts.push_back(rt.spawn((FnValue *)mod->scope->getMember("sum"), nullptr, { n.get() }));
+		}
+	}
+	for (int i = 0; i < 20; ++i) {
+		rt.gc();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	rt.waitForTasks();
+	{
+		Runtime::ExecScope execScope(&rt);
+		for (int i = 0; i < 64; ++i) {
+			int32_t n = 100 + i * 10;
+			SLAKE_TEST_CHECK(contexts[i]->isDone());
+			SLAKE_TEST_CHECK(getI32(contexts[i]->getResult()) == n * (n - 1) / 2);
+		}
+		contexts.clear();
+	}
+
+	// Contexts which are queued to a blocked worker are stolen.
+	{
+		Runtime::ExecScope execScope(&rt);
+		rt.spawn((FnValue *)mod->scope->getMember("parent"));
+	}
+	rt.waitForTasks();
+	SLAKE_TEST_CHECK(_hasChildRun);
+	SLAKE_TEST_CHECK(_parentThread != _childThread);
+
+	// Contexts cannot be awaited until the scheduler is done with them.
+	ValueRef<ContextValue> held;
+	{
+		Runtime::ExecScope execScope(&rt);
+		held = rt.spawn((FnValue *)mod->scope->getMember("held"));
+
+		for (int i = 0; i < 100; ++i) {
+			bool isRejected = false;
+			try {
+				callFn(mod.get(), "awaitContext", { held.get() });
+			} catch (InvalidOperandsError &) {
+				isRejected = true;
+			}
+			SLAKE_TEST_CHECK(isRejected);
+		}
+	}
+	_isReleased = true;
+	rt.waitForTasks();
+	{
+		Runtime::ExecScope execScope(&rt);
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "awaitContext", { held.get() })) == 7);
+		held = nullptr;
+	}
+
+	rt.stopScheduler();
+
+	return 0;
+}
@@ -0,0 +1,25 @@
+// Runs main() of a module which was compiled by slkc, which returns 0 if
+// every check of the module passed, or the number of the failed check.
+
+#include "../test.h"
+
+using namespace slake;
+using namespace slake::test;
+
+int main(int argc, char **argv) {
+	SLAKE_TEST_CHECK(argc >= 2);
+
+	Runtime rt(getRuntimeFlags(argc, argv));
+
+	auto mod = rt.loadModuleFile(argv[1], 0);
+
+	for (int i = 0; i < N_WARMUP_CALLS; ++i) {
+		int32_t result = getI32(callFn(mod.get(), "main"));
+		if (result) {
+			fprintf(stderr, "Check %d of %s failed\n", (int)result, argv[1]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,115 @@
+// Saves a snapshot of a runtime with a lazily loaded module and a native
+// function, and restores it into other runtimes.
+
+#include "test.h"
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static ValueRef<> _twice(Runtime *rt, Value *thisObject, std::deque<Value *> args) {
+	SLAKE_TEST_CHECK(args.size() == 1 && args[0]->getType() == TypeId::I32);
+	return new I32Value(rt, ((I32Value *)args[0])->getData() * 2);
+}
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 2);
+
+	// sum(n): Sum of 0 to n - 1.
+	w.beginFn("sum", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i32(0);
+	w.ins(Opcode::STORE, 2); w.localVar(1); w.i32(0);
+	w.ins(Opcode::JMP, 1); w.label(8);
+	w.ins(Opcode::ADD, 3); w.localVar(1); w.localVarValue(1); w.localVarValue(0);
+	w.ins(Opcode::INCF, 2); w.reg(0); w.localVar(0);
+	w.ins(Opcode::LT, 3); w.reg(0); w.localVarValue(0); w.argValue(0);
+	w.ins(Opcode::JT, 2); w.label(6); w.regValue(0);
+	w.ins(Opcode::RET, 1); w.localVarValue(1);
+	w.endFn();
+
+	// main(): twice(sum(100)), twice() is registered by the host.
+	w.beginFn("main", T::I32);
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::PUSHARG, 1); w.i32(100);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "test", "sum" });
+	w.ins(Opcode::CALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(0);
+	w.ins(Opcode::PUSHARG, 1); w.regValue(0);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "test", "twice" });
+	w.ins(Opcode::CALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(0);
+	w.ins(Opcode::RET, 1); w.regValue(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+/// @brief Restore a snapshot into a new runtime, native functions have to
+/// be registered before restoring.
+static std::unique_ptr<Runtime> restore(RuntimeFlags flags, const std::string &snapshot) {
+	auto rt = std::make_unique<Runtime>(flags);
+
+	ValueRef<ModuleValue> mod = new ModuleValue(rt.get(), ACCESS_PUB);
+	mod->scope->putMember("twice", new NativeFnValue(rt.get(), _twice, ACCESS_PUB, TypeId::I32));
+	rt->getRootValue()->scope->putMember("test", mod.get());
+
+	rt->loadSnapshot(std::make_shared<BufferedModuleImage>(std::string(snapshot)));
+	return rt;
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	std::string snapshot;
+	{
+		Runtime rt(flags);
+
+		std::string image = buildModule();
+		image = slxfmt::upgradeImage(image.data(), image.size());
+		auto mod = rt.loadModule(std::make_shared<BufferedModuleImage>(std::move(image)), LMOD_NOLINK);
+		mod->scope->putMember("twice", new NativeFnValue(&rt, _twice, ACCESS_PUB, TypeId::I32));
+		rt.linkModule(mod.get());
+
+		// Bodies which were not decoded yet are saved as well.
+		SLAKE_TEST_CHECK(!((FnValue *)mod->scope->getMember("sum"))->isBodyLoaded());
+
+		std::ostringstream os;
+		SLAKE_TEST_CHECK(rt.saveSnapshot(os).empty());
+		snapshot = os.str();
+
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "main")) == 9900);
+	}
+
+	// Snapshots can be restored for several times.
+	for (int i = 0; i < 2; ++i) {
+		auto rt = restore(flags, snapshot);
+		auto mod = (ModuleValue *)rt->getRootValue()->getMember("test");
+		SLAKE_TEST_CHECK(mod);
+
+		for (int j = 0; j < N_WARMUP_CALLS; ++j)
+			SLAKE_TEST_CHECK(getI32(callFn(mod, "main")) == 9900);
+
+		rt->gc();
+		SLAKE_TEST_CHECK(getI32(callFn(mod, "main")) == 9900);
+	}
+
+	// Native functions which were not registered are reported.
+	{
+		Runtime rt(flags);
+		bool isRejected = false;
+		try {
+			rt.loadSnapshot(std::make_shared<BufferedModuleImage>(std::string(snapshot)));
+		} catch (LoaderError &) {
+			isRejected = true;
+		}
+		SLAKE_TEST_CHECK(isRejected);
+	}
+
+	return 0;
+}
@@ -0,0 +1,96 @@
+// Counts executions, allocations, GC cycles and module loads with
+// statistics compiled in, see test/CMakeLists.txt.
+
+#include "test.h"
+
+#if !SLAKE_ENABLE_STATS
+	#error Statistics must be enabled for this test
+#endif
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 1);
+
+	// sum(n): Sum of 0 to n - 1.
+	w.beginFn("sum", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i32(0);
+	w.ins(Opcode::STORE, 2); w.localVar(1); w.i32(0);
+	w.ins(Opcode::JMP, 1); w.label(8);
+	w.ins(Opcode::ADD, 3); w.localVar(1); w.localVarValue(1); w.localVarValue(0);
+	w.ins(Opcode::INCF, 2); w.reg(0); w.localVar(0);
+	w.ins(Opcode::LT, 3); w.reg(0); w.localVarValue(0); w.argValue(0);
+	w.ins(Opcode::JT, 2); w.label(6); w.regValue(0);
+	w.ins(Opcode::RET, 1); w.localVarValue(1);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	std::string image = buildModule();
+
+	Runtime rt(flags);
+	auto mod = rt.loadModule(image.data(), image.size(), 0);
+
+	ValueRef<> n = new I32Value(&rt, 100);
+	SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "sum", { n.get() })) == 4950);
+
+	rt.gc();
+
+	auto stats = rt.getStats();
+
+	// The first call is always interpreted.
+	SLAKE_TEST_CHECK(stats.nExecutedIns[(size_t)Opcode::RET] == 1);
+	SLAKE_TEST_CHECK(stats.nExecutedIns[(size_t)Opcode::JMP] == 1);
+	// LT and JT are fused once the comparison is quickened.
+	SLAKE_TEST_CHECK(stats.getExecutedInsCount() > 100 * 3);
+
+	// The arithmetic is quickened after it was executed with I32 operands.
+	SLAKE_TEST_CHECK(stats.nQuickInsHits > 0);
+	SLAKE_TEST_CHECK(stats.nQuickInsMisses == 0);
+
+	SLAKE_TEST_CHECK(stats.nAllocs[(size_t)TypeId::I32] > 0);
+	SLAKE_TEST_CHECK(stats.getAllocCount() >= stats.nAllocs[(size_t)TypeId::I32]);
+	SLAKE_TEST_CHECK(stats.szAllocated > 0 && stats.szInUse > 0);
+
+	SLAKE_TEST_CHECK(stats.nGcCycles >= 1);
+	SLAKE_TEST_CHECK(stats.maxGcPauseTime <= stats.gcPauseTime);
+
+	SLAKE_TEST_CHECK(stats.moduleLoadTimes.count("test"));
+
+	// Counters are accumulated.
+	SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "sum", { n.get() })) == 4950);
+	SLAKE_TEST_CHECK(rt.getStats().getAllocCount() > stats.getAllocCount());
+
+	{
+		std::ostringstream ss;
+		stats.writeJSON(ss);
+		auto json = ss.str();
+
+		SLAKE_TEST_CHECK(json.front() == '{' && json.back() == '}');
+		for (auto i : { "\"executedIns\":{", "\"RET\":1", "\"gc\":{", "\"quickIns\":{", "\"inlineCaches\":{", "\"moduleLoadNs\":{\"test\":" })
+			SLAKE_TEST_CHECK(json.find(i) != std::string::npos);
+	}
+
+	{
+		std::ostringstream ss;
+		stats.writeText(ss);
+		auto text = ss.str();
+
+		SLAKE_TEST_CHECK(text.find("instructions: ") == 0);
+		SLAKE_TEST_CHECK(text.find("\ninline caches: ") != std::string::npos);
+	}
+
+	return 0;
+}
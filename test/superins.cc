@@ -0,0 +1,189 @@
+// Superinstructions give the same results as the instructions they fuse,
+// and the fused instructions are kept in place, so jumps into them still
+// work.
+
+#include "test.h"
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static const Opcode compareOpcodes[] = { Opcode::EQ, Opcode::NEQ, Opcode::LT, Opcode::GT, Opcode::LTEQ, Opcode::GTEQ };
+static const Opcode jumpOpcodes[] = { Opcode::JT, Opcode::JF };
+
+static std::string getCompareFnName(Opcode opcode, Opcode jumpOpcode, bool isFused) {
+	return OPCODE_MNEMONIC_MAP.at(opcode) + "_" + OPCODE_MNEMONIC_MAP.at(jumpOpcode) + (isFused ? "" : "_unfused");
+}
+
+/// @brief Write a function which returns 1 if the jump after a comparison of
+/// its arguments was taken, a NOP is put between them if the comparison must
+/// not be fused.
+static void writeCompare(ImageWriter &w, Opcode opcode, Opcode jumpOpcode, bool isFused) {
+	uint32_t b = isFused ? 0 : 1;
+
+	w.beginFn(getCompareFnName(opcode, jumpOpcode, isFused), T::I32, { T::I32, T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(getQuickOpcode(opcode, QV_I32), 3); w.reg(0); w.argValue(0); w.argValue(1);
+	if (!isFused)
+		w.ins(Opcode::NOP);
+	w.ins(jumpOpcode, 2); w.label(b + 4); w.regValue(0);
+	w.ins(Opcode::RET, 1); w.i32(0);
+	w.ins(Opcode::RET, 1); w.i32(1);
+	w.endFn();
+}
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, std::size(compareOpcodes) * std::size(jumpOpcodes) * 2 + 4);
+
+	for (auto i : compareOpcodes) {
+		for (auto j : jumpOpcodes) {
+			writeCompare(w, i, j, true);
+			writeCompare(w, i, j, false);
+		}
+	}
+
+	// jumpIntoFused(a, b, c): Jumps to the fused jump with c as the result
+	// of the comparison, returns 1 if c is true.
+	w.beginFn("jumpIntoFused", T::I32, { T::I32, T::I32, T::Bool });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::STORE, 2); w.reg(0); w.argValue(2);
+	w.ins(Opcode::JMP, 1); w.label(4);
+	w.ins(Opcode::LT_I32, 3); w.reg(0); w.argValue(0); w.argValue(1);
+	w.ins(Opcode::JT, 2); w.label(6); w.regValue(0);
+	w.ins(Opcode::RET, 1); w.i32(0);
+	w.ins(Opcode::RET, 1); w.i32(1);
+	w.endFn();
+
+	// loadAdd(x): x + 5, the load is fused with the addition on loading.
+	w.beginFn("loadAdd", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.argValue(0);
+	w.ins(Opcode::LVALUE, 2); w.reg(0); w.localVar(0);
+	w.ins(Opcode::ADD_I32, 3); w.localVar(0); w.regValue(0); w.i32(5);
+	w.ins(Opcode::RET, 1); w.localVarValue(0);
+	w.endFn();
+
+	// loadAddAny(x, y): x + y, the load is fused once the addition was
+	// specialized.
+	w.beginFn("loadAddAny", T::Any, { T::Any, T::Any });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::Any);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.argValue(0);
+	w.ins(Opcode::LVALUE, 2); w.reg(0); w.localVar(0);
+	w.ins(Opcode::ADD, 3); w.localVar(0); w.regValue(0); w.argValue(1);
+	w.ins(Opcode::RET, 1); w.localVarValue(0);
+	w.endFn();
+
+	// jumpIntoArith(x, c): Skips the load and adds 5 to 100 if c is true,
+	// returns x + 5 otherwise.
+	w.beginFn("jumpIntoArith", T::I32, { T::I32, T::Bool });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.argValue(0);
+	w.ins(Opcode::STORE, 2); w.reg(0); w.i32(100);
+	w.ins(Opcode::JT, 2); w.label(6); w.argValue(1);
+	w.ins(Opcode::LVALUE, 2); w.reg(0); w.localVar(0);
+	w.ins(Opcode::ADD_I32, 3); w.localVar(0); w.regValue(0); w.i32(5);
+	w.ins(Opcode::RET, 1); w.localVarValue(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+static bool compare(Opcode opcode, int32_t a, int32_t b) {
+	switch (opcode) {
+		case Opcode::EQ:
+			return a == b;
+		case Opcode::NEQ:
+			return a != b;
+		case Opcode::LT:
+			return a < b;
+		case Opcode::GT:
+			return a > b;
+		case Opcode::LTEQ:
+			return a <= b;
+		default:
+			return a >= b;
+	}
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	Runtime rt(flags);
+
+	std::string image = buildModule();
+	auto mod = rt.loadModule(image.data(), image.size(), 0);
+
+	// Comparisons are fused with the jumps, which keep their destinations.
+	for (auto i : compareOpcodes) {
+		for (auto j : jumpOpcodes) {
+			auto fused = (FnValue *)mod->scope->getMember(getCompareFnName(i, j, true)),
+				 unfused = (FnValue *)mod->scope->getMember(getCompareFnName(i, j, false));
+
+			SLAKE_TEST_CHECK(fused->getBody()[1].opcode == getFusedJumpOpcode(getQuickOpcode(i, QV_I32), j));
+			SLAKE_TEST_CHECK(fused->getBody()[2].opcode == j);
+			SLAKE_TEST_CHECK(((U32Value *)fused->getBody()[2].operands[0])->getData() == 4);
+			SLAKE_TEST_CHECK(unfused->getBody()[1].opcode == getQuickOpcode(i, QV_I32));
+		}
+	}
+
+	for (int n = 0; n < N_WARMUP_CALLS; ++n) {
+		for (auto i : compareOpcodes) {
+			for (auto j : jumpOpcodes) {
+				for (auto [a, b] : { std::pair<int32_t, int32_t>{ 1, 2 }, { 2, 1 }, { -3, -3 }, { INT32_MIN, INT32_MAX } }) {
+					ValueRef<> x = new I32Value(&rt, a), y = new I32Value(&rt, b);
+					int32_t expected = compare(i, a, b) == (j == Opcode::JT);
+
+					SLAKE_TEST_CHECK(getI32(callFn(mod.get(), getCompareFnName(i, j, true), { x.get(), y.get() })) == expected);
+					SLAKE_TEST_CHECK(getI32(callFn(mod.get(), getCompareFnName(i, j, false), { x.get(), y.get() })) == expected);
+				}
+			}
+		}
+
+		for (bool c : { true, false }) {
+			ValueRef<> x = new I32Value(&rt, 1), y = new I32Value(&rt, 2), z = new BoolValue(&rt, c);
+			SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "jumpIntoFused", { x.get(), y.get(), z.get() })) == (int32_t)c);
+		}
+
+		{
+			ValueRef<> x = new I32Value(&rt, n);
+			SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "loadAdd", { x.get() })) == n + 5);
+		}
+
+		for (bool c : { true, false }) {
+			ValueRef<> x = new I32Value(&rt, n), z = new BoolValue(&rt, c);
+			SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "jumpIntoArith", { x.get(), z.get() })) == (c ? 105 : n + 5));
+		}
+
+		{
+			ValueRef<> x = new I32Value(&rt, n), y = new I32Value(&rt, 7);
+			SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "loadAddAny", { x.get(), y.get() })) == n + 7);
+		}
+	}
+
+	// Loads are fused with the arithmetic, which is kept in place.
+	SLAKE_TEST_CHECK(((FnValue *)mod->scope->getMember("loadAdd"))->getBody()[3].opcode == Opcode::LVALUE_ARITH_I32);
+	SLAKE_TEST_CHECK(((FnValue *)mod->scope->getMember("loadAdd"))->getBody()[4].opcode == Opcode::ADD_I32);
+	SLAKE_TEST_CHECK(((FnValue *)mod->scope->getMember("jumpIntoArith"))->getBody()[5].opcode == Opcode::LVALUE_ARITH_I32);
+
+	auto loadAddAny = (FnValue *)mod->scope->getMember("loadAddAny");
+	SLAKE_TEST_CHECK(loadAddAny->getBody()[3].opcode == Opcode::LVALUE_ARITH_I32);
+	SLAKE_TEST_CHECK(loadAddAny->getBody()[4].opcode == Opcode::ADD_I32);
+
+	// The superinstruction falls back to the generic instructions once the
+	// types changed.
+	for (int n = 0; n < 4; ++n) {
+		ValueRef<> x = new I64Value(&rt, 1LL << 40), y = new I64Value(&rt, n);
+		auto result = callFn(mod.get(), "loadAddAny", { x.get(), y.get() });
+		SLAKE_TEST_CHECK(result && result->getType() == TypeId::I64);
+		SLAKE_TEST_CHECK(((I64Value *)result.get())->getData() == (1LL << 40) + n);
+	}
+	SLAKE_TEST_CHECK(!isQuickOpcode(loadAddAny->getBody()[4].opcode) || getQuickVariant(loadAddAny->getBody()[4].opcode) != QV_I32);
+
+	return 0;
+}
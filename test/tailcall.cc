@@ -0,0 +1,102 @@
+// Tail calls reuse the frames of their callers, except in frames with
+// exception handlers, where they fall back to normal calls.
+
+#include "test.h"
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+/// @brief Number of major frames when the recursion bottomed out.
+static size_t _nFramesAtBottom;
+
+static ValueRef<> _bottom(Runtime *rt, Value *thisObject, std::deque<Value *> args) {
+	_nFramesAtBottom = rt->getActiveContext()->majorFrames.size();
+	return new I32Value(rt, ((I32Value *)args[0])->getData());
+}
+
+/// @brief Write count(n, acc), which tail-calls itself with (n - 1, acc + 1)
+/// and returns bottom(acc) once n is 0.
+static void writeCount(ImageWriter &w, const std::string &name, bool isInTry) {
+	w.beginFn(name, T::I32, { T::I32, T::I32 });
+
+	uint32_t b = 0;
+	if (isInTry) {
+		// The handler is never invoked.
+		w.ins(Opcode::ENTER);
+		w.ins(Opcode::PUSHXH, 2); w.typeName(T::I32); w.label(17);
+		b = 2;
+	}
+
+	w.ins(Opcode::REG, 1); w.u32(2);
+	w.ins(Opcode::EQ, 3); w.reg(0); w.argValue(0); w.i32(0);
+	w.ins(Opcode::JF, 2); w.label(b + 8); w.regValue(0);
+	w.ins(Opcode::PUSHARG, 1); w.argValue(1);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "test", "bottom" });
+	w.ins(Opcode::CALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(0);
+	w.ins(Opcode::RET, 1); w.regValue(0);
+	w.ins(Opcode::SUB, 3); w.reg(0); w.argValue(0); w.i32(1);
+	w.ins(Opcode::ADD, 3); w.reg(1); w.argValue(1); w.i32(1);
+	w.ins(Opcode::PUSHARG, 1); w.regValue(0);
+	w.ins(Opcode::PUSHARG, 1); w.regValue(1);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "test", name });
+	w.ins(Opcode::TAILCALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(0);
+	w.ins(Opcode::RET, 1); w.regValue(0);
+
+	w.endFn();
+}
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 3);
+
+	writeCount(w, "count", false);
+	writeCount(w, "countInTry", true);
+
+	// Tail calls which are not followed by LRET and RET are rewritten into
+	// normal calls by the loader.
+	w.beginFn("notTail", T::I32);
+	w.ins(Opcode::TAILCALL, 1); w.regValue(0);
+	w.ins(Opcode::NOP);
+	w.ins(Opcode::RET, 1); w.regValue(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+static int32_t count(Runtime *rt, ModuleValue *mod, const std::string &name, int32_t n) {
+	ValueRef<> nValue = new I32Value(rt, n), accValue = new I32Value(rt, 0);
+	return getI32(callFn(mod, name, { nValue.get(), accValue.get() }));
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	Runtime rt(flags);
+
+	std::string image = buildModule();
+	auto mod = rt.loadModule(image.data(), image.size(), LMOD_NOLINK);
+	mod->scope->putMember("bottom", new NativeFnValue(&rt, _bottom, ACCESS_PUB, TypeId::I32));
+	rt.linkModule(mod.get());
+
+	auto countFn = (FnValue *)mod->scope->getMember("count"),
+		 notTailFn = (FnValue *)mod->scope->getMember("notTail");
+	SLAKE_TEST_CHECK(countFn->getBody()[countFn->getInsCount() - 3].opcode == Opcode::TAILCALL);
+	SLAKE_TEST_CHECK(notTailFn->getBody()[0].opcode == Opcode::CALL);
+
+	// Frames of the recursion are reused.
+	for (int i = 0; i < 4; ++i) {
+		SLAKE_TEST_CHECK(count(&rt, mod.get(), "count", 100000) == 100000);
+		SLAKE_TEST_CHECK(_nFramesAtBottom <= 3);
+	}
+
+	// Frames with exception handlers are kept.
+	SLAKE_TEST_CHECK(count(&rt, mod.get(), "countInTry", 2000) == 2000);
+	SLAKE_TEST_CHECK(_nFramesAtBottom > 2000);
+
+	return 0;
+}
@@ -0,0 +1,218 @@
+#ifndef _SLAKE_TEST_TEST_H_
+#define _SLAKE_TEST_TEST_H_
+
+#include <slake/runtime.h>
+#include <slake/slxconv.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+/// @brief Fail the test if a condition does not hold.
+#define SLAKE_TEST_CHECK(x)                                                   \
+	if (!(x)) {                                                               \
+		fprintf(stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #x); \
+		exit(EXIT_FAILURE);                                                   \
+	}
+
+namespace slake {
+	namespace test {
+		/// @brief Number of calls which is enough for functions to be compiled
+		/// by the JIT compiler.
+		constexpr int N_WARMUP_CALLS = SLAKE_JIT_THRESHOLD + 16;
+
+		/// @brief Get flags for runtimes of a test, every test is run with
+		/// the JIT compiler disabled and with it enabled (--jit).
+		inline RuntimeFlags getRuntimeFlags(int argc, char **argv) {
+			for (int i = 1; i < argc; ++i) {
+				if (!strcmp(argv[i], "--jit"))
+					return 0;
+			}
+			return RT_NOJIT;
+		}
+
+		/// @brief Writer of v0 images, which are converted into the newest
+		/// format by slxfmt::upgradeImage().
+		///
+		/// Functions are written between beginFn() and endFn(), operands of
+		/// each instruction follow the instruction.
+		class ImageWriter final {
+		private:
+			std::ostringstream _os, _body;
+			std::ostream *_cur = &_os;
+
+			std::string _fnName;
+			slxfmt::Type _returnType;
+			std::deque<slxfmt::Type> _paramTypes;
+			uint32_t _nIns;
+
+			template <typename T>
+			inline void _write(const T &data) {
+				_cur->write((const char *)&data, sizeof(T));
+			}
+			inline void _writeValueDesc(slxfmt::Type type) {
+				slxfmt::ValueDesc vd = {};
+				vd.type = type;
+				_write(vd);
+			}
+			void _writeRefEntries(const std::deque<std::string> &names) {
+				for (size_t i = 0; i < names.size(); ++i) {
+					slxfmt::RefEntryDesc red = {};
+					red.lenName = (uint16_t)names[i].size();
+					if (i + 1 < names.size())
+						red.flags |= slxfmt::RSD_NEXT;
+					_write(red);
+					_cur->write(names[i].data(), names[i].size());
+				}
+			}
+
+		public:
+			/// @brief Begin a module without variables.
+			/// @param imports Aliases and names of the imported modules.
+			void beginModule(
+				const std::deque<std::string> &name,
+				uint32_t nFns,
+				const std::deque<std::pair<std::string, std::deque<std::string>>> &imports = {}) {
+				slxfmt::ImgHeader ih = {};
+				memcpy(ih.magic, slxfmt::IMH_MAGIC, sizeof(ih.magic));
+				ih.flags = slxfmt::IMH_MODNAME;
+				ih.nImports = (uint16_t)imports.size();
+				_write(ih);
+				_writeRefEntries(name);
+
+				for (auto &i : imports) {
+					_write((uint32_t)i.first.size());
+					_cur->write(i.first.data(), i.first.size());
+					_writeRefEntries(i.second);
+				}
+
+				_write((uint32_t)0);
+				_write(nFns);
+			}
+			/// @brief End a module without classes, interfaces and traits.
+			void endModule() {
+				for (int i = 0; i < 3; ++i)
+					_write((uint32_t)0);
+			}
+
+			void beginFn(const std::string &name, slxfmt::Type returnType, std::deque<slxfmt::Type> paramTypes = {}) {
+				_fnName = name;
+				_returnType = returnType;
+				_paramTypes = paramTypes;
+				_nIns = 0;
+
+				_body.str({});
+				_cur = &_body;
+			}
+			void endFn() {
+				_cur = &_os;
+
+				slxfmt::FnDesc fnd = {};
+				fnd.flags = slxfmt::FND_PUB;
+				fnd.lenName = (uint16_t)_fnName.size();
+				fnd.nParams = (uint8_t)_paramTypes.size();
+				fnd.lenBody = _nIns;
+				_write(fnd);
+				_os.write(_fnName.data(), _fnName.size());
+				_write(_returnType);
+				for (auto i : _paramTypes)
+					_write(i);
+
+				_os << _body.str();
+			}
+
+			/// @brief Begin an instruction, which is followed by its operands.
+			/// @return Offset of the instruction.
+			uint32_t ins(Opcode opcode, uint8_t nOperands = 0) {
+				_write(slxfmt::InsHeader(opcode, nOperands));
+				return _nIns++;
+			}
+			/// @brief Begin an instruction with an opcode which is not
+			/// checked, for images which are expected to be rejected.
+			uint32_t rawIns(uint16_t opcode, uint8_t nOperands = 0) {
+				slxfmt::InsHeader ih;
+				ih.opcode = (Opcode)opcode;
+				ih.nOperands = nOperands;
+				_write(ih);
+				return _nIns++;
+			}
+
+			void i32(int32_t data) {
+				_writeValueDesc(slxfmt::Type::I32);
+				_write(data);
+			}
+			void i64(int64_t data) {
+				_writeValueDesc(slxfmt::Type::I64);
+				_write(data);
+			}
+			void u32(uint32_t data) {
+				_writeValueDesc(slxfmt::Type::U32);
+				_write(data);
+			}
+			void u64(uint64_t data) {
+				_writeValueDesc(slxfmt::Type::U64);
+				_write(data);
+			}
+			void str(const std::string &data) {
+				_writeValueDesc(slxfmt::Type::String);
+				_write((uint32_t)data.size());
+				_cur->write(data.data(), data.size());
+			}
+			/// @brief Begin an array of values of any type, which is followed
+			/// by its elements.
+			void array(uint32_t nElements) {
+				_writeValueDesc(slxfmt::Type::Array);
+				_write(slxfmt::Type::Any);
+				_write(nElements);
+			}
+			void ref(const std::deque<std::string> &names) {
+				_writeValueDesc(slxfmt::Type::Ref);
+				_writeRefEntries(names);
+			}
+			void typeName(slxfmt::Type type) {
+				_writeValueDesc(slxfmt::Type::TypeName);
+				_write(type);
+			}
+			/// @brief Destination of a jump, which is an offset of an
+			/// instruction.
+			void label(uint32_t offIns) {
+				u32(offIns);
+			}
+			void reg(uint32_t index) {
+				_writeValueDesc(slxfmt::Type::Reg);
+				_write(index);
+			}
+			void regValue(uint32_t index) {
+				_writeValueDesc(slxfmt::Type::RegValue);
+				_write(index);
+			}
+			void localVar(uint32_t index) {
+				_writeValueDesc(slxfmt::Type::LocalVar);
+				_write(index);
+			}
+			void localVarValue(uint32_t index) {
+				_writeValueDesc(slxfmt::Type::LocalVarValue);
+				_write(index);
+			}
+			void argValue(uint32_t index) {
+				_writeValueDesc(slxfmt::Type::ArgValue);
+				_write(index);
+			}
+
+			inline std::string getImage() const { return _os.str(); }
+		};
+
+		/// @brief Call a function of a module.
+		inline ValueRef<> callFn(ModuleValue *mod, const std::string &name, std::deque<Value *> args = {}) {
+			return mod->scope->getMember(name)->call(nullptr, args);
+		}
+
+		inline int32_t getI32(const ValueRef<> &v) {
+			SLAKE_TEST_CHECK(v && v->getType() == TypeId::I32);
+			return ((I32Value *)v.get())->getData();
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,359 @@
+// Traces calls, coroutines, loads and GC cycles, and checks that the trace
+// is valid JSON in the trace event format with spans nested on each thread.
+
+#include "test.h"
+
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 4);
+
+	// gen(n): Yields 0 to n - 1 and returns -1.
+	w.beginFn("gen", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(1);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i32(0);
+	w.ins(Opcode::JMP, 1); w.label(6);
+	w.ins(Opcode::YIELD, 1); w.localVarValue(0);
+	w.ins(Opcode::ADD, 3); w.localVar(0); w.localVarValue(0); w.i32(1);
+	w.ins(Opcode::LT, 3); w.reg(0); w.localVarValue(0); w.argValue(0);
+	w.ins(Opcode::JT, 2); w.label(4); w.regValue(0);
+	w.ins(Opcode::RET, 1); w.i32(-1);
+	w.endFn();
+
+	// drain(n): Sum of the values yielded by gen(n).
+	w.beginFn("drain", T::I32, { T::I32 });
+	w.ins(Opcode::REG, 1); w.u32(3);
+	w.ins(Opcode::LVAR, 1); w.typeName(T::I32);
+	w.ins(Opcode::STORE, 2); w.localVar(0); w.i32(0);
+	w.ins(Opcode::PUSHARG, 1); w.argValue(0);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "test", "gen" });
+	w.ins(Opcode::ACALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(1);
+	w.ins(Opcode::AWAIT, 1); w.regValue(1);
+	w.ins(Opcode::LRET, 1); w.reg(2);
+	w.ins(Opcode::EQ, 3); w.reg(0); w.regValue(2); w.i32(-1);
+	w.ins(Opcode::JT, 2); w.label(13); w.regValue(0);
+	w.ins(Opcode::ADD, 3); w.localVar(0); w.localVarValue(0); w.regValue(2);
+	w.ins(Opcode::JMP, 1); w.label(7);
+	w.ins(Opcode::RET, 1); w.localVarValue(0);
+	w.endFn();
+
+	// Names are escaped in the trace.
+	w.beginFn("q\"uote\\", T::I32);
+	w.ins(Opcode::RET, 1); w.i32(1);
+	w.endFn();
+
+	// outer(): q"uote\().
+	w.beginFn("outer", T::I32);
+	w.ins(Opcode::REG, 1); w.u32(2);
+	w.ins(Opcode::LOAD, 2); w.reg(0); w.ref({ "test", "q\"uote\\" });
+	w.ins(Opcode::CALL, 1); w.regValue(0);
+	w.ins(Opcode::LRET, 1); w.reg(1);
+	w.ins(Opcode::RET, 1); w.regValue(1);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+/// @brief Minimal JSON value, numbers are kept as doubles.
+struct JSONValue {
+	enum Kind { Null, Bool, Number, String, Array, Object } kind = Null;
+	bool boolean = false;
+	double number = 0;
+	std::string string;
+	std::vector<JSONValue> array;
+	std::vector<std::pair<std::string, JSONValue>> object;
+
+	const JSONValue *get(const std::string &key) const {
+		for (auto &i : object) {
+			if (i.first == key)
+				return &i.second;
+		}
+		return nullptr;
+	}
+};
+
+/// @brief Strict parser of JSON documents, any error fails the test.
+class JSONParser {
+private:
+	const std::string &_s;
+	size_t _i = 0;
+
+	void _skipSpaces() {
+		while (_i < _s.size() && strchr(" \t\r\n", _s[_i]))
+			++_i;
+	}
+
+	char _peek() {
+		_skipSpaces();
+		SLAKE_TEST_CHECK(_i < _s.size());
+		return _s[_i];
+	}
+
+	void _expect(char c) {
+		SLAKE_TEST_CHECK(_peek() == c);
+		++_i;
+	}
+
+	std::string _parseString() {
+		_expect('"');
+
+		std::string s;
+		for (;;) {
+			SLAKE_TEST_CHECK(_i < _s.size());
+			char c = _s[_i++];
+			SLAKE_TEST_CHECK((unsigned char)c >= 0x20);
+			if (c == '"')
+				return s;
+			if (c != '\\') {
+				s += c;
+				continue;
+			}
+
+			SLAKE_TEST_CHECK(_i < _s.size());
+			switch (char e = _s[_i++]; e) {
+				case '"':
+				case '\\':
+				case '/':
+					s += e;
+					break;
+				case 'b':
+					s += '\b';
+					break;
+				case 'f':
+					s += '\f';
+					break;
+				case 'n':
+					s += '\n';
+					break;
+				case 'r':
+					s += '\r';
+					break;
+				case 't':
+					s += '\t';
+					break;
+				case 'u': {
+					SLAKE_TEST_CHECK(_i + 4 <= _s.size());
+					size_t nDigits;
+					unsigned long code = std::stoul(_s.substr(_i, 4), &nDigits, 16);
+					SLAKE_TEST_CHECK(nDigits == 4 && code < 0x80);
+					s += (char)code;
+					_i += 4;
+					break;
+				}
+				default:
+					SLAKE_TEST_CHECK(false);
+			}
+		}
+	}
+
+	double _parseNumber() {
+		size_t begin = _i;
+		if (_s[_i] == '-')
+			++_i;
+		SLAKE_TEST_CHECK(_i < _s.size() && isdigit((unsigned char)_s[_i]));
+		// Leading zeros are not allowed.
+		if (_s[_i] == '0')
+			++_i;
+		else {
+			while (_i < _s.size() && isdigit((unsigned char)_s[_i]))
+				++_i;
+		}
+		if (_i < _s.size() && _s[_i] == '.') {
+			++_i;
+			SLAKE_TEST_CHECK(_i < _s.size() && isdigit((unsigned char)_s[_i]));
+			while (_i < _s.size() && isdigit((unsigned char)_s[_i]))
+				++_i;
+		}
+		return std::stod(_s.substr(begin, _i - begin));
+	}
+
+public:
+	inline JSONParser(const std::string &s) : _s(s) {}
+
+	JSONValue parseValue() {
+		JSONValue v;
+
+		switch (_peek()) {
+			case '{':
+				v.kind = JSONValue::Object;
+				++_i;
+				if (_peek() == '}') {
+					++_i;
+					break;
+				}
+				for (;;) {
+					std::string key = _parseString();
+					SLAKE_TEST_CHECK(!v.get(key));
+					_expect(':');
+					v.object.push_back({ key, parseValue() });
+					if (_peek() == '}') {
+						++_i;
+						break;
+					}
+					_expect(',');
+				}
+				break;
+			case '[':
+				v.kind = JSONValue::Array;
+				++_i;
+				if (_peek() == ']') {
+					++_i;
+					break;
+				}
+				for (;;) {
+					v.array.push_back(parseValue());
+					if (_peek() == ']') {
+						++_i;
+						break;
+					}
+					_expect(',');
+				}
+				break;
+			case '"':
+				v.kind = JSONValue::String;
+				v.string = _parseString();
+				break;
+			default:
+				if (!_s.compare(_i, 4, "true") || !_s.compare(_i, 5, "false")) {
+					v.kind = JSONValue::Bool;
+					v.boolean = _s[_i] == 't';
+					_i += v.boolean ? 4 : 5;
+				} else if (!_s.compare(_i, 4, "null"))
+					_i += 4;
+				else {
+					v.kind = JSONValue::Number;
+					v.number = _parseNumber();
+				}
+		}
+
+		return v;
+	}
+
+	JSONValue parseDocument() {
+		JSONValue v = parseValue();
+		_skipSpaces();
+		SLAKE_TEST_CHECK(_i == _s.size());
+		return v;
+	}
+};
+
+static const std::string &getString(const JSONValue &event, const std::string &key) {
+	auto v = event.get(key);
+	SLAKE_TEST_CHECK(v && v->kind == JSONValue::String);
+	return v->string;
+}
+
+static double getNumber(const JSONValue &event, const std::string &key) {
+	auto v = event.get(key);
+	SLAKE_TEST_CHECK(v && v->kind == JSONValue::Number);
+	return v->number;
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	Runtime rt(flags);
+
+	rt.startTracing();
+
+	std::string image = buildModule();
+	auto mod = rt.loadModule(image.data(), image.size(), 0);
+
+	for (int i = 0; i < N_WARMUP_CALLS; ++i) {
+		ValueRef<> n = new I32Value(&rt, 3);
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "drain", { n.get() })) == 3);
+		SLAKE_TEST_CHECK(getI32(callFn(mod.get(), "outer")) == 1);
+	}
+	rt.gc();
+
+	rt.stopTracing();
+
+	std::ostringstream os;
+	rt.writeTrace(os);
+	std::string json = os.str();
+
+	JSONValue doc = JSONParser(json).parseDocument();
+	SLAKE_TEST_CHECK(doc.kind == JSONValue::Object);
+	SLAKE_TEST_CHECK(getString(doc, "displayTimeUnit") == "ns");
+
+	auto events = doc.get("traceEvents");
+	SLAKE_TEST_CHECK(events && events->kind == JSONValue::Array);
+
+	std::map<std::string, size_t> nCalls;
+	std::map<std::string, size_t> nCategories;
+	std::map<int, std::vector<std::pair<std::string, double>>> openSpans;
+	size_t nThreadNames = 0;
+
+	for (auto &i : events->array) {
+		SLAKE_TEST_CHECK(i.kind == JSONValue::Object);
+		SLAKE_TEST_CHECK(getNumber(i, "pid") == 1);
+
+		const std::string &phase = getString(i, "ph");
+		int tid = (int)getNumber(i, "tid");
+
+		if (phase == "M") {
+			SLAKE_TEST_CHECK(getString(i, "name") == "thread_name");
+			++nThreadNames;
+			continue;
+		}
+
+		++nCategories[getString(i, "cat")];
+		double ts = getNumber(i, "ts");
+		SLAKE_TEST_CHECK(ts >= 0);
+
+		// Spans of each thread are nested.
+		auto &spans = openSpans[tid];
+		if (phase == "B") {
+			SLAKE_TEST_CHECK(spans.empty() || spans.back().second <= ts);
+			spans.push_back({ getString(i, "name"), ts });
+			++nCalls[getString(i, "name")];
+		} else if (phase == "E") {
+			SLAKE_TEST_CHECK(!i.get("name"));
+			SLAKE_TEST_CHECK(spans.size() && spans.back().second <= ts);
+			spans.pop_back();
+		} else if (phase == "X") {
+			SLAKE_TEST_CHECK(getNumber(i, "dur") >= 0);
+			getString(i, "name");
+		} else if (phase == "i") {
+			SLAKE_TEST_CHECK(getString(i, "s") == "t");
+			getString(i, "name");
+		} else
+			SLAKE_TEST_CHECK(false);
+	}
+
+	// Only the main thread executed.
+	SLAKE_TEST_CHECK(nThreadNames == 1);
+	SLAKE_TEST_CHECK(openSpans.size() == 1);
+	for (auto &i : openSpans)
+		SLAKE_TEST_CHECK(i.second.empty());
+
+	SLAKE_TEST_CHECK(nCalls["test.outer"] == N_WARMUP_CALLS);
+	SLAKE_TEST_CHECK(nCalls["test.q\"uote\\"] == N_WARMUP_CALLS);
+	SLAKE_TEST_CHECK(nCalls["test.drain"] >= N_WARMUP_CALLS);
+	SLAKE_TEST_CHECK(nCalls["test.gen"] >= N_WARMUP_CALLS);
+	SLAKE_TEST_CHECK(nCategories["load"] >= 1);
+	SLAKE_TEST_CHECK(nCategories["gc"] >= 1);
+	SLAKE_TEST_CHECK(nCategories["switch"] >= 1);
+
+	// Cleared traces are still valid.
+	rt.clearTrace();
+	os.str({});
+	rt.writeTrace(os);
+	json = os.str();
+	doc = JSONParser(json).parseDocument();
+	SLAKE_TEST_CHECK(doc.get("traceEvents")->array.empty());
+
+	return 0;
+}
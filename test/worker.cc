@@ -0,0 +1,100 @@
+// Posts messages to workers, which return literals of their modules and
+// echo the messages, literals stay intact over several messages and
+// transfers while the other strings are moved by transfers.
+
+#include "test.h"
+
+#include <slake/lib/std.h>
+#include <slake/lib/std/worker.h>
+
+using namespace slake;
+using namespace slake::test;
+
+using T = slxfmt::Type;
+
+static std::string buildModule() {
+	ImageWriter w;
+	w.beginModule({ "test" }, 2);
+
+	// greet(x): Returns a literal regardless of the message.
+	w.beginFn("greet", T::String, { T::Any });
+	w.ins(Opcode::RET, 1); w.str("hello");
+	w.endFn();
+
+	// echo(x): Returns the message.
+	w.beginFn("echo", T::Any, { T::Any });
+	w.ins(Opcode::RET, 1); w.argValue(0);
+	w.endFn();
+
+	w.endModule();
+	return w.getImage();
+}
+
+/// @brief Call a member of std.worker.
+static ValueRef<> callWorkerFn(Runtime *rt, const std::string &name, std::deque<Type> paramTypes, std::deque<Value *> args) {
+	return stdlib::worker::modWorker->scope->getMember(rt->mangleName(name, paramTypes))->call(nullptr, args);
+}
+
+static std::string getStr(const ValueRef<> &v) {
+	SLAKE_TEST_CHECK(v && v->getType() == TypeId::String);
+	return ((StringValue *)v.get())->getData();
+}
+
+int main(int argc, char **argv) {
+	RuntimeFlags flags = getRuntimeFlags(argc, argv);
+
+	std::string image = buildModule();
+
+	Runtime rt(flags);
+	stdlib::load(&rt);
+	rt.setModuleImageLocator([&image](Runtime *rt, ValueRef<RefValue> ref) {
+		return std::make_shared<BufferedModuleImage>(std::string(image));
+	});
+
+	auto mod = rt.loadModule(image.data(), image.size(), 0);
+
+	ValueRef<> modName = new StringValue(&rt, "test"),
+			   greetName = new StringValue(&rt, "greet"),
+			   echoName = new StringValue(&rt, "echo");
+
+	// Results which are literals of the worker are copied, so the following
+	// messages get the same results.
+	{
+		auto id = callWorkerFn(&rt, "spawn", { TypeId::String, TypeId::String }, { modName.get(), greetName.get() });
+
+		for (int i = 0; i < 2; ++i) {
+			ValueRef<> message = new I32Value(&rt, i);
+			callWorkerFn(&rt, "post", { TypeId::U32, TypeId::Any }, { id.get(), message.get() });
+		}
+		for (int i = 0; i < 2; ++i)
+			SLAKE_TEST_CHECK(getStr(callWorkerFn(&rt, "recv", { TypeId::U32 }, { id.get() })) == "hello");
+
+		callWorkerFn(&rt, "close", { TypeId::U32 }, { id.get() });
+	}
+
+	// Literals of the sender are copied by transfers, the other strings are
+	// moved.
+	{
+		auto id = callWorkerFn(&rt, "spawn", { TypeId::String, TypeId::String }, { modName.get(), echoName.get() });
+
+		auto greet = (FnValue *)mod->scope->getMember("greet");
+		greet->loadBody();
+		Value *literal = greet->getBody()[0].operands[0];
+		SLAKE_TEST_CHECK(literal->_flags & VF_LITERAL);
+
+		for (int i = 0; i < 2; ++i)
+			callWorkerFn(&rt, "transfer", { TypeId::U32, TypeId::Any }, { id.get(), literal });
+		for (int i = 0; i < 2; ++i)
+			SLAKE_TEST_CHECK(getStr(callWorkerFn(&rt, "recv", { TypeId::U32 }, { id.get() })) == "hello");
+		SLAKE_TEST_CHECK(getStr(callFn(mod.get(), "greet", { literal })) == "hello");
+
+		ValueRef<StringValue> message = new StringValue(&rt, "moved");
+		callWorkerFn(&rt, "transfer", { TypeId::U32, TypeId::Any }, { id.get(), message.get() });
+		SLAKE_TEST_CHECK(getStr(callWorkerFn(&rt, "recv", { TypeId::U32 }, { id.get() })) == "moved");
+		SLAKE_TEST_CHECK(message->getData().empty());
+
+		callWorkerFn(&rt, "close", { TypeId::U32 }, { id.get() });
+	}
+
+	return 0;
+}